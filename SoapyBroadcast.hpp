@@ -0,0 +1,153 @@
+// SoapyBroadcast.hpp - lock-free single producer, many consumer item ring
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapyBroadcast_hpp
+#define SoapyBroadcast_hpp
+
+// Broadcast ring used to fan one device stream out to several data
+// connections (see shared streams in SoapyTCPServer). Design notes:
+// - fixed number of item slots (each up to slotSize bytes), 'seq' counts items
+//   published, so item n lives in slot n % slots.
+// - the producer never waits: it overwrites the oldest item, so a slow consumer
+//   cannot hold up the producer or any other consumer.
+// - each consumer keeps its own cursor (next item wanted) and copies items out,
+//   checking afterwards that the producer did not start overwriting that slot
+//   meanwhile ('wr' is set before each write, as in a seqlock).
+// - a consumer that is lapped skips ahead (half a ring behind the producer) and
+//   is told how many items it missed.
+// - waiting consumers park on a futex (see SoapyPipe.hpp), only woken by the
+//   producer if any are waiting.
+
+#include "SoapyPipe.hpp"
+#include <climits>
+
+struct bcastbuf_t {
+    uint8_t *buf;
+    size_t slots, slotSize;
+    size_t *lens;
+    // producer side: item being written, items published
+    alignas(64) std::atomic<uint64_t> wr;
+    std::atomic<uint64_t> seq;
+    // wakeup word & waiting consumer count
+    alignas(64) std::atomic<int> wrseq;
+    std::atomic<int> waiting;
+    std::atomic<bool> closed;
+};
+
+static inline bcastbuf_t *newbcast(size_t slots, size_t slotSize) {
+    if (slots<2 || slotSize<1)
+        return nullptr;
+    // (aligned as the pipe is, see newpipe)
+    void *mem = nullptr;
+    if (posix_memalign(&mem, alignof(bcastbuf_t), sizeof(bcastbuf_t)))
+        return nullptr;
+    bcastbuf_t *ring = new (mem) bcastbuf_t;
+    ring->buf = (uint8_t *)malloc(slots*slotSize);
+    ring->lens = (size_t *)calloc(slots, sizeof(size_t));
+    if (!ring->buf || !ring->lens) {
+        free(ring->buf);
+        free(ring->lens);
+        ring->~bcastbuf_t();
+        free(mem);
+        return nullptr;
+    }
+    ring->slots = slots;
+    ring->slotSize = slotSize;
+    ring->wr = 0;
+    ring->seq = 0;
+    ring->wrseq = 0;
+    ring->waiting = 0;
+    ring->closed = false;
+    return ring;
+}
+
+static inline void freebcast(bcastbuf_t *ring) {
+    if (!ring)
+        return;
+    free(ring->buf);
+    free(ring->lens);
+    ring->~bcastbuf_t();
+    free(ring);
+}
+
+static inline void bcastwakeall(bcastbuf_t *ring) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring->waiting.load(std::memory_order_relaxed)>0) {
+        ring->wrseq.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+        syscall(SYS_futex, (int *)&ring->wrseq, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    }
+}
+
+// mark ring as closed, waking all waiting consumers
+static inline void bcastclose(bcastbuf_t *ring) {
+    ring->closed.store(true, std::memory_order_release);
+    ring->waiting.fetch_add(1, std::memory_order_relaxed);
+    bcastwakeall(ring);
+    ring->waiting.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// (producer) publish one item of len bytes (truncated to the slot size), never blocks
+static inline void bcastwrite(bcastbuf_t *ring, const void *src, size_t len) {
+    uint64_t n = ring->seq.load(std::memory_order_relaxed);
+    if (len>ring->slotSize)
+        len = ring->slotSize;
+    // tell consumers this slot is changing before we touch it
+    ring->wr.store(n, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    size_t slot = n % ring->slots;
+    memcpy(ring->buf + slot*ring->slotSize, src, len);
+    ring->lens[slot] = len;
+    ring->seq.store(n+1, std::memory_order_release);
+    bcastwakeall(ring);
+}
+
+// (consumer) cursor for a new consumer: the next item to be published
+static inline uint64_t bcastnext(bcastbuf_t *ring) {
+    return ring->seq.load(std::memory_order_acquire);
+}
+
+// (consumer) copy out the item at *cursor (dst must hold slotSize bytes), waiting a
+// short while for it. Returns 1 with *len set and the cursor advanced, 0 if nothing
+// arrived (try again), or -1 once closed. Items lost to lapping are added to *missed.
+static inline int bcastread(bcastbuf_t *ring, uint64_t *cursor, void *dst, size_t *len, uint64_t *missed) {
+    while (true) {
+        if (ring->closed.load(std::memory_order_acquire))
+            return -1;
+        uint64_t seq = ring->seq.load(std::memory_order_acquire);
+        if (*cursor>=seq) {
+            // wait for the producer (bounded, see pipepark)
+            int ws = ring->wrseq.load(std::memory_order_acquire);
+            ring->waiting.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool empty = *cursor>=ring->seq.load(std::memory_order_relaxed) && !ring->closed.load(std::memory_order_relaxed);
+            if (empty)
+                pipepark(&ring->wrseq, ws);
+            ring->waiting.fetch_sub(1, std::memory_order_relaxed);
+            if (empty && *cursor>=ring->seq.load(std::memory_order_acquire))
+                return 0;
+            continue;
+        }
+        // lapped? the oldest slot may be in the middle of being rewritten, skip ahead
+        if (seq-*cursor>=ring->slots) {
+            uint64_t next = seq - ring->slots/2;
+            *missed += next-*cursor;
+            *cursor = next;
+            continue;
+        }
+        size_t slot = *cursor % ring->slots;
+        size_t sz = ring->lens[slot];
+        memcpy(dst, ring->buf + slot*ring->slotSize, sz);
+        // did the producer get round to this slot while we copied it?
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (ring->wr.load(std::memory_order_relaxed)-*cursor>=ring->slots)
+            continue;
+        *len = sz;
+        ++*cursor;
+        return 1;
+    }
+}
+
+#endif
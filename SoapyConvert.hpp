@@ -0,0 +1,657 @@
+// SoapyConvert.hpp - sample format conversion kernels
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapyConvert_hpp
+#define SoapyConvert_hpp
+
+// Block converters from an interleaved wire buffer (frames of nchans samples)
+// into per-channel output buffers, de-interleaving as we go. Design notes:
+// - one table entry per {CS8, CS12, CS16, CF32} wire -> output format pair, every
+//   entry handles any channel count, with SIMD variants for the hot paths
+//   (single & dual channel integer to float), selected once at runtime.
+// - integer full scale is INT8_MAX / INT16_MAX (matching getNativeStreamFormat
+//   fullScale values), float to integer conversions saturate.
+// - 'off' is the element offset into each output buffer, so callers can fill
+//   buffers from several wire reads.
+// - CS12 is packed 3 bytes per sample, as SoapySDR: i[7:0], q[3:0]|i[11:8], q[11:4].
+// - the server also uses these to quantise interleaved data for the wire, by
+//   treating the whole block as one channel.
+// - the reverse (interleaving channel buffers into wire frames, for transmit
+//   and the server receive pump) has its own, smaller, table.
+// - identity (de-)interleaving moves whole frames, with kernels fixed at
+//   compile time for 1, 2, 3, 4 & 8 channels and SIMD for CS16 / CF32 layouts.
+
+#include <map>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <stdint.h>
+#include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SOAPY_CONVERT_X86 1
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SOAPY_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef void (*convert_t)(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems);
+typedef void (*interleave_t)(void *dst, const void * const *src, size_t off, size_t nchans, size_t nelems);
+
+// scalar component conversions
+static inline float cnvToF32(int8_t v) { return (float)v*(1.0f/(float)INT8_MAX); }
+static inline float cnvToF32(int16_t v) { return (float)v*(1.0f/(float)INT16_MAX); }
+static inline float cnvToF32(float v) { return v; }
+template <typename T> static inline T cnvFromF32(float v, float fs) {
+    float s = v*fs;
+    if (s>fs) s = fs;
+    if (s<-fs) s = -fs;
+    return (T)(s<0 ? s-0.5f : s+0.5f);
+}
+template <typename T> static inline T cnvTo(int8_t v);
+template <typename T> static inline T cnvTo(int16_t v);
+template <typename T> static inline T cnvTo(float v);
+template <> inline int8_t cnvTo<int8_t>(int8_t v) { return v; }
+template <> inline int8_t cnvTo<int8_t>(int16_t v) { return (int8_t)(v>>8); }
+template <> inline int8_t cnvTo<int8_t>(float v) { return cnvFromF32<int8_t>(v, (float)INT8_MAX); }
+template <> inline int16_t cnvTo<int16_t>(int8_t v) { return (int16_t)(v*256); }
+template <> inline int16_t cnvTo<int16_t>(int16_t v) { return v; }
+template <> inline int16_t cnvTo<int16_t>(float v) { return cnvFromF32<int16_t>(v, (float)INT16_MAX); }
+template <> inline float cnvTo<float>(int8_t v) { return cnvToF32(v); }
+template <> inline float cnvTo<float>(int16_t v) { return cnvToF32(v); }
+template <> inline float cnvTo<float>(float v) { return v; }
+
+// Sample frames (one complex sample) moved as opaque units by the identity
+// (de-)interleavers, templated on frame type and channel count so the inner
+// loops are fixed size, with SIMD specialisations for the common layouts.
+struct Frame12 { uint8_t b[3]; };
+template <size_t B> struct FrameOf;
+template <> struct FrameOf<2> { typedef uint16_t type; };
+template <> struct FrameOf<3> { typedef Frame12 type; };
+template <> struct FrameOf<4> { typedef uint32_t type; };
+template <> struct FrameOf<8> { typedef uint64_t type; };
+
+template <typename F, size_t N>
+static void interleaveFrames(void *dst, const void * const *src, size_t off, size_t nelems) {
+    F *d = (F *)dst;
+    const F *s[N];
+    for (size_t c=0; c<N; ++c)
+        s[c] = (const F *)src[c] + off;
+    for (size_t e=0; e<nelems; ++e)
+        for (size_t c=0; c<N; ++c)
+            d[e*N+c] = s[c][e];
+}
+
+template <typename F, size_t N>
+static void deinterleaveFrames(void * const *dst, size_t off, const void *src, size_t nelems) {
+    const F *s = (const F *)src;
+    F *d[N];
+    for (size_t c=0; c<N; ++c)
+        d[c] = (F *)dst[c] + off;
+    for (size_t e=0; e<nelems; ++e)
+        for (size_t c=0; c<N; ++c)
+            d[c][e] = s[e*N+c];
+}
+
+#ifdef SOAPY_CONVERT_X86
+// 4x4 transpose of 32-bit lanes (frames), it is its own inverse
+__attribute__((target("sse2")))
+static inline void transpose4x32(__m128i &r0, __m128i &r1, __m128i &r2, __m128i &r3) {
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+    __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+    __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+    r0 = _mm_unpacklo_epi64(t0, t1);
+    r1 = _mm_unpackhi_epi64(t0, t1);
+    r2 = _mm_unpacklo_epi64(t2, t3);
+    r3 = _mm_unpackhi_epi64(t2, t3);
+}
+#endif
+
+#if defined(__SSE2__)
+// SSE2 (compile time, always present on x86_64): 32-bit frames (CS16) in 2 & 4 channels,
+// 64-bit frames (CF32) in 2 channels.
+
+template <> void interleaveFrames<uint32_t, 2>(void *dst, const void * const *src, size_t off, size_t nelems) {
+    uint32_t *d = (uint32_t *)dst;
+    const uint32_t *a = (const uint32_t *)src[0] + off;
+    const uint32_t *b = (const uint32_t *)src[1] + off;
+    size_t e = 0;
+    for (; e+4<=nelems; e+=4) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a+e));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b+e));
+        _mm_storeu_si128((__m128i *)(d+e*2), _mm_unpacklo_epi32(va, vb));
+        _mm_storeu_si128((__m128i *)(d+e*2+4), _mm_unpackhi_epi32(va, vb));
+    }
+    for (; e<nelems; ++e) {
+        d[e*2] = a[e];
+        d[e*2+1] = b[e];
+    }
+}
+
+template <> void deinterleaveFrames<uint32_t, 2>(void * const *dst, size_t off, const void *src, size_t nelems) {
+    const uint32_t *s = (const uint32_t *)src;
+    uint32_t *a = (uint32_t *)dst[0] + off;
+    uint32_t *b = (uint32_t *)dst[1] + off;
+    size_t e = 0;
+    for (; e+4<=nelems; e+=4) {
+        // [a0 b0 a1 b1] [a2 b2 a3 b3] -> [a0 a1 b0 b1] [a2 a3 b2 b3] -> [a0..a3] [b0..b3]
+        __m128i v0 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(s+e*2)), _MM_SHUFFLE(3,1,2,0));
+        __m128i v1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(s+e*2+4)), _MM_SHUFFLE(3,1,2,0));
+        _mm_storeu_si128((__m128i *)(a+e), _mm_unpacklo_epi64(v0, v1));
+        _mm_storeu_si128((__m128i *)(b+e), _mm_unpackhi_epi64(v0, v1));
+    }
+    for (; e<nelems; ++e) {
+        a[e] = s[e*2];
+        b[e] = s[e*2+1];
+    }
+}
+
+template <> void interleaveFrames<uint32_t, 4>(void *dst, const void * const *src, size_t off, size_t nelems) {
+    uint32_t *d = (uint32_t *)dst;
+    const uint32_t *s[4];
+    for (size_t c=0; c<4; ++c)
+        s[c] = (const uint32_t *)src[c] + off;
+    size_t e = 0;
+    for (; e+4<=nelems; e+=4) {
+        __m128i r0 = _mm_loadu_si128((const __m128i *)(s[0]+e));
+        __m128i r1 = _mm_loadu_si128((const __m128i *)(s[1]+e));
+        __m128i r2 = _mm_loadu_si128((const __m128i *)(s[2]+e));
+        __m128i r3 = _mm_loadu_si128((const __m128i *)(s[3]+e));
+        transpose4x32(r0, r1, r2, r3);
+        _mm_storeu_si128((__m128i *)(d+e*4), r0);
+        _mm_storeu_si128((__m128i *)(d+e*4+4), r1);
+        _mm_storeu_si128((__m128i *)(d+e*4+8), r2);
+        _mm_storeu_si128((__m128i *)(d+e*4+12), r3);
+    }
+    for (; e<nelems; ++e)
+        for (size_t c=0; c<4; ++c)
+            d[e*4+c] = s[c][e];
+}
+
+template <> void deinterleaveFrames<uint32_t, 4>(void * const *dst, size_t off, const void *src, size_t nelems) {
+    const uint32_t *s = (const uint32_t *)src;
+    uint32_t *d[4];
+    for (size_t c=0; c<4; ++c)
+        d[c] = (uint32_t *)dst[c] + off;
+    size_t e = 0;
+    for (; e+4<=nelems; e+=4) {
+        __m128i r0 = _mm_loadu_si128((const __m128i *)(s+e*4));
+        __m128i r1 = _mm_loadu_si128((const __m128i *)(s+e*4+4));
+        __m128i r2 = _mm_loadu_si128((const __m128i *)(s+e*4+8));
+        __m128i r3 = _mm_loadu_si128((const __m128i *)(s+e*4+12));
+        transpose4x32(r0, r1, r2, r3);
+        _mm_storeu_si128((__m128i *)(d[0]+e), r0);
+        _mm_storeu_si128((__m128i *)(d[1]+e), r1);
+        _mm_storeu_si128((__m128i *)(d[2]+e), r2);
+        _mm_storeu_si128((__m128i *)(d[3]+e), r3);
+    }
+    for (; e<nelems; ++e)
+        for (size_t c=0; c<4; ++c)
+            d[c][e] = s[e*4+c];
+}
+
+template <> void interleaveFrames<uint64_t, 2>(void *dst, const void * const *src, size_t off, size_t nelems) {
+    uint64_t *d = (uint64_t *)dst;
+    const uint64_t *a = (const uint64_t *)src[0] + off;
+    const uint64_t *b = (const uint64_t *)src[1] + off;
+    size_t e = 0;
+    for (; e+2<=nelems; e+=2) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a+e));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b+e));
+        _mm_storeu_si128((__m128i *)(d+e*2), _mm_unpacklo_epi64(va, vb));
+        _mm_storeu_si128((__m128i *)(d+e*2+2), _mm_unpackhi_epi64(va, vb));
+    }
+    for (; e<nelems; ++e) {
+        d[e*2] = a[e];
+        d[e*2+1] = b[e];
+    }
+}
+
+template <> void deinterleaveFrames<uint64_t, 2>(void * const *dst, size_t off, const void *src, size_t nelems) {
+    const uint64_t *s = (const uint64_t *)src;
+    uint64_t *a = (uint64_t *)dst[0] + off;
+    uint64_t *b = (uint64_t *)dst[1] + off;
+    size_t e = 0;
+    for (; e+2<=nelems; e+=2) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(s+e*2));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(s+e*2+2));
+        _mm_storeu_si128((__m128i *)(a+e), _mm_unpacklo_epi64(v0, v1));
+        _mm_storeu_si128((__m128i *)(b+e), _mm_unpackhi_epi64(v0, v1));
+    }
+    for (; e<nelems; ++e) {
+        a[e] = s[e*2];
+        b[e] = s[e*2+1];
+    }
+}
+#elif defined(SOAPY_CONVERT_NEON)
+// NEON structure loads/stores do the (de-)interleave for 32-bit frames (CS16)
+template <> void interleaveFrames<uint32_t, 2>(void *dst, const void * const *src, size_t off, size_t nelems) {
+    uint32_t *d = (uint32_t *)dst;
+    const uint32_t *a = (const uint32_t *)src[0] + off;
+    const uint32_t *b = (const uint32_t *)src[1] + off;
+    size_t e = 0;
+    for (; e+4<=nelems; e+=4) {
+        uint32x4x2_t v = { { vld1q_u32(a+e), vld1q_u32(b+e) } };
+        vst2q_u32(d+e*2, v);
+    }
+    for (; e<nelems; ++e) {
+        d[e*2] = a[e];
+        d[e*2+1] = b[e];
+    }
+}
+
+template <> void deinterleaveFrames<uint32_t, 2>(void * const *dst, size_t off, const void *src, size_t nelems) {
+    const uint32_t *s = (const uint32_t *)src;
+    uint32_t *a = (uint32_t *)dst[0] + off;
+    uint32_t *b = (uint32_t *)dst[1] + off;
+    size_t e = 0;
+    for (; e+4<=nelems; e+=4) {
+        uint32x4x2_t v = vld2q_u32(s+e*2);
+        vst1q_u32(a+e, v.val[0]);
+        vst1q_u32(b+e, v.val[1]);
+    }
+    for (; e<nelems; ++e) {
+        a[e] = s[e*2];
+        b[e] = s[e*2+1];
+    }
+}
+
+template <> void interleaveFrames<uint32_t, 4>(void *dst, const void * const *src, size_t off, size_t nelems) {
+    uint32_t *d = (uint32_t *)dst;
+    const uint32_t *s[4];
+    for (size_t c=0; c<4; ++c)
+        s[c] = (const uint32_t *)src[c] + off;
+    size_t e = 0;
+    for (; e+4<=nelems; e+=4) {
+        uint32x4x4_t v = { { vld1q_u32(s[0]+e), vld1q_u32(s[1]+e), vld1q_u32(s[2]+e), vld1q_u32(s[3]+e) } };
+        vst4q_u32(d+e*4, v);
+    }
+    for (; e<nelems; ++e)
+        for (size_t c=0; c<4; ++c)
+            d[e*4+c] = s[c][e];
+}
+
+template <> void deinterleaveFrames<uint32_t, 4>(void * const *dst, size_t off, const void *src, size_t nelems) {
+    const uint32_t *s = (const uint32_t *)src;
+    uint32_t *d[4];
+    for (size_t c=0; c<4; ++c)
+        d[c] = (uint32_t *)dst[c] + off;
+    size_t e = 0;
+    for (; e+4<=nelems; e+=4) {
+        uint32x4x4_t v = vld4q_u32(s+e*4);
+        for (size_t c=0; c<4; ++c)
+            vst1q_u32(d[c]+e, v.val[c]);
+    }
+    for (; e<nelems; ++e)
+        for (size_t c=0; c<4; ++c)
+            d[c][e] = s[e*4+c];
+}
+#endif
+
+// identity interleave / de-interleave by channel count, other counts use a runtime strided loop
+template <typename F>
+static void joinFrames(void *dst, const void * const *src, size_t off, size_t nchans, size_t nelems) {
+    switch (nchans) {
+    case 1: memcpy(dst, (const F *)src[0] + off, nelems*sizeof(F)); return;
+    case 2: return interleaveFrames<F, 2>(dst, src, off, nelems);
+    case 3: return interleaveFrames<F, 3>(dst, src, off, nelems);
+    case 4: return interleaveFrames<F, 4>(dst, src, off, nelems);
+    case 8: return interleaveFrames<F, 8>(dst, src, off, nelems);
+    }
+    F *d = (F *)dst;
+    for (size_t c=0; c<nchans; ++c) {
+        const F *s = (const F *)src[c] + off;
+        for (size_t e=0; e<nelems; ++e)
+            d[e*nchans+c] = s[e];
+    }
+}
+
+template <typename F>
+static void splitFrames(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems) {
+    switch (nchans) {
+    case 1: memcpy((F *)dst[0] + off, src, nelems*sizeof(F)); return;
+    case 2: return deinterleaveFrames<F, 2>(dst, off, src, nelems);
+    case 3: return deinterleaveFrames<F, 3>(dst, off, src, nelems);
+    case 4: return deinterleaveFrames<F, 4>(dst, off, src, nelems);
+    case 8: return deinterleaveFrames<F, 8>(dst, off, src, nelems);
+    }
+    const F *s = (const F *)src;
+    for (size_t c=0; c<nchans; ++c) {
+        F *d = (F *)dst[c] + off;
+        for (size_t e=0; e<nelems; ++e)
+            d[e] = s[e*nchans+c];
+    }
+}
+
+// generic de-interleave + convert, any pair, any channel count
+template <typename S, typename D>
+static void convertBlock(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems) {
+    const S *s = (const S *)src;
+    for (size_t c=0; c<nchans; ++c) {
+        D *d = (D *)dst[c] + off*2;
+        const S *sc = s + c*2;
+        for (size_t e=0; e<nelems; ++e) {
+            d[e*2]   = cnvTo<D>(sc[e*nchans*2]);
+            d[e*2+1] = cnvTo<D>(sc[e*nchans*2+1]);
+        }
+    }
+}
+
+// generic interleave + convert, 'off' is the element offset into each source buffer
+template <typename S, typename D>
+static void interleaveBlock(void *dst, const void * const *src, size_t off, size_t nchans, size_t nelems) {
+    D *d = (D *)dst;
+    if (std::is_same<S, D>::value)
+        return joinFrames<typename FrameOf<sizeof(S)*2>::type>(dst, src, off, nchans, nelems);
+    for (size_t c=0; c<nchans; ++c) {
+        const S *sc = (const S *)src[c] + off*2;
+        D *dc = d + c*2;
+        for (size_t e=0; e<nelems; ++e) {
+            dc[e*nchans*2]   = cnvTo<D>(sc[e*2]);
+            dc[e*nchans*2+1] = cnvTo<D>(sc[e*2+1]);
+        }
+    }
+}
+
+// CS12 as a 12-bit value held in an int16_t
+template <typename T> static inline T cnv12To(int16_t v);
+template <> inline int8_t cnv12To<int8_t>(int16_t v) { return (int8_t)(v>>4); }
+template <> inline int16_t cnv12To<int16_t>(int16_t v) { return (int16_t)(v*16); }
+template <> inline float cnv12To<float>(int16_t v) { return (float)v*(1.0f/2047.0f); }
+static inline int16_t cnvTo12(int8_t v) { return (int16_t)(v*16); }
+static inline int16_t cnvTo12(int16_t v) { return (int16_t)(v>>4); }
+static inline int16_t cnvTo12(float v) { return cnvFromF32<int16_t>(v, 2047.0f); }
+
+template <typename D>
+static void convertFromCS12(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems) {
+    const uint8_t *s = (const uint8_t *)src;
+    for (size_t c=0; c<nchans; ++c) {
+        D *d = (D *)dst[c] + off*2;
+        const uint8_t *sc = s + c*3;
+        for (size_t e=0; e<nelems; ++e) {
+            const uint8_t *p = sc + e*nchans*3;
+            // shift up to sign extend from bit 11
+            d[e*2]   = cnv12To<D>((int16_t)(uint16_t)((p[0]<<4) | (p[1]<<12))>>4);
+            d[e*2+1] = cnv12To<D>((int16_t)(uint16_t)((p[1]&0xf0) | (p[2]<<8))>>4);
+        }
+    }
+}
+
+template <typename S>
+static void convertToCS12(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems) {
+    const S *s = (const S *)src;
+    for (size_t c=0; c<nchans; ++c) {
+        uint8_t *d = (uint8_t *)dst[c] + off*3;
+        const S *sc = s + c*2;
+        for (size_t e=0; e<nelems; ++e) {
+            uint16_t i = (uint16_t)cnvTo12(sc[e*nchans*2]);
+            uint16_t q = (uint16_t)cnvTo12(sc[e*nchans*2+1]);
+            d[e*3]   = (uint8_t)i;
+            d[e*3+1] = (uint8_t)(((q<<4)&0xf0) | ((i>>8)&0x0f));
+            d[e*3+2] = (uint8_t)(q>>4);
+        }
+    }
+}
+
+// identity, de-interleave only
+template <typename S>
+static void convertCopy(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems) {
+    splitFrames<typename FrameOf<sizeof(S)*2>::type>(dst, off, src, nchans, nelems);
+}
+
+static void convertCopy12(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems) {
+    splitFrames<Frame12>(dst, off, src, nchans, nelems);
+}
+
+#ifdef SOAPY_CONVERT_X86
+// SSE2 (always present on x86_64): 8 components per step
+__attribute__((target("sse2")))
+static void convertCS16toCF32_sse2(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems) {
+    if (nchans!=1 && nchans!=2 && nchans!=4)
+        return convertBlock<int16_t, float>(dst, off, src, nchans, nelems);
+    const int16_t *s = (const int16_t *)src;
+    const __m128 scale = _mm_set1_ps(1.0f/(float)INT16_MAX);
+    size_t e = 0;
+    if (1==nchans) {
+        float *d = (float *)dst[0] + off*2;
+        for (; e+4<=nelems; e+=4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(s+e*2));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(d+e*2, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+            _mm_storeu_ps(d+e*2+4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        }
+    } else if (2==nchans) {
+        float *d0 = (float *)dst[0] + off*2;
+        float *d1 = (float *)dst[1] + off*2;
+        for (; e+2<=nelems; e+=2) {
+            // [a0 b0 a1 b1] (complex units) -> [a0 a1 b0 b1]
+            __m128i v = _mm_loadu_si128((const __m128i *)(s+e*4));
+            v = _mm_shuffle_epi32(v, _MM_SHUFFLE(3,1,2,0));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(d0+e*2, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+            _mm_storeu_ps(d1+e*2, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        }
+    } else {
+        // four frames (x 4 channels) transposed into four samples per channel
+        for (; e+4<=nelems; e+=4) {
+            __m128i r[4];
+            for (size_t k=0; k<4; ++k)
+                r[k] = _mm_loadu_si128((const __m128i *)(s+(e+k)*8));
+            transpose4x32(r[0], r[1], r[2], r[3]);
+            for (size_t c=0; c<4; ++c) {
+                float *d = (float *)dst[c] + (off+e)*2;
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(r[c], r[c]), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(r[c], r[c]), 16);
+                _mm_storeu_ps(d, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+                _mm_storeu_ps(d+4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+            }
+        }
+    }
+    // tail
+    if (e<nelems) {
+        void *td[4];
+        for (size_t c=0; c<nchans; ++c)
+            td[c] = (float *)dst[c] + e*2;
+        convertBlock<int16_t, float>(td, off, s+e*nchans*2, nchans, nelems-e);
+    }
+}
+
+__attribute__((target("sse2")))
+static void convertCS8toCF32_sse2(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems) {
+    if (nchans>1)
+        return convertBlock<int8_t, float>(dst, off, src, nchans, nelems);
+    const int8_t *s = (const int8_t *)src;
+    float *d = (float *)dst[0] + off*2;
+    const __m128 scale = _mm_set1_ps(1.0f/(float)INT8_MAX);
+    size_t e = 0;
+    for (; e+4<=nelems; e+=4) {
+        __m128i v = _mm_loadl_epi64((const __m128i *)(s+e*2));
+        __m128i w = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(w, w), 16);
+        _mm_storeu_ps(d+e*2, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(d+e*2+4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    if (e<nelems) {
+        void *td[1] = { d + e*2 };
+        convertBlock<int8_t, float>(td, 0, s+e*2, 1, nelems-e);
+    }
+}
+
+// AVX2: 16 components per step, single channel only (dual uses SSE2)
+__attribute__((target("avx2")))
+static void convertCS16toCF32_avx2(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems) {
+    if (nchans!=1)
+        return convertCS16toCF32_sse2(dst, off, src, nchans, nelems);
+    const int16_t *s = (const int16_t *)src;
+    float *d = (float *)dst[0] + off*2;
+    const __m256 scale = _mm256_set1_ps(1.0f/(float)INT16_MAX);
+    size_t e = 0;
+    for (; e+8<=nelems; e+=8) {
+        __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(s+e*2)));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(s+e*2+8)));
+        _mm256_storeu_ps(d+e*2, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+        _mm256_storeu_ps(d+e*2+8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+    }
+    if (e<nelems) {
+        void *td[1] = { d + e*2 };
+        convertBlock<int16_t, float>(td, 0, s+e*2, 1, nelems-e);
+    }
+}
+
+__attribute__((target("avx2")))
+static void convertCS8toCF32_avx2(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems) {
+    if (nchans!=1)
+        return convertBlock<int8_t, float>(dst, off, src, nchans, nelems);
+    const int8_t *s = (const int8_t *)src;
+    float *d = (float *)dst[0] + off*2;
+    const __m256 scale = _mm256_set1_ps(1.0f/(float)INT8_MAX);
+    size_t e = 0;
+    for (; e+8<=nelems; e+=8) {
+        __m256i lo = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(s+e*2)));
+        __m256i hi = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(s+e*2+8)));
+        _mm256_storeu_ps(d+e*2, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+        _mm256_storeu_ps(d+e*2+8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+    }
+    if (e<nelems) {
+        void *td[1] = { d + e*2 };
+        convertBlock<int8_t, float>(td, 0, s+e*2, 1, nelems-e);
+    }
+}
+#endif
+
+#ifdef SOAPY_CONVERT_NEON
+static void convertCS16toCF32_neon(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems) {
+    if (nchans!=1 && nchans!=2 && nchans!=4)
+        return convertBlock<int16_t, float>(dst, off, src, nchans, nelems);
+    const int16_t *s = (const int16_t *)src;
+    const float32x4_t scale = vdupq_n_f32(1.0f/(float)INT16_MAX);
+    size_t e = 0;
+    if (1==nchans) {
+        float *d = (float *)dst[0] + off*2;
+        for (; e+4<=nelems; e+=4) {
+            int16x8_t v = vld1q_s16(s+e*2);
+            vst1q_f32(d+e*2, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+            vst1q_f32(d+e*2+4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+        }
+    } else if (2==nchans) {
+        float *d0 = (float *)dst[0] + off*2;
+        float *d1 = (float *)dst[1] + off*2;
+        for (; e+4<=nelems; e+=4) {
+            // de-interleave complex units (32 bits) between the two channels
+            int32x4x2_t v = vld2q_s32((const int32_t *)(s+e*4));
+            int16x8_t a = vreinterpretq_s16_s32(v.val[0]);
+            int16x8_t b = vreinterpretq_s16_s32(v.val[1]);
+            vst1q_f32(d0+e*2, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(a))), scale));
+            vst1q_f32(d0+e*2+4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(a))), scale));
+            vst1q_f32(d1+e*2, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(b))), scale));
+            vst1q_f32(d1+e*2+4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(b))), scale));
+        }
+    } else {
+        for (; e+4<=nelems; e+=4) {
+            // four samples from each of four channels
+            int32x4x4_t v = vld4q_s32((const int32_t *)(s+e*8));
+            for (size_t c=0; c<4; ++c) {
+                float *d = (float *)dst[c] + (off+e)*2;
+                int16x8_t a = vreinterpretq_s16_s32(v.val[c]);
+                vst1q_f32(d, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(a))), scale));
+                vst1q_f32(d+4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(a))), scale));
+            }
+        }
+    }
+    if (e<nelems) {
+        void *td[4];
+        for (size_t c=0; c<nchans; ++c)
+            td[c] = (float *)dst[c] + e*2;
+        convertBlock<int16_t, float>(td, off, s+e*nchans*2, nchans, nelems-e);
+    }
+}
+
+static void convertCS8toCF32_neon(void * const *dst, size_t off, const void *src, size_t nchans, size_t nelems) {
+    if (nchans!=1)
+        return convertBlock<int8_t, float>(dst, off, src, nchans, nelems);
+    const int8_t *s = (const int8_t *)src;
+    float *d = (float *)dst[0] + off*2;
+    const float32x4_t scale = vdupq_n_f32(1.0f/(float)INT8_MAX);
+    size_t e = 0;
+    for (; e+4<=nelems; e+=4) {
+        int16x8_t w = vmovl_s8(vld1_s8(s+e*2));
+        vst1q_f32(d+e*2, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(w))), scale));
+        vst1q_f32(d+e*2+4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(w))), scale));
+    }
+    if (e<nelems) {
+        void *td[1] = { d + e*2 };
+        convertBlock<int8_t, float>(td, 0, s+e*2, 1, nelems-e);
+    }
+}
+#endif
+
+// in place scaling of float components (quantising with a full scale other than 1.0)
+static inline void scaleBlock(void *buf, size_t ncomp, float mul) {
+    float *f = (float *)buf;
+    for (size_t i=0; i<ncomp; ++i)
+        f[i] *= mul;
+}
+
+// find the best converter for a wire -> output format pair, nullptr if unknown
+static inline convert_t getConverter(const std::string &wire, const std::string &out) {
+    convert_t cs16cf32 = convertBlock<int16_t, float>;
+    convert_t cs8cf32 = convertBlock<int8_t, float>;
+#if defined(SOAPY_CONVERT_X86)
+    if (__builtin_cpu_supports("avx2")) {
+        cs16cf32 = convertCS16toCF32_avx2;
+        cs8cf32 = convertCS8toCF32_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        cs16cf32 = convertCS16toCF32_sse2;
+        cs8cf32 = convertCS8toCF32_sse2;
+    }
+#elif defined(SOAPY_CONVERT_NEON)
+    cs16cf32 = convertCS16toCF32_neon;
+    cs8cf32 = convertCS8toCF32_neon;
+#endif
+    const std::map<std::pair<std::string, std::string>, convert_t> table = {
+        { { "CS8", "CS8" },   convertCopy<int8_t> },
+        { { "CS8", "CS16" },  convertBlock<int8_t, int16_t> },
+        { { "CS8", "CF32" },  cs8cf32 },
+        { { "CS16", "CS8" },  convertBlock<int16_t, int8_t> },
+        { { "CS16", "CS16" }, convertCopy<int16_t> },
+        { { "CS16", "CF32" }, cs16cf32 },
+        { { "CF32", "CS8" },  convertBlock<float, int8_t> },
+        { { "CF32", "CS16" }, convertBlock<float, int16_t> },
+        { { "CF32", "CF32" }, convertCopy<float> },
+        { { "CS12", "CS8" },  convertFromCS12<int8_t> },
+        { { "CS12", "CS12" }, convertCopy12 },
+        { { "CS12", "CS16" }, convertFromCS12<int16_t> },
+        { { "CS12", "CF32" }, convertFromCS12<float> },
+        { { "CS8", "CS12" },  convertToCS12<int8_t> },
+        { { "CS16", "CS12" }, convertToCS12<int16_t> },
+        { { "CF32", "CS12" }, convertToCS12<float> },
+    };
+    auto it = table.find(std::make_pair(wire, out));
+    return it!=table.end() ? it->second : nullptr;
+}
+
+// find an interleaver for an input -> wire format pair, nullptr if unknown
+static inline interleave_t getInterleaver(const std::string &in, const std::string &wire) {
+    const std::map<std::pair<std::string, std::string>, interleave_t> table = {
+        { { "CS8", "CS8" },   interleaveBlock<int8_t, int8_t> },
+        { { "CS8", "CS16" },  interleaveBlock<int8_t, int16_t> },
+        { { "CS8", "CF32" },  interleaveBlock<int8_t, float> },
+        { { "CS16", "CS8" },  interleaveBlock<int16_t, int8_t> },
+        { { "CS16", "CS16" }, interleaveBlock<int16_t, int16_t> },
+        { { "CS16", "CF32" }, interleaveBlock<int16_t, float> },
+        { { "CF32", "CS8" },  interleaveBlock<float, int8_t> },
+        { { "CF32", "CS16" }, interleaveBlock<float, int16_t> },
+        { { "CF32", "CF32" }, interleaveBlock<float, float> },
+        { { "CS12", "CS12" }, joinFrames<Frame12> },
+    };
+    auto it = table.find(std::make_pair(in, wire));
+    return it!=table.end() ? it->second : nullptr;
+}
+
+#endif
@@ -0,0 +1,138 @@
+// SoapyDSP.hpp - server side frequency shift & decimation of receive streams
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapyDSP_hpp
+#define SoapyDSP_hpp
+
+// Optional processing between the device and the network (receive only, see
+// tcpremote:shift & tcpremote:decim in SoapyTCPServer), so a narrow channel can
+// be sent instead of the device's full rate. Design notes:
+// - works in place on one channel of CF32 samples, one state per channel.
+// - mixer (NCO): multiplies by exp(-j.2pi.shift.t), moving 'shift' Hz to zero,
+//   using DSP_LANES phasors stepped together (SoA, so the compiler vectorises),
+//   reset from a double precision phase every DSP_CHUNK samples to stop drift.
+// - decimator: windowed-sinc (Blackman) low pass, DSP_TAPS_PER*decim+1 taps with
+//   cutoff at the output Nyquist rate and unity gain, evaluated only for kept
+//   outputs (the polyphase saving: decim times less work than filtering every
+//   input). Taps are stored reversed & doubled (i,q) so each output is one long
+//   multiply-add over interleaved history, two accumulators (even = I, odd = Q).
+// - history (taps-1 samples) is carried between blocks, as is the decimation
+//   phase, so any block size works & outputs are evenly spaced across blocks.
+
+#include <vector>
+#include <math.h>
+#include <string.h>
+
+#define DSP_LANES 8
+#define DSP_CHUNK 1024
+#define DSP_TAPS_PER 16
+
+struct DspState {
+    // mixer
+    double shift;       // cycles per input sample
+    double phase;       // cycles, [0,1)
+    // decimator
+    size_t decim;
+    std::vector<float> taps2;   // reversed, each tap twice (i,q)
+    std::vector<float> hist;    // interleaved i,q: (taps-1) history then the block
+    size_t skip;        // inputs to skip before the next output
+};
+
+static inline void dspInit(DspState &st, double shiftHz, double rate, size_t decim) {
+    st.shift = rate>0 ? shiftHz/rate : 0;
+    st.phase = 0;
+    st.decim = decim<1 ? 1 : decim;
+    st.taps2.clear();
+    st.hist.clear();
+    st.skip = 0;
+    if (st.decim<2)
+        return;
+    size_t ntaps = DSP_TAPS_PER*st.decim+1;
+    double fc = 0.5/st.decim;
+    std::vector<double> h(ntaps);
+    double sum = 0;
+    for (size_t n=0; n<ntaps; ++n) {
+        double m = (double)n-(double)(ntaps-1)/2;
+        double sinc = m==0 ? 2*fc : sin(2*M_PI*fc*m)/(M_PI*m);
+        double w = 0.42-0.5*cos(2*M_PI*n/(ntaps-1))+0.08*cos(4*M_PI*n/(ntaps-1));
+        h[n] = sinc*w;
+        sum += h[n];
+    }
+    st.taps2.resize(2*ntaps);
+    for (size_t n=0; n<ntaps; ++n)
+        st.taps2[2*n] = st.taps2[2*n+1] = (float)(h[ntaps-1-n]/sum);
+    st.hist.assign(2*(ntaps-1), 0.0f);
+}
+
+// mix 'n' interleaved complex samples in place
+static inline void dspMix(DspState &st, float *iq, size_t n) {
+    if (0==st.shift)
+        return;
+    for (size_t base=0; base<n; base+=DSP_CHUNK) {
+        size_t len = n-base<DSP_CHUNK ? n-base : DSP_CHUNK;
+        // lane phasors exp(-j.2pi.(phase+k.shift)), and the step between groups of lanes
+        float pr[DSP_LANES], pi[DSP_LANES];
+        for (int k=0; k<DSP_LANES; ++k) {
+            double a = -2*M_PI*(st.phase+k*st.shift);
+            pr[k] = (float)cos(a);
+            pi[k] = (float)sin(a);
+        }
+        float sr = (float)cos(-2*M_PI*DSP_LANES*st.shift);
+        float si = (float)sin(-2*M_PI*DSP_LANES*st.shift);
+        float *p = iq+2*base;
+        size_t i = 0;
+        for (; i+DSP_LANES<=len; i+=DSP_LANES, p+=2*DSP_LANES) {
+            for (int k=0; k<DSP_LANES; ++k) {
+                float xr = p[2*k], xi = p[2*k+1];
+                p[2*k] = xr*pr[k]-xi*pi[k];
+                p[2*k+1] = xr*pi[k]+xi*pr[k];
+                float nr = pr[k]*sr-pi[k]*si;
+                pi[k] = pr[k]*si+pi[k]*sr;
+                pr[k] = nr;
+            }
+        }
+        for (int k=0; i<len; ++i, ++k, p+=2) {
+            float xr = p[0], xi = p[1];
+            p[0] = xr*pr[k]-xi*pi[k];
+            p[1] = xr*pi[k]+xi*pr[k];
+        }
+        st.phase += len*st.shift;
+        st.phase -= floor(st.phase);
+    }
+}
+
+// decimate 'n' interleaved complex samples in place, returns the outputs made, and
+// in 'first' the input index of the first one (for timestamps)
+static inline size_t dspDecimate(DspState &st, float *iq, size_t n, size_t &first) {
+    first = 0;
+    if (st.decim<2)
+        return n;
+    size_t keep = st.hist.size();
+    st.hist.resize(keep+2*n);
+    memcpy(st.hist.data()+keep, iq, 2*n*sizeof(float));
+    const float *h = st.taps2.data();
+    size_t len = st.taps2.size();
+    size_t out = 0;
+    first = st.skip;
+    size_t i = st.skip;
+    for (; i<n; i+=st.decim) {
+        // input i is the newest sample under the filter
+        const float *x = st.hist.data()+2*i;
+        float ai = 0, aq = 0;
+        for (size_t k=0; k<len; k+=2) {
+            ai += h[k]*x[k];
+            aq += h[k+1]*x[k+1];
+        }
+        iq[2*out] = ai;
+        iq[2*out+1] = aq;
+        ++out;
+    }
+    st.skip = i-n;
+    // keep the newest (taps-1) samples for the next block
+    memmove(st.hist.data(), st.hist.data()+2*n, keep*sizeof(float));
+    st.hist.resize(keep);
+    return out;
+}
+
+#endif
@@ -0,0 +1,243 @@
+// SoapyDatagram.hpp - UDP (unicast or multicast) transport for receive streams
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapyDatagram_hpp
+#define SoapyDatagram_hpp
+
+// Optional datagram transport (stream arg tcpremote:udp), used instead of the
+// TCP data connection for sample data, which stays open to identify & hold
+// the stream. Design notes:
+// - receive only, always framed: each datagram is a self contained framed
+//   block (SoapyRPCDataHeader + whole frames), so the running frame count is
+//   the sequence number, a gap is reported as SOAPY_SDR_OVERFLOW by the usual
+//   framed reader and nothing is ever retransmitted.
+// - the server splits each block into datagrams that fit the path MTU (capped
+//   at tcpremote:mtu, default 1500), with times offset to each one's first
+//   frame, planar blocks are re-laid as planar sub-blocks.
+// - datagrams are laid end to end in one buffer, the server sends them with
+//   UDP GSO (one send per 64 datagrams) where available, else sendmmsg, the
+//   client receives with recvmmsg, optionally with UDP GRO (tcpremote:gro=1)
+//   coalescing many datagrams per buffer, which is the same layout again.
+// - tcpremote:udp=1 is unicast to the client's address (port chosen by the
+//   client), tcpremote:udp=<group>:<port> multicast, joined by any number of
+//   clients, see README for sharing one multicast stream.
+
+#include "SoapyRPC.hpp"
+#include <SoapySDR/Logger.h>
+#include <vector>
+#include <string>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+// default link MTU for datagram sizing, and the most GSO takes in one send
+#define TCPREMOTE_UDP_MTU 1500
+#define TCPREMOTE_UDP_GSO_SEGS 64
+#define TCPREMOTE_UDP_GSO_MAX 65000
+// datagrams (or GRO buffers) per recvmmsg / sendmmsg
+#define TCPREMOTE_UDP_BATCH 64
+
+// destination (or group to join) from tcpremote:udp: "<port>" is unicast to 'peer',
+// "<address>:<port>" (or "[<address>]:<port>" for IPv6) an explicit address
+static inline bool dgramAddress(const std::string &spec, const struct sockaddr_storage *peer,
+    struct sockaddr_storage &addr, socklen_t &len) {
+    size_t colon = spec.rfind(':');
+    if (std::string::npos==colon) {
+        if (!peer || (AF_INET!=peer->ss_family && AF_INET6!=peer->ss_family))
+            return false;
+        int port = atoi(spec.c_str());
+        if (port<=0 || port>65535)
+            return false;
+        addr = *peer;
+        len = peer->ss_family==AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+        if (peer->ss_family==AF_INET6)
+            ((struct sockaddr_in6 *)&addr)->sin6_port = htons(port);
+        else
+            ((struct sockaddr_in *)&addr)->sin_port = htons(port);
+        return true;
+    }
+    std::string host = spec.substr(0, colon);
+    if (host.size()>=2 && '['==host[0] && ']'==host[host.size()-1])
+        host = host.substr(1, host.size()-2);
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST|AI_NUMERICSERV;
+    if (getaddrinfo(host.c_str(), spec.substr(colon+1).c_str(), &hints, &res))
+        return false;
+    memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return true;
+}
+
+static inline bool dgramIsMulticast(const struct sockaddr_storage &addr) {
+    if (AF_INET6==addr.ss_family)
+        return IN6_IS_ADDR_MULTICAST(&((const struct sockaddr_in6 *)&addr)->sin6_addr);
+    return IN_MULTICAST(ntohl(((const struct sockaddr_in *)&addr)->sin_addr.s_addr));
+}
+
+// (server) socket connected to the destination, multicast with 'ttl' hops (looped back,
+// so consumers on the server itself can join), -1 on error
+static inline int dgramConnect(const struct sockaddr_storage &addr, socklen_t len, int ttl) {
+    int sock = socket(addr.ss_family, SOCK_DGRAM, 0);
+    if (sock<0)
+        return -1;
+    if (dgramIsMulticast(addr)) {
+        int loop = 1;
+        if (AF_INET6==addr.ss_family) {
+            setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof(ttl));
+            setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &loop, sizeof(loop));
+        } else {
+            setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+            setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+        }
+    }
+    if (connect(sock, (const struct sockaddr *)&addr, len)) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// (server) largest datagram payload for a connected socket: path MTU (where known) capped
+// at 'mtu', less IP & UDP headers
+static inline size_t dgramPayload(int sock, int family, size_t mtu) {
+    size_t hdrs = (AF_INET6==family ? 40 : 20) + 8;
+#ifdef __linux__
+    int path = 0;
+    socklen_t plen = sizeof(path);
+    if (AF_INET6==family ? !getsockopt(sock, IPPROTO_IPV6, IPV6_MTU, &path, &plen) :
+        !getsockopt(sock, IPPROTO_IP, IP_MTU, &path, &plen)) {
+        if (path>0 && (size_t)path<mtu)
+            mtu = path;
+    }
+#endif
+    return mtu>hdrs ? mtu-hdrs : 0;
+}
+
+// (client) socket receiving at 'addr': a local address & port (zero picks one), or a
+// multicast group & port, which is joined (bound to the group, so other groups on the
+// same port stay out), optionally with GRO. -1 on error
+static inline int dgramListen(const struct sockaddr_storage &addr, socklen_t len, bool gro) {
+    int sock = socket(addr.ss_family, SOCK_DGRAM, 0);
+    if (sock<0)
+        return -1;
+    bool mcast = dgramIsMulticast(addr);
+    if (mcast) {
+        int one = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    int rv = bind(sock, (const struct sockaddr *)&addr, len);
+    if (!rv && mcast) {
+        if (AF_INET6==addr.ss_family) {
+            struct ipv6_mreq mr;
+            mr.ipv6mr_multiaddr = ((const struct sockaddr_in6 *)&addr)->sin6_addr;
+            mr.ipv6mr_interface = 0;
+            rv = setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mr, sizeof(mr));
+        } else {
+            struct ip_mreq mr;
+            mr.imr_multiaddr = ((const struct sockaddr_in *)&addr)->sin_addr;
+            mr.imr_interface.s_addr = htonl(INADDR_ANY);
+            rv = setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mr, sizeof(mr));
+        }
+    }
+    if (rv) {
+        int err = errno;
+        close(sock);
+        errno = err;
+        return -1;
+    }
+#ifdef __linux__
+    int one = 1;
+    if (gro && setsockopt(sock, SOL_UDP, UDP_GRO, &one, sizeof(one)))
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "dgramListen: UDP_GRO: %s", strerror(errno));
+#endif
+    return sock;
+}
+
+// (server) split a framed block into datagrams of up to maxFrames frames, laid end to end
+// in 'out', every one 'seg' bytes except perhaps the last, returns how many
+static inline size_t dgramSplit(std::vector<uint8_t> &out, size_t &seg, const uint8_t *blk,
+    size_t wfSize, size_t numChans, bool planar, size_t maxFrames, double rate) {
+    SoapyRPCDataHeader hdr;
+    getDataHeader(blk, hdr);
+    const uint8_t *data = blk+TCPREMOTE_DATA_HDR;
+    size_t frameSize = wfSize*numChans;
+    size_t elems = hdr.elems;
+    size_t count = elems>0 ? (elems+maxFrames-1)/maxFrames : 1;
+    seg = TCPREMOTE_DATA_HDR + (elems<maxFrames ? elems : maxFrames)*frameSize;
+    out.resize(count*TCPREMOTE_DATA_HDR + elems*frameSize);
+    uint8_t *p = out.data();
+    for (size_t d=0, off=0; d<count; ++d) {
+        size_t n = elems-off<maxFrames ? elems-off : maxFrames;
+        SoapyRPCDataHeader dh = hdr;
+        dh.elems = n;
+        dh.count = hdr.count+off;
+        // loss is reported before the first, end of burst after the last
+        if (d>0)
+            dh.flags &= ~TCPREMOTE_FLAG_OVERFLOW;
+        if (d+1<count)
+            dh.flags &= ~SOAPY_SDR_END_BURST;
+        if (off>0 && (dh.flags & SOAPY_SDR_HAS_TIME)) {
+            if (rate>0)
+                dh.timeNs += (int64_t)(off*1e9/rate);
+            else
+                dh.flags &= ~SOAPY_SDR_HAS_TIME;
+        }
+        putDataHeader(p, dh);
+        p += TCPREMOTE_DATA_HDR;
+        if (planar) {
+            for (size_t c=0; c<numChans; ++c, p+=n*wfSize)
+                memcpy(p, data + (c*elems+off)*wfSize, n*wfSize);
+        } else {
+            memcpy(p, data + off*frameSize, n*frameSize);
+            p += n*frameSize;
+        }
+        off += n;
+    }
+    return count;
+}
+
+// (client) receive up to TCPREMOTE_UDP_BATCH datagrams (or GRO buffers) into 'buf', in
+// slots of 'slot' bytes, without waiting: returns how many, lengths in 'lens' (zero for
+// anything truncated), or -1 with errno (EAGAIN if nothing is waiting)
+static inline int dgramRecv(int sock, uint8_t *buf, size_t cap, size_t slot, size_t *lens) {
+    size_t num = cap/slot;
+    if (num>TCPREMOTE_UDP_BATCH)
+        num = TCPREMOTE_UDP_BATCH;
+    if (0==num) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    struct mmsghdr msgs[TCPREMOTE_UDP_BATCH];
+    struct iovec iov[TCPREMOTE_UDP_BATCH];
+    memset(msgs, 0, num*sizeof(msgs[0]));
+    for (size_t i=0; i<num; ++i) {
+        iov[i].iov_base = buf + i*slot;
+        iov[i].iov_len = slot;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int n = recvmmsg(sock, msgs, num, MSG_DONTWAIT, nullptr);
+    for (int i=0; i<n; ++i)
+        lens[i] = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : msgs[i].msg_len;
+    return n;
+}
+
+#endif
@@ -6,6 +6,7 @@
 #define SoapyLog_hpp
 
 #include <SoapySDR/Logger.h>
+#include <atomic>
 #include <stdio.h>
 
 /***********************************************************************
@@ -69,4 +70,36 @@ static inline SoapySDRLogLevel detectLogLevel()
     return found;
 }
 
+/***********************************************************************
+ * Cheap level checks & trace points: the effective level is cached here
+ * (set when it changes, as we cannot read it back from SoapySDR), so hot
+ * paths test an integer before formatting anything. Building with
+ * TCPREMOTE_NO_TRACE removes trace points entirely.
+ **********************************************************************/
+static std::atomic<int> s_logLevel(SOAPY_SDR_INFO);
+
+static inline void setLogLevel(SoapySDRLogLevel level)
+{
+    s_logLevel.store((int)level, std::memory_order_relaxed);
+    SoapySDR_setLogLevel(level);
+}
+
+static inline bool logEnabled(SoapySDRLogLevel level)
+{
+#ifdef TCPREMOTE_NO_TRACE
+    if (level>=SOAPY_SDR_TRACE)
+        return false;
+#endif
+    return (int)level <= s_logLevel.load(std::memory_order_relaxed);
+}
+
+#ifdef TCPREMOTE_NO_TRACE
+#define TCPREMOTE_TRACE(...) do { } while (0)
+#else
+#define TCPREMOTE_TRACE(...) do { \
+        if (logEnabled(SOAPY_SDR_TRACE)) \
+            SoapySDR_logf(SOAPY_SDR_TRACE, __VA_ARGS__); \
+    } while (0)
+#endif
+
 #endif
\ No newline at end of file
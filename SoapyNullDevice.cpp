@@ -0,0 +1,287 @@
+//  SoapyNullDevice.cpp
+//  Copyright (c) 2021 Phil Ashby
+//  SPDX-License-Identifier: BSL-1.0
+
+// Synthetic device built into the server for benchmarking (see SoapyTCPBench),
+// so numbers do not depend on real hardware or a driver's quirks.
+// Only made when asked for by name: tcpremote:driver=tcpnull, device args:
+//  chans=<n>       - channels in each direction (default 1)
+//  native=<fmt>    - native format CS8, CS16 (default) or CF32, all are offered
+//  mtu=<elems>     - samples per read / write (default 8192)
+//  direct=<n>      - offer <n> direct access buffers (default 0, none)
+//  open=<msecs>    - take this long to make (default 0), like firmware loading
+// Receive samples are paced to the sample rate (zero: as fast as possible),
+// channel <c> holds I = running sample count, Q = c (CF32 scaled by 1/32767,
+// CS8 truncated), so a client can check for gaps. Transmit data is discarded
+// at the same pace.
+
+#include <SoapySDR/Device.hpp>
+#include <SoapySDR/Registry.hpp>
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Logger.h>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+struct NullStream
+{
+    int direction;
+    std::string format;
+    size_t numChans;
+    bool active;
+    // pacing: start of run & samples since then
+    struct timespec start;
+    uint64_t count;
+    // direct buffers, one block of interleaved frames per buffer (one channel only)
+    std::vector<std::vector<uint8_t>> bufs;
+    std::vector<bool> held;
+    size_t next;
+};
+
+static size_t frameSize(const std::string &format)
+{
+    return format==SOAPY_SDR_CF32 ? 8 : format==SOAPY_SDR_CS16 ? 4 : 2;
+}
+
+class SoapyNullDevice : public SoapySDR::Device
+{
+private:
+    size_t chans;
+    std::string native;
+    size_t mtu;
+    size_t direct;
+    double rate[2];
+    double freq[2];
+    double gain[2];
+
+    // wait until another 'elems' samples are due, false if that is beyond the timeout
+    bool pace(NullStream *s, size_t elems, long timeoutUs)
+    {
+        double r = rate[s->direction];
+        if (r<=0)
+            return true;
+        long long due = s->start.tv_sec*1000000000LL + s->start.tv_nsec + (long long)((s->count+elems)*1e9/r);
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long wait = due - (now.tv_sec*1000000000LL + now.tv_nsec);
+        if (wait>timeoutUs*1000LL)
+            return false;
+        if (wait>0) {
+            struct timespec ts = { (time_t)(due/1000000000LL), (long)(due%1000000000LL) };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+        }
+        return true;
+    }
+
+    void fill(NullStream *s, void *buf, size_t chan, size_t elems)
+    {
+        uint64_t n = s->count;
+        if (s->format==SOAPY_SDR_CF32) {
+            float *p = (float *)buf;
+            for (size_t i=0; i<elems; ++i, p+=2) {
+                p[0] = (float)((n+i)&0x7fff)/32767.0f;
+                p[1] = (float)chan/32767.0f;
+            }
+        } else if (s->format==SOAPY_SDR_CS8) {
+            int8_t *p = (int8_t *)buf;
+            for (size_t i=0; i<elems; ++i, p+=2) {
+                p[0] = (int8_t)((n+i)&0x7f);
+                p[1] = (int8_t)chan;
+            }
+        } else {
+            int16_t *p = (int16_t *)buf;
+            for (size_t i=0; i<elems; ++i, p+=2) {
+                p[0] = (int16_t)((n+i)&0x7fff);
+                p[1] = (int16_t)chan;
+            }
+        }
+    }
+
+public:
+    SoapyNullDevice(const SoapySDR::Kwargs &args)
+    {
+        chans = args.count("chans") ? std::stoul(args.at("chans")) : 1;
+        native = args.count("native") ? args.at("native") : SOAPY_SDR_CS16;
+        mtu = args.count("mtu") ? std::stoul(args.at("mtu")) : 8192;
+        direct = args.count("direct") ? std::stoul(args.at("direct")) : 0;
+        if (chans<1 || mtu<1 || (native!=SOAPY_SDR_CS8 && native!=SOAPY_SDR_CS16 && native!=SOAPY_SDR_CF32))
+            throw std::runtime_error("tcpnull: invalid device arguments");
+        long openMs = args.count("open") ? std::stol(args.at("open")) : 0;
+        if (openMs>0) {
+            struct timespec ts = { openMs/1000, (openMs%1000)*1000000 };
+            nanosleep(&ts, nullptr);
+        }
+        for (int d=0; d<2; ++d) {
+            rate[d] = 1e6;
+            freq[d] = 100e6;
+            gain[d] = 0;
+        }
+    }
+
+    std::string getDriverKey(void) const { return "tcpnull"; }
+    std::string getHardwareKey(void) const { return "tcpnull"; }
+    SoapySDR::Kwargs getHardwareInfo(void) const
+    {
+        SoapySDR::Kwargs info;
+        info["chans"] = std::to_string(chans);
+        info["native"] = native;
+        info["mtu"] = std::to_string(mtu);
+        info["direct"] = std::to_string(direct);
+        return info;
+    }
+    size_t getNumChannels(const int direction) const { return chans; }
+    bool getFullDuplex(const int direction, const size_t channel) const { return true; }
+
+    // Stream API
+    std::vector<std::string> getStreamFormats(const int direction, const size_t channel) const
+    {
+        return { SOAPY_SDR_CS8, SOAPY_SDR_CS16, SOAPY_SDR_CF32 };
+    }
+    std::string getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const
+    {
+        fullScale = native==SOAPY_SDR_CF32 ? 1.0 : native==SOAPY_SDR_CS8 ? 127.0 : 32767.0;
+        return native;
+    }
+    SoapySDR::Stream *setupStream(const int direction, const std::string &format,
+        const std::vector<size_t> &channels, const SoapySDR::Kwargs &args)
+    {
+        if (format!=SOAPY_SDR_CS8 && format!=SOAPY_SDR_CS16 && format!=SOAPY_SDR_CF32)
+            throw std::runtime_error("tcpnull: unsupported format: "+format);
+        for (auto c: channels) {
+            if (c>=chans)
+                throw std::runtime_error("tcpnull: no such channel");
+        }
+        NullStream *s = new NullStream();
+        s->direction = direction;
+        s->format = format;
+        s->numChans = channels.empty() ? 1 : channels.size();
+        s->active = false;
+        s->count = 0;
+        s->next = 0;
+        if (SOAPY_SDR_RX==direction && 1==s->numChans) {
+            s->bufs.resize(direct, std::vector<uint8_t>(mtu*frameSize(format)));
+            s->held.resize(direct, false);
+        }
+        return (SoapySDR::Stream *)s;
+    }
+    void closeStream(SoapySDR::Stream *stream) { delete (NullStream *)stream; }
+    size_t getStreamMTU(SoapySDR::Stream *stream) const { return mtu; }
+    int activateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs, const size_t numElems)
+    {
+        NullStream *s = (NullStream *)stream;
+        clock_gettime(CLOCK_MONOTONIC, &s->start);
+        s->count = 0;
+        s->active = true;
+        return 0;
+    }
+    int deactivateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs)
+    {
+        ((NullStream *)stream)->active = false;
+        return 0;
+    }
+    int readStream(SoapySDR::Stream *stream, void * const *buffs, const size_t numElems,
+        int &flags, long long &timeNs, const long timeoutUs)
+    {
+        NullStream *s = (NullStream *)stream;
+        if (SOAPY_SDR_RX!=s->direction || !s->active)
+            return SOAPY_SDR_STREAM_ERROR;
+        size_t elems = numElems<mtu ? numElems : mtu;
+        if (!pace(s, elems, timeoutUs))
+            return SOAPY_SDR_TIMEOUT;
+        for (size_t c=0; c<s->numChans; ++c)
+            fill(s, buffs[c], c, elems);
+        flags = SOAPY_SDR_HAS_TIME;
+        timeNs = rate[s->direction]>0 ? (long long)(s->count*1e9/rate[s->direction]) : 0;
+        s->count += elems;
+        return (int)elems;
+    }
+    int writeStream(SoapySDR::Stream *stream, const void * const *buffs, const size_t numElems,
+        int &flags, const long long timeNs, const long timeoutUs)
+    {
+        NullStream *s = (NullStream *)stream;
+        if (SOAPY_SDR_TX!=s->direction || !s->active)
+            return SOAPY_SDR_STREAM_ERROR;
+        size_t elems = numElems<mtu ? numElems : mtu;
+        if (!pace(s, elems, timeoutUs))
+            return SOAPY_SDR_TIMEOUT;
+        s->count += elems;
+        return (int)elems;
+    }
+
+    // Direct buffer API (receive, one channel)
+    size_t getNumDirectAccessBuffers(SoapySDR::Stream *stream) { return ((NullStream *)stream)->bufs.size(); }
+    int acquireReadBuffer(SoapySDR::Stream *stream, size_t &handle, const void **buffs,
+        int &flags, long long &timeNs, const long timeoutUs)
+    {
+        NullStream *s = (NullStream *)stream;
+        if (s->bufs.empty() || !s->active)
+            return SOAPY_SDR_STREAM_ERROR;
+        // all held by the caller? nothing to hand out
+        if (s->held[s->next])
+            return SOAPY_SDR_TIMEOUT;
+        if (!pace(s, mtu, timeoutUs))
+            return SOAPY_SDR_TIMEOUT;
+        handle = s->next;
+        s->next = (s->next+1) % s->bufs.size();
+        s->held[handle] = true;
+        fill(s, s->bufs[handle].data(), 0, mtu);
+        buffs[0] = s->bufs[handle].data();
+        flags = SOAPY_SDR_HAS_TIME;
+        timeNs = rate[s->direction]>0 ? (long long)(s->count*1e9/rate[s->direction]) : 0;
+        s->count += mtu;
+        return (int)mtu;
+    }
+    void releaseReadBuffer(SoapySDR::Stream *stream, const size_t handle)
+    {
+        NullStream *s = (NullStream *)stream;
+        if (handle<s->held.size())
+            s->held[handle] = false;
+    }
+
+    // Settings, enough for RPC latency measurement
+    std::vector<std::string> listAntennas(const int direction, const size_t channel) const { return { "NULL" }; }
+    std::string getAntenna(const int direction, const size_t channel) const { return "NULL"; }
+    std::vector<std::string> listGains(const int direction, const size_t channel) const { return { "NULL" }; }
+    void setGain(const int direction, const size_t channel, const double value) { gain[direction&1] = value; }
+    double getGain(const int direction, const size_t channel) const { return gain[direction&1]; }
+    SoapySDR::Range getGainRange(const int direction, const size_t channel) const { return SoapySDR::Range(0, 60, 1); }
+    void setFrequency(const int direction, const size_t channel, const double frequency, const SoapySDR::Kwargs &args)
+    {
+        freq[direction&1] = frequency;
+    }
+    double getFrequency(const int direction, const size_t channel) const { return freq[direction&1]; }
+    SoapySDR::RangeList getFrequencyRange(const int direction, const size_t channel) const
+    {
+        return { SoapySDR::Range(0, 10e9) };
+    }
+    void setSampleRate(const int direction, const size_t channel, const double r) { rate[direction&1] = r; }
+    double getSampleRate(const int direction, const size_t channel) const { return rate[direction&1]; }
+    SoapySDR::RangeList getSampleRateRange(const int direction, const size_t channel) const
+    {
+        // zero: unpaced
+        return { SoapySDR::Range(0, 1e9) };
+    }
+};
+
+static SoapySDR::KwargsList findNullDevice(const SoapySDR::Kwargs &args)
+{
+    // never volunteered in a general enumeration
+    SoapySDR::KwargsList results;
+    if (args.count("driver") && args.at("driver")=="tcpnull") {
+        SoapySDR::Kwargs info = args;
+        info["label"] = "TCP remote null device";
+        results.push_back(info);
+    }
+    return results;
+}
+
+static SoapySDR::Device *makeNullDevice(const SoapySDR::Kwargs &args)
+{
+    SoapySDR_log(SOAPY_SDR_INFO, "makeNullDevice");
+    return new SoapyNullDevice(args);
+}
+
+static SoapySDR::Registry registerNullDevice("tcpnull", &findNullDevice, &makeNullDevice, SOAPY_SDR_ABI_VERSION);
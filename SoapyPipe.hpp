@@ -0,0 +1,294 @@
+// SoapyPipe.hpp - lock-free inter-thread byte pipe
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapyPipe_hpp
+#define SoapyPipe_hpp
+
+// Single producer, single consumer ring buffer used to pass sample data
+// between pump threads. Design notes:
+// - ring size is a power of two, in/out are free running byte counters
+//   (unsigned wrap is fine), masked to find the buffer offset.
+// - producer owns 'in', consumer owns 'out', each published with release
+//   and observed with acquire, so no locks are needed to move data.
+// - data is moved with at most two memcpy()s (before & after the wrap).
+// - a blocked side parks on a futex, and is only woken if it has marked
+//   itself idle, so the fast path is free of syscalls.
+// - closing stops the producer at once, the consumer still has what was
+//   written before (the end of a burst), and sees closed once it is empty.
+//   Pumps are stopped outright by their own flag (ConnectionInfo::pid).
+// - non-blocking writes that cannot fit are dropped & counted in overruns,
+//   the high water mark records the worst fill level seen by the producer.
+// - the consumer may also peek at, or skip, the oldest data (eg: to drop stale
+//   items when latency matters more than completeness).
+// - a pipe may also live in memory shared with another process (see SoapyShm.hpp),
+//   its futexes are then process shared, and 'buf' is the producer's own mapping.
+
+#include <atomic>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+struct pipebuf_t {
+    uint8_t *buf;
+    size_t len, mask;
+    // producer side
+    alignas(64) std::atomic<size_t> in;
+    std::atomic<size_t> hiwater;
+    std::atomic<unsigned long> overruns;
+    // consumer side
+    alignas(64) std::atomic<size_t> out;
+    // wakeup words: sequence counters for futex, idle flags for each side
+    alignas(64) std::atomic<int> wrseq, rdseq;
+    std::atomic<int> rdidle, wridle;
+    std::atomic<bool> closed;
+    // wakeups cross processes (pipe in shared memory)
+    bool shared;
+};
+
+static inline void pipepark(std::atomic<int> *seq, int val, bool shared = false, long waitNs = 100000000) {
+#ifdef __linux__
+    // bounded wait, in case a wakeup races with closing
+    struct timespec ts = { waitNs/1000000000, waitNs%1000000000 };
+    syscall(SYS_futex, (int *)seq, shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, val, &ts, nullptr, 0);
+#else
+    struct timespec ts = { 0, waitNs<1000000 ? waitNs : 1000000 };
+    nanosleep(&ts, nullptr);
+#endif
+}
+
+static inline void pipewake(std::atomic<int> *seq, std::atomic<int> *idle, bool shared = false) {
+    // pairs with the fence in the waiting side, one of us will see the other
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle->load(std::memory_order_relaxed)) {
+        seq->fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+        syscall(SYS_futex, (int *)seq, shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#endif
+    }
+}
+
+// power of two ring size for at least 'size' bytes
+static inline size_t pipesize(size_t size) {
+    size_t len = 1;
+    while (len < size)
+        len <<= 1;
+    return len;
+}
+
+// set up an empty pipe over buf (len a power of two)
+static inline void pipeinit(pipebuf_t *pipe, uint8_t *buf, size_t len, bool shared) {
+    pipe->buf = buf;
+    pipe->len = len;
+    pipe->mask = len-1;
+    pipe->in = 0;
+    pipe->out = 0;
+    pipe->hiwater = 0;
+    pipe->overruns = 0;
+    pipe->wrseq = 0;
+    pipe->rdseq = 0;
+    pipe->rdidle = 0;
+    pipe->wridle = 0;
+    pipe->closed = false;
+    pipe->shared = shared;
+}
+
+static inline pipebuf_t *newpipe(size_t size) {
+    size_t len = pipesize(size);
+    // (plain new need not honour the cache line alignment before C++17)
+    void *mem = nullptr;
+    if (posix_memalign(&mem, alignof(pipebuf_t), sizeof(pipebuf_t)))
+        return nullptr;
+    uint8_t *buf = (uint8_t *)malloc(len);
+    if (!buf) {
+        free(mem);
+        return nullptr;
+    }
+    pipebuf_t *pipe = new (mem) pipebuf_t;
+    pipeinit(pipe, buf, len, false);
+    return pipe;
+}
+
+static inline void freepipe(pipebuf_t *pipe) {
+    if (!pipe)
+        return;
+    free(pipe->buf);
+    pipe->~pipebuf_t();
+    free(pipe);
+}
+
+// mark pipe as closed, waking any blocked reader or writer
+static inline void pipeclose(pipebuf_t *pipe) {
+    pipe->closed.store(true, std::memory_order_release);
+    pipe->rdidle = 1;
+    pipe->wridle = 1;
+    pipewake(&pipe->wrseq, &pipe->rdidle, pipe->shared);
+    pipewake(&pipe->rdseq, &pipe->wridle, pipe->shared);
+}
+
+// current fill level in bytes (approximate if called from a third thread)
+static inline size_t pipeused(pipebuf_t *pipe) {
+    return pipe->in.load(std::memory_order_acquire) - pipe->out.load(std::memory_order_acquire);
+}
+
+// blocking/failing write of whole items, returns number of items written
+// or -1 if there is not room for a single item (non-blocking) or closed.
+static inline int pipewrite(const void *src, int sz, int num, pipebuf_t *pipe, bool block = true) {
+    // args check
+    if (!src || sz<=0 || num<=0 || !pipe)
+        return -1;
+    size_t in = pipe->in.load(std::memory_order_relaxed);
+    size_t av;
+    // wait for space..
+    while (true) {
+        if (pipe->closed.load(std::memory_order_acquire))
+            return -1;
+        av = pipe->len - (in - pipe->out.load(std::memory_order_acquire));
+        if (av>=(size_t)sz)
+            break;
+        if (!block) {
+            pipe->overruns.fetch_add(1, std::memory_order_relaxed);
+            return -1;
+        }
+        int seq = pipe->rdseq.load(std::memory_order_acquire);
+        pipe->wridle.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        av = pipe->len - (in - pipe->out.load(std::memory_order_relaxed));
+        if (av<(size_t)sz && !pipe->closed.load(std::memory_order_relaxed))
+            pipepark(&pipe->rdseq, seq, pipe->shared);
+        pipe->wridle.store(0, std::memory_order_relaxed);
+    }
+    // calculate how many items of sz will fit (up to num)
+    size_t ft = av/sz;
+    if (ft>(size_t)num) {
+        ft = num;
+    } else if (ft<(size_t)num && !block) {
+        // partial write, the remainder is lost to the caller (blocking callers retry)
+        pipe->overruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    // move those bytes, in up to two spans!
+    size_t by = ft*sz;
+    size_t off = in & pipe->mask;
+    size_t n1 = pipe->len - off;
+    if (n1>by) n1 = by;
+    memcpy(pipe->buf+off, src, n1);
+    if (by>n1)
+        memcpy(pipe->buf, (const uint8_t *)src+n1, by-n1);
+    pipe->in.store(in+by, std::memory_order_release);
+    // record the high water mark
+    size_t us = pipe->len - av + by;
+    if (us>pipe->hiwater.load(std::memory_order_relaxed))
+        pipe->hiwater.store(us, std::memory_order_relaxed);
+    // signal a write has occurred (if anyone cares)
+    pipewake(&pipe->wrseq, &pipe->rdidle, pipe->shared);
+    return (int)ft;
+}
+
+// (consumer) wait for at least sz bytes, returns the number available,
+// or zero when non-blocking and short, or the pipe has been closed (and
+// what was written before that has been read).
+static inline size_t pipeavail(pipebuf_t *pipe, size_t sz, bool block = true) {
+    size_t out = pipe->out.load(std::memory_order_relaxed);
+    size_t us;
+    while (true) {
+        // (closed first: everything written before closing is then in view)
+        bool closed = pipe->closed.load(std::memory_order_acquire);
+        us = pipe->in.load(std::memory_order_acquire) - out;
+        if (us>=sz)
+            return us;
+        if (closed || !block)
+            return 0;
+        int seq = pipe->wrseq.load(std::memory_order_acquire);
+        pipe->rdidle.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        us = pipe->in.load(std::memory_order_relaxed) - out;
+        if (us<sz && !pipe->closed.load(std::memory_order_relaxed))
+            pipepark(&pipe->wrseq, seq, pipe->shared);
+        pipe->rdidle.store(0, std::memory_order_relaxed);
+    }
+}
+
+// (consumer) as pipeavail, waiting no more than timeoutUs: returns the number available,
+// fewer than sz on timeout, or once the pipe has been closed (and holds less).
+static inline size_t pipewait(pipebuf_t *pipe, size_t sz, long timeoutUs) {
+    size_t out = pipe->out.load(std::memory_order_relaxed);
+    struct timespec t0, now;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (true) {
+        bool closed = pipe->closed.load(std::memory_order_acquire);
+        size_t us = pipe->in.load(std::memory_order_acquire) - out;
+        if (us>=sz || closed)
+            return us;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long left = timeoutUs - ((now.tv_sec-t0.tv_sec)*1000000L + (now.tv_nsec-t0.tv_nsec)/1000);
+        if (left<=0)
+            return us;
+        int seq = pipe->wrseq.load(std::memory_order_acquire);
+        pipe->rdidle.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        us = pipe->in.load(std::memory_order_relaxed) - out;
+        if (us<sz && !pipe->closed.load(std::memory_order_relaxed))
+            pipepark(&pipe->wrseq, seq, pipe->shared, left<100000 ? left*1000 : 100000000);
+        pipe->rdidle.store(0, std::memory_order_relaxed);
+    }
+}
+
+// (consumer) copy the oldest len bytes without removing them, false if not there
+static inline bool pipepeek(void *dst, size_t len, pipebuf_t *pipe) {
+    size_t out = pipe->out.load(std::memory_order_relaxed);
+    if (pipe->in.load(std::memory_order_acquire) - out < len)
+        return false;
+    size_t off = out & pipe->mask;
+    size_t n1 = pipe->len - off;
+    if (n1>len) n1 = len;
+    memcpy(dst, pipe->buf+off, n1);
+    if (len>n1)
+        memcpy((uint8_t *)dst+n1, pipe->buf, len-n1);
+    return true;
+}
+
+// (consumer) discard the oldest len bytes (no more than are there)
+static inline void pipeskip(pipebuf_t *pipe, size_t len) {
+    size_t out = pipe->out.load(std::memory_order_relaxed);
+    size_t us = pipe->in.load(std::memory_order_acquire) - out;
+    if (len>us) len = us;
+    pipe->out.store(out+len, std::memory_order_release);
+    pipewake(&pipe->rdseq, &pipe->wridle, pipe->shared);
+}
+
+// blocking/failing read of whole items, returns number of items read,
+// or zero when non-blocking and empty, or the pipe has been closed and drained.
+static inline int piperead(void *dst, int sz, int num, pipebuf_t *pipe, bool block = true) {
+    // args check
+    if (!dst || sz<=0 || num<=0 || !pipe)
+        return -1;
+    size_t out = pipe->out.load(std::memory_order_relaxed);
+    // wait for data..
+    size_t us = pipeavail(pipe, sz, block);
+    if (us<(size_t)sz)
+        return 0;
+    // calculate how many items of sz are in the pipe (up to num)
+    size_t nm = us/sz;
+    if (nm>(size_t)num) nm = num;
+    // move those bytes, in up to two spans!
+    size_t by = nm*sz;
+    size_t off = out & pipe->mask;
+    size_t n1 = pipe->len - off;
+    if (n1>by) n1 = by;
+    memcpy(dst, pipe->buf+off, n1);
+    if (by>n1)
+        memcpy((uint8_t *)dst+n1, pipe->buf, by-n1);
+    pipe->out.store(out+by, std::memory_order_release);
+    // signal that a read has occurred (if anyone cares)
+    pipewake(&pipe->rdseq, &pipe->wridle, pipe->shared);
+    return (int)nm;
+}
+
+#endif
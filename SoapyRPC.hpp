@@ -7,15 +7,26 @@
 
 // This RPC implementation uses text I/O over TCP
 // in the tradition of many 'simple xxx' internet
-// protocols.
+// protocols. Optionally (negotiated after load) it
+// switches to a binary length-prefixed framing for
+// lower overhead.
 
 #include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <cmath>
 #include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <SoapySDR/Types.hpp>
 #include <SoapySDR/Logger.hpp>
 
 // map of format names to frame sizes
 const std::map<std::string, size_t> g_frameSizes = {
-    { "CS8", 2 }, { "CS16", 4 }, { "CF32", 8 },
+    { "CS8", 2 }, { "CS12", 3 }, { "CS16", 4 }, { "CF32", 8 },
 };
 
 // RPC separator
@@ -29,6 +40,11 @@ enum
     TCPREMOTE_LOG_STREAM,
     TCPREMOTE_DATA_SEND,
     TCPREMOTE_DATA_RECV,
+    // ..and coming back to a resumable session, see TCPREMOTE_OPEN_SESSION
+    TCPREMOTE_RPC_RESUME,
+    TCPREMOTE_DATA_RESUME,
+    // ..or just asking what devices the server has (one shot, see findTCPRemote)
+    TCPREMOTE_ENUMERATE,
     // identification API
     TCPREMOTE_GET_HARDWARE_KEY = 10,
     TCPREMOTE_GET_HARDWARE_INFO,
@@ -148,19 +164,114 @@ enum
     TCPREMOTE_LIST_UARTS,
     TCPREMOTE_WRITE_UART,
     TCPREMOTE_READ_UART,
+    // batch API (tcpremote extension) - several settings in one call
+    TCPREMOTE_SET_BATCH,
+    // describe API (tcpremote extension) - all the constant metadata in one call
+    TCPREMOTE_DESCRIBE,
+    // stats API (tcpremote extension) - data stream counters as name=value pairs
+    TCPREMOTE_GET_STREAM_STATS,
+    // session API (tcpremote extension) - hold the connection & streams when it is lost
+    TCPREMOTE_OPEN_SESSION,
     // internal special - dropping connection
-    TCPREMOTE_DROP_RPC = 1000
+    TCPREMOTE_DROP_RPC = 1000,
+    // internal special - switch connection to binary framing, replies 1 if accepted
+    TCPREMOTE_RPC_BINARY,
+    // internal special - binary frame header code for replies
+    TCPREMOTE_RPC_REPLY
 };
 
+// Binary framing:
+// - frame header: uint32 payload length, int32 call code (or TCPREMOTE_RPC_REPLY)
+// - payload: packed little-endian fields, in the same order as the text protocol,
+//   integers as int32, doubles as IEEE754 64bit, strings as uint32 length + bytes,
+//   Kwargs as uint32 count + name/value string pairs, string vectors as uint32 count + strings
+// - a call frame is started by writeCall(), a reply frame by the first write after reading,
+//   frames are flushed to the socket by flush(), or before waiting on a read (not in no-wait
+//   mode, where nothing waits, the caller flushes once it has taken all it can).
+const size_t TCPREMOTE_RPC_HDR = 8;
+// the most we take from the peer in one frame, string or text line (bytes) and one list
+// (items), anything bigger is an error rather than an allocation
+const size_t TCPREMOTE_RPC_MAX_SIZE = 4*1024*1024;
+const size_t TCPREMOTE_RPC_MAX_COUNT = 64*1024;
+
+// Framed data mode (tcpremote:framed=1 stream arg when receiving, always when transmitting
+// with binary RPC): each block of sample frames on the data connection is preceded by a
+// fixed size header, packed little-endian: uint32 frames following, int32 flags, int64
+// timeNs, uint64 count.
+// - flags are the driver readStream flags, plus TCPREMOTE_FLAG_OVERFLOW if data was
+//   lost (by the driver, or the server) before this block.
+// - count is the running total of frames read from the driver at the first frame,
+//   so the frames lost are the difference from the expected value.
+// - transmitting, a block is one writeStream call: flags & timeNs are its own (count is
+//   zero), and the server sends the device's stream events (readStreamStatus) back as
+//   headers with no frames: the channel mask in place of frames, the status code as count.
+const size_t TCPREMOTE_DATA_HDR = 24;
+const int TCPREMOTE_FLAG_OVERFLOW = (1<<30);
+
+struct SoapyRPCDataHeader
+{
+    uint32_t elems;
+    int32_t flags;
+    int64_t timeNs;
+    uint64_t count;
+};
+
+static inline void putDataHeader(uint8_t *p, const SoapyRPCDataHeader &hdr) {
+    uint64_t f[4] = { hdr.elems, (uint32_t)hdr.flags, (uint64_t)hdr.timeNs, hdr.count };
+    const int w[4] = { 4, 4, 8, 8 };
+    for (int i=0; i<4; ++i)
+        for (int b=0; b<w[i]; ++b)
+            *p++ = (uint8_t)(f[i]>>(b*8));
+}
+
+static inline void getDataHeader(const uint8_t *p, SoapyRPCDataHeader &hdr) {
+    uint64_t f[4] = { 0, 0, 0, 0 };
+    const int w[4] = { 4, 4, 8, 8 };
+    for (int i=0; i<4; ++i)
+        for (int b=0; b<w[i]; ++b)
+            f[i] |= (uint64_t)(*p++)<<(b*8);
+    hdr.elems = (uint32_t)f[0];
+    hdr.flags = (int32_t)(uint32_t)f[1];
+    hdr.timeNs = (int64_t)f[2];
+    hdr.count = f[3];
+}
+
+// One setting within a TCPREMOTE_SET_BATCH call, 'call' is the equivalent
+// single RPC code, which also determines the fields sent (in the same order
+// as that RPC): direction, channel, [name], [value], [args]
+struct SoapyRPCSetting
+{
+    int call;
+    int direction;
+    size_t channel;
+    std::string name;
+    double value;
+    SoapySDR::Kwargs args;
+};
+
+// Thrown by a SoapyRPC in no-wait mode when a read needs input that has
+// not arrived yet. Deliberately not a std::exception.
+struct SoapyRPCIncomplete {};
+
 // Design notes:
 // - holds error state, to ensure no further I/O is attempted once errored,
 //   this allows strerror()/perror() to work despite subsequent rpc methods
 //   and allows error to be detected at the end of a series of rpc methods.
+// - binary mode builds frames in memory and writes them with one syscall.
+// - input is buffered here (not stdio), so we can tell when complete requests
+//   are waiting (see pending()), and lines are not length limited.
+// - optionally pipelined: setter status replies are not waited for, but
+//   collected (and any errors logged) before the next value is read.
+// - optionally no-wait (event driven servers): input is only taken from the
+//   socket by absorb(), a read that runs out of buffered input throws
+//   SoapyRPCIncomplete, the caller rewinds to a mark() and tries again later.
+// - optionally resumable (binary only): after a failure the next writeCall()
+//   asks onFail to reconnect, which carries on over a new socket (resume()).
 class SoapyRPC
 {
 public:
     SoapyRPC(int socket) {
-        hasError = false;
+        init();
         handle = fdopen(socket, "r+");
         if (handle) {
             setlinebuf(handle);
@@ -171,19 +282,166 @@ public:
         }
     }
     SoapyRPC(FILE *fp) {
-        hasError = false;
+        init();
         handle = fp;
         setlinebuf(handle);
         SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyRPC::<cons>(%p=>%d)", fp, fileno(fp));
     }
     ~SoapyRPC() {
         SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyRPC::<dest>(%d)", handle? fileno(handle): -1);
+        flush();
         if (handle)
             fclose(handle);
     }
+    // switch to binary framing (after successful negotiation)
+    void setBinary() {
+        SoapySDR_log(SOAPY_SDR_DEBUG, "SoapyRPC: binary framing enabled");
+        binary = true;
+    }
+    bool isBinary() const { return binary; }
+    bool isError() const { return hasError; }
+    int socket() const { return handle ? fileno(handle) : -1; }
+    // called by writeCall() once errored, true if it has resumed the connection
+    std::function<bool()> onFail;
+    // carry on over a new connection (binary framing only): 'sock' takes the place of ours
+    // (same descriptor), anything buffered either way is dropped
+    bool resume(int sock) {
+        if (!handle || !binary || dup2(sock, fileno(handle))<0)
+            return false;
+        close(sock);
+        clearerr(handle);
+        hasError = false;
+        deferred = 0;
+        rbuf.clear();
+        rpos = 0;
+        obuf.clear();
+        ibuf.clear();
+        ipos = 0;
+        frame = std::string::npos;
+        return true;
+    }
+    // enable/disable pipelined status replies
+    void setPipelined(bool p) {
+        if (!p)
+            drain();
+        pipelined = p;
+    }
+    // enable/disable no-wait input (see absorb(), mark(), rewind())
+    void setNoWait(bool nw) { nowait = nw; }
+    // take all available input from the socket without blocking,
+    // returns false on EOF/error (input already buffered remains readable)
+    bool absorb() {
+        if (hasError || !handle) return false;
+        if (rpos>0) {
+            rbuf.erase(0, rpos);
+            rpos = 0;
+        }
+        char tmp[BUFSIZ];
+        while (true) {
+            ssize_t n = ::recv(fileno(handle), tmp, sizeof(tmp), MSG_DONTWAIT);
+            if (n>0) {
+                rbuf.append(tmp, n);
+                continue;
+            }
+            if (n<0 && EINTR==errno)
+                continue;
+            if (n<0 && (EAGAIN==errno || EWOULDBLOCK==errno))
+                return true;
+            SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyRPC::absorb: %s", n<0? strerror(errno): "EOF");
+            return false;
+        }
+    }
+    // input position to rewind() to if a request turns out to be incomplete
+    size_t mark() const { return rpos; }
+    void rewind(size_t m) {
+        rpos = m;
+        ipos = ibuf.size();
+    }
+    // true if a complete line (text) or frame (binary) is already buffered
+    bool pending() const {
+        if (hasError) return false;
+        if (!binary)
+            return memchr(rbuf.data()+rpos, '\n', rbuf.size()-rpos)!=nullptr;
+        if (rbuf.size()-rpos<TCPREMOTE_RPC_HDR)
+            return false;
+        return rbuf.size()-rpos >= TCPREMOTE_RPC_HDR+getLE(rbuf.data()+rpos);
+    }
+    // wait for a setter's completion status, or if pipelining, send it on
+    // its way and collect the status later.
+    int readStatus() {
+        if (hasError) return -1;
+        if (!pipelined)
+            return readInteger();
+        ++deferred;
+        return flush()<0? -1: 0;
+    }
+    // begin a new call
+    int writeCall(const int call) {
+        if (hasError && !(onFail && onFail())) return -1;
+        if (!binary) {
+            int r = writeString(TCPREMOTE_RPC_SEP);
+            if (r<0)
+                return r;
+            return writeInteger(call);
+        }
+        // any unread reply is stale now
+        ipos = ibuf.size();
+        endFrame();
+        beginFrame(call);
+        return TCPREMOTE_RPC_HDR;
+    }
+    // read the next call, returns call code or -1 on error/EOF
+    int readCall() {
+        if (hasError) return -1;
+        if (!binary) {
+            if (readString() != TCPREMOTE_RPC_SEP) {
+                if (!hasError)
+                    SoapySDR_log(SOAPY_SDR_ERROR,"SoapyRPC::readCall, missing separator (out of sync?)");
+                return -1;
+            }
+            return readInteger();
+        }
+        if (ipos<ibuf.size())
+            SoapySDR_logf(SOAPY_SDR_WARNING, "SoapyRPC::readCall, discarding %zu unread bytes", ibuf.size()-ipos);
+        return readFrame();
+    }
+    // push any pending output to the socket
+    int flush() {
+        if (!binary || hasError || !handle) return 0;
+        endFrame();
+        if (obuf.empty()) return 0;
+        size_t off = 0;
+        while (off<obuf.size()) {
+            // (no SIGPIPE on sockets, a lost connection is an error here, and perhaps resumed)
+            ssize_t n = ::send(fileno(handle), obuf.data()+off, obuf.size()-off, MSG_NOSIGNAL);
+            if (n<0 && ENOTSOCK==errno)
+                n = ::write(fileno(handle), obuf.data()+off, obuf.size()-off);
+            if (n<0) {
+                if (EINTR==errno)
+                    continue;
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::flush: %s", strerror(errno));
+                hasError = true;
+                // resumable? the server has not had it, so all of it again over the new connection
+                std::string unsent = obuf;
+                if (onFail && onFail()) {
+                    obuf = unsent;
+                    off = 0;
+                    continue;
+                }
+                return -1;
+            }
+            off += n;
+        }
+        obuf.clear();
+        return (int)off;
+    }
     int writeInteger(const int i) {
         if (hasError) return -1;
         SoapySDR_logf(SOAPY_SDR_TRACE, "Wi %d", i);
+        if (binary) {
+            putU32((uint32_t)i);
+            return 4;
+        }
         int r = fprintf(handle, "%d\n", i);
         if (r<0) {
             SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::writeInteger: %s", strerror(errno));
@@ -194,6 +452,13 @@ public:
     int writeDouble(const double d) {
         if (hasError) return -1;
         SoapySDR_logf(SOAPY_SDR_TRACE, "Wd %f", d);
+        if (binary) {
+            uint64_t u;
+            memcpy(&u, &d, sizeof(u));
+            putU32((uint32_t)u);
+            putU32((uint32_t)(u>>32));
+            return 8;
+        }
         int r = fprintf(handle, "%f\n", d);
         if (r<0) {
             SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::writeDouble %s", strerror(errno));
@@ -204,6 +469,11 @@ public:
     int writeString(const std::string s) {
         if (hasError) return -1;
         SoapySDR_logf(SOAPY_SDR_TRACE, "Ws %s", s.c_str());
+        if (binary) {
+            putU32((uint32_t)s.length());
+            obuf += s;
+            return 4+s.length();
+        }
         int r = fprintf(handle, "%s\n", s.c_str());
         if (r<0) {
             SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::writeString: %s", strerror(errno));
@@ -214,6 +484,15 @@ public:
     int writeKwargs(const SoapySDR::Kwargs &args) {
         if (hasError) return -1;
         int n = 0, r;
+        if (binary) {
+            putU32((uint32_t)args.size());
+            n += 4;
+            for (auto it=args.begin(); it!=args.end(); ++it) {
+                n += writeString(it->first);
+                n += writeString(it->second);
+            }
+            return n;
+        }
         for (auto it=args.begin(); it!=args.end(); ++it) {
             std::string nv;
             nv += it->first;
@@ -233,6 +512,13 @@ public:
     int writeStrVector(const std::vector<std::string> &vec) {
         if (hasError) return -1;
         int n = 0, r;
+        if (binary) {
+            putU32((uint32_t)vec.size());
+            n += 4;
+            for (auto &it: vec)
+                n += writeString(it);
+            return n;
+        }
         for (auto it: vec) {
             r = writeString(it);
             if (r<0)
@@ -247,7 +533,15 @@ public:
     }
     int readInteger() {
         if (hasError) return -1;
+        drain();
         int rv=-1;
+        if (binary) {
+            uint32_t u;
+            if (getU32(u))
+                rv = (int)u;
+            SoapySDR_logf(SOAPY_SDR_TRACE, "Ri %d", rv);
+            return rv;
+        }
         std::string s = readString();
         if (s.length()>0)
             sscanf(s.c_str(), "%d", &rv);
@@ -257,7 +551,17 @@ public:
     }
     double readDouble() {
         if (hasError) return -1;
+        drain();
         double rv=NAN;
+        if (binary) {
+            uint32_t lo, hi;
+            if (getU32(lo) && getU32(hi)) {
+                uint64_t u = ((uint64_t)hi<<32) | lo;
+                memcpy(&rv, &u, sizeof(rv));
+            }
+            SoapySDR_logf(SOAPY_SDR_TRACE, "Rd %f", rv);
+            return rv;
+        }
         std::string s = readString();
         if (s.length()>0)
             sscanf(s.c_str(), "%lf", &rv);
@@ -266,15 +570,17 @@ public:
         return rv;
     }
     std::string readString() {
-        char line[256];
         std::string rv;
         if (hasError) return rv;
-        if (fgets(line, sizeof(line), handle)) {
-            line[strlen(line)-1] = 0;
-            rv = line;
+        drain();
+        if (binary) {
+            uint32_t len;
+            if (getU32(len) && !tooBig(len, TCPREMOTE_RPC_MAX_SIZE, "string") && need(len)) {
+                rv = ibuf.substr(ipos, len);
+                ipos += len;
+            }
         } else {
-            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::readString: %s", strerror(errno));
-            hasError = true;
+            readLine(rv);
         }
         SoapySDR_logf(SOAPY_SDR_TRACE, "R '%s'", rv.c_str());
         return rv;
@@ -282,6 +588,17 @@ public:
     SoapySDR::Kwargs readKwargs() {
         SoapySDR::Kwargs args;
         if (hasError) return args;
+        drain();
+        if (binary) {
+            uint32_t cnt = 0;
+            if (getU32(cnt) && tooBig(cnt, TCPREMOTE_RPC_MAX_COUNT, "kwargs"))
+                return args;
+            while (cnt-- > 0 && !hasError) {
+                std::string n = readString();
+                args[n] = readString();
+            }
+            return args;
+        }
         while (true) {
             std::string nv = readString();
             if (nv.length()<2)      // '=' or empty is a terminator
@@ -298,6 +615,15 @@ public:
     std::vector<std::string> readStrVector() {
         std::vector<std::string> list;
         if (hasError) return list;
+        drain();
+        if (binary) {
+            uint32_t cnt = 0;
+            if (getU32(cnt) && tooBig(cnt, TCPREMOTE_RPC_MAX_COUNT, "list"))
+                return list;
+            while (cnt-- > 0 && !hasError)
+                list.push_back(readString());
+            return list;
+        }
         while (true) {
             // blank/error indicates end of list
             std::string str = readString();
@@ -311,6 +637,162 @@ public:
 private:
     FILE *handle;
     bool hasError;
+    bool binary;
+    bool pipelined;
+    // number of status replies not yet read (pipelined mode)
+    int deferred;
+    // raw socket input buffer
+    std::string rbuf;
+    size_t rpos;
+    // binary mode output (whole frames) & input (current frame payload)
+    std::string obuf;
+    std::string ibuf;
+    size_t ipos;
+    // offset of open frame header in obuf, or npos
+    size_t frame;
+    bool nowait;
+
+    void init() {
+        hasError = false;
+        binary = false;
+        pipelined = false;
+        nowait = false;
+        deferred = 0;
+        rpos = 0;
+        ipos = 0;
+        frame = std::string::npos;
+    }
+    // collect outstanding status replies from pipelined calls
+    void drain() {
+        int n = deferred;
+        deferred = 0;
+        while (n-- > 0 && !hasError) {
+            int r = readInteger();
+            if (r!=0)
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC: pipelined call failed: %d", r);
+        }
+    }
+    // read more from the socket into rbuf, false on EOF/error
+    bool fill() {
+        // not allowed to wait? the caller will come back when there is more
+        if (nowait)
+            throw SoapyRPCIncomplete();
+        // discard consumed input first
+        if (rpos>0) {
+            rbuf.erase(0, rpos);
+            rpos = 0;
+        }
+        char tmp[BUFSIZ];
+        ssize_t n;
+        do {
+            n = ::read(fileno(handle), tmp, sizeof(tmp));
+        } while (n<0 && EINTR==errno);
+        if (n<=0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::read: %s", n<0? strerror(errno): "EOF");
+            hasError = true;
+            return false;
+        }
+        rbuf.append(tmp, n);
+        return true;
+    }
+    // read exactly n bytes of raw input
+    bool readBytes(char *dst, size_t n) {
+        while (rbuf.size()-rpos<n) {
+            if (!fill())
+                return false;
+        }
+        memcpy(dst, rbuf.data()+rpos, n);
+        rpos += n;
+        return true;
+    }
+    // read a text line (without newline)
+    bool readLine(std::string &line) {
+        while (true) {
+            size_t nl = rbuf.find('\n', rpos);
+            if (nl!=std::string::npos) {
+                line = rbuf.substr(rpos, nl-rpos);
+                rpos = nl+1;
+                return true;
+            }
+            if (tooBig(rbuf.size()-rpos, TCPREMOTE_RPC_MAX_SIZE, "line") || !fill())
+                return false;
+        }
+    }
+
+    void putU32(uint32_t v) {
+        // replies open a frame implicitly
+        if (std::string::npos==frame)
+            beginFrame(TCPREMOTE_RPC_REPLY);
+        char b[4] = { (char)v, (char)(v>>8), (char)(v>>16), (char)(v>>24) };
+        obuf.append(b, 4);
+    }
+    static uint32_t getLE(const char *p) {
+        const uint8_t *u = (const uint8_t *)p;
+        return (uint32_t)u[0] | ((uint32_t)u[1]<<8) | ((uint32_t)u[2]<<16) | ((uint32_t)u[3]<<24);
+    }
+    void beginFrame(int call) {
+        frame = obuf.size();
+        obuf.append(TCPREMOTE_RPC_HDR, 0);
+        uint32_t c = (uint32_t)call;
+        for (int i=0; i<4; ++i)
+            obuf[frame+4+i] = (char)(c>>(8*i));
+    }
+    void endFrame() {
+        if (std::string::npos==frame)
+            return;
+        uint32_t len = obuf.size()-frame-TCPREMOTE_RPC_HDR;
+        for (int i=0; i<4; ++i)
+            obuf[frame+i] = (char)(len>>(8*i));
+        frame = std::string::npos;
+    }
+    // read a whole frame into ibuf, returns the frame code
+    int readFrame() {
+        // we are about to wait, so send anything pending (not allowed to wait? the caller
+        // sends it, with the replies to whatever else is pipelined behind, see fill)
+        if (!nowait && flush()<0)
+            return -1;
+        char hdr[TCPREMOTE_RPC_HDR];
+        if (!readBytes(hdr, sizeof(hdr)))
+            return -1;
+        uint32_t len = getLE(hdr);
+        int code = (int)getLE(hdr+4);
+        if (tooBig(len, TCPREMOTE_RPC_MAX_SIZE, "frame"))
+            return -1;
+        ibuf.resize(len);
+        ipos = 0;
+        if (len>0 && !readBytes(&ibuf[0], len))
+            return -1;
+        SoapySDR_logf(SOAPY_SDR_TRACE, "RF %d (%u)", code, len);
+        return code;
+    }
+    // ensure n bytes are available in the current frame (fetching the next reply if exhausted)
+    bool need(size_t n) {
+        if (ipos>=ibuf.size() && n>0) {
+            if (readFrame()<0)
+                return false;
+        }
+        if (ipos+n>ibuf.size()) {
+            SoapySDR_log(SOAPY_SDR_ERROR, "SoapyRPC: read past end of frame (out of sync?)");
+            hasError = true;
+            return false;
+        }
+        return true;
+    }
+    // a size from the peer over the limit? that's an error (bad, or hostile, peer)
+    bool tooBig(size_t n, size_t max, const char *what) {
+        if (n<=max)
+            return false;
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC: %s too big: %zu (out of sync?)", what, n);
+        hasError = true;
+        return true;
+    }
+    bool getU32(uint32_t &v) {
+        if (!need(4))
+            return false;
+        v = getLE(ibuf.data()+ipos);
+        ipos += 4;
+        return true;
+    }
 };
 
 #endif
@@ -0,0 +1,303 @@
+//  SoapyReplayDevice.cpp
+//  Copyright (c) 2021 Phil Ashby
+//  SPDX-License-Identifier: BSL-1.0
+
+// Replay device built into the server: a recording (see SoapySigMF.hpp) from the
+// server's recordings directory (-r <dir>) played back as a receiver, so downstream
+// DSP can be run (and benchmarked) on the same data again and again.
+// Only made when asked for by name: tcpremote:driver=tcpreplay, device args (/ separated):
+//  name=<recording> - as recorded (tcpremote:record=<name>), rotated files in turn
+//  loop=1           - start again at the end (default: end of burst, then timeouts)
+//  mtu=<elems>      - samples per read (default 8192)
+// The sample rate and frequency start as recorded, setSampleRate changes the pace
+// (zero: as fast as possible), times count from the start of the recording at the
+// recorded rate. Files are memory mapped and read in order, converted to any of
+// CS8, CS16 or CF32, all channels (as recorded) in each stream.
+
+#include "SoapySigMF.hpp"
+#include "SoapyConvert.hpp"
+#include <SoapySDR/Device.hpp>
+#include <SoapySDR/Registry.hpp>
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Logger.h>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct ReplayFile
+{
+    const uint8_t *data;
+    size_t len;
+};
+
+struct ReplayStream
+{
+    convert_t cnv;
+    bool active;
+    bool ended;
+    // where we are (file & byte offset), pacing: start of run & samples since then
+    size_t file;
+    size_t pos;
+    struct timespec start;
+    uint64_t count;
+    // samples from the start of the recording, for timestamps
+    uint64_t played;
+};
+
+class SoapyReplayDevice : public SoapySDR::Device
+{
+private:
+    std::string name;
+    std::string format;
+    int chans;
+    size_t frameSize;
+    size_t mtu;
+    bool loop;
+    // as recorded (timestamps), and as played (pacing)
+    double recRate;
+    double rate;
+    double freq;
+    uint64_t offset;
+    std::vector<ReplayFile> files;
+
+    // map one data file, checking its meta data matches the first's (which sets ours)
+    bool addFile(const std::string &path)
+    {
+        std::string json;
+        if (!sigmfReadMeta(path+".sigmf-meta", json))
+            return false;
+        std::string fmt = sigmfFormat(sigmfField(json, "core:datatype"));
+        std::string nch = sigmfField(json, "core:num_channels");
+        int n = nch.empty() ? 1 : atoi(nch.c_str());
+        if (files.empty()) {
+            format = fmt;
+            chans = n;
+            recRate = atof(sigmfField(json, "core:sample_rate").c_str());
+            freq = atof(sigmfField(json, "core:frequency").c_str());
+            offset = strtoull(sigmfField(json, "core:offset").c_str(), nullptr, 10);
+            if (format.empty() || chans<1)
+                throw std::runtime_error("tcpreplay: unsupported recording: "+path);
+            frameSize = (format==SOAPY_SDR_CF32 ? 8 : format==SOAPY_SDR_CS16 ? 4 : 2)*chans;
+        } else if (fmt!=format || n!=chans) {
+            throw std::runtime_error("tcpreplay: recording changes format: "+path);
+        }
+        int fd = open((path+".sigmf-data").c_str(), O_RDONLY|O_CLOEXEC);
+        struct stat st;
+        if (fd<0 || fstat(fd, &st)) {
+            if (fd>=0)
+                close(fd);
+            throw std::runtime_error("tcpreplay: "+path+".sigmf-data: "+strerror(errno));
+        }
+        ReplayFile rf = { nullptr, (size_t)st.st_size/frameSize*frameSize };
+        if (rf.len>0) {
+            void *map = mmap(nullptr, rf.len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (MAP_FAILED==map) {
+                close(fd);
+                throw std::runtime_error("tcpreplay: "+path+".sigmf-data: "+strerror(errno));
+            }
+            madvise(map, rf.len, MADV_SEQUENTIAL);
+            rf.data = (const uint8_t *)map;
+            files.push_back(rf);
+        }
+        close(fd);
+        return true;
+    }
+
+    // wait until another 'elems' samples are due, false if that is beyond the timeout
+    bool pace(ReplayStream *s, size_t elems, long timeoutUs)
+    {
+        if (rate<=0)
+            return true;
+        long long due = s->start.tv_sec*1000000000LL + s->start.tv_nsec + (long long)((s->count+elems)*1e9/rate);
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long wait = due - (now.tv_sec*1000000000LL + now.tv_nsec);
+        if (wait>timeoutUs*1000LL)
+            return false;
+        if (wait>0) {
+            struct timespec ts = { (time_t)(due/1000000000LL), (long)(due%1000000000LL) };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+        }
+        return true;
+    }
+
+public:
+    SoapyReplayDevice(const SoapySDR::Kwargs &args) :
+        chans(1), frameSize(0), recRate(0), rate(0), freq(0), offset(0)
+    {
+        std::string dir = args.count("dir") ? args.at("dir") : "";
+        name = args.count("name") ? args.at("name") : "";
+        mtu = args.count("mtu") ? std::stoul(args.at("mtu")) : 8192;
+        loop = args.count("loop") && args.at("loop")!="0";
+        if (dir.empty() || !sigmfName(name) || mtu<1)
+            throw std::runtime_error("tcpreplay: invalid device arguments (name=<recording>, server run with -r)");
+        // one file, or rotated ones
+        if (!addFile(sigmfPath(dir, name, -1))) {
+            for (int i=0; addFile(sigmfPath(dir, name, i)); ++i)
+                ;
+        }
+        if (files.empty())
+            throw std::runtime_error("tcpreplay: no such recording: "+name);
+        rate = recRate;
+        SoapySDR_logf(SOAPY_SDR_INFO, "tcpreplay: %s: %zu file(s), %s x %d at %g", name.c_str(), files.size(),
+            format.c_str(), chans, recRate);
+    }
+    ~SoapyReplayDevice()
+    {
+        for (auto &rf: files)
+            munmap((void *)rf.data, rf.len);
+    }
+
+    std::string getDriverKey(void) const { return "tcpreplay"; }
+    std::string getHardwareKey(void) const { return "tcpreplay"; }
+    SoapySDR::Kwargs getHardwareInfo(void) const
+    {
+        SoapySDR::Kwargs info;
+        info["name"] = name;
+        info["format"] = format;
+        info["files"] = std::to_string(files.size());
+        info["rate"] = std::to_string(recRate);
+        return info;
+    }
+    size_t getNumChannels(const int direction) const { return SOAPY_SDR_RX==direction ? chans : 0; }
+
+    // Stream API
+    std::vector<std::string> getStreamFormats(const int direction, const size_t channel) const
+    {
+        return { SOAPY_SDR_CS8, SOAPY_SDR_CS16, SOAPY_SDR_CF32 };
+    }
+    std::string getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const
+    {
+        fullScale = format==SOAPY_SDR_CF32 ? 1.0 : format==SOAPY_SDR_CS8 ? 127.0 : 32767.0;
+        return format;
+    }
+    SoapySDR::Stream *setupStream(const int direction, const std::string &fmt,
+        const std::vector<size_t> &channels, const SoapySDR::Kwargs &args)
+    {
+        if (SOAPY_SDR_RX!=direction)
+            throw std::runtime_error("tcpreplay: receive only");
+        convert_t cnv = getConverter(format, fmt);
+        if (!cnv || (fmt!=SOAPY_SDR_CS8 && fmt!=SOAPY_SDR_CS16 && fmt!=SOAPY_SDR_CF32))
+            throw std::runtime_error("tcpreplay: unsupported format: "+fmt);
+        // all the channels, as recorded
+        bool all = channels.empty() ? 1==chans : channels.size()==(size_t)chans;
+        for (size_t c=0; all && c<channels.size(); ++c)
+            all = channels[c]==c;
+        if (!all)
+            throw std::runtime_error("tcpreplay: streams have all channels, in order");
+        ReplayStream *s = new ReplayStream();
+        s->cnv = cnv;
+        s->active = false;
+        s->ended = false;
+        s->file = s->pos = 0;
+        s->count = 0;
+        s->played = offset;
+        return (SoapySDR::Stream *)s;
+    }
+    void closeStream(SoapySDR::Stream *stream) { delete (ReplayStream *)stream; }
+    size_t getStreamMTU(SoapySDR::Stream *stream) const { return mtu; }
+    int activateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs, const size_t numElems)
+    {
+        // (carrying on from where it was, or from the top once played to the end)
+        ReplayStream *s = (ReplayStream *)stream;
+        if (s->ended) {
+            s->ended = false;
+            s->played = offset;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &s->start);
+        s->count = 0;
+        s->active = true;
+        return 0;
+    }
+    int deactivateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs)
+    {
+        ((ReplayStream *)stream)->active = false;
+        return 0;
+    }
+    int readStream(SoapySDR::Stream *stream, void * const *buffs, const size_t numElems,
+        int &flags, long long &timeNs, const long timeoutUs)
+    {
+        ReplayStream *s = (ReplayStream *)stream;
+        if (!s->active)
+            return SOAPY_SDR_STREAM_ERROR;
+        if (s->ended) {
+            struct timespec ts = { timeoutUs/1000000, (timeoutUs%1000000)*1000 };
+            nanosleep(&ts, nullptr);
+            return SOAPY_SDR_TIMEOUT;
+        }
+        const ReplayFile &rf = files[s->file];
+        size_t left = (rf.len-s->pos)/frameSize;
+        size_t elems = numElems<mtu ? numElems : mtu;
+        if (elems>left)
+            elems = left;
+        if (!pace(s, elems, timeoutUs))
+            return SOAPY_SDR_TIMEOUT;
+        s->cnv(buffs, 0, rf.data+s->pos, chans, elems);
+        flags = SOAPY_SDR_HAS_TIME;
+        timeNs = recRate>0 ? (long long)(s->played*1e9/recRate) : 0;
+        s->count += elems;
+        s->played += elems;
+        s->pos += elems*frameSize;
+        // next file, perhaps from the top
+        if (s->pos>=rf.len) {
+            s->pos = 0;
+            if (++s->file==files.size()) {
+                s->file = 0;
+                if (loop) {
+                    s->played = offset;
+                } else {
+                    s->ended = true;
+                    flags |= SOAPY_SDR_END_BURST;
+                }
+            }
+        }
+        return (int)elems;
+    }
+
+    // Settings: frequency as recorded (a new one is only remembered), rate paces the replay
+    std::vector<std::string> listAntennas(const int direction, const size_t channel) const { return { "REPLAY" }; }
+    std::string getAntenna(const int direction, const size_t channel) const { return "REPLAY"; }
+    void setFrequency(const int direction, const size_t channel, const double frequency, const SoapySDR::Kwargs &args)
+    {
+        freq = frequency;
+    }
+    double getFrequency(const int direction, const size_t channel) const { return freq; }
+    SoapySDR::RangeList getFrequencyRange(const int direction, const size_t channel) const
+    {
+        return { SoapySDR::Range(freq, freq) };
+    }
+    void setSampleRate(const int direction, const size_t channel, const double r) { rate = r; }
+    double getSampleRate(const int direction, const size_t channel) const { return rate; }
+    SoapySDR::RangeList getSampleRateRange(const int direction, const size_t channel) const
+    {
+        // zero: unpaced
+        return { SoapySDR::Range(0, 1e9) };
+    }
+};
+
+static SoapySDR::KwargsList findReplayDevice(const SoapySDR::Kwargs &args)
+{
+    // never volunteered in a general enumeration
+    SoapySDR::KwargsList results;
+    if (args.count("driver") && args.at("driver")=="tcpreplay") {
+        SoapySDR::Kwargs info = args;
+        info["label"] = "TCP remote replay device";
+        results.push_back(info);
+    }
+    return results;
+}
+
+static SoapySDR::Device *makeReplayDevice(const SoapySDR::Kwargs &args)
+{
+    SoapySDR_log(SOAPY_SDR_INFO, "makeReplayDevice");
+    return new SoapyReplayDevice(args);
+}
+
+static SoapySDR::Registry registerReplayDevice("tcpreplay", &findReplayDevice, &makeReplayDevice, SOAPY_SDR_ABI_VERSION);
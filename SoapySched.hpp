@@ -0,0 +1,232 @@
+// SoapySched.hpp - placing stream pump threads: CPUs, scheduling & NUMA memory
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapySched_hpp
+#define SoapySched_hpp
+
+// Each stream's pump threads may be placed, server wide (SoapyTCPServer
+// -a/-n/-s/-S/-N) or per stream (tcpremote:cpus / netcpus / sched / netsched /
+// numa), say the device pump next to the USB host controller's interrupts and
+// the network pump next to the NIC's. Design notes:
+// - the device side (dataPump) and the network side (netPump, netReader, a
+//   subscriber's fanoutPump) are placed separately: CPU lists ("2", "0-3,8")
+//   and a policy ("fifo", "rr", "other", "batch" or "idle", optionally with
+//   ":<priority>"). The device pump asks for fifo:1 unless told otherwise,
+//   the network side is as the server started (not as the device pump that
+//   made it, threads inherit both).
+// - a thread places itself as it starts, before it makes its buffers, so the
+//   pipe, broadcast ring & work areas it allocates (and first touches) are on
+//   its own node. A NUMA node makes that the preferred node for the thread's
+//   allocations (set_mempolicy, no libnuma needed) and, without a CPU list, runs
+//   the thread on that node's CPUs.
+// - each step is checked, a failure (no CAP_SYS_NICE for a real-time policy,
+//   CPUs outside our cpuset, a missing node) leaves that step as it was and is
+//   logged as a warning, then the outcome (what the thread actually got) is
+//   logged, and log stream clients see both.
+// Linux only: elsewhere placement is logged as unsupported.
+
+#include <SoapySDR/Logger.h>
+#include <string>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+// (from linux/mempolicy.h, not always installed)
+#define TCPREMOTE_MPOL_PREFERRED 1
+#define TCPREMOTE_MAX_NODES 64
+
+struct SchedPlacement
+{
+    std::string cpus;       // CPU list, empty for anywhere
+    std::string sched;      // policy[:priority], empty to leave as started
+    std::string numa;       // NUMA node, empty for first touch
+    bool quiet;             // nothing asked for (defaults only), log at debug
+};
+
+#ifdef __linux__
+// "0-3,8" into a set, false if malformed or empty
+static inline bool schedCpuSet(const std::string &list, cpu_set_t &set) {
+    CPU_ZERO(&set);
+    const char *p = list.c_str();
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        long hi = lo;
+        if (end==p || lo<0)
+            return false;
+        p = end;
+        if ('-'==*p) {
+            hi = strtol(++p, &end, 10);
+            if (end==p || hi<lo)
+                return false;
+            p = end;
+        }
+        if (hi>=CPU_SETSIZE)
+            return false;
+        for (long c=lo; c<=hi; ++c)
+            CPU_SET(c, &set);
+        if (','==*p)
+            ++p;
+        else if (*p)
+            return false;
+    }
+    return CPU_COUNT(&set)>0;
+}
+
+static inline std::string schedCpuList(const cpu_set_t &set) {
+    std::string list;
+    for (int c=0; c<CPU_SETSIZE; ++c) {
+        if (!CPU_ISSET(c, &set))
+            continue;
+        int hi = c;
+        while (hi+1<CPU_SETSIZE && CPU_ISSET(hi+1, &set))
+            ++hi;
+        char buf[32];
+        snprintf(buf, sizeof(buf), hi>c ? "%s%d-%d" : "%s%d", list.empty() ? "" : ",", c, hi);
+        list += buf;
+        c = hi;
+    }
+    return list;
+}
+
+// the CPUs of a NUMA node, empty if there is no such node
+static inline std::string schedNodeCpus(int node) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return "";
+    char buf[1024];
+    std::string list = fgets(buf, sizeof(buf), fp) ? buf : "";
+    fclose(fp);
+    size_t end = list.find_last_not_of(" \t\r\n");
+    return std::string::npos==end ? "" : list.substr(0, end+1);
+}
+#endif
+
+static const struct {
+    const char *name;
+    int policy;
+} s_schedPolicies[] = {
+    { "other", SCHED_OTHER },
+    { "fifo", SCHED_FIFO },
+    { "rr", SCHED_RR },
+#ifdef SCHED_BATCH
+    { "batch", SCHED_BATCH },
+#endif
+#ifdef SCHED_IDLE
+    { "idle", SCHED_IDLE },
+#endif
+};
+
+// "fifo[:<priority>]" etc. (real-time policies default to priority 1), false if unknown or out of range
+static inline bool schedPolicy(const std::string &spec, int &policy, int &prio) {
+    size_t colon = spec.find(':');
+    std::string name = spec.substr(0, colon);
+    policy = -1;
+    for (auto &p: s_schedPolicies) {
+        if (name==p.name)
+            policy = p.policy;
+    }
+    if (policy<0)
+        return false;
+    bool rt = SCHED_FIFO==policy || SCHED_RR==policy;
+    prio = std::string::npos==colon ? (rt ? 1 : 0) : atoi(spec.c_str()+colon+1);
+    return prio>=sched_get_priority_min(policy) && prio<=sched_get_priority_max(policy);
+}
+
+static inline std::string schedPolicyName(int policy, int prio) {
+    for (auto &p: s_schedPolicies) {
+        if (policy==p.policy)
+            return SCHED_FIFO==policy || SCHED_RR==policy ? std::string(p.name)+":"+std::to_string(prio) : p.name;
+    }
+    return std::to_string(policy);
+}
+
+// the calling thread's CPUs & policy, as a placement would give them
+static inline void schedCurrent(std::string &cpus, std::string &sched) {
+    cpus.clear();
+#ifdef __linux__
+    cpu_set_t set;
+    if (0==pthread_getaffinity_np(pthread_self(), sizeof(set), &set))
+        cpus = schedCpuList(set);
+#endif
+    int policy;
+    struct sched_param sch;
+    sched = pthread_getschedparam(pthread_self(), &policy, &sch) ? "" : schedPolicyName(policy, sch.sched_priority);
+}
+
+// a CPU list & policy make sense (either may be empty), to check options up front
+static inline bool schedValid(const std::string &cpus, const std::string &sched) {
+    int policy, prio;
+    if (!sched.empty() && !schedPolicy(sched, policy, prio))
+        return false;
+#ifdef __linux__
+    cpu_set_t set;
+    if (!cpus.empty() && !schedCpuSet(cpus, set))
+        return false;
+#endif
+    return true;
+}
+
+// place the calling thread ('who' for the log), what can't be done is left as it was
+static inline void schedPlace(const char *who, const SchedPlacement &place) {
+    SoapySDRLogLevel level = place.quiet ? SOAPY_SDR_DEBUG : SOAPY_SDR_WARNING;
+#ifdef __linux__
+    pthread_t self = pthread_self();
+    std::string cpus = place.cpus;
+    int node = -1;
+    if (!place.numa.empty()) {
+        node = atoi(place.numa.c_str());
+        std::string nodeCpus = node>=0 && node<TCPREMOTE_MAX_NODES ? schedNodeCpus(node) : "";
+        if (nodeCpus.empty()) {
+            SoapySDR_logf(level, "%s: no such NUMA node: %s", who, place.numa.c_str());
+            node = -1;
+        } else {
+            unsigned long mask = 1UL<<node;
+            if (syscall(SYS_set_mempolicy, TCPREMOTE_MPOL_PREFERRED, &mask, TCPREMOTE_MAX_NODES+1)) {
+                SoapySDR_logf(level, "%s: unable to prefer NUMA node %d: %s", who, node, strerror(errno));
+                node = -1;
+            }
+            if (cpus.empty())
+                cpus = nodeCpus;
+        }
+    }
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        int rv = schedCpuSet(cpus, set) ? pthread_setaffinity_np(self, sizeof(set), &set) : EINVAL;
+        if (rv)
+            SoapySDR_logf(level, "%s: unable to run on CPUs %s: %s", who, cpus.c_str(), strerror(rv));
+    }
+    if (!place.sched.empty()) {
+        int policy, prio;
+        int rv = EINVAL;
+        if (schedPolicy(place.sched, policy, prio)) {
+            struct sched_param sch;
+            memset(&sch, 0, sizeof(sch));
+            sch.sched_priority = prio;
+            rv = pthread_setschedparam(self, policy, &sch);
+        }
+        if (rv)
+            SoapySDR_logf(level, "%s: unable to schedule %s: %s", who, place.sched.c_str(), strerror(rv));
+    }
+    // what we got
+    std::string gotCpus, gotSched;
+    schedCurrent(gotCpus, gotSched);
+    SoapySDR_logf(place.quiet ? SOAPY_SDR_DEBUG : SOAPY_SDR_INFO, "%s: placed: CPUs %s, %s%s%s", who,
+        gotCpus.c_str(), gotSched.c_str(), node>=0 ? ", NUMA node " : "", node>=0 ? std::to_string(node).c_str() : "");
+#else
+    if (!place.quiet && (!place.cpus.empty() || !place.sched.empty() || !place.numa.empty()))
+        SoapySDR_logf(level, "%s: thread placement is not supported here", who);
+#endif
+}
+
+#endif
@@ -0,0 +1,185 @@
+// SoapyShm.hpp - shared memory data transport for same host clients
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapyShm_hpp
+#define SoapyShm_hpp
+
+// Receive streams from a client on the same host (connected by Unix domain
+// socket, see unixAddress) may ask for their data in shared memory
+// (tcpremote:shm=1) instead of the data connection. Design notes:
+// - the stream's pipe (SoapyPipe.hpp) is made in a memfd, the server writes
+//   blocks straight into it (dataPump, or a subscriber's fanoutPump) and the
+//   client's readStream converts straight out of it, so samples are copied
+//   once, by the conversion, and never cross the socket layer.
+// - the memfd is passed to the client over the data connection (SCM_RIGHTS),
+//   which otherwise stays quiet, holding the stream as it does for UDP.
+// - layout: one page holding a shmhdr_t (the pipe, magic & layout sizes, so
+//   mismatched builds refuse each other), then the ring (power of two, whole
+//   pages). The client maps the ring twice, back to back, so whatever is held
+//   is one run of bytes and readStream needs no wrap handling.
+// - wakeups are process shared futexes, a full ring drops the newest block
+//   (counted as an overrun, as the network pipe does), nobody waits on the
+//   client.
+// Linux only: elsewhere shmCreate fails and the client stays on the socket.
+
+#include "SoapyPipe.hpp"
+#include <new>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define TCPREMOTE_SHM_MAGIC 0x53545352u
+// ring size limits (bytes)
+#define TCPREMOTE_SHM_MIN (1024*1024)
+#define TCPREMOTE_SHM_MAX (256*1024*1024)
+
+// first in the file (so the pipe is the start of the mapping)
+struct shmhdr_t {
+    pipebuf_t pipe;
+    uint32_t magic;
+    uint32_t hdrSize;
+    uint64_t ringSize;
+};
+
+static inline size_t shmPage() {
+    long pg = sysconf(_SC_PAGESIZE);
+    return pg>0 ? (size_t)pg : 4096;
+}
+
+// (server) a ring of at least 'size' bytes in a new memfd: returns the pipe (in our own
+// mapping, 'map' bytes long), the fd to pass on in 'fd', or null on error
+static inline pipebuf_t *shmCreate(size_t size, int &fd, size_t &map) {
+#ifdef __linux__
+    size_t page = shmPage();
+    size_t len = pipesize(size<page ? page : size);
+    if (sizeof(shmhdr_t)>page)
+        return nullptr;
+    fd = memfd_create("SoapyTCPRemote", MFD_CLOEXEC);
+    if (fd<0)
+        return nullptr;
+    map = page+len;
+    void *base = MAP_FAILED;
+    if (0==ftruncate(fd, map))
+        base = mmap(nullptr, map, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED==base) {
+        int err = errno;
+        close(fd);
+        fd = -1;
+        errno = err;
+        return nullptr;
+    }
+    shmhdr_t *hdr = new (base) shmhdr_t;
+    hdr->magic = TCPREMOTE_SHM_MAGIC;
+    hdr->hdrSize = sizeof(shmhdr_t);
+    hdr->ringSize = len;
+    pipeinit(&hdr->pipe, (uint8_t *)base+page, len, true);
+    return &hdr->pipe;
+#else
+    errno = ENOSYS;
+    return nullptr;
+#endif
+}
+
+// (client) map a ring passed to us, with the ring mirrored after itself: returns the pipe,
+// the mirrored ring in 'data' (2 x pipe->len) & our mapping's length in 'map', or null if
+// it is not one of ours
+static inline pipebuf_t *shmAttach(int fd, uint8_t *&data, size_t &map) {
+#ifdef __linux__
+    size_t page = shmPage();
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size<=page)
+        return nullptr;
+    size_t len = st.st_size-page;
+    if (len & (len-1) || len%page)
+        return nullptr;
+    // reserve the whole span, then put the file (header & ring) and the ring again over it
+    map = page+2*len;
+    uint8_t *base = (uint8_t *)mmap(nullptr, map, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED==(void *)base)
+        return nullptr;
+    if (MAP_FAILED==mmap(base, page+len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) ||
+        MAP_FAILED==mmap(base+page+len, len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, page)) {
+        munmap(base, map);
+        return nullptr;
+    }
+    shmhdr_t *hdr = (shmhdr_t *)base;
+    if (hdr->magic!=TCPREMOTE_SHM_MAGIC || hdr->hdrSize!=sizeof(shmhdr_t) || hdr->ringSize!=len ||
+        hdr->pipe.len!=len || !hdr->pipe.shared) {
+        munmap(base, map);
+        errno = EPROTO;
+        return nullptr;
+    }
+    data = base+page;
+    return &hdr->pipe;
+#else
+    errno = ENOSYS;
+    return nullptr;
+#endif
+}
+
+// either end: unmap a ring from shmCreate or shmAttach
+static inline void shmDetach(pipebuf_t *pipe, size_t map) {
+#ifdef __linux__
+    if (pipe)
+        munmap((void *)pipe, map);
+#endif
+}
+
+// pass a file descriptor across a Unix domain socket (with one byte of data), -1 on error
+static inline int shmSendFd(int sock, int fd) {
+    char one = 1;
+    struct iovec iov = { &one, 1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctrl;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+    return sendmsg(sock, &msg, MSG_NOSIGNAL)==1 ? 0 : -1;
+}
+
+// receive a file descriptor sent by shmSendFd, waiting up to timeoutMs, -1 on error/timeout
+static inline int shmRecvFd(int sock, int timeoutMs) {
+    struct pollfd pfd = { sock, POLLIN, 0 };
+    if (poll(&pfd, 1, timeoutMs)<=0)
+        return -1;
+    char one;
+    struct iovec iov = { &one, 1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctrl;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)!=1)
+        return -1;
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (!cm || cm->cmsg_level!=SOL_SOCKET || cm->cmsg_type!=SCM_RIGHTS || cm->cmsg_len!=CMSG_LEN(sizeof(int)))
+        return -1;
+    int fd;
+    memcpy(&fd, CMSG_DATA(cm), sizeof(int));
+    return fd;
+}
+
+#endif
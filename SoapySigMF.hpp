@@ -0,0 +1,316 @@
+// SoapySigMF.hpp - recording receive streams to SigMF files, and reading them back
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapySigMF_hpp
+#define SoapySigMF_hpp
+
+// Receive streams may be recorded on the server (tcpremote:record=<name>)
+// instead of sent, into the directory it was given (SoapyTCPServer -r <dir>),
+// and replayed from there by the built in tcpreplay device. Design notes:
+// - the stream's pump thread (netPump, or a subscriber's fanoutPump), which
+//   would have sent the data, writes it instead, so the device side is as for
+//   any other stream and the disk cannot hold it up: a slow disk fills the
+//   pipe, which drops (and counts) data as a slow network would.
+// - data is the wire format (interleaved frames, unframed), staged in an
+//   aligned buffer and written in whole chunks, with O_DIRECT where the file
+//   system allows, so recording does not fill the page cache. Chunks are whole
+//   pages and frames, so files always hold whole frames.
+// - tcpremote:record_size=<MiB> rotates files (<name>-<nnnn>), each whole
+//   chunks, with core:offset saying where it starts in the recording.
+// - each data file has its .sigmf-meta, written when it opens and again
+//   with a capture segment for each activation (the frequency may change) and
+//   when it is closed, so an interrupted recording is still readable.
+// - names are plain file names (no paths), files are never overwritten.
+
+#include <SoapySDR/Logger.h>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// staging (and write) size, rounded to whole frames & pages
+#define TCPREMOTE_RECORD_CHUNK (4*1024*1024)
+#define TCPREMOTE_RECORD_ALIGN 4096
+
+// SigMF datatype for a wire format, empty if there isn't one (CS12)
+static inline std::string sigmfDatatype(const std::string &format) {
+    if ("CS8"==format)
+        return "ci8";
+    if ("CS16"==format)
+        return "ci16_le";
+    if ("CF32"==format)
+        return "cf32_le";
+    return "";
+}
+
+static inline std::string sigmfFormat(const std::string &datatype) {
+    if ("ci8"==datatype)
+        return "CS8";
+    if ("ci16_le"==datatype)
+        return "CS16";
+    if ("cf32_le"==datatype)
+        return "CF32";
+    return "";
+}
+
+// a recording name is a plain file name in the directory
+static inline bool sigmfName(const std::string &name) {
+    return !name.empty() && name[0]!='.' && name.find('/')==std::string::npos;
+}
+
+// path of a recording's file, without the extension: <dir>/<name>[-<index>], index<0 for unrotated
+static inline std::string sigmfPath(const std::string &dir, const std::string &name, int index) {
+    std::string path = dir + "/" + name;
+    if (index>=0) {
+        char num[16];
+        snprintf(num, sizeof(num), "-%04d", index);
+        path += num;
+    }
+    return path;
+}
+
+// the value of a (top level, or first) "key": value in SigMF JSON, as text (strings unquoted), empty if missing
+static inline std::string sigmfField(const std::string &json, const std::string &key) {
+    size_t pos = json.find("\""+key+"\"");
+    if (std::string::npos==pos)
+        return "";
+    pos = json.find(':', pos+key.length()+2);
+    if (std::string::npos==pos)
+        return "";
+    pos = json.find_first_not_of(" \t\r\n", pos+1);
+    if (std::string::npos==pos)
+        return "";
+    if ('"'==json[pos]) {
+        size_t end = json.find('"', pos+1);
+        return std::string::npos==end ? "" : json.substr(pos+1, end-pos-1);
+    }
+    size_t end = json.find_first_of(",}] \t\r\n", pos);
+    return json.substr(pos, std::string::npos==end ? std::string::npos : end-pos);
+}
+
+static inline bool sigmfReadMeta(const std::string &path, std::string &json) {
+    FILE *fp = fopen(path.c_str(), "r");
+    if (!fp)
+        return false;
+    char buf[4096];
+    size_t n;
+    json.clear();
+    while ((n = fread(buf, 1, sizeof(buf), fp))>0)
+        json.append(buf, n);
+    fclose(fp);
+    return true;
+}
+
+static inline std::string sigmfDatetime(const struct timespec &ts) {
+    struct tm tm;
+    gmtime_r(&ts.tv_sec, &tm);
+    char buf[64];
+    size_t n = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf+n, sizeof(buf)-n, ".%06ldZ", ts.tv_nsec/1000);
+    return buf;
+}
+
+class SigMFRecorder
+{
+public:
+    // what the meta data says, set before start()
+    std::string datatype;
+    double rate;
+    int numChans;
+    std::string hardware;
+
+    SigMFRecorder(const std::string &dir, const std::string &name, size_t frameSize, uint64_t rotateBytes) :
+        rate(0), numChans(1), dir(dir), name(name), frameSize(frameSize), fd(-1), direct(false),
+        index(rotateBytes>0 ? 0 : -1), fileFrames(0), offset(0), used(0), buf(nullptr) {
+        // chunks are whole pages & frames
+        size_t unit = TCPREMOTE_RECORD_ALIGN*frameSize;
+        chunk = TCPREMOTE_RECORD_CHUNK/unit>0 ? TCPREMOTE_RECORD_CHUNK/unit*unit : unit;
+        rotate = rotateBytes>0 ? (rotateBytes<chunk ? chunk : rotateBytes/chunk*chunk) : 0;
+        if (posix_memalign((void **)&buf, TCPREMOTE_RECORD_ALIGN, chunk))
+            buf = nullptr;
+    }
+    ~SigMFRecorder() {
+        close();
+        free(buf);
+    }
+    // bytes a writer may be behind by while a chunk is written
+    size_t chunkSize() const { return chunk; }
+    // the first file must not already be there
+    bool exists() const {
+        struct stat st;
+        return 0==stat((sigmfPath(dir, name, index)+".sigmf-data").c_str(), &st) ||
+            0==stat((sigmfPath(dir, name, index)+".sigmf-meta").c_str(), &st);
+    }
+    // a new capture segment (each activation), opening the first file if need be
+    bool start(double frequency) {
+        if (!buf)
+            return false;
+        if (fd<0 && !openFile())
+            return false;
+        Capture cap;
+        cap.start = fileFrames + used/frameSize;
+        cap.frequency = frequency;
+        clock_gettime(CLOCK_REALTIME, &cap.time);
+        // (nothing recorded since the last one? this replaces it)
+        if (!captures.empty() && captures.back().start==cap.start)
+            captures.pop_back();
+        captures.push_back(cap);
+        return writeMeta();
+    }
+    // whole frames in, false on a write error (recording stops)
+    bool write(const uint8_t *data, size_t len) {
+        if (fd<0)
+            return false;
+        while (len>0) {
+            size_t n = chunk-used<len ? chunk-used : len;
+            memcpy(buf+used, data, n);
+            used += n;
+            data += n;
+            len -= n;
+            if (used==chunk && !flush())
+                return false;
+        }
+        return true;
+    }
+    // write what is held, finish the meta data
+    void close() {
+        if (fd<0)
+            return;
+        if (used>0) {
+#ifdef O_DIRECT
+            // (the tail need not be a whole chunk, so not direct)
+            if (direct)
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+#endif
+            if (writeAll(buf, used))
+                fileFrames += used/frameSize;
+            used = 0;
+        }
+        ::close(fd);
+        fd = -1;
+        writeMeta();
+        SoapySDR_logf(SOAPY_SDR_INFO, "Recorded: %s (%llu frames)", sigmfPath(dir, name, index).c_str(),
+            (unsigned long long)fileFrames);
+    }
+
+private:
+    struct Capture {
+        uint64_t start;
+        double frequency;
+        struct timespec time;
+    };
+    std::string dir, name;
+    size_t frameSize;
+    size_t chunk;
+    uint64_t rotate;
+    int fd;
+    bool direct;
+    int index;
+    // frames in this file, and before it (core:offset)
+    uint64_t fileFrames;
+    uint64_t offset;
+    std::vector<Capture> captures;
+    size_t used;
+    uint8_t *buf;
+
+    bool openFile() {
+        std::string path = sigmfPath(dir, name, index)+".sigmf-data";
+        int flags = O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC;
+#ifdef O_DIRECT
+        fd = open(path.c_str(), flags|O_DIRECT, 0644);
+        direct = fd>=0;
+        // (not on this file system, tmpfs for one)
+        if (fd<0 && EINVAL==errno)
+#endif
+            fd = open(path.c_str(), flags, 0644);
+        if (fd<0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SigMFRecorder: %s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        SoapySDR_logf(SOAPY_SDR_INFO, "Recording: %s%s", path.c_str(), direct ? " (direct)" : "");
+        fileFrames = 0;
+        return true;
+    }
+    bool writeAll(const uint8_t *data, size_t len) {
+        while (len>0) {
+            ssize_t n = ::write(fd, data, len);
+            if (n<0 && EINTR==errno)
+                continue;
+            if (n<=0) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SigMFRecorder: write: %s", n<0 ? strerror(errno) : "no space");
+                return false;
+            }
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+    // one whole chunk, then the next file if this one is full
+    bool flush() {
+        if (!writeAll(buf, used))
+            return false;
+        fileFrames += used/frameSize;
+        used = 0;
+        if (rotate>0 && fileFrames*frameSize+chunk>rotate) {
+            Capture last = captures.back();
+            uint64_t since = fileFrames-last.start;
+            close();
+            offset += fileFrames;
+            ++index;
+            captures.clear();
+            if (!openFile())
+                return false;
+            // carrying on from the last capture, at the time of the first frame here
+            last.start = 0;
+            if (rate>0) {
+                double secs = last.time.tv_nsec/1e9 + since/rate;
+                last.time.tv_sec += (time_t)secs;
+                last.time.tv_nsec = (long)((secs-(time_t)secs)*1e9);
+            }
+            captures.push_back(last);
+            return writeMeta();
+        }
+        return true;
+    }
+    bool writeMeta() {
+        std::string path = sigmfPath(dir, name, index)+".sigmf-meta";
+        std::string tmp = path+".tmp";
+        FILE *fp = fopen(tmp.c_str(), "w");
+        if (!fp) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SigMFRecorder: %s: %s", tmp.c_str(), strerror(errno));
+            return false;
+        }
+        fprintf(fp, "{\n    \"global\": {\n");
+        fprintf(fp, "        \"core:datatype\": \"%s\",\n", datatype.c_str());
+        fprintf(fp, "        \"core:sample_rate\": %.17g,\n", rate);
+        fprintf(fp, "        \"core:num_channels\": %d,\n", numChans);
+        fprintf(fp, "        \"core:offset\": %llu,\n", (unsigned long long)offset);
+        fprintf(fp, "        \"core:hw\": \"%s\",\n", hardware.c_str());
+        fprintf(fp, "        \"core:recorder\": \"SoapyTCPServer\",\n");
+        fprintf(fp, "        \"core:version\": \"1.0.0\"\n    },\n    \"captures\": [");
+        for (size_t i=0; i<captures.size(); ++i) {
+            fprintf(fp, "%s\n        {\n            \"core:sample_start\": %llu,\n", i ? "," : "",
+                (unsigned long long)captures[i].start);
+            fprintf(fp, "            \"core:frequency\": %.17g,\n", captures[i].frequency);
+            fprintf(fp, "            \"core:datetime\": \"%s\"\n        }", sigmfDatetime(captures[i].time).c_str());
+        }
+        fprintf(fp, "\n    ],\n    \"annotations\": []\n}\n");
+        bool ok = 0==fclose(fp);
+        if (!ok || rename(tmp.c_str(), path.c_str())) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SigMFRecorder: %s: %s", path.c_str(), strerror(errno));
+            unlink(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif
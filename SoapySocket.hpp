@@ -0,0 +1,174 @@
+// SoapySocket.hpp - socket option tuning, shared by client & server
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapySocket_hpp
+#define SoapySocket_hpp
+
+// RPC & log sockets carry small request/reply messages, so they disable
+// Nagle (TCP_NODELAY). Data sockets are sized from the stream rate once
+// it is known (activateStream), so each end buffers about 'buffer' msecs:
+// the sending end sizes SO_SNDBUF (and optionally TCP_NOTSENT_LOWAT), the
+// receiving end SO_RCVBUF (and optionally SO_BUSY_POLL). Stream args:
+//  tcpremote:buffer=<msecs>   - time held in socket buffers (default 250)
+//  tcpremote:sockbuf=<bytes>  - explicit buffer size, overrides the above
+//  tcpremote:lowat=<bytes>    - TCP_NOTSENT_LOWAT when sending (default off)
+//  tcpremote:busypoll=<usecs> - SO_BUSY_POLL when receiving (default off)
+//  tcpremote:nodelay=1        - TCP_NODELAY on the data socket too
+// A low latency stream (tcpremote:latency=low|<msecs>, see getLatencyMs)
+// defaults to buffering a quarter of its budget, TCP_NODELAY and a 16k
+// TCP_NOTSENT_LOWAT.
+// NB: setting a buffer size switches off kernel auto-tuning, so derived sizes
+// the kernel would cap (net.core.[rw]mem_max) are skipped, leaving auto-tuning
+// to do better, explicit sizes are always applied. Datagram sockets (UDP
+// transport) have no auto-tuning, so take as much as the kernel allows.
+// Unix domain sockets (tcpremote:address=unix:<path>) get buffer sizes only.
+
+#include <SoapySDR/Types.hpp>
+#include <SoapySDR/Logger.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TCPREMOTE_SOCKBUF_MIN (16*1024)
+#define TCPREMOTE_SOCKBUF_MAX (64*1024*1024)
+
+struct SocketTuning {
+    double bufferMs;
+    int sockBuf;
+    int lowat;
+    int busyPoll;
+    bool noDelay;
+};
+
+// end to end delay budget in msecs for low latency streams, zero for the
+// default (throughput) profile: tcpremote:latency=low (20) or =<msecs>
+#define TCPREMOTE_LOW_LATENCY_MS 20.0
+
+static inline double getLatencyMs(const SoapySDR::Kwargs &opts) {
+    if (!opts.count("tcpremote:latency"))
+        return 0;
+    const std::string &val = opts.at("tcpremote:latency");
+    if ("low"==val)
+        return TCPREMOTE_LOW_LATENCY_MS;
+    double ms = atof(val.c_str());
+    return ms>0 ? ms : 0;
+}
+
+static inline SocketTuning getSocketTuning(const SoapySDR::Kwargs &opts) {
+    SocketTuning t = { 250.0, 0, 0, 0, false };
+    double budget = getLatencyMs(opts);
+    if (budget>0) {
+        t.bufferMs = budget/4;
+        t.lowat = 16*1024;
+        t.noDelay = true;
+    }
+    if (opts.count("tcpremote:buffer"))
+        t.bufferMs = atof(opts.at("tcpremote:buffer").c_str());
+    if (opts.count("tcpremote:sockbuf"))
+        t.sockBuf = atoi(opts.at("tcpremote:sockbuf").c_str());
+    if (opts.count("tcpremote:lowat"))
+        t.lowat = atoi(opts.at("tcpremote:lowat").c_str());
+    if (opts.count("tcpremote:busypoll"))
+        t.busyPoll = atoi(opts.at("tcpremote:busypoll").c_str());
+    if (opts.count("tcpremote:nodelay"))
+        t.noDelay = opts.at("tcpremote:nodelay")!="0";
+    return t;
+}
+
+static inline int sockType(int sock) {
+    int type = 0;
+    socklen_t len = sizeof(type);
+    getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &len);
+    return type;
+}
+
+static inline int sockFamily(int sock) {
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(sock, (struct sockaddr *)&addr, &len))
+        return AF_UNSPEC;
+    return addr.ss_family;
+}
+
+static inline void setNoDelay(int sock) {
+    int one = 1;
+    // (no Nagle on Unix domain sockets)
+    if (AF_UNIX!=sockFamily(sock) && setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)))
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "setNoDelay: %s", strerror(errno));
+}
+
+// largest buffer the kernel allows without privileges (0 if unknown)
+static inline int sockBufLimit(bool sending) {
+    int lim = 0;
+    FILE *fp = fopen(sending ? "/proc/sys/net/core/wmem_max" : "/proc/sys/net/core/rmem_max", "r");
+    if (fp) {
+        if (fscanf(fp, "%d", &lim)!=1)
+            lim = 0;
+        fclose(fp);
+    }
+    return lim;
+}
+
+// Unix domain socket address from "unix:<path>" (or "unix:@<name>", Linux abstract namespace),
+// false if it is not one (or too long)
+static inline bool unixAddress(const std::string &spec, struct sockaddr_un &addr, socklen_t &len) {
+    if (spec.compare(0, 5, "unix:")!=0)
+        return false;
+    std::string path = spec.substr(5);
+    if (path.empty() || path.length()>=sizeof(addr.sun_path))
+        return false;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.data(), path.length());
+    if ('@'==path[0])
+        addr.sun_path[0] = 0;
+    len = offsetof(struct sockaddr_un, sun_path) + path.length() + ('@'==path[0] ? 0 : 1);
+    return true;
+}
+
+static inline void tuneDataSocket(int sock, bool sending, double bytesPerSec, const SocketTuning &t) {
+    int opt = sending ? SO_SNDBUF : SO_RCVBUF;
+    const char *name = sending ? "SO_SNDBUF" : "SO_RCVBUF";
+    bool dgram = SOCK_DGRAM==sockType(sock);
+    bool tcp = !dgram && AF_UNIX!=sockFamily(sock);
+    int size = t.sockBuf;
+    if (size<=0 && bytesPerSec>0 && t.bufferMs>0) {
+        double want = bytesPerSec*t.bufferMs/1000.0;
+        size = want<TCPREMOTE_SOCKBUF_MIN ? TCPREMOTE_SOCKBUF_MIN : want>TCPREMOTE_SOCKBUF_MAX ? TCPREMOTE_SOCKBUF_MAX : (int)want;
+        int lim = sockBufLimit(sending);
+        if (lim>0 && size>lim && dgram) {
+            SoapySDR_logf(SOAPY_SDR_DEBUG, "tuneDataSocket: %s %d > limit %d, using the limit", name, size, lim);
+            size = lim;
+        } else if (lim>0 && size>lim) {
+            SoapySDR_logf(SOAPY_SDR_DEBUG, "tuneDataSocket: %s %d > limit %d, leaving auto-tuning on", name, size, lim);
+            size = 0;
+        }
+    }
+    if (size>0) {
+        if (setsockopt(sock, SOL_SOCKET, opt, &size, sizeof(size)))
+            SoapySDR_logf(SOAPY_SDR_WARNING, "tuneDataSocket: %s=%d: %s", name, size, strerror(errno));
+        int got = 0;
+        socklen_t len = sizeof(got);
+        getsockopt(sock, SOL_SOCKET, opt, &got, &len);
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "tuneDataSocket: %s asked=%d got=%d", name, size, got);
+    }
+#ifdef TCP_NOTSENT_LOWAT
+    if (sending && t.lowat>0 && tcp && setsockopt(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &t.lowat, sizeof(t.lowat)))
+        SoapySDR_logf(SOAPY_SDR_WARNING, "tuneDataSocket: TCP_NOTSENT_LOWAT=%d: %s", t.lowat, strerror(errno));
+#endif
+#ifdef SO_BUSY_POLL
+    if (!sending && t.busyPoll>0 && setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &t.busyPoll, sizeof(t.busyPoll)))
+        SoapySDR_logf(SOAPY_SDR_WARNING, "tuneDataSocket: SO_BUSY_POLL=%d: %s", t.busyPoll, strerror(errno));
+#endif
+    if (t.noDelay && tcp)
+        setNoDelay(sock);
+}
+
+#endif
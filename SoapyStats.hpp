@@ -0,0 +1,160 @@
+// SoapyStats.hpp - per stream counters, RPC & metrics formatting
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapyStats_hpp
+#define SoapyStats_hpp
+
+// Counters for one data stream, so we can see how close it is to trouble.
+// Design notes:
+// - updated by the pump threads, each counter has a single writer so relaxed
+//   load + store is enough (no locked instructions), readers may see values
+//   from slightly different moments, which is fine for monitoring.
+// - samples are frames across all channels: 'in' from the source (the device
+//   when receiving, the network when transmitting) and 'out' to the sink.
+// - overruns: pipe full, data dropped by the server. underruns: pipe empty,
+//   the device was starved. drops: overflows / underflows reported by the driver.
+// - lost: frames the server dropped (whole blocks on overruns, or a subscriber
+//   lapped), resumes: times the client reattached (see Session in the server).
+// - device call latency (readStream, writeStream, acquireReadBuffer) is a
+//   histogram of power of two buckets in uSecs, the last is everything above.
+// - stall time is spent blocked in socket sends.
+
+#include <SoapySDR/Types.hpp>
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define TCPREMOTE_STATS_BUCKETS 20
+
+struct StreamStats {
+    std::atomic<uint64_t> samplesIn{0};
+    std::atomic<uint64_t> samplesOut{0};
+    std::atomic<uint64_t> netBytes{0};
+    std::atomic<uint64_t> overruns{0};
+    std::atomic<uint64_t> underruns{0};
+    std::atomic<uint64_t> drops{0};
+    std::atomic<uint64_t> lost{0};
+    std::atomic<uint64_t> resumes{0};
+    std::atomic<uint64_t> pipeSize{0};
+    std::atomic<uint64_t> pipeHigh{0};
+    std::atomic<uint64_t> stallNs{0};
+    std::atomic<uint64_t> callNs{0};
+    std::atomic<uint64_t> calls[TCPREMOTE_STATS_BUCKETS];
+    StreamStats() {
+        for (int b=0; b<TCPREMOTE_STATS_BUCKETS; ++b)
+            calls[b] = 0;
+    }
+};
+
+static inline uint64_t statsNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+// single writer updates
+static inline void statsAdd(std::atomic<uint64_t> &c, uint64_t v) {
+    c.store(c.load(std::memory_order_relaxed)+v, std::memory_order_relaxed);
+}
+
+static inline void statsMax(std::atomic<uint64_t> &c, uint64_t v) {
+    if (v>c.load(std::memory_order_relaxed))
+        c.store(v, std::memory_order_relaxed);
+}
+
+static inline void statsDeviceCall(StreamStats *s, uint64_t ns) {
+    uint64_t us = ns/1000;
+    int b = 0;
+    while (b<TCPREMOTE_STATS_BUCKETS-1 && ((uint64_t)1<<b)<=us)
+        ++b;
+    statsAdd(s->calls[b], 1);
+    statsAdd(s->callNs, ns);
+}
+
+// flat name=value form, for the stream stats RPC ('calls_lt_<n>us' are non-empty buckets)
+static inline SoapySDR::Kwargs statsToKwargs(const StreamStats &s) {
+    SoapySDR::Kwargs kw;
+    kw["samples_in"] = std::to_string(s.samplesIn.load());
+    kw["samples_out"] = std::to_string(s.samplesOut.load());
+    kw["net_bytes"] = std::to_string(s.netBytes.load());
+    kw["overruns"] = std::to_string(s.overruns.load());
+    kw["underruns"] = std::to_string(s.underruns.load());
+    kw["drops"] = std::to_string(s.drops.load());
+    kw["lost"] = std::to_string(s.lost.load());
+    kw["resumes"] = std::to_string(s.resumes.load());
+    kw["pipe_size"] = std::to_string(s.pipeSize.load());
+    kw["pipe_high"] = std::to_string(s.pipeHigh.load());
+    kw["stall_us"] = std::to_string(s.stallNs.load()/1000);
+    kw["device_us"] = std::to_string(s.callNs.load()/1000);
+    uint64_t total = 0;
+    for (int b=0; b<TCPREMOTE_STATS_BUCKETS; ++b) {
+        uint64_t n = s.calls[b].load();
+        total += n;
+        if (n>0)
+            kw[b<TCPREMOTE_STATS_BUCKETS-1 ? "calls_lt_"+std::to_string(1UL<<b)+"us" : "calls_more"] = std::to_string(n);
+    }
+    kw["device_calls"] = std::to_string(total);
+    return kw;
+}
+
+// Prometheus text exposition, one entry per stream: label set, stats
+typedef std::vector<std::pair<std::string, const StreamStats *>> StatsList;
+
+static inline void statsCounter(std::string &out, const char *name, const char *help, const StatsList &list,
+    std::atomic<uint64_t> StreamStats::*field, double mul = 1.0) {
+    char line[256];
+    snprintf(line, sizeof(line), "# HELP tcpremote_%s %s\n# TYPE tcpremote_%s %s\n",
+        name, help, name, strstr(name, "_total") ? "counter" : "gauge");
+    out += line;
+    for (auto &it: list) {
+        uint64_t v = (it.second->*field).load();
+        if (1.0==mul)
+            snprintf(line, sizeof(line), "tcpremote_%s{%s} %llu\n", name, it.first.c_str(), (unsigned long long)v);
+        else
+            snprintf(line, sizeof(line), "tcpremote_%s{%s} %.9g\n", name, it.first.c_str(), (double)v*mul);
+        out += line;
+    }
+}
+
+static inline std::string statsPrometheus(const StatsList &list) {
+    std::string out;
+    statsCounter(out, "samples_in_total", "Samples accepted from the device (RX) or network (TX)", list, &StreamStats::samplesIn);
+    statsCounter(out, "samples_out_total", "Samples delivered to the network (RX) or device (TX)", list, &StreamStats::samplesOut);
+    statsCounter(out, "net_bytes_total", "Bytes sent or received on the data connection", list, &StreamStats::netBytes);
+    statsCounter(out, "overruns_total", "Pipe full, data dropped by the server", list, &StreamStats::overruns);
+    statsCounter(out, "underruns_total", "Pipe empty, device starved", list, &StreamStats::underruns);
+    statsCounter(out, "drops_total", "Overflows or underflows reported by the driver", list, &StreamStats::drops);
+    statsCounter(out, "lost_samples_total", "Samples dropped by the server", list, &StreamStats::lost);
+    statsCounter(out, "resumes_total", "Client reattached after losing the connection", list, &StreamStats::resumes);
+    statsCounter(out, "pipe_size_bytes", "Inter-thread pipe size", list, &StreamStats::pipeSize);
+    statsCounter(out, "pipe_high_bytes", "Inter-thread pipe high water mark", list, &StreamStats::pipeHigh);
+    statsCounter(out, "send_stall_seconds_total", "Time blocked writing to the network", list, &StreamStats::stallNs, 1e-9);
+    char line[256];
+    out += "# HELP tcpremote_device_call_seconds Device stream call duration\n"
+           "# TYPE tcpremote_device_call_seconds histogram\n";
+    for (auto &it: list) {
+        uint64_t cum = 0;
+        for (int b=0; b<TCPREMOTE_STATS_BUCKETS; ++b) {
+            cum += it.second->calls[b].load();
+            if (b<TCPREMOTE_STATS_BUCKETS-1)
+                snprintf(line, sizeof(line), "tcpremote_device_call_seconds_bucket{%s,le=\"%g\"} %llu\n",
+                    it.first.c_str(), (double)(1UL<<b)*1e-6, (unsigned long long)cum);
+            else
+                snprintf(line, sizeof(line), "tcpremote_device_call_seconds_bucket{%s,le=\"+Inf\"} %llu\n",
+                    it.first.c_str(), (unsigned long long)cum);
+            out += line;
+        }
+        snprintf(line, sizeof(line), "tcpremote_device_call_seconds_sum{%s} %.9g\ntcpremote_device_call_seconds_count{%s} %llu\n",
+            it.first.c_str(), (double)it.second->callNs.load()*1e-9, it.first.c_str(), (unsigned long long)cum);
+        out += line;
+    }
+    return out;
+}
+
+#endif
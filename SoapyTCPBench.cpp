@@ -0,0 +1,275 @@
+//  SoapyTCPBench.cpp
+//  Copyright (c) 2021 Phil Ashby
+//  SPDX-License-Identifier: BSL-1.0
+
+// Benchmark: connects to a SoapyTCPServer (by default using its built in
+// 'tcpnull' synthetic device), then measures device setup & stream
+// activation times, RPC round trip latency per call type, and sustained
+// streaming throughput, with CPU use per Msps at both ends and data loss,
+// plus delivery delay for timestamped (tcpremote:framed) streams.
+// Output is one 'name: value' per line, so runs can be diffed.
+
+#include <SoapySDR/Device.hpp>
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Logger.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static double cpuSecs() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec*1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec*1e-6;
+}
+
+// "k=v, k=v" from readSensor("tcpremote:stats")
+static std::map<std::string, double> readStats(SoapySDR::Device *dev) {
+    std::map<std::string, double> kw;
+    std::string s = dev->readSensor("tcpremote:stats");
+    size_t cur = 0;
+    while (cur<s.length()) {
+        size_t end = s.find(", ", cur);
+        if (std::string::npos==end)
+            end = s.length();
+        std::string kv = s.substr(cur, end-cur);
+        size_t eq = kv.find('=');
+        if (eq!=std::string::npos) {
+            // drop the stream prefix (<dir><id>.), we only have one
+            std::string key = kv.substr(0, eq);
+            size_t dot = key.find('.');
+            if (dot!=std::string::npos)
+                key = key.substr(dot+1);
+            kw[key] = atof(kv.substr(eq+1).c_str());
+        }
+        cur = end+2;
+    }
+    return kw;
+}
+
+static void timeCall(const char *name, int count, std::function<void()> call) {
+    std::vector<double> t;
+    for (int i=0; i<count; ++i) {
+        double t0 = now();
+        call();
+        t.push_back((now()-t0)*1e6);
+    }
+    std::sort(t.begin(), t.end());
+    printf("rpc_%s_us: min=%.1f median=%.1f p99=%.1f max=%.1f\n", name,
+        t.front(), t[t.size()/2], t[(t.size()*99)/100], t.back());
+}
+
+static void usage(const char *prog) {
+    printf("usage: %s [-a <address[:port]>] [-D <driver>] [-d <device args>] [-s <stream args>]\n"
+        "\t[-f <format>] [-c <channels>] [-r <sample rate>] [-t <seconds>] [-n <rpc calls>] [-b <block>] [-x]\n"
+        "\t-D: remote driver (default tcpnull, the server's synthetic device)\n"
+        "\t-d: extra remote device args, separated by '/', eg: 'native=CS16/direct=8'\n"
+        "\t-s: stream args, eg: 'tcpremote:wire=CS8' or 'tcpremote:zerocopy=1'\n"
+        "\t-r: sample rate (default 10e6, 0 = as fast as the server can generate), -t: streaming time (default 5)\n"
+        "\t-n: calls per RPC latency test (default 200), -b: samples per read/write (default 8192)\n"
+        "\t-x: transmit instead of receive\n", prog);
+}
+
+int main(int argc, char **argv) {
+    std::string address = "127.0.0.1";
+    std::string driver = "tcpnull";
+    std::string devArgs;
+    std::string streamArgs;
+    std::string format = SOAPY_SDR_CS16;
+    size_t numChans = 1;
+    double rate = 10e6;
+    double secs = 5;
+    int calls = 200;
+    size_t blk = 8192;
+    int direction = SOAPY_SDR_RX;
+    int opt;
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    while ((opt=getopt(argc, argv, "a:D:d:s:f:c:r:t:n:b:xh"))!=-1) {
+        switch (opt) {
+        case 'a': address = optarg; break;
+        case 'D': driver = optarg; break;
+        case 'd': devArgs = optarg; break;
+        case 's': streamArgs = optarg; break;
+        case 'f': format = optarg; break;
+        case 'c': numChans = atoi(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 't': secs = atof(optarg); break;
+        case 'n': calls = atoi(optarg); break;
+        case 'b': blk = atol(optarg); break;
+        case 'x': direction = SOAPY_SDR_TX; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (numChans<1 || blk<1 || calls<1 || (format!=SOAPY_SDR_CS8 && format!=SOAPY_SDR_CS16 && format!=SOAPY_SDR_CF32)) {
+        usage(argv[0]);
+        return 1;
+    }
+    // the synthetic device needs enough channels, metadata caching would hide RPC latency
+    std::string remArgs = "tcpnull"==driver ? "chans="+std::to_string(numChans) : "";
+    if (devArgs.length()>0)
+        remArgs += (remArgs.length()>0 ? "/" : "")+devArgs;
+    std::string args = "driver=tcpremote,tcpremote:cache=0,tcpremote:address="+address+",tcpremote:driver="+driver;
+    if (remArgs.length()>0)
+        args += ",tcpremote:args="+remArgs;
+    SoapySDR::Kwargs sargs = SoapySDR::KwargsFromString(streamArgs);
+    // server side DSP sends fewer (and different) samples than the device makes
+    double decim = sargs.count("tcpremote:decim") ? atof(sargs.at("tcpremote:decim").c_str()) : 1;
+    bool dsp = decim!=1 || sargs.count("tcpremote:shift");
+    printf("device: %s\nstream: %s %s x%zu %s\n", args.c_str(), SOAPY_SDR_RX==direction ? "rx" : "tx",
+        format.c_str(), numChans, streamArgs.c_str());
+
+    double t0 = now();
+    SoapySDR::Device *dev;
+    try {
+        dev = SoapySDR::Device::make(args);
+    } catch (const std::exception &ex) {
+        printf("error: make failed: %s\n", ex.what());
+        return 2;
+    }
+    printf("make_ms: %.2f\n", (now()-t0)*1e3);
+
+    // RPC round trips
+    double freq = 100e6, gain = 10;
+    timeCall("getFrequency", calls, [&]{ freq = dev->getFrequency(direction, 0); });
+    timeCall("setFrequency", calls, [&]{ dev->setFrequency(direction, 0, freq); });
+    timeCall("getGain", calls, [&]{ gain = dev->getGain(direction, 0); });
+    timeCall("setGain", calls, [&]{ dev->setGain(direction, 0, gain); });
+    timeCall("getSampleRate", calls, [&]{ dev->getSampleRate(direction, 0); });
+    timeCall("listGains", calls, [&]{ dev->listGains(direction, 0); });
+    timeCall("getFrequencyRange", calls, [&]{ dev->getFrequencyRange(direction, 0); });
+    dev->setSampleRate(direction, 0, rate);
+
+    // stream setup
+    std::vector<size_t> channels;
+    for (size_t c=0; c<numChans; ++c)
+        channels.push_back(c);
+    t0 = now();
+    SoapySDR::Stream *stream = dev->setupStream(direction, format, channels, sargs);
+    if (!stream) {
+        printf("error: setupStream failed\n");
+        SoapySDR::Device::unmake(dev);
+        return 2;
+    }
+    printf("setupStream_ms: %.2f\n", (now()-t0)*1e3);
+    t0 = now();
+    if (dev->activateStream(stream)) {
+        printf("error: activateStream failed\n");
+        dev->closeStream(stream);
+        SoapySDR::Device::unmake(dev);
+        return 2;
+    }
+    double active = now();
+    printf("activateStream_ms: %.2f\n", (active-t0)*1e3);
+
+    size_t fSize = SOAPY_SDR_CF32==format ? 8 : SOAPY_SDR_CS16==format ? 4 : 2;
+    std::vector<std::vector<uint8_t>> bufs(numChans, std::vector<uint8_t>(blk*fSize));
+    std::vector<void *> buffs;
+    for (auto &b: bufs)
+        buffs.push_back(b.data());
+    // first samples may be waiting on the device, time from the first read
+    std::map<std::string, double> st0 = readStats(dev);
+    double c0 = cpuSecs();
+    double start = now(), first = 0, elapsed = 0;
+    uint64_t samples = 0, errors = 0, timeouts = 0, gaps = 0, overflows = 0;
+    uint32_t expect = 0, mask = SOAPY_SDR_CS8==format ? 0x7f : 0x7fff;
+    bool seen = false;
+    std::vector<double> delays;
+    while ((elapsed=now()-start)<secs) {
+        int flags = 0;
+        long long timeNs = 0;
+        int n;
+        if (SOAPY_SDR_RX==direction)
+            n = dev->readStream(stream, buffs.data(), blk, flags, timeNs, 1000000);
+        else
+            n = dev->writeStream(stream, (const void * const *)buffs.data(), blk, flags, 0, 1000000);
+        if (SOAPY_SDR_TIMEOUT==n) {
+            ++timeouts;
+            continue;
+        }
+        // lost data reported by the stream (framed, or UDP), the ramp check sees the gap too
+        if (SOAPY_SDR_OVERFLOW==n) {
+            ++overflows;
+            continue;
+        }
+        if (n<0) {
+            if (++errors>100)
+                break;
+            continue;
+        }
+        if (0==first)
+            first = now();
+        samples += n;
+        // delivery delay, from the synthetic device's time (zero at activation) to here
+        if ((flags & SOAPY_SDR_HAS_TIME) && "tcpnull"==driver && rate>0 && n>0)
+            delays.push_back((now()-active-timeNs*1e-9-n*decim/rate)*1e3);
+        // ramp check on channel 0 (synthetic device only)
+        if (SOAPY_SDR_RX==direction && "tcpnull"==driver && !dsp) {
+            for (int i=0; i<n; ++i) {
+                uint32_t v;
+                if (SOAPY_SDR_CF32==format)
+                    v = (uint32_t)(((float *)bufs[0].data())[2*i]*32767.0f+0.5f);
+                else if (SOAPY_SDR_CS16==format)
+                    v = (uint16_t)((int16_t *)bufs[0].data())[2*i];
+                else
+                    v = (uint8_t)((int8_t *)bufs[0].data())[2*i];
+                if (seen && (v&mask)!=expect)
+                    ++gaps;
+                expect = (v+1)&mask;
+                seen = true;
+            }
+        }
+    }
+    double cpu = cpuSecs()-c0;
+    std::map<std::string, double> st1 = readStats(dev);
+    double msps = samples/elapsed/1e6;
+    printf("first_samples_ms: %.2f\n", first>0 ? (first-start)*1e3 : -1.0);
+    if (delays.size()>0) {
+        std::sort(delays.begin(), delays.end());
+        printf("delay_ms: min=%.2f median=%.2f p99=%.2f max=%.2f\n", delays.front(),
+            delays[delays.size()/2], delays[(delays.size()*99)/100], delays.back());
+    }
+    printf("seconds: %.3f\nsamples: %llu\nmsps: %.3f\n", elapsed, (unsigned long long)samples, msps);
+    printf("client_cpu_percent: %.1f\nclient_cpu_percent_per_msps: %.2f\n",
+        cpu/elapsed*100, msps>0 ? cpu/elapsed*100/msps : 0.0);
+    if (st1.count("server_cpu_us")) {
+        double scpu = (st1["server_cpu_us"]-st0["server_cpu_us"])*1e-6;
+        printf("server_cpu_percent: %.1f\nserver_cpu_percent_per_msps: %.2f\n",
+            scpu/elapsed*100, msps>0 ? scpu/elapsed*100/msps : 0.0);
+    }
+    // losses: server pipe overruns/underruns and driver drops, plus any gaps seen here
+    uint64_t lost = (uint64_t)(st1["overruns"]+st1["underruns"]+st1["drops"]);
+    printf("server_overruns: %.0f\nserver_underruns: %.0f\nserver_drops: %.0f\n",
+        st1["overruns"], st1["underruns"], st1["drops"]);
+    printf("gaps: %llu\noverflows: %llu\ntimeouts: %llu\nerrors: %llu\n", (unsigned long long)gaps,
+        (unsigned long long)overflows, (unsigned long long)timeouts, (unsigned long long)errors);
+    if (SOAPY_SDR_RX==direction && st1["samples_in"]>0)
+        printf("loss_percent: %.4f\n", 100.0*(st1["samples_in"]/decim-st1["samples_out"])/(st1["samples_in"]/decim));
+    if (st1.count("device_calls") && st1["device_calls"]>0)
+        printf("device_call_us: %.1f\n", st1["device_us"]/st1["device_calls"]);
+    printf("send_stall_ms: %.1f\n", st1["stall_us"]/1e3);
+
+    t0 = now();
+    dev->deactivateStream(stream);
+    printf("deactivateStream_ms: %.2f\n", (now()-t0)*1e3);
+    t0 = now();
+    dev->closeStream(stream);
+    printf("closeStream_ms: %.2f\n", (now()-t0)*1e3);
+    t0 = now();
+    SoapySDR::Device::unmake(dev);
+    printf("unmake_ms: %.2f\n", (now()-t0)*1e3);
+    return (errors || lost || gaps) ? 3 : 0;
+}
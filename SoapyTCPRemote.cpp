@@ -4,12 +4,40 @@
 
 #include "SoapyTCPRemote.hpp"
 #include "SoapyLog.hpp"
+#include "SoapyConvert.hpp"
+#include "SoapySocket.hpp"
+#include "SoapyDatagram.hpp"
+#include "SoapyShm.hpp"
+#include "SoapyURing.hpp"
 
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <poll.h>
 #include <netdb.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// configuration file lookup (see below)
+std::string getConfValue(const std::string &key);
+
+// receive buffer size (bytes), see fillStream
+#define TCPREMOTE_RXBUF (256*1024)
+// io_uring provided receive buffers (see SoapyURing.hpp): size (bytes) & count (a power of two)
+#define TCPREMOTE_URING_BUF (64*1024)
+#define TCPREMOTE_URING_BUFS 16
+// resumable sessions (see resumeRpc): connect attempts, wait between them & for replies (usecs)
+#define TCPREMOTE_RESUME_CONNECT_US 1000000L
+#define TCPREMOTE_RESUME_BACKOFF_US 250000L
+#define TCPREMOTE_RESUME_REPLY_US 5000000L
+// finding devices (see findTCPRemote): how long each server has to answer, and answers are reused for (msecs)
+#define TCPREMOTE_FIND_TIMEOUT_MS 1000
+#define TCPREMOTE_FIND_CACHE_MS 2000
 
 // declare the contents of a Stream object for ourselves
 class SoapySDR::Stream
@@ -19,49 +47,195 @@ public:
     int remoteId;
     int numChans;
     size_t fSize;
+    convert_t cnv;
+    float scale;
+    interleave_t ilv;
+    std::vector<uint8_t> txbuf;
+    // (transmit) the rest of a frame or header a timeout left part sent, and the frames a
+    // framed block still owes (its header has gone), both sent ahead of the next block
+    std::vector<uint8_t> txStub;
+    size_t txOwed;
     bool running;
+    // framed data mode state (see SoapyRPCDataHeader), current block & stream events
+    bool framed;
+    bool planar;
+    // server side decimation, stream rate is the device rate / decim
+    long decim;
+    SoapyRPCDataHeader hdr;
+    size_t blkLeft;
+    size_t blkDone;
+    uint64_t expect;
+    double rate;
+    size_t chan0;
+    // receive buffer, filled by large recv()s and drained by readStream, carries
+    // partial frames & blocks between calls: held data is rxbuf[rxHead..rxTail)
+    std::vector<uint8_t> rxbuf;
+    size_t rxHead;
+    size_t rxTail;
+    // UDP transport (see SoapyDatagram.hpp): socket (-1 if not), receive slot size, and
+    // the frame count expected next (set by the first datagram), older ones are dropped
+    int udpSock;
+    size_t udpSlot;
+    bool udpSync;
+    uint64_t udpNext;
+    uint64_t udpLate;
+    // shared memory transport (see SoapyShm.hpp): the server's pipe (null if not), which we
+    // read in place, mirrored at shmData, our mapping's length, and where rxHead was when
+    // last filled, the bytes since are handed back on the next fill
+    pipebuf_t *shm;
+    uint8_t *shmData;
+    size_t shmMap;
+    size_t shmHead;
+#ifdef TCPREMOTE_IO_URING
+    // io_uring receives (tcpremote:uring=1) instead of recv(), null if not
+    URingReceiver *uring;
+#endif
+    struct StreamEvent {
+        int code;
+        int flags;
+        long long timeNs;
+    };
+    std::mutex evLock;
+    std::condition_variable evCond;
+    std::deque<StreamEvent> events;
+    // client side counters (see readSensor("tcpremote:stats"))
+    int direction;
+    uint64_t calls;
+    uint64_t timeouts;
+    uint64_t elems;
+    uint64_t netBytes;
+    size_t maxElems;
+    // socket options for the data connection, applied once the rate is known (bytes/sec)
+    SocketTuning tuning;
+    double byteRate;
+    // resumable session (see resumeStream): lost connection & since when, netBytes when last
+    // (re)attached, frames a resumed transmit stream need not send again, and the counts
+    bool broken;
+    std::chrono::steady_clock::time_point brokenAt;
+    uint64_t attachBytes;
+    uint64_t resumeSkip;
+    uint64_t resumes;
+    uint64_t resumeLost;
 };
 
-SoapyTCPRemote::SoapyTCPRemote(const std::string &address, const std::string &port, const std::string &remdriver, const std::string &remargs) :
+// count one read/write call and the frames it moved
+static inline int countCall(SoapySDR::Stream *stream, int rv)
+{
+    ++stream->calls;
+    if (SOAPY_SDR_TIMEOUT==rv)
+        ++stream->timeouts;
+    if (rv>0) {
+        stream->elems += rv;
+        if ((size_t)rv>stream->maxElems)
+            stream->maxElems = rv;
+    }
+    return rv;
+}
+
+#ifdef TCPREMOTE_IO_URING
+// receive the stream's data connection through io_uring, if this kernel lets us
+static void openURing(SoapySDR::Stream *stream)
+{
+    stream->uring = new URingReceiver();
+    if (!stream->uring->open(stream->netSock, TCPREMOTE_URING_BUF, TCPREMOTE_URING_BUFS)) {
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote: io_uring unavailable (%s), using recv", strerror(errno));
+        delete stream->uring;
+        stream->uring = nullptr;
+        return;
+    }
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote: io_uring receive: %d", stream->netSock);
+}
+#endif
+
+SoapyTCPRemote::SoapyTCPRemote(const std::string &address, const std::string &port, const std::string &remdriver, const std::string &remargs, const SoapySDR::Kwargs &options) :
     remoteAddress(address),
     remotePort(port),
     remoteDriver(remdriver),
-    remoteArgs(remargs)
+    remoteArgs(remargs),
+    remoteOptions(options),
+    logEnded(false),
+    sessionId(-1),
+    sessionHold(0),
+    metaValid(false)
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::<cons>(%s,%s,%s,%s)",
         address.c_str(), port.c_str(), remdriver.c_str(), remargs.c_str());
-    int status = connectLogStream(detectLogLevel());
+    // cache the level for trace points in the stream paths, and ask the server for the same
+    SoapySDRLogLevel level = detectLogLevel();
+    setLogLevel(level);
+    logLevel = level;
+    int status = connectLogStream(level);
     if (status<0)
         throw std::runtime_error("unable to connect log stream");
     int sock = connect();
     if (sock<0)
         throw std::runtime_error("unable to connect to remote");
+    setNoDelay(sock);
     rpc = new SoapyRPC(sock);
     status = loadRemoteDriver();
     if (status<0)
         throw std::runtime_error("unable to load remote driver");
+    // opt-in: ask the server to hold on for us if the connection is lost (binary only)
+    if (remoteOptions.count("tcpremote:resume") && rpc->isBinary()) {
+        double hold = atof(remoteOptions.at("tcpremote:resume").c_str());
+        if (hold>0) {
+            rpc->writeCall(TCPREMOTE_OPEN_SESSION);
+            rpc->writeDouble(hold);
+            if (rpc->readInteger()==0) {
+                sessionToken = rpc->readString();
+                sessionId = status;
+                sessionHold = hold;
+                rpc->onFail = [this]{ return resumeRpc(); };
+            } else {
+                SoapySDR_log(SOAPY_SDR_WARNING, "SoapyTCPRemote: remote does not support resumable sessions");
+            }
+        }
+    }
+    // opt-in: don't wait for setter completion
+    if (remoteOptions.find("tcpremote:pipeline")!=remoteOptions.end() && remoteOptions.at("tcpremote:pipeline")!="0")
+        rpc->setPipelined(true);
+    // prefetch constant metadata unless asked not to
+    metaEnabled = remoteOptions.find("tcpremote:cache")==remoteOptions.end() || remoteOptions.at("tcpremote:cache")!="0";
+    if (metaEnabled)
+        describe();
 }
 
 SoapyTCPRemote::~SoapyTCPRemote()
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::<dest>");
     if (rpc) {
-        rpc->writeString(TCPREMOTE_RPC_SEP);
-        rpc->writeInteger(TCPREMOTE_DROP_RPC);
+        rpc->writeCall(TCPREMOTE_DROP_RPC);
         delete rpc;
         rpc = nullptr;
     }
     if (log) {
-        // writing to this stream terminates it via the remote end
-        write(fileno(log), "\n", 1);
+        // writing to this stream terminates it via the remote end (unless it has already ended)
+        if (!logEnded)
+            send(fileno(log), "\n", 1, MSG_NOSIGNAL);
         logThread.join();
     }
 }
 
-// private connector method
-int SoapyTCPRemote::connect() const
+// connect to a server, a timeout (when resuming, or finding devices) gives up on unresponsive
+// servers, quietly. -1 if we can't
+static int connectTo(const std::string &address, const std::string &port, long timeoutUs)
 {
-    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::connect()");
+    SoapySDR_log(SOAPY_SDR_TRACE, "connectTo()");
+    SoapySDRLogLevel level = timeoutUs<0 ? SOAPY_SDR_ERROR : SOAPY_SDR_DEBUG;
+    // server on this host, at a Unix domain socket?
+    struct sockaddr_un uaddr;
+    socklen_t ulen;
+    if (unixAddress(address, uaddr, ulen)) {
+        int sock = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        if (sock<0 || ::connect(sock, (struct sockaddr *)&uaddr, ulen)) {
+            SoapySDR_logf(level, "Failed to connect to %s: %s", address.c_str(), strerror(errno));
+            if (sock>=0)
+                close(sock);
+            return -1;
+        }
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote: connected: %s", address.c_str());
+        return sock;
+    }
     // create new socket
     int sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock < 0) {
@@ -70,34 +244,147 @@ int SoapyTCPRemote::connect() const
     }
     // resolve address (or parse)
     struct addrinfo *res = nullptr;
-    if (getaddrinfo(remoteAddress.c_str(), remotePort.c_str(), nullptr, &res)) {
-        SoapySDR_logf(SOAPY_SDR_ERROR, "Failed to resolve address/port: %s/%s: %s",
-            remoteAddress.c_str(), remotePort.c_str(), strerror(errno));
+    if (getaddrinfo(address.c_str(), port.c_str(), nullptr, &res)) {
+        SoapySDR_logf(level, "Failed to resolve address/port: %s/%s: %s",
+            address.c_str(), port.c_str(), strerror(errno));
         close(sock);
         return -1;
     }
-    // attempt connection to remote server
-    if (::connect(sock, res->ai_addr, res->ai_addrlen)) {
-        SoapySDR_logf(SOAPY_SDR_ERROR, "Failed to connect to address/port: %s/%s: %s",
-            remoteAddress.c_str(), remotePort.c_str(), strerror(errno));
+    // attempt connection to remote server (in the background, if we can't wait for ever)
+    int flags = fcntl(sock, F_GETFL);
+    if (timeoutUs>=0)
+        fcntl(sock, F_SETFL, flags|O_NONBLOCK);
+    int rv = ::connect(sock, res->ai_addr, res->ai_addrlen);
+    if (rv && EINPROGRESS==errno) {
+        struct pollfd pfd = { sock, POLLOUT, 0 };
+        int err = ETIMEDOUT;
+        socklen_t len = sizeof(err);
+        if (poll(&pfd, 1, (int)(timeoutUs/1000))>0)
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len);
+        errno = err;
+        rv = err ? -1 : 0;
+    }
+    fcntl(sock, F_SETFL, flags);
+    if (rv) {
+        SoapySDR_logf(level, "Failed to connect to address/port: %s/%s: %s",
+            address.c_str(), port.c_str(), strerror(errno));
         freeaddrinfo(res);
         close(sock);
         return -1;
     }
     freeaddrinfo(res);
     SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote: connected: %s/%s",
-            remoteAddress.c_str(), remotePort.c_str());
+            address.c_str(), port.c_str());
     return sock;
 }
 
+// private connector method
+int SoapyTCPRemote::connect(long timeoutUs) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::connect()");
+    return connectTo(remoteAddress, remotePort, timeoutUs);
+}
+
 int SoapyTCPRemote::loadRemoteDriver() const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::loadRemoteDriver()");
     // identify this connection as an RPC stream load the remote driver
     rpc->writeInteger(TCPREMOTE_RPC_LOAD);
     rpc->writeString(remoteDriver);
-    rpc->writeString(remoteArgs);
-    return rpc->readInteger();
+    // ask for a device shared with other clients, with the server's own device arg
+    std::string args = remoteArgs;
+    if (remoteOptions.find("tcpremote:share")!=remoteOptions.end() && remoteOptions.at("tcpremote:share")!="0")
+        args += std::string(args.empty() ? "" : "/") + "tcpremote:share=1";
+    rpc->writeString(args);
+    int id = rpc->readInteger();
+    if (id<0)
+        return id;
+    // negotiate binary framing unless asked not to, older servers reply with an error
+    // and we stay with text.
+    if (remoteOptions.find("tcpremote:rpc")==remoteOptions.end() || remoteOptions.at("tcpremote:rpc")!="text") {
+        rpc->writeCall(TCPREMOTE_RPC_BINARY);
+        if (rpc->readInteger()==1)
+            rpc->setBinary();
+        else
+            SoapySDR_log(SOAPY_SDR_DEBUG, "SoapyTCPRemote: remote does not support binary RPC, using text");
+    }
+    return id;
+}
+
+SoapySDR::RangeList SoapyTCPRemote::readRangeList() const
+{
+    // read triplets of beg/end/step until step<0
+    SoapySDR::RangeList list;
+    while (!rpc->isError()) {
+        double beg = rpc->readDouble();
+        double end = rpc->readDouble();
+        double step = rpc->readDouble();
+        if (step<0)
+            break;
+        list.push_back(SoapySDR::Range(beg,end,step));
+    }
+    return list;
+}
+
+// fetch (or refresh) all constant metadata in one call, returns false if unavailable
+bool SoapyTCPRemote::describe() const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::describe()");
+    metaValid = false;
+    // as with batches, not safe to try on a text connection
+    if (!rpc->isBinary()) {
+        metaEnabled = false;
+        return false;
+    }
+    rpc->writeCall(TCPREMOTE_DESCRIBE);
+    int status = rpc->readInteger();
+    if (status!=0) {
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote::describe, not supported by remote: %d", status);
+        metaEnabled = false;
+        return false;
+    }
+    metaHardwareKey = rpc->readString();
+    metaHardwareInfo = rpc->readKwargs();
+    for (int dir=SOAPY_SDR_TX; dir<=SOAPY_SDR_RX; ++dir) {
+        int num = rpc->readInteger();
+        meta[dir].clear();
+        for (int chn=0; chn<num && !rpc->isError(); ++chn) {
+            ChannelMeta cm;
+            cm.nativeFormat = rpc->readString();
+            cm.fullScale = rpc->readDouble();
+            cm.formats = rpc->readStrVector();
+            cm.gains = rpc->readStrVector();
+            double min = rpc->readDouble();
+            double max = rpc->readDouble();
+            double step = rpc->readDouble();
+            cm.gainRange = SoapySDR::Range(min, max, step);
+            for (auto &nam: cm.gains) {
+                min = rpc->readDouble();
+                max = rpc->readDouble();
+                step = rpc->readDouble();
+                cm.gainRanges[nam] = SoapySDR::Range(min, max, step);
+            }
+            cm.freqRange = readRangeList();
+            cm.rateRange = readRangeList();
+            meta[dir].push_back(cm);
+        }
+    }
+    metaValid = !rpc->isError();
+    return metaValid;
+}
+
+bool SoapyTCPRemote::haveMeta(const int direction) const
+{
+    if (!metaEnabled || (direction!=SOAPY_SDR_TX && direction!=SOAPY_SDR_RX))
+        return false;
+    return metaValid || describe();
+}
+
+const SoapyTCPRemote::ChannelMeta *SoapyTCPRemote::getMeta(const int direction, const size_t channel) const
+{
+    if (!haveMeta(direction) || channel>=meta[direction].size())
+        return nullptr;
+    return &meta[direction][channel];
 }
 
 int SoapyTCPRemote::connectLogStream(SoapySDRLogLevel level)
@@ -107,6 +394,7 @@ int SoapyTCPRemote::connectLogStream(SoapySDRLogLevel level)
     int sock = connect();
     if (sock<0)
         return sock;
+    setNoDelay(sock);
     log = fdopen(sock, "r+");
     if (!log) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "fdopen() log stream: %s", strerror(errno));
@@ -128,6 +416,7 @@ int SoapyTCPRemote::connectLogStream(SoapySDRLogLevel level)
     return 0;
 }
 
+// the server's log connection, ending with it (see resumeRpc)
 void SoapyTCPRemote::processLogStream(SoapyTCPRemote *rem)
 {
     char msg[256];
@@ -146,22 +435,165 @@ void SoapyTCPRemote::processLogStream(SoapyTCPRemote *rem)
         SoapySDR_log(lev, msg);
     }
     fclose(rem->log);
+    rem->logEnded = true;
+}
+
+// the RPC connection has failed (see SoapyRPC::onFail): while the server holds our session,
+// reconnect & take it back (resuming streams is left to them, see resumeStream), then bring
+// back the log stream if that has gone too. False once the session is gone.
+bool SoapyTCPRemote::resumeRpc()
+{
+    std::lock_guard<std::mutex> lock(resumeLock);
+    if (!rpc->isError())
+        return true;
+    SoapySDR_logf(SOAPY_SDR_WARNING, "SoapyTCPRemote: lost connection to %s, resuming session", remoteAddress.c_str());
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(sessionHold);
+    while (std::chrono::steady_clock::now()<deadline) {
+        int sock = connect(TCPREMOTE_RESUME_CONNECT_US);
+        if (sock>=0) {
+            char line[96];
+            int len = snprintf(line, sizeof(line), "%d\n%d %s\n", TCPREMOTE_RPC_RESUME, sessionId, sessionToken.c_str());
+            // a refusal is a text line ("-1"), our ID comes back as a binary reply
+            struct pollfd pfd = { sock, POLLIN, 0 };
+            char first = 0;
+            bool replied = send(sock, line, len, MSG_NOSIGNAL)==len &&
+                poll(&pfd, 1, (int)(TCPREMOTE_RESUME_REPLY_US/1000))>0 && recv(sock, &first, 1, MSG_PEEK)==1;
+            if (replied && '-'==first) {
+                close(sock);
+                break;
+            }
+            if (replied && rpc->resume(sock)) {
+                if (rpc->readInteger()==sessionId) {
+                    setNoDelay(rpc->socket());
+                    SoapySDR_logf(SOAPY_SDR_INFO, "SoapyTCPRemote: resumed session with %s", remoteAddress.c_str());
+                    if (logEnded && log) {
+                        logThread.join();
+                        log = nullptr;
+                        logEnded = false;
+                        if (connectLogStream(logLevel)<0)
+                            SoapySDR_log(SOAPY_SDR_WARNING, "SoapyTCPRemote: unable to reconnect log stream");
+                    }
+                    return true;
+                }
+            } else {
+                close(sock);
+            }
+        }
+        usleep(TCPREMOTE_RESUME_BACKOFF_US);
+    }
+    SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote: unable to resume session with %s", remoteAddress.c_str());
+    sessionToken.clear();
+    return false;
+}
+
+// a data connection has failed (or has not yet been resumed): one attempt at reattaching it
+// to the stream the server is holding for us, which says how many frames were lost (received),
+// or for transmit streams, how many arrived. 1 if resumed, 0 to try again later, -1 if never.
+int SoapyTCPRemote::resumeStream(SoapySDR::Stream *stream, const long timeoutUs)
+{
+    if (sessionToken.empty() || stream->udpSock>=0 || stream->shm)
+        return -1;
+    auto now = std::chrono::steady_clock::now();
+    if (!stream->broken) {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "SoapyTCPRemote: stream %d lost its connection, resuming", stream->remoteId);
+        stream->broken = true;
+        stream->brokenAt = now;
+    }
+    if (now-stream->brokenAt>std::chrono::duration<double>(sessionHold)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote: unable to resume stream %d", stream->remoteId);
+        sessionToken.clear();
+        return -1;
+    }
+    int sock = connect(timeoutUs>TCPREMOTE_RESUME_CONNECT_US ? timeoutUs : TCPREMOTE_RESUME_CONNECT_US);
+    if (sock<0)
+        return 0;
+    // what we have had of the data since it was last attached (not counting any we drop now)
+    size_t frameSize = stream->fSize*stream->numChans;
+    uint64_t got = stream->netBytes-stream->attachBytes;
+    if (SOAPY_SDR_RX==stream->direction)
+        got -= stream->rxTail-stream->rxHead;
+    char line[128];
+    int len = snprintf(line, sizeof(line), "%d\n%d %s %llu\n", TCPREMOTE_DATA_RESUME, stream->remoteId,
+        sessionToken.c_str(), (unsigned long long)got);
+    if (send(sock, line, len, MSG_NOSIGNAL)!=len) {
+        close(sock);
+        return 0;
+    }
+    // one line reply, "-1" if the server has given up on us
+    len = 0;
+    auto deadline = now + std::chrono::microseconds(TCPREMOTE_RESUME_REPLY_US);
+    while (len<(int)sizeof(line)-1 && (0==len || line[len-1]!='\n')) {
+        long left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        if (left<=0 || poll(&pfd, 1, (int)((left+999)/1000))<=0 || recv(sock, line+len, 1, 0)!=1)
+            break;
+        ++len;
+    }
+    line[len] = 0;
+    if (0==len || line[len-1]!='\n' || '-'==line[0]) {
+        close(sock);
+        if ('-'==line[0]) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote: stream %d refused to resume", stream->remoteId);
+            sessionToken.clear();
+            return -1;
+        }
+        return 0;
+    }
+    uint64_t count = strtoull(line, nullptr, 10);
+    if (dup2(sock, stream->netSock)<0) {
+        close(sock);
+        return 0;
+    }
+    close(sock);
+    tuneDataSocket(stream->netSock, SOAPY_SDR_TX==stream->direction, stream->byteRate, stream->tuning);
+#ifdef TCPREMOTE_IO_URING
+    // (the old receive went with the old socket)
+    if (stream->uring) {
+        delete stream->uring;
+        stream->uring = nullptr;
+        openURing(stream);
+    }
+#endif
+    // start afresh (whatever we held is now counted as lost), for framed streams the next
+    // block's count shows the gap
+    stream->rxHead = stream->rxTail = 0;
+    stream->blkLeft = stream->blkDone = 0;
+    stream->attachBytes = stream->netBytes;
+    stream->resumeSkip = 0;
+    stream->txStub.clear();
+    stream->txOwed = 0;
+    uint64_t lost = count;
+    if (SOAPY_SDR_TX==stream->direction) {
+        // count arrived of the frames we sent, perhaps followed by some of the block that failed
+        uint64_t sent = got/frameSize;
+        lost = sent>count ? sent-count : 0;
+        stream->resumeSkip = count>sent ? count-sent : 0;
+        stream->attachBytes += stream->resumeSkip*frameSize;
+    }
+    stream->broken = false;
+    ++stream->resumes;
+    stream->resumeLost += lost;
+    SoapySDR_logf(SOAPY_SDR_INFO, "SoapyTCPRemote: resumed stream %d, %llu frames lost", stream->remoteId,
+        (unsigned long long)lost);
+    return 1;
 }
 
 // Identification API
 std::string SoapyTCPRemote::getHardwareKey() const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getHardwareKey()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_HARDWARE_KEY);
+    if (haveMeta(SOAPY_SDR_RX))
+        return metaHardwareKey;
+    rpc->writeCall(TCPREMOTE_GET_HARDWARE_KEY);
     return rpc->readString();
 }
 
 SoapySDR::Kwargs SoapyTCPRemote::getHardwareInfo() const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getHardwareInfo()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_HARDWARE_INFO);
+    if (haveMeta(SOAPY_SDR_RX))
+        return metaHardwareInfo;
+    rpc->writeCall(TCPREMOTE_GET_HARDWARE_INFO);
     return rpc->readKwargs();
 }
 
@@ -169,18 +601,17 @@ SoapySDR::Kwargs SoapyTCPRemote::getHardwareInfo() const
 void SoapyTCPRemote::setFrontendMapping(const int direction, const std::string &mapping)
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::setFrontendMapping()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_SET_FRONTEND_MAPPING);
+    metaValid = false;
+    rpc->writeCall(TCPREMOTE_SET_FRONTEND_MAPPING);
     rpc->writeInteger(direction);
     rpc->writeString(mapping);
-    rpc->readInteger(); // wait for completion!
+    rpc->readStatus(); // wait for completion (unless pipelined)!
 }
 
 std::string SoapyTCPRemote::getFrontendMapping(const int direction) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrontendMapping()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_FRONTEND_MAPPING);
+    rpc->writeCall(TCPREMOTE_GET_FRONTEND_MAPPING);
     rpc->writeInteger(direction);
     return rpc->readString();
 }
@@ -188,8 +619,9 @@ std::string SoapyTCPRemote::getFrontendMapping(const int direction) const
 size_t SoapyTCPRemote::getNumChannels(const int dir) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getNumChannels()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_NUM_CHANNELS);
+    if (haveMeta(dir))
+        return meta[dir].size();
+    rpc->writeCall(TCPREMOTE_GET_NUM_CHANNELS);
     rpc->writeInteger(dir);
     return rpc->readInteger();
 }
@@ -197,8 +629,7 @@ size_t SoapyTCPRemote::getNumChannels(const int dir) const
 SoapySDR::Kwargs SoapyTCPRemote::getChannelInfo(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getChannelInfo()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_CHANNEL_INFO);
+    rpc->writeCall(TCPREMOTE_GET_CHANNEL_INFO);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return rpc->readKwargs();
@@ -207,8 +638,7 @@ SoapySDR::Kwargs SoapyTCPRemote::getChannelInfo(const int direction, const size_
 bool SoapyTCPRemote::getFullDuplex(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFullDuplex()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_FULL_DUPLEX);
+    rpc->writeCall(TCPREMOTE_GET_FULL_DUPLEX);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return rpc->readInteger()>0;
@@ -217,8 +647,10 @@ bool SoapyTCPRemote::getFullDuplex(const int direction, const size_t channel) co
 std::vector<std::string> SoapyTCPRemote::getStreamFormats(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getStreamFormats()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_STREAM_FORMATS);
+    const ChannelMeta *cm = getMeta(direction, channel);
+    if (cm)
+        return cm->formats;
+    rpc->writeCall(TCPREMOTE_GET_STREAM_FORMATS);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return rpc->readStrVector();
@@ -227,8 +659,12 @@ std::vector<std::string> SoapyTCPRemote::getStreamFormats(const int direction, c
 std::string SoapyTCPRemote::getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getNativeStreamFormat()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_STREAM_NATIVE_FORMAT);
+    const ChannelMeta *cm = getMeta(direction, channel);
+    if (cm) {
+        fullScale = cm->fullScale;
+        return cm->nativeFormat;
+    }
+    rpc->writeCall(TCPREMOTE_GET_STREAM_NATIVE_FORMAT);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     std::string fmt = rpc->readString();
@@ -239,8 +675,7 @@ std::string SoapyTCPRemote::getNativeStreamFormat(const int direction, const siz
 SoapySDR::ArgInfoList SoapyTCPRemote::getStreamArgsInfo(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getStreamArgsInfo()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_STREAM_ARGS_INFO);
+    rpc->writeCall(TCPREMOTE_GET_STREAM_ARGS_INFO);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     SoapySDR::ArgInfoList info;
@@ -277,13 +712,137 @@ SoapySDR::Stream *SoapyTCPRemote::setupStream(const int direction, const std::st
         SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, unknown native format (%s)", fmtnat.c_str());
         return nullptr;
     }
-    // choose smallest wire format..
+    // choose smallest device format..
+    std::string fmtdev;
     if (g_frameSizes.at(fmtnat)<g_frameSizes.at(format)) {
-        fmtwire = fmtnat;
-        fmtout = format;
+        fmtdev = fmtnat;
     } else {
-        fmtwire = format;
-        fmtout = format;
+        fmtdev = format;
+    }
+    fmtwire = fmtdev;
+    fmtout = format;
+    // ..optionally quantised further by the server (RX only, needs a server that understands us)
+    SoapySDR::Kwargs sargs = args;
+    float scale = 1.0f;
+    // server side DSP (frequency shift & decimation) works in floats, so is sent as requested
+    // rather than in a smaller native format, at the device rate / decim
+    long decim = 1;
+    if (sargs.find("tcpremote:decim")!=sargs.end() || sargs.find("tcpremote:shift")!=sargs.end()) {
+        if (SOAPY_SDR_RX!=direction || !rpc->isBinary()) {
+            SoapySDR_log(SOAPY_SDR_WARNING, "SoapyTCPRemote::setupStream, tcpremote:decim/shift ignored (RX with binary RPC only)");
+            sargs.erase("tcpremote:decim");
+            sargs.erase("tcpremote:shift");
+        } else {
+            if (sargs.find("tcpremote:decim")!=sargs.end())
+                decim = atol(sargs.at("tcpremote:decim").c_str());
+            if (decim<1) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, invalid tcpremote:decim (%ld)", decim);
+                return nullptr;
+            }
+            fmtdev = fmtwire = format;
+        }
+    }
+    if (sargs.find("tcpremote:wire")!=sargs.end()) {
+        std::string wire = sargs.at("tcpremote:wire");
+        if (SOAPY_SDR_RX!=direction || !rpc->isBinary()) {
+            SoapySDR_log(SOAPY_SDR_WARNING, "SoapyTCPRemote::setupStream, tcpremote:wire ignored (RX with binary RPC only)");
+            sargs.erase("tcpremote:wire");
+        } else if (g_frameSizes.find(wire)==g_frameSizes.end() || !getConverter(wire, format)) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, unknown wire format (%s)", wire.c_str());
+            return nullptr;
+        } else if (wire!=fmtdev) {
+            // float samples are quantised relative to the device full scale unless told otherwise
+            if (sargs.find("tcpremote:scale")==sargs.end())
+                sargs["tcpremote:scale"] = std::to_string(fmtdev=="CF32" ? fs : 1.0);
+            scale = (float)atof(sargs.at("tcpremote:scale").c_str());
+            fmtwire = wire;
+        } else {
+            sargs.erase("tcpremote:wire");
+        }
+    }
+    if (SOAPY_SDR_TX==direction && !getInterleaver(format, fmtwire)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, unable to transmit %s as %s", format.c_str(), fmtwire.c_str());
+        return nullptr;
+    }
+    // framed data (timestamps, flags & loss accounting), needs a server that understands us,
+    // transmit streams are framed unless told not to (so bursts end, and start on time)
+    bool framed = false;
+    if (SOAPY_SDR_TX==direction && rpc->isBinary() && sargs.find("tcpremote:framed")==sargs.end())
+        sargs["tcpremote:framed"] = "1";
+    if (sargs.find("tcpremote:framed")!=sargs.end()) {
+        if (!rpc->isBinary()) {
+            SoapySDR_log(SOAPY_SDR_WARNING, "SoapyTCPRemote::setupStream, tcpremote:framed ignored (binary RPC only)");
+            sargs.erase("tcpremote:framed");
+        } else if (sargs.at("tcpremote:framed")!="0") {
+            framed = true;
+        } else {
+            sargs.erase("tcpremote:framed");
+        }
+    }
+    // planar blocks (each channel contiguous, no interleaving), always framed
+    bool planar = false;
+    if (sargs.find("tcpremote:planar")!=sargs.end()) {
+        if (SOAPY_SDR_RX!=direction || !rpc->isBinary()) {
+            SoapySDR_log(SOAPY_SDR_WARNING, "SoapyTCPRemote::setupStream, tcpremote:planar ignored (RX with binary RPC only)");
+            sargs.erase("tcpremote:planar");
+        } else {
+            planar = sargs.at("tcpremote:planar")!="0";
+            framed = framed || planar;
+        }
+    }
+    // UDP transport for the data, unicast back to us or multicast, always framed
+    std::string udp;
+    if (sargs.find("tcpremote:udp")!=sargs.end()) {
+        if (SOAPY_SDR_RX!=direction || !rpc->isBinary()) {
+            SoapySDR_log(SOAPY_SDR_WARNING, "SoapyTCPRemote::setupStream, tcpremote:udp ignored (RX with binary RPC only)");
+            sargs.erase("tcpremote:udp");
+        } else if (sargs.at("tcpremote:udp")!="0") {
+            udp = sargs.at("tcpremote:udp");
+            framed = true;
+        } else {
+            sargs.erase("tcpremote:udp");
+        }
+    }
+    // shared memory transport for the data, from a server on this host (unix:<path> address)
+    bool shm = false;
+    if (sargs.find("tcpremote:shm")!=sargs.end()) {
+        if (SOAPY_SDR_RX!=direction || !rpc->isBinary() || remoteAddress.compare(0, 5, "unix:")!=0 || udp.length()>0) {
+            SoapySDR_log(SOAPY_SDR_WARNING, "SoapyTCPRemote::setupStream, tcpremote:shm ignored (RX with binary RPC, at a unix: address, without UDP only)");
+            sargs.erase("tcpremote:shm");
+        } else if (sargs.at("tcpremote:shm")!="0") {
+            shm = true;
+        } else {
+            sargs.erase("tcpremote:shm");
+        }
+    }
+    // io_uring for the data connection at both ends (each falls back to plain calls if it has to)
+#ifdef TCPREMOTE_IO_URING
+    bool uring = false;
+#endif
+    if (sargs.find("tcpremote:uring")!=sargs.end()) {
+        if (SOAPY_SDR_RX!=direction || !rpc->isBinary() || udp.length()>0 || shm) {
+            SoapySDR_log(SOAPY_SDR_WARNING, "SoapyTCPRemote::setupStream, tcpremote:uring ignored (RX with binary RPC, over TCP only)");
+            sargs.erase("tcpremote:uring");
+        } else if (sargs.at("tcpremote:uring")!="0") {
+#ifdef TCPREMOTE_IO_URING
+            uring = true;
+#else
+            // (still passed on, the server's end may have it)
+            SoapySDR_log(SOAPY_SDR_DEBUG, "SoapyTCPRemote::setupStream, built without io_uring, receiving with recv");
+#endif
+        } else {
+            sargs.erase("tcpremote:uring");
+        }
+    }
+    // socket tuning, defaults from our configuration file, passed on so both ends agree
+    static const char *tuneKeys[] = { "buffer", "sockbuf", "lowat", "busypoll", "nodelay" };
+    for (auto key: tuneKeys) {
+        std::string opt = std::string("tcpremote:")+key;
+        if (sargs.find(opt)==sargs.end()) {
+            std::string val = getConfValue(key);
+            if (val.length()>0)
+                sargs[opt] = val;
+        }
     }
     // in order to help the remote side associate the data stream with the setup call,
     // we create the data connection *first*, then send it's remoteId as the first
@@ -309,19 +868,86 @@ SoapySDR::Stream *SoapyTCPRemote::setupStream(const int direction, const std::st
         close(data);
         return nullptr;
     }
+    // our datagram socket: at the address the server sees for the data connection (telling
+    // it the port), or joining the multicast group
+    int udpSock = -1;
+    size_t udpSlot = 0;
+    if (udp.length()>0) {
+        struct sockaddr_storage addr;
+        socklen_t alen = sizeof(addr);
+        bool unicast = "1"==udp;
+        if (unicast) {
+            getsockname(data, (struct sockaddr *)&addr, &alen);
+            if (AF_INET6==addr.ss_family)
+                ((struct sockaddr_in6 *)&addr)->sin6_port = 0;
+            else
+                ((struct sockaddr_in *)&addr)->sin_port = 0;
+        } else if (!dgramAddress(udp, nullptr, addr, alen) || !dgramIsMulticast(addr)) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, tcpremote:udp must be 1 or <group>:<port> (%s)", udp.c_str());
+            close(data);
+            return nullptr;
+        }
+        bool gro = sargs.find("tcpremote:gro")!=sargs.end() && sargs.at("tcpremote:gro")!="0";
+        udpSock = dgramListen(addr, alen, gro);
+        if (udpSock<0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, unable to receive UDP at %s: %s",
+                udp.c_str(), strerror(errno));
+            close(data);
+            return nullptr;
+        }
+        if (unicast) {
+            alen = sizeof(addr);
+            getsockname(udpSock, (struct sockaddr *)&addr, &alen);
+            sargs["tcpremote:udp"] = std::to_string(ntohs(AF_INET6==addr.ss_family ?
+                ((struct sockaddr_in6 *)&addr)->sin6_port : ((struct sockaddr_in *)&addr)->sin_port));
+        }
+        // datagrams fit the link MTU, GRO buffers can be anything up to 64k
+        udpSlot = sargs.find("tcpremote:mtu")!=sargs.end() ? atol(sargs.at("tcpremote:mtu").c_str()) : TCPREMOTE_UDP_MTU;
+        if (gro)
+            udpSlot = 65536;
+    }
     SoapySDR::Stream *rv = new SoapySDR::Stream();
     dir[dlen]=0;
     sscanf(dir, "%d", &rv->remoteId);
     rv->netSock = data;
     rv->fSize = g_frameSizes.at(fmtwire);
+    rv->cnv = getConverter(fmtwire, fmtout);
+    rv->ilv = getInterleaver(fmtout, fmtwire);
+    rv->framed = framed;
+    rv->planar = planar;
+    rv->decim = decim;
+    rv->blkLeft = 0;
+    rv->blkDone = 0;
+    rv->rxHead = rv->rxTail = 0;
+    rv->udpSock = udpSock;
+    rv->udpSlot = udpSlot;
+    rv->udpSync = false;
+    rv->udpNext = rv->udpLate = 0;
+    rv->shm = nullptr;
+    rv->shmData = nullptr;
+    rv->shmMap = rv->shmHead = 0;
+#ifdef TCPREMOTE_IO_URING
+    rv->uring = nullptr;
+#endif
+    rv->expect = 0;
+    rv->rate = 0;
+    rv->chan0 = lchannels[0];
+    rv->scale = (fmtwire!=fmtdev && fmtout=="CF32") ? scale : 1.0f;
     rv->numChans = lchannels.size();
     rv->running = false;
+    rv->direction = direction;
+    rv->calls = rv->timeouts = rv->elems = rv->netBytes = 0;
+    rv->maxElems = 0;
+    rv->tuning = getSocketTuning(sargs);
+    rv->byteRate = 0;
+    rv->broken = false;
+    rv->attachBytes = rv->resumeSkip = rv->resumes = rv->resumeLost = 0;
+    rv->txOwed = 0;
     // make the RPC call with the remoteId
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_SETUP_STREAM);
+    rpc->writeCall(TCPREMOTE_SETUP_STREAM);
     rpc->writeInteger(rv->remoteId);
     rpc->writeInteger(direction);
-    rpc->writeString(fmtwire);
+    rpc->writeString(fmtdev);
     // channel list, sent as a space separated list of numbers on one line
     std::string chans;
     for (auto it=lchannels.begin(); it!=lchannels.end(); ++it) {
@@ -330,10 +956,27 @@ SoapySDR::Stream *SoapyTCPRemote::setupStream(const int direction, const std::st
         chans += std::to_string(*it);
     }
     rpc->writeString(chans);
-    rpc->writeKwargs(args);
+    rpc->writeKwargs(sargs);
     int status = rpc->readInteger();
+    if (status>=0 && shm) {
+        // the server has passed its pipe over the data connection
+        int fd = shmRecvFd(data, 5000);
+        if (fd>=0) {
+            rv->shm = shmAttach(fd, rv->shmData, rv->shmMap);
+            close(fd);
+        }
+        if (!rv->shm) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, unable to map shared memory: %s", strerror(errno));
+            status = -1;
+        }
+    }
+#ifdef TCPREMOTE_IO_URING
+    if (status>=0 && uring)
+        openURing(rv);
+#endif
     if (status>=0) {
         SoapySDR_logf(SOAPY_SDR_TRACE,"SoapyTCPRemote::setupStream, data stream remoteId: %d", rv->remoteId);
+        streams.push_back(rv);
     } else {
         SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, error: %d", status);
         if (rv)
@@ -348,19 +991,25 @@ void SoapyTCPRemote::closeStream(SoapySDR::Stream *stream)
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::closeStream()");
     if (stream->running)
         deactivateStream(stream);
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_CLOSE_STREAM);
+    rpc->writeCall(TCPREMOTE_CLOSE_STREAM);
     rpc->writeInteger(stream->remoteId);
     rpc->readInteger(); // ignore return value, but wait!
+#ifdef TCPREMOTE_IO_URING
+    delete stream->uring;
+#endif
     close(stream->netSock);
+    if (stream->udpSock>=0)
+        close(stream->udpSock);
+    if (stream->shm)
+        shmDetach(stream->shm, stream->shmMap);
+    streams.erase(std::remove(streams.begin(), streams.end(), stream), streams.end());
     delete stream;
 }
 
 size_t SoapyTCPRemote::getStreamMTU(SoapySDR::Stream *stream) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getStreamMTU()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_STREAM_MTU);
+    rpc->writeCall(TCPREMOTE_GET_STREAM_MTU);
     rpc->writeInteger(stream->remoteId);
     return rpc->readInteger();
 }
@@ -373,8 +1022,17 @@ int SoapyTCPRemote::activateStream(SoapySDR::Stream *stream,
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::activateStream()");
     if (stream->running)
         return 0;
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_ACTIVATE_STREAM);
+    // size socket buffers for the rate, timestamps of partial blocks are offset from the block time at this rate
+    double rate = getSampleRate(stream->direction, stream->chan0)/stream->decim;
+    stream->byteRate = rate*stream->fSize*stream->numChans;
+    if (!stream->shm)
+        tuneDataSocket(stream->udpSock>=0 ? stream->udpSock : stream->netSock, SOAPY_SDR_TX==stream->direction,
+            stream->byteRate, stream->tuning);
+    if (stream->framed)
+        stream->rate = rate;
+    // datagrams resume from wherever the (perhaps already running) stream has got to
+    stream->udpSync = false;
+    rpc->writeCall(TCPREMOTE_ACTIVATE_STREAM);
     rpc->writeInteger(stream->remoteId);
     int status = rpc->readInteger();
     if (status==0)
@@ -387,8 +1045,7 @@ int SoapyTCPRemote::deactivateStream(SoapySDR::Stream *stream, const int flags,
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::deactivateStream()");
     if (!stream->running)
         return 0;
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_DEACTIVATE_STREAM);
+    rpc->writeCall(TCPREMOTE_DEACTIVATE_STREAM);
     rpc->writeInteger(stream->remoteId);
     int status = rpc->readInteger();
     if (status==0)
@@ -396,16 +1053,296 @@ int SoapyTCPRemote::deactivateStream(SoapySDR::Stream *stream, const int flags,
     return status;
 }
 
-static void *convertCS16toCF32(void *dst, const void *src, size_t cnt /* ignored */)
+// wait up to timeoutUs for data (rounded up to msecs, so short timeouts still wait), 0 on timeout
+static int waitData(int sock, const long timeoutUs)
 {
-    int16_t *cs16 = (int16_t *)src;
-    float *cf32   = (float *)dst;
-    // convert complex sample in range -INT16_MAX>INT16_MAX to -1.0>1.0
-    int16_t si = cs16[0];
-    int16_t sq = cs16[1];
-    cf32[0]   = (float)si/(float)INT16_MAX;
-    cf32[1] = (float)sq/(float)INT16_MAX;
-    return dst;
+    struct pollfd pfd = { sock, POLLIN, 0 };
+    return poll(&pfd, 1, timeoutUs>0 ? (int)((timeoutUs+999)/1000) : 0);
+}
+
+// ensure at least 'need' bytes are held in the receive buffer, waiting up to timeoutUs for
+// them, and take whatever else has arrived (without waiting) when holding less than 'want'.
+// Returns bytes held, 0 on timeout or -1 on error/EOF.
+static ssize_t fillDatagrams(SoapySDR::Stream *stream, size_t need, size_t want, const long timeoutUs);
+static ssize_t fillShm(SoapySDR::Stream *stream, size_t need, const long timeoutUs);
+
+static ssize_t fillStream(SoapySDR::Stream *stream, size_t need, size_t want, const long timeoutUs)
+{
+    if (stream->udpSock>=0)
+        return fillDatagrams(stream, need, want, timeoutUs);
+    if (stream->shm)
+        return fillShm(stream, need, timeoutUs);
+    size_t held = stream->rxTail - stream->rxHead;
+    if (held>=want)
+        return held;
+    // move any partial frame to the front, grow for oversize requests
+    if (stream->rxHead>0) {
+        memmove(stream->rxbuf.data(), stream->rxbuf.data()+stream->rxHead, held);
+        stream->rxHead = 0;
+        stream->rxTail = held;
+    }
+    if (want<TCPREMOTE_RXBUF)
+        want = TCPREMOTE_RXBUF;
+    if (stream->rxbuf.size()<want)
+        stream->rxbuf.resize(want);
+    // the timeout covers the whole fill, however the data trickles in
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+    while (true) {
+        uint8_t *dst = stream->rxbuf.data()+stream->rxTail;
+        size_t room = stream->rxbuf.size()-stream->rxTail;
+#ifdef TCPREMOTE_IO_URING
+        ssize_t nrd = stream->uring ? stream->uring->recv(dst, room) : recv(stream->netSock, dst, room, MSG_DONTWAIT);
+        // (no multishot receives in this kernel: nothing has been taken, so plain recv() it is)
+        if (nrd<0 && stream->uring && stream->uring->unsupported()) {
+            SoapySDR_log(SOAPY_SDR_DEBUG, "fillStream: io_uring multishot receive unavailable, using recv");
+            delete stream->uring;
+            stream->uring = nullptr;
+            continue;
+        }
+#else
+        ssize_t nrd = recv(stream->netSock, dst, room, MSG_DONTWAIT);
+#endif
+        if (nrd>0) {
+            stream->rxTail += nrd;
+            stream->netBytes += nrd;
+            held += nrd;
+            if (held>=need)
+                return held;
+            continue;
+        }
+        if (0==nrd)
+            return -1;
+        if (EINTR==errno)
+            continue;
+        if (EAGAIN!=errno && EWOULDBLOCK!=errno)
+            return -1;
+        if (held>=need)
+            return held;
+        long left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (left<=0)
+            return 0;
+#ifdef TCPREMOTE_IO_URING
+        int rv = stream->uring ? stream->uring->wait(left) : waitData(stream->netSock, left);
+#else
+        int rv = waitData(stream->netSock, left);
+#endif
+        if (rv<=0)
+            return rv;
+    }
+}
+
+// as fillStream, for UDP streams: each datagram is a whole framed block, kept in order
+// end to end (closing up the receive slots), those older than the last kept (reordered or
+// duplicated) are dropped, any gaps are seen as lost data by readFramed.
+static ssize_t fillDatagrams(SoapySDR::Stream *stream, size_t need, size_t want, const long timeoutUs)
+{
+    size_t held = stream->rxTail - stream->rxHead;
+    if (held>=want)
+        return held;
+    if (stream->rxHead>0) {
+        memmove(stream->rxbuf.data(), stream->rxbuf.data()+stream->rxHead, held);
+        stream->rxHead = 0;
+        stream->rxTail = held;
+    }
+    if (stream->rxbuf.size()<TCPREMOTE_RXBUF || stream->rxbuf.size()<held+stream->udpSlot)
+        stream->rxbuf.resize(held+stream->udpSlot>TCPREMOTE_RXBUF ? held+stream->udpSlot : TCPREMOTE_RXBUF);
+    size_t blkSize = stream->fSize * stream->numChans;
+    size_t lens[TCPREMOTE_UDP_BATCH];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+    while (true) {
+        uint8_t *base = stream->rxbuf.data()+stream->rxTail;
+        int n = dgramRecv(stream->udpSock, base, stream->rxbuf.size()-stream->rxTail, stream->udpSlot, lens);
+        if (n>0) {
+            uint8_t *dst = base;
+            for (int i=0; i<n; ++i) {
+                // one datagram, or several coalesced by GRO
+                const uint8_t *p = base + i*stream->udpSlot;
+                size_t len = lens[i];
+                stream->netBytes += len;
+                while (len>=TCPREMOTE_DATA_HDR) {
+                    SoapyRPCDataHeader hdr;
+                    getDataHeader(p, hdr);
+                    size_t dlen = TCPREMOTE_DATA_HDR + hdr.elems*blkSize;
+                    if (dlen>len)
+                        break;
+                    if (!stream->udpSync) {
+                        stream->expect = stream->udpNext = hdr.count;
+                        stream->udpSync = true;
+                    }
+                    // (zero is a restarted stream)
+                    if (hdr.count<stream->udpNext && hdr.count!=0) {
+                        ++stream->udpLate;
+                    } else {
+                        memmove(dst, p, dlen);
+                        dst += dlen;
+                        stream->udpNext = hdr.count+hdr.elems;
+                    }
+                    p += dlen;
+                    len -= dlen;
+                }
+            }
+            stream->rxTail += dst-base;
+            held += dst-base;
+            if (held>=need)
+                return held;
+            continue;
+        }
+        if (n<0 && EINTR==errno)
+            continue;
+        if (n<0 && EAGAIN!=errno && EWOULDBLOCK!=errno)
+            return -1;
+        if (held>=need)
+            return held;
+        long left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (left<=0)
+            return 0;
+        int rv = waitData(stream->udpSock, left);
+        if (rv<=0)
+            return rv;
+    }
+}
+
+// as fillStream, for shared memory streams: the held data is the server's pipe itself (read
+// in place through the mirror, so it never wraps), anything used since the last fill is
+// handed back first, so the server can reuse it.
+static ssize_t fillShm(SoapySDR::Stream *stream, size_t need, const long timeoutUs)
+{
+    pipebuf_t *pipe = stream->shm;
+    size_t used = stream->rxHead - stream->shmHead;
+    if (used>0) {
+        pipeskip(pipe, used);
+        stream->netBytes += used;
+    }
+    stream->rxHead = stream->shmHead = pipe->out.load(std::memory_order_relaxed) & pipe->mask;
+    stream->rxTail = stream->rxHead;
+    if (need>pipe->len) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    size_t held = pipewait(pipe, need, timeoutUs);
+    if (held<need && pipe->closed.load(std::memory_order_acquire)) {
+        errno = EPIPE;
+        return -1;
+    }
+    stream->rxTail = stream->rxHead + held;
+    return held>=need ? (ssize_t)held : 0;
+}
+
+// start of the held data (see fillStream)
+static inline const uint8_t *rxData(SoapySDR::Stream *stream)
+{
+    return (stream->shm ? stream->shmData : stream->rxbuf.data()) + stream->rxHead;
+}
+
+static void pushEvent(SoapySDR::Stream *stream, int code, int flags, long long timeNs)
+{
+    std::lock_guard<std::mutex> lock(stream->evLock);
+    // nobody listening? don't grow forever
+    if (stream->events.size()>=100)
+        stream->events.pop_front();
+    stream->events.push_back({ code, flags, timeNs });
+    stream->evCond.notify_one();
+}
+
+// framed data mode: one block header, then up to numElems frames of that block per call
+// (interleaved blocks are returned as they arrive, planar blocks are held in one piece)
+static int readFramed(SoapySDR::Stream *stream,
+                           void * const *buffs,
+                           const size_t numElems,
+                           int &flags,
+                           long long &timeNs,
+                           const long timeoutUs)
+{
+    size_t blkSize = stream->fSize * stream->numChans;
+    if (0==stream->blkLeft) {
+        // header, and as much of the block as has arrived
+        ssize_t rv = fillStream(stream, TCPREMOTE_DATA_HDR, TCPREMOTE_DATA_HDR+numElems*blkSize, timeoutUs);
+        if (0==rv)
+            return SOAPY_SDR_TIMEOUT;
+        if (rv<0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::readStream, error reading data header: %s", strerror(errno));
+            return SOAPY_SDR_STREAM_ERROR;
+        }
+        getDataHeader(rxData(stream), stream->hdr);
+        stream->rxHead += TCPREMOTE_DATA_HDR;
+        stream->blkLeft = stream->hdr.elems;
+        stream->blkDone = 0;
+        // data lost? flagged by the server, or a gap in the count (zero is a restarted stream)
+        bool lost = (stream->hdr.flags & TCPREMOTE_FLAG_OVERFLOW)!=0 ||
+            (stream->hdr.count!=0 && stream->hdr.count!=stream->expect);
+        if (lost) {
+            SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote::readStream, overflow, lost %lld frames",
+                (long long)(stream->hdr.count-stream->expect));
+        }
+        stream->expect = stream->hdr.count;
+        if (lost) {
+            // report now, the data follows in the next call
+            flags = stream->hdr.flags & SOAPY_SDR_HAS_TIME;
+            timeNs = stream->hdr.timeNs;
+            pushEvent(stream, SOAPY_SDR_OVERFLOW, flags, timeNs);
+            return SOAPY_SDR_OVERFLOW;
+        }
+        if (0==stream->blkLeft) {
+            flags = stream->hdr.flags & ~TCPREMOTE_FLAG_OVERFLOW;
+            timeNs = stream->hdr.timeNs;
+            return 0;
+        }
+    }
+    size_t elems = numElems<stream->blkLeft ? numElems : stream->blkLeft;
+    if (stream->planar) {
+        // whole block is held from the first visit (until the last), each channel converted from its own plane
+        size_t len = stream->hdr.elems * blkSize;
+        if (0==stream->blkDone) {
+            ssize_t rv = fillStream(stream, len, len, timeoutUs);
+            if (0==rv)
+                return SOAPY_SDR_TIMEOUT;
+            if (rv<0) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::readStream, error reading data: %s", strerror(errno));
+                return SOAPY_SDR_STREAM_ERROR;
+            }
+        }
+        const uint8_t *blk = rxData(stream);
+        for (int c=0; c<stream->numChans; ++c) {
+            void *d[1] = { buffs[c] };
+            stream->cnv(d, 0, blk + (c*stream->hdr.elems + stream->blkDone)*stream->fSize, 1, elems);
+        }
+        if (elems==stream->blkLeft)
+            stream->rxHead += len;
+    } else {
+        // whatever whole frames of the block we have (at least one)
+        ssize_t rv = fillStream(stream, blkSize, elems*blkSize, timeoutUs);
+        if (0==rv)
+            return SOAPY_SDR_TIMEOUT;
+        if (rv<0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::readStream, error reading data: %s", strerror(errno));
+            return SOAPY_SDR_STREAM_ERROR;
+        }
+        if ((size_t)rv/blkSize<elems)
+            elems = rv/blkSize;
+        stream->cnv(buffs, 0, rxData(stream), stream->numChans, elems);
+        stream->rxHead += elems*blkSize;
+    }
+    if (stream->scale!=1.0f) {
+        for (int c=0; c<stream->numChans; ++c)
+            scaleBlock(buffs[c], elems*2, stream->scale);
+    }
+    // flags apply to the whole block: end of burst only at the end, time offset by the frames already read
+    flags = stream->hdr.flags & ~TCPREMOTE_FLAG_OVERFLOW;
+    timeNs = stream->hdr.timeNs;
+    if (stream->blkDone>0 && (flags & SOAPY_SDR_HAS_TIME)) {
+        if (stream->rate>0)
+            timeNs += (long long)((double)stream->blkDone*1e9/stream->rate);
+        else
+            flags &= ~SOAPY_SDR_HAS_TIME;
+    }
+    stream->blkLeft -= elems;
+    stream->blkDone += elems;
+    stream->expect += elems;
+    if (stream->blkLeft>0)
+        flags = (flags & ~SOAPY_SDR_END_BURST) | SOAPY_SDR_MORE_FRAGMENTS;
+    if ((flags & SOAPY_SDR_END_BURST))
+        pushEvent(stream, 0, flags, timeNs);
+    return (int)elems;
 }
 
 int SoapyTCPRemote::readStream(SoapySDR::Stream *stream,
@@ -415,41 +1352,133 @@ int SoapyTCPRemote::readStream(SoapySDR::Stream *stream,
                            long long &timeNs,
                            const long timeoutUs)
 {
-    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::readStream()");
+    TCPREMOTE_TRACE("SoapyTCPRemote::readStream()");
     // Not running? timeout (says the docs)
     if (!stream->running)
         return SOAPY_SDR_TIMEOUT;
+    // lost the data connection? (unframed streams are told here of what that lost, framed
+    // streams by the next block's count)
+    if (stream->broken) {
+        uint64_t lost = stream->resumeLost;
+        int rv = resumeStream(stream, timeoutUs);
+        if (rv<=0)
+            return countCall(stream, rv<0 ? SOAPY_SDR_STREAM_ERROR : SOAPY_SDR_TIMEOUT);
+        if (!stream->framed && stream->resumeLost>lost)
+            return countCall(stream, SOAPY_SDR_OVERFLOW);
+    }
+    if (stream->framed) {
+        int rv = readFramed(stream, buffs, numElems, flags, timeNs, timeoutUs);
+        if (SOAPY_SDR_STREAM_ERROR==rv && !sessionToken.empty() && resumeStream(stream, timeoutUs)>=0)
+            rv = SOAPY_SDR_TIMEOUT;
+        return countCall(stream, rv);
+    }
     // Transfer format on the wire is interleaved sample frames (each fSize) across channels.
-    // We read by making one syscall for the maximum amount, then de-interleaving and possibly
-    // converting formats into buffs.
+    // We wait (up to the timeout) for at least one whole frame in our receive buffer, which
+    // takes as much as the network has with each recv(), so small reads are served without
+    // syscalls, and partial frames wait in the buffer for the next call.
     size_t blkSize = stream->fSize * stream->numChans;
-    uint8_t *swamp = (uint8_t *)alloca(blkSize * numElems);
-    int status = read(stream->netSock, swamp, blkSize*numElems);
-    if (status<=0) {
+    ssize_t status = fillStream(stream, blkSize, blkSize*numElems, timeoutUs);
+    if (0==status)
+        return countCall(stream, SOAPY_SDR_TIMEOUT);
+    if (status<0 && !sessionToken.empty()) {
+        uint64_t lost = stream->resumeLost;
+        int rv = resumeStream(stream, timeoutUs);
+        if (rv<0)
+            return countCall(stream, SOAPY_SDR_STREAM_ERROR);
+        return countCall(stream, rv>0 && stream->resumeLost>lost ? SOAPY_SDR_OVERFLOW : SOAPY_SDR_TIMEOUT);
+    }
+    if (status<0) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::readStream, error reading data: %s", strerror(errno));
-        return SOAPY_SDR_STREAM_ERROR;
-    }
-    status /= stream->fSize;
-    int elems=0;
-    int soff=0;
-    int boff=0;
-    int bSize=stream->fSize;
-    void *(*cnv)(void *, const void *, size_t) = memcpy;
-    if (fmtout!=fmtwire) {
-        bSize = g_frameSizes.at(fmtout);
-        // TODO: actually check these formats =)
-        cnv = convertCS16toCF32;
-    }
-    while (elems<status) {
-        for (int c=0; c<stream->numChans; ++c) {
-            uint8_t *buf = (uint8_t *)(buffs[c]);
-            cnv(buf+boff, swamp+soff, stream->fSize);
-            soff += stream->fSize;
+        return countCall(stream, SOAPY_SDR_STREAM_ERROR);
+    }
+    // de-interleave & convert whole frames in one pass
+    int elems = (size_t)status/blkSize<numElems ? (int)(status/blkSize) : (int)numElems;
+    stream->cnv(buffs, 0, rxData(stream), stream->numChans, elems);
+    stream->rxHead += elems*blkSize;
+    if (stream->scale!=1.0f) {
+        for (int c=0; c<stream->numChans; ++c)
+            scaleBlock(buffs[c], elems*2, stream->scale);
+    }
+    return countCall(stream, elems);
+}
+
+// where a resumed transmit stream carries on in this block, past the frames that arrived (of
+// the block that failed, which should be this one, so no more than all of it)
+static size_t resumeOffset(SoapySDR::Stream *stream, size_t numElems)
+{
+    size_t frameSize = stream->fSize * stream->numChans;
+    if (stream->resumeSkip>numElems) {
+        stream->attachBytes -= (stream->resumeSkip-numElems)*frameSize;
+        stream->resumeSkip = numElems;
+    }
+    return stream->resumeSkip*frameSize;
+}
+
+// the block to send, from 'off' into its frames (a resumed one, past those that arrived):
+// interleaved (and converted) into txbuf, framed streams' header just before the first frame
+// of a block (so a restart is a block of its own, without the time). Frames a framed block
+// still owes (its header has gone, see writeStream) come first, moved down to just ahead of
+// the header for the rest. Returns where sending starts, and where the header is (in 'hpos',
+// npos if none).
+static size_t txBlock(SoapySDR::Stream *stream, const void * const *buffs, size_t numElems, size_t off,
+    int flags, long long timeNs, size_t &hpos)
+{
+    size_t frameSize = stream->fSize * stream->numChans;
+    size_t hlen = stream->framed ? TCPREMOTE_DATA_HDR : 0;
+    size_t len = frameSize * numElems;
+    if (stream->txbuf.size()<hlen+len)
+        stream->txbuf.resize(hlen+len);
+    stream->ilv(stream->txbuf.data()+hlen, buffs, 0, stream->numChans, numElems);
+    hpos = std::string::npos;
+    // (nothing left of a resumed block, its end went with the rest, or all owed)
+    size_t owed = std::min(stream->txOwed*frameSize, len);
+    if (!stream->framed || (off>0 && off==len) || (stream->txOwed>0 && owed==len))
+        return hlen+off;
+    if (owed>0) {
+        memmove(stream->txbuf.data(), stream->txbuf.data()+hlen, owed);
+        off = owed;
+    }
+    SoapyRPCDataHeader hdr;
+    hdr.elems = (len-off)/frameSize;
+    hdr.flags = off>0 ? flags & ~SOAPY_SDR_HAS_TIME : flags;
+    hdr.timeNs = timeNs;
+    hdr.count = 0;
+    putDataHeader(stream->txbuf.data()+off, hdr);
+    hpos = off;
+    return owed>0 ? 0 : off;
+}
+
+// wait up to timeoutUs for room to send (rounded up to msecs, as waitData), 0 on timeout
+static int waitRoom(int sock, const long timeoutUs)
+{
+    struct pollfd pfd = { sock, POLLOUT, 0 };
+    return poll(&pfd, 1, timeoutUs>0 ? (int)((timeoutUs+999)/1000) : 0);
+}
+
+// send without blocking past the deadline, returns bytes sent (fewer on timeout), or -1 on error
+static ssize_t sendUntil(int sock, const uint8_t *data, size_t len, std::chrono::steady_clock::time_point deadline)
+{
+    size_t done = 0;
+    while (done<len) {
+        ssize_t nw = send(sock, data+done, len-done, MSG_DONTWAIT|MSG_NOSIGNAL);
+        if (nw>=0) {
+            done += nw;
+            continue;
         }
-        boff += bSize;
-        ++elems;
+        if (EINTR==errno)
+            continue;
+        if (EAGAIN!=errno && EWOULDBLOCK!=errno)
+            return -1;
+        long left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (left<=0)
+            break;
+        int rv = waitRoom(sock, left);
+        if (rv<0 && EINTR!=errno)
+            return -1;
+        if (0==rv)
+            break;
     }
-    return elems;
+    return (ssize_t)done;
 }
 
 int SoapyTCPRemote::writeStream(SoapySDR::Stream *stream,
@@ -459,31 +1488,119 @@ int SoapyTCPRemote::writeStream(SoapySDR::Stream *stream,
                     const long long timeNs,
                     const long timeoutUs)
 {
-    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::writeStream()");
+    TCPREMOTE_TRACE("SoapyTCPRemote::writeStream()");
     // Not running? timeout (says the docs)
     if (!stream->running)
         return SOAPY_SDR_TIMEOUT;
-    // allocate buffer for a set of interleaved channels
-    size_t bufSize = stream->fSize * stream->numChans;
-    uint8_t *nbuf = (uint8_t *)alloca(bufSize);
-    // assemble interleaved buffer for each element and write to network via stdio buffering/TCP back pressure
-    size_t elems=0;
-    int noff=0;
-    int boff=0;
-    while (elems<numElems) {
-        for (int c=0; c<stream->numChans; ++c) {
-            uint8_t *buf = (uint8_t *)buffs[c];
-            memcpy(nbuf+noff, buf+boff, stream->fSize);
-            noff += stream->fSize;
-        }
-        boff += stream->fSize;
-        if (write(stream->netSock, nbuf, bufSize)!=(int)bufSize) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(std::max(timeoutUs, 0L));
+    // lost the data connection? carry on from wherever the server got to
+    size_t off = 0;
+    size_t frameSize = stream->fSize * stream->numChans;
+    size_t hlen = stream->framed ? TCPREMOTE_DATA_HDR : 0;
+    size_t len = frameSize * numElems;
+    if (stream->broken) {
+        int rs = resumeStream(stream, timeoutUs);
+        if (rs<=0)
+            return countCall(stream, rs<0 ? SOAPY_SDR_STREAM_ERROR : SOAPY_SDR_TIMEOUT);
+        off = resumeOffset(stream, numElems);
+    }
+    // assemble the whole block, then hand to the network until it is all gone or the timeout,
+    // first finishing whatever frame (or header) the last timeout left part sent, the wire
+    // never carries part of one
+    size_t end = hlen + len;
+    size_t hpos;
+    size_t pos = txBlock(stream, buffs, numElems, off, flags, timeNs, hpos);
+    size_t owed = stream->txOwed;
+    bool stubDone = stream->txStub.empty();
+    while (!stubDone || pos<end) {
+        const uint8_t *data = stubDone ? stream->txbuf.data()+pos : stream->txStub.data();
+        size_t want = stubDone ? end-pos : stream->txStub.size();
+        ssize_t nw = sendUntil(stream->netSock, data, want, deadline);
+        if (nw<0) {
+            // resumed? send again whatever of this block did not arrive
+            int rs = sessionToken.empty() ? -1 : resumeStream(stream, timeoutUs);
+            if (rs>0) {
+                pos = txBlock(stream, buffs, numElems, resumeOffset(stream, numElems), flags, timeNs, hpos);
+                owed = 0;
+                stubDone = true;
+                continue;
+            }
+            if (0==rs)
+                return countCall(stream, SOAPY_SDR_TIMEOUT);
             SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::writeStream, error writing data: %s", strerror(errno));
+            return countCall(stream, SOAPY_SDR_STREAM_ERROR);
+        }
+        if (!stubDone) {
+            stream->txStub.erase(stream->txStub.begin(), stream->txStub.begin()+nw);
+            // (none of this block goes before the last one's end)
+            if (!stream->txStub.empty())
+                return countCall(stream, SOAPY_SDR_TIMEOUT);
+            stubDone = true;
+            continue;
+        }
+        pos += nw;
+        if ((size_t)nw<want)
             break;
+    }
+    // timed out part way? hold the rest of the frame (or header) being sent for next time,
+    // it counts as written
+    size_t next = pos;
+    if (pos<end) {
+        if (hpos!=std::string::npos && pos>hpos && pos<hpos+hlen)
+            next = hpos+hlen;
+        else if (hpos!=std::string::npos && pos<=hpos)
+            next = (pos+frameSize-1)/frameSize*frameSize;
+        else
+            next = hlen + (pos-hlen+frameSize-1)/frameSize*frameSize;
+        stream->txStub.assign(stream->txbuf.data()+pos, stream->txbuf.data()+next);
+    }
+    // frames written: those before the header, then those past it
+    size_t done;
+    if (hpos!=std::string::npos && next<=hpos)
+        done = next/frameSize;
+    else if (hpos!=std::string::npos && next<hpos+hlen)
+        done = hpos/frameSize;
+    else
+        done = (next-hlen)/frameSize;
+    // what a framed block still owes: this one's rest if its header went, else the last one's
+    if (stream->framed)
+        stream->txOwed = hpos!=std::string::npos && next>=hpos+hlen ? numElems-done :
+            owed>done ? owed-done : 0;
+    // (frames only, the headers are not counted, see resumeStream)
+    stream->netBytes += done*frameSize;
+    if (next>=end)
+        return countCall(stream, (int)numElems);
+    return countCall(stream, done>0 ? (int)done : SOAPY_SDR_TIMEOUT);
+}
+
+// (transmit) the next of the device's stream events, from the data connection, partial headers
+// wait in rxbuf for the rest (which transmit has no other use for)
+static int readTxStatus(SoapySDR::Stream *stream, size_t &chanMask, int &flags, long long &timeNs, const long timeoutUs)
+{
+    if (stream->rxbuf.size()<TCPREMOTE_DATA_HDR)
+        stream->rxbuf.resize(TCPREMOTE_DATA_HDR);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+    while (stream->rxTail<TCPREMOTE_DATA_HDR) {
+        ssize_t nrd = recv(stream->netSock, stream->rxbuf.data()+stream->rxTail, TCPREMOTE_DATA_HDR-stream->rxTail, MSG_DONTWAIT);
+        if (nrd>0) {
+            stream->rxTail += nrd;
+            continue;
         }
-        ++elems;
+        if (nrd<0 && EINTR==errno)
+            continue;
+        if (0==nrd || (EAGAIN!=errno && EWOULDBLOCK!=errno))
+            return SOAPY_SDR_STREAM_ERROR;
+        long left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (left<=0 || waitData(stream->netSock, left)<=0)
+            return SOAPY_SDR_TIMEOUT;
     }
-    return (int)elems;
+    SoapyRPCDataHeader hdr;
+    getDataHeader(stream->rxbuf.data(), hdr);
+    stream->rxTail = 0;
+    chanMask = hdr.elems;
+    flags = hdr.flags;
+    timeNs = hdr.timeNs;
+    return (int)(int64_t)hdr.count;
 }
 
 int SoapyTCPRemote::readStreamStatus(
@@ -493,16 +1610,86 @@ int SoapyTCPRemote::readStreamStatus(
                     long long &timeNs,
                     const long timeoutUs)
 {
-    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::readStreamStatus()");
-    // TODO: report something?
-    return SOAPY_SDR_NOT_SUPPORTED;
+    TCPREMOTE_TRACE("SoapyTCPRemote::readStreamStatus()");
+    // only framed streams know anything, events are queued by readStream, or for transmit
+    // streams sent back by the server (see SoapyRPCDataHeader)
+    if (!stream->framed)
+        return SOAPY_SDR_NOT_SUPPORTED;
+    if (SOAPY_SDR_TX==stream->direction)
+        return readTxStatus(stream, chanMask, flags, timeNs, timeoutUs);
+    std::unique_lock<std::mutex> lock(stream->evLock);
+    if (!stream->evCond.wait_for(lock, std::chrono::microseconds(timeoutUs), [stream]{ return !stream->events.empty(); }))
+        return SOAPY_SDR_TIMEOUT;
+    SoapySDR::Stream::StreamEvent ev = stream->events.front();
+    stream->events.pop_front();
+    chanMask = (1<<stream->numChans)-1;
+    flags = ev.flags;
+    timeNs = ev.timeNs;
+    return ev.code;
+}
+
+// Sensor API
+std::vector<std::string> SoapyTCPRemote::listSensors(void) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::listSensors()");
+    std::vector<std::string> l;
+    l.push_back("tcpremote:stats");
+    return l;
+}
+
+SoapySDR::ArgInfo SoapyTCPRemote::getSensorInfo(const std::string &key) const
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::getSensorInfo(%s)", key.c_str());
+    SoapySDR::ArgInfo info;
+    if (key=="tcpremote:stats") {
+        info.key = key;
+        info.name = "Stream statistics";
+        info.description = "Per stream counters from the client and server, as <dir><id>.<name>=<value> pairs";
+        info.type = SoapySDR::ArgInfo::STRING;
+    }
+    return info;
+}
+
+std::string SoapyTCPRemote::readSensor(const std::string &key) const
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::readSensor(%s)", key.c_str());
+    if (key!="tcpremote:stats")
+        return "";
+    SoapySDR::Kwargs kw;
+    for (auto stream: streams) {
+        std::string pfx = (SOAPY_SDR_RX==stream->direction ? "rx" : "tx") + std::to_string(stream->remoteId) + ".";
+        kw[pfx+"client_calls"] = std::to_string(stream->calls);
+        kw[pfx+"client_timeouts"] = std::to_string(stream->timeouts);
+        kw[pfx+"client_samples"] = std::to_string(stream->elems);
+        kw[pfx+"client_bytes"] = std::to_string(stream->netBytes);
+        kw[pfx+"client_max_samples"] = std::to_string(stream->maxElems);
+        if (stream->udpSock>=0)
+            kw[pfx+"client_udp_late"] = std::to_string(stream->udpLate);
+        if (!sessionToken.empty()) {
+            kw[pfx+"client_resumes"] = std::to_string(stream->resumes);
+            kw[pfx+"client_resume_lost"] = std::to_string(stream->resumeLost);
+        }
+        // only servers that understand binary RPC know about stats
+        if (!rpc->isBinary())
+            continue;
+        rpc->writeCall(TCPREMOTE_GET_STREAM_STATS);
+        rpc->writeInteger(stream->remoteId);
+        for (auto &it: rpc->readKwargs())
+            kw[pfx+it.first] = it.second;
+    }
+    std::string rv;
+    for (auto &it: kw) {
+        if (rv.length()>0)
+            rv += ", ";
+        rv += it.first+"="+it.second;
+    }
+    return rv;
 }
 
 bool SoapyTCPRemote::hasFrequencyCorrection(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::hasFrequencyCorrection()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_HAS_FREQUENCY_CORRECTION);
+    rpc->writeCall(TCPREMOTE_HAS_FREQUENCY_CORRECTION);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return rpc->readInteger()!=0;
@@ -511,19 +1698,17 @@ bool SoapyTCPRemote::hasFrequencyCorrection(const int direction, const size_t ch
 void SoapyTCPRemote::setFrequencyCorrection(const int direction, const size_t channel, double value)
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::setFrequencyCorrection()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_SET_FREQUENCY_CORRECTION);
+    rpc->writeCall(TCPREMOTE_SET_FREQUENCY_CORRECTION);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeDouble(value);
-    rpc->readInteger(); // wait for completion!
+    rpc->readStatus(); // wait for completion (unless pipelined)!
 }
 
 double SoapyTCPRemote::getFrequencyCorrection(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrequencyCorrection()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_FREQUENCY_CORRECTION);
+    rpc->writeCall(TCPREMOTE_GET_FREQUENCY_CORRECTION);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return rpc->readDouble();
@@ -534,8 +1719,10 @@ std::vector<std::string> SoapyTCPRemote::listGains(const int direction, const si
     //list available gain element names,
     //the functions below have a "name" parameter
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::listGains()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_LIST_GAINS);
+    const ChannelMeta *cm = getMeta(direction, channel);
+    if (cm)
+        return cm->gains;
+    rpc->writeCall(TCPREMOTE_LIST_GAINS);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return rpc->readStrVector();
@@ -544,8 +1731,7 @@ std::vector<std::string> SoapyTCPRemote::listGains(const int direction, const si
 bool SoapyTCPRemote::hasGainMode(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::hasGainMode()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_HAS_GAIN_MODE);
+    rpc->writeCall(TCPREMOTE_HAS_GAIN_MODE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return rpc->readInteger()>0;
@@ -554,19 +1740,17 @@ bool SoapyTCPRemote::hasGainMode(const int direction, const size_t channel) cons
 void SoapyTCPRemote::setGainMode(const int direction, const size_t channel, const bool automatic)
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::setGainMode()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_SET_GAIN_MODE);
+    rpc->writeCall(TCPREMOTE_SET_GAIN_MODE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeInteger(automatic?1:0);
-    rpc->readInteger(); // wait for completion!
+    rpc->readStatus(); // wait for completion (unless pipelined)!
 }
 
 bool SoapyTCPRemote::getGainMode(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getGainMode()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_GAIN_MODE);
+    rpc->writeCall(TCPREMOTE_GET_GAIN_MODE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return rpc->readInteger()>0;
@@ -575,31 +1759,28 @@ bool SoapyTCPRemote::getGainMode(const int direction, const size_t channel) cons
 void SoapyTCPRemote::setGain(const int direction, const size_t channel, const double value)
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::setGain()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_SET_GAIN);
+    rpc->writeCall(TCPREMOTE_SET_GAIN);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeDouble(value);
-    rpc->readInteger(); // wait for completion!
+    rpc->readStatus(); // wait for completion (unless pipelined)!
 }
 
 void SoapyTCPRemote::setGain(const int direction, const size_t channel, const std::string &name, const double value)
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setGain(%s)", name.c_str());
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_SET_GAIN_NAMED);
+    rpc->writeCall(TCPREMOTE_SET_GAIN_NAMED);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeString(name);
     rpc->writeDouble(value);
-    rpc->readInteger(); // wait for completion!
+    rpc->readStatus(); // wait for completion (unless pipelined)!
 }
 
 double SoapyTCPRemote::getGain(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getGain()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_GAIN);
+    rpc->writeCall(TCPREMOTE_GET_GAIN);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return rpc->readDouble();
@@ -608,8 +1789,7 @@ double SoapyTCPRemote::getGain(const int direction, const size_t channel) const
 double SoapyTCPRemote::getGain(const int direction, const size_t channel, const std::string &name) const
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::getGain(%s)", name.c_str());
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_GAIN_NAMED);
+    rpc->writeCall(TCPREMOTE_GET_GAIN_NAMED);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeString(name);
@@ -619,8 +1799,10 @@ double SoapyTCPRemote::getGain(const int direction, const size_t channel, const
 SoapySDR::Range SoapyTCPRemote::getGainRange(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getGainRange()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_GAIN_RANGE);
+    const ChannelMeta *cm = getMeta(direction, channel);
+    if (cm)
+        return cm->gainRange;
+    rpc->writeCall(TCPREMOTE_GET_GAIN_RANGE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return SoapySDR::Range(
@@ -633,8 +1815,10 @@ SoapySDR::Range SoapyTCPRemote::getGainRange(const int direction, const size_t c
 SoapySDR::Range SoapyTCPRemote::getGainRange(const int direction, const size_t channel, const std::string &name) const
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::getGainRange(%s)", name.c_str());
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_GAIN_RANGE_NAMED);
+    const ChannelMeta *cm = getMeta(direction, channel);
+    if (cm && cm->gainRanges.find(name)!=cm->gainRanges.end())
+        return cm->gainRanges.at(name);
+    rpc->writeCall(TCPREMOTE_GET_GAIN_RANGE_NAMED);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeString(name);
@@ -645,6 +1829,101 @@ SoapySDR::Range SoapyTCPRemote::getGainRange(const int direction, const size_t c
     );
 }
 
+// parse a setting name (op[:name]) and value into a batch entry, false if unknown
+static bool parseSetting(const std::string &op, const std::string &val, const int direction, const size_t channel, SoapyRPCSetting &set)
+{
+    std::string nam;
+    std::string key = op;
+    size_t colon = op.find(':');
+    if (colon!=std::string::npos) {
+        key = op.substr(0, colon);
+        nam = op.substr(colon+1);
+    }
+    set.direction = direction;
+    set.channel = channel;
+    set.name = nam;
+    set.value = atof(val.c_str());
+    if ("frequency"==key || "freq"==key) {
+        set.call = nam.empty()? TCPREMOTE_SET_FREQUENCY: TCPREMOTE_SET_FREQUENCY_NAMED;
+    } else if ("gain"==key) {
+        set.call = nam.empty()? TCPREMOTE_SET_GAIN: TCPREMOTE_SET_GAIN_NAMED;
+    } else if ("gainmode"==key || "agc"==key) {
+        set.call = TCPREMOTE_SET_GAIN_MODE;
+        set.value = ("true"==val || "auto"==val || atoi(val.c_str())>0)? 1: 0;
+    } else if ("antenna"==key || "ant"==key) {
+        set.call = TCPREMOTE_SET_ANTENNA;
+        set.name = val;
+    } else if ("rate"==key) {
+        set.call = TCPREMOTE_SET_SAMPLE_RATE;
+    } else if ("bandwidth"==key || "bw"==key) {
+        set.call = TCPREMOTE_SET_BANDWIDTH;
+    } else if ("correction"==key || "ppm"==key) {
+        set.call = TCPREMOTE_SET_FREQUENCY_CORRECTION;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// write the fields of one setting, as the equivalent single RPC would
+void SoapyTCPRemote::writeSettingFields(const SoapyRPCSetting &set)
+{
+    rpc->writeInteger(set.direction);
+    rpc->writeInteger(set.channel);
+    switch (set.call) {
+    case TCPREMOTE_SET_FREQUENCY:
+        rpc->writeDouble(set.value);
+        rpc->writeKwargs(set.args);
+        break;
+    case TCPREMOTE_SET_FREQUENCY_NAMED:
+        rpc->writeString(set.name);
+        rpc->writeDouble(set.value);
+        rpc->writeKwargs(set.args);
+        break;
+    case TCPREMOTE_SET_GAIN_NAMED:
+        rpc->writeString(set.name);
+        rpc->writeDouble(set.value);
+        break;
+    case TCPREMOTE_SET_GAIN_MODE:
+        rpc->writeInteger(set.value>0? 1: 0);
+        break;
+    case TCPREMOTE_SET_ANTENNA:
+        rpc->writeString(set.name);
+        break;
+    default:
+        rpc->writeDouble(set.value);
+        break;
+    }
+}
+
+// apply a list of settings in one round trip (TCPREMOTE_SET_BATCH), or one
+// at a time if the server cannot. Returns number of failed settings.
+int SoapyTCPRemote::setBatch(const std::vector<SoapyRPCSetting> &batch)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setBatch(%zu)", batch.size());
+    // only safe with binary framing, a text server that does not know the
+    // call would lose sync reading the batch as further calls.
+    if (rpc->isBinary()) {
+        rpc->writeCall(TCPREMOTE_SET_BATCH);
+        rpc->writeInteger(batch.size());
+        for (auto &set: batch) {
+            rpc->writeInteger(set.call);
+            writeSettingFields(set);
+        }
+        // (waits even when pipelining, the count of failures and the fallback need the reply)
+        int status = rpc->readInteger();
+        if (status!=-1000)
+            return status;
+        SoapySDR_log(SOAPY_SDR_DEBUG, "SoapyTCPRemote::setBatch, remote does not support batches");
+    }
+    for (auto &set: batch) {
+        rpc->writeCall(set.call);
+        writeSettingFields(set);
+        rpc->readStatus();
+    }
+    return 0;
+}
+
 // Frequency
 void SoapyTCPRemote::setFrequency(const int direction,
                               const size_t channel,
@@ -652,13 +1931,36 @@ void SoapyTCPRemote::setFrequency(const int direction,
                               const SoapySDR::Kwargs &args)
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setFrequency(%f)", frequency);
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_SET_FREQUENCY);
+    // extension: tcpremote:<setting>=<value> args are applied along with the frequency, as a batch
+    std::vector<SoapyRPCSetting> batch;
+    SoapySDR::Kwargs fargs;
+    for (auto &kv: args) {
+        SoapyRPCSetting set;
+        if (kv.first.compare(0, 10, "tcpremote:")!=0) {
+            fargs[kv.first] = kv.second;
+        } else if (parseSetting(kv.first.substr(10), kv.second, direction, channel, set)) {
+            batch.push_back(set);
+        } else {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "SoapyTCPRemote::setFrequency, unknown setting: %s", kv.first.c_str());
+        }
+    }
+    if (batch.size()>0) {
+        SoapyRPCSetting set;
+        set.call = TCPREMOTE_SET_FREQUENCY;
+        set.direction = direction;
+        set.channel = channel;
+        set.value = frequency;
+        set.args = fargs;
+        batch.insert(batch.begin(), set);
+        setBatch(batch);
+        return;
+    }
+    rpc->writeCall(TCPREMOTE_SET_FREQUENCY);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeDouble(frequency);
     rpc->writeKwargs(args);
-    rpc->readInteger(); // wait for completion!
+    rpc->readStatus(); // wait for completion (unless pipelined)!
 }
 
 void SoapyTCPRemote::setFrequency(const int direction,
@@ -668,21 +1970,19 @@ void SoapyTCPRemote::setFrequency(const int direction,
                               const SoapySDR::Kwargs &args)
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setFrequency(%s,%f)", name.c_str(), frequency);
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_SET_FREQUENCY_NAMED);
+    rpc->writeCall(TCPREMOTE_SET_FREQUENCY_NAMED);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeString(name);
     rpc->writeDouble(frequency);
     rpc->writeKwargs(args);
-    rpc->readInteger(); // wait for completion!
+    rpc->readStatus(); // wait for completion (unless pipelined)!
 }
 
 double SoapyTCPRemote::getFrequency(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrequency()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_FREQUENCY);
+    rpc->writeCall(TCPREMOTE_GET_FREQUENCY);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return rpc->readDouble();
@@ -691,8 +1991,7 @@ double SoapyTCPRemote::getFrequency(const int direction, const size_t channel) c
 double SoapyTCPRemote::getFrequency(const int direction, const size_t channel, const std::string &name) const
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrequency(%s)", name.c_str());
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_FREQUENCY_NAMED);
+    rpc->writeCall(TCPREMOTE_GET_FREQUENCY_NAMED);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeString(name);
@@ -702,8 +2001,7 @@ double SoapyTCPRemote::getFrequency(const int direction, const size_t channel, c
 std::vector<std::string> SoapyTCPRemote::listFrequencies(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::listFrequencies()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_LIST_FREQUENCIES);
+    rpc->writeCall(TCPREMOTE_LIST_FREQUENCIES);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return rpc->readStrVector();
@@ -711,50 +2009,30 @@ std::vector<std::string> SoapyTCPRemote::listFrequencies(const int direction, co
 SoapySDR::RangeList SoapyTCPRemote::getFrequencyRange(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrequencyRange()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_FREQUENCY_RANGE);
+    const ChannelMeta *cm = getMeta(direction, channel);
+    if (cm)
+        return cm->freqRange;
+    rpc->writeCall(TCPREMOTE_GET_FREQUENCY_RANGE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
-    // read triplets of beg/end/step until step<0
-    SoapySDR::RangeList list;
-    while (true) {
-        double beg = rpc->readDouble();
-        double end = rpc->readDouble();
-        double step = rpc->readDouble();
-        if (step<0)
-            break;
-        list.push_back(SoapySDR::Range(beg,end,step));
-    }
-    return list;
+    return readRangeList();
 }
 
 
 SoapySDR::RangeList SoapyTCPRemote::getFrequencyRange(const int direction, const size_t channel, const std::string &name) const
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrequencyRange(%s)", name.c_str());
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_FREQUENCY_RANGE_NAMED);
+    rpc->writeCall(TCPREMOTE_GET_FREQUENCY_RANGE_NAMED);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeString(name);
-    // read triplets of beg/end/step until step<0
-    SoapySDR::RangeList list;
-    while (true) {
-        double beg = rpc->readDouble();
-        double end = rpc->readDouble();
-        double step = rpc->readDouble();
-        if (step<0)
-            break;
-        list.push_back(SoapySDR::Range(beg,end,step));
-    }
-    return list;
+    return readRangeList();
 }
 
 SoapySDR::ArgInfoList SoapyTCPRemote::getFrequencyArgsInfo(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrequencyArgsInfo()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_FREQUENCY_ARGS_INFO);
+    rpc->writeCall(TCPREMOTE_GET_FREQUENCY_ARGS_INFO);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     // TODO: parse complex structure!
@@ -772,19 +2050,17 @@ SoapySDR::ArgInfoList SoapyTCPRemote::getFrequencyArgsInfo(const int direction,
 void SoapyTCPRemote::setSampleRate(const int direction, const size_t channel, const double rate)
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setSampleRate(%f)", rate);
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_SET_SAMPLE_RATE);
+    rpc->writeCall(TCPREMOTE_SET_SAMPLE_RATE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeDouble(rate);
-    rpc->readInteger(); // wait for completion!
+    rpc->readStatus(); // wait for completion (unless pipelined)!
 }
 
 double SoapyTCPRemote::getSampleRate(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getSampleRate()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_SAMPLE_RATE);
+    rpc->writeCall(TCPREMOTE_GET_SAMPLE_RATE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     return rpc->readDouble();
@@ -806,21 +2082,91 @@ std::vector<double> SoapyTCPRemote::listSampleRates(const int direction, const s
 SoapySDR::RangeList SoapyTCPRemote::getSampleRateRange(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getSampleRateRange()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_SAMPLE_RATE_RANGE);
+    const ChannelMeta *cm = getMeta(direction, channel);
+    if (cm)
+        return cm->rateRange;
+    rpc->writeCall(TCPREMOTE_GET_SAMPLE_RATE_RANGE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
-    SoapySDR::RangeList list;
-    // read triplets of beg/end/step until step<0
-    while (true) {
-        double beg = rpc->readDouble();
-        double end = rpc->readDouble();
-        double step = rpc->readDouble();
-        if (step<0)
-            break;
-        list.push_back(SoapySDR::Range(beg,end,step));
+    return readRangeList();
+}
+
+void SoapyTCPRemote::setBandwidth(const int direction, const size_t channel, const double bw)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setBandwidth(%f)", bw);
+    rpc->writeCall(TCPREMOTE_SET_BANDWIDTH);
+    rpc->writeInteger(direction);
+    rpc->writeInteger(channel);
+    rpc->writeDouble(bw);
+    rpc->readStatus(); // wait for completion (unless pipelined)!
+}
+
+double SoapyTCPRemote::getBandwidth(const int direction, const size_t channel) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getBandwidth()");
+    rpc->writeCall(TCPREMOTE_GET_BANDWIDTH);
+    rpc->writeInteger(direction);
+    rpc->writeInteger(channel);
+    return rpc->readDouble();
+}
+
+void SoapyTCPRemote::setMasterClockRate(const double rate)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setMasterClockRate(%f)", rate);
+    // sample rate ranges may change
+    metaValid = false;
+    rpc->writeCall(TCPREMOTE_SET_MASTER_CLOCK_RATE);
+    rpc->writeDouble(rate);
+    rpc->readStatus(); // wait for completion (unless pipelined)!
+}
+
+double SoapyTCPRemote::getMasterClockRate(void) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getMasterClockRate()");
+    rpc->writeCall(TCPREMOTE_GET_MASTER_CLOCK_RATE);
+    return rpc->readDouble();
+}
+
+void SoapyTCPRemote::writeSetting(const std::string &key, const std::string &value)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::writeSetting(%s)", key.c_str());
+    // tcpremote:batch[:tx] takes a comma separated list of <setting>[:<name>][@<channel>]=<value>
+    // where setting is one of: frequency, gain, gainmode, antenna, rate, bandwidth, correction
+    if (key=="tcpremote:batch" || key=="tcpremote:batch:rx" || key=="tcpremote:batch:tx") {
+        int direction = key=="tcpremote:batch:tx"? SOAPY_SDR_TX: SOAPY_SDR_RX;
+        std::vector<SoapyRPCSetting> batch;
+        size_t cur, nxt = -1;
+        do {
+            cur = nxt+1;
+            nxt = value.find(',', cur);
+            std::string item = value.substr(cur, nxt-cur);
+            size_t eq = item.find('=');
+            if (item.length()==0)
+                continue;
+            if (eq==std::string::npos) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::writeSetting, invalid batch item: %s", item.c_str());
+                return;
+            }
+            std::string op = item.substr(0, eq);
+            size_t channel = 0;
+            size_t at = op.find('@');
+            if (at!=std::string::npos) {
+                channel = atoi(op.substr(at+1).c_str());
+                op = op.substr(0, at);
+            }
+            SoapyRPCSetting set;
+            if (!parseSetting(op, item.substr(eq+1), direction, channel, set)) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::writeSetting, unknown batch setting: %s", op.c_str());
+                return;
+            }
+            batch.push_back(set);
+        } while (nxt!=std::string::npos);
+        int failed = setBatch(batch);
+        if (failed!=0)
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::writeSetting, batch failed: %d", failed);
+        return;
     }
-    return list;
+    SoapySDR_logf(SOAPY_SDR_ERROR, "Unimplemented: writeSetting(%s)", key.c_str());
 }
 
 std::string getConfFile() {
@@ -855,77 +2201,221 @@ done:
     return tst;
 }
 
-std::string getConfValue(const std::string &key) {
-    SoapySDR_logf(SOAPY_SDR_TRACE, "getConfValue(%s)", key.c_str());
-    std::string rv = "";
-    std::string cf = getConfFile();
-    FILE *fp = nullptr;
-    if (cf.length()>0 && (fp=fopen(cf.c_str(), "r"))!=nullptr) {
-        char line[80];
+// the configuration file, read once: name=value lines ('#' for comments), the last of a name
+// wins, except address, where each line adds a server (see findTCPRemote)
+static const std::map<std::string, std::string> &getConf() {
+    static const std::map<std::string, std::string> conf = []() {
+        std::map<std::string, std::string> kv;
+        std::string cf = getConfFile();
+        FILE *fp = cf.length()>0 ? fopen(cf.c_str(), "r") : nullptr;
+        if (!fp)
+            return kv;
+        char line[1024];
         while (fgets(line, sizeof(line), fp)) {
             std::string arg = line;
-            if (arg[0]=='#')
-                continue;
-            arg = arg.substr(0, arg.length()-1);
-            size_t off = arg.find(key, 0);
-            if (std::string::npos==off)
-                continue;
-            off = arg.find('=', off);
-            if (std::string::npos==off)
+            arg = arg.substr(0, arg.find_last_not_of("\r\n")+1);
+            size_t off = arg.find('=');
+            if (arg.empty() || '#'==arg[0] || std::string::npos==off)
                 continue;
-            rv = arg.substr(off+1);
-            break;
+            std::string name = arg.substr(0, off);
+            name = name.substr(0, name.find_last_not_of(" \t")+1);
+            if ("address"==name && !kv[name].empty())
+                kv[name] += " "+arg.substr(off+1);
+            else
+                kv[name] = arg.substr(off+1);
         }
         fclose(fp);
+        return kv;
+    }();
+    return conf;
+}
+
+std::string getConfValue(const std::string &key) {
+    SoapySDR_logf(SOAPY_SDR_TRACE, "getConfValue(%s)", key.c_str());
+    auto &conf = getConf();
+    auto it = conf.find(key);
+    return it==conf.end() ? "" : it->second;
+}
+
+// "host[:port]" into address & port, no port for unix:<path>, default 0x50AF (20655)
+static void splitAddress(const std::string &spec, std::string &address, int &port) {
+    address = spec;
+    port = 0x50AF;
+    size_t colon = address.find(':',0);
+    if (address.compare(0, 5, "unix:")!=0 && colon != std::string::npos) {
+        port = atoi(address.substr(colon+1).c_str());
+        address = address.substr(0, colon);
     }
-    return rv;
 }
 
+// an option from the app's args, else the configuration file, else the default
+static long findOption(const SoapySDR::Kwargs &args, const std::string &key, long def) {
+    std::string val = args.count("tcpremote:"+key) ? args.at("tcpremote:"+key) : getConfValue(key);
+    return val.empty() ? def : atol(val.c_str());
+}
+
+// ask one server what devices it has (Device::enumerate there, with the filter args), within
+// the timeout. 1 if it answered, 0 if it connected but could not (older servers), -1 if not
+static int enumerateServer(const std::string &address, const std::string &port, const SoapySDR::Kwargs &filter,
+    long timeoutUs, SoapySDR::KwargsList &found) {
+    auto start = std::chrono::steady_clock::now();
+    int sock = connectTo(address, port, timeoutUs);
+    if (sock<0)
+        return -1;
+    // (whatever is left of the timeout, for each wait from here)
+    long left = timeoutUs - (long)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now()-start).count();
+    if (left<1000)
+        left = 1000;
+    struct timeval tv = { left/1000000, left%1000000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    SoapyRPC rpc(sock);
+    rpc.writeInteger(TCPREMOTE_ENUMERATE);
+    rpc.writeKwargs(filter);
+    int count = rpc.readInteger();
+    for (int i=0; i<count && !rpc.isError(); ++i)
+        found.push_back(rpc.readKwargs());
+    if (rpc.isError()) {
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "findTCPRemote: %s/%s did not list its devices", address.c_str(), port.c_str());
+        found.clear();
+        return 0;
+    }
+    return 1;
+}
+
+// recent answers (see findTCPRemote), by servers & filter
+struct FoundDevices
+{
+    std::chrono::steady_clock::time_point expires;
+    SoapySDR::KwargsList results;
+};
+static std::mutex s_foundLock;
+static std::map<std::string, FoundDevices> s_found;
+
 // NB: this is called with random (can be NULL) parameters when enumeration is done by an app,
 // and with *merged* parameters (app & enumeration response) when a device is created by Device::make().
+// Enumeration asks every server (tcpremote:address, or the configured address lines, several
+// separated by spaces or ';') at once, each given tcpremote:find_timeout msecs (default 1000), and
+// lists what they have, filtered by the app's args (and the configured driver). Answers are reused
+// for tcpremote:find_cache msecs (default 2000), so Device::make() after enumerating doesn't ask again.
+// A remote driver (tcpremote:driver, as our results have) is the device, we don't ask.
 SoapySDR::KwargsList findTCPRemote(const SoapySDR::Kwargs &args)
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "findTCPRemote");
 
     SoapySDR::KwargsList results;
-    
-    // We MUST have:
-    // tcpremote:address - server IP:Port
-    // tcpremote:driver  - driver to load at the remote end
-    // We MAY have:
-    // tcpremote:args    - driver arguments when creating
-    // We ensure mandatory args are present, and parse them
-    std::string address = getConfValue("address");
-    if (args.find("tcpremote:address")==args.end()) {
-        SoapySDR_logf(SOAPY_SDR_DEBUG, "Missing tcpremote:address, using: %s", address.c_str());
-    } else {
-         address = args.at("tcpremote:address");
+    std::string addresses = args.count("tcpremote:address") ? args.at("tcpremote:address") : getConfValue("address");
+    std::vector<std::string> servers;
+    size_t cur, nxt = -1;
+    do {
+        cur = nxt+1;
+        nxt = addresses.find_first_of(" \t;", cur);
+        std::string spec = addresses.substr(cur, nxt-cur);
+        if (!spec.empty())
+            servers.push_back(spec);
+    } while (nxt!=std::string::npos);
+    std::string extra = args.count("tcpremote:args") ? args.at("tcpremote:args") : getConfValue("args");
+    std::string address;
+    int port;
+    if (args.find("tcpremote:driver")!=args.end()) {
+        // We MUST have:
+        // tcpremote:address - server IP:Port
+        // tcpremote:driver  - driver to load at the remote end
+        // We MAY have:
+        // tcpremote:args    - driver arguments when creating
+        if (servers.empty())
+            SoapySDR_log(SOAPY_SDR_DEBUG, "Missing tcpremote:address");
+        splitAddress(servers.empty() ? "" : servers[0], address, port);
+        SoapySDR_logf(SOAPY_SDR_TRACE, "findTCPRemote parsed: address=%s port=%u", address.c_str(), port);
+        SoapySDR::Kwargs soapyInfo;
+        // This is the name that shows up.
+        soapyInfo["device"] = "TCP remote: "+address;
+        soapyInfo["address"] = address;
+        soapyInfo["port"] = std::to_string(port);
+        soapyInfo["tcpremote:driver"] = args.at("tcpremote:driver");
+        soapyInfo["tcpremote:args"] = extra;
+        results.push_back(soapyInfo);
+        return results;
+    }
+    // (nothing to ask from inside the server, see enumerateWorker)
+    if (servers.empty() || getenv("SOAPY_TCPREMOTE_SERVER")!=nullptr) {
+        SoapySDR_log(SOAPY_SDR_DEBUG, "findTCPRemote: no servers to ask");
+        return results;
+    }
+    // what the app is looking for, for the drivers there
+    SoapySDR::Kwargs filter;
+    for (auto &kv: args) {
+        if (kv.first.compare(0, 10, "tcpremote:")!=0 && kv.first!="driver")
+            filter[kv.first] = kv.second;
     }
     std::string driver = getConfValue("driver");
-    if (args.find("tcpremote:driver")==args.end()) {
-        SoapySDR_logf(SOAPY_SDR_DEBUG, "Missing tcpremote:driver, using: %s", driver.c_str());
-    } else {
-        driver = args.at("tcpremote:driver");
+    if (!driver.empty())
+        filter["driver"] = driver;
+    long timeoutMs = findOption(args, "find_timeout", TCPREMOTE_FIND_TIMEOUT_MS);
+    long cacheMs = findOption(args, "find_cache", TCPREMOTE_FIND_CACHE_MS);
+    std::string key = addresses;
+    for (auto &kv: filter)
+        key += "/"+kv.first+"="+kv.second;
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(s_foundLock);
+        auto it = s_found.find(key);
+        if (it!=s_found.end() && it->second.expires>now) {
+            SoapySDR_log(SOAPY_SDR_DEBUG, "findTCPRemote: recent answers");
+            return it->second.results;
+        }
     }
-    size_t colon = address.find(':',0);
-    // no port, default to 0x50AF (20655)
-    int port = 0x50AF;
-    if (colon != (size_t)-1) {
-        port = atoi(address.substr(colon+1).c_str());
-        address = address.substr(0, colon);
+    // all at once, so the slowest (or a dead one) costs one timeout, not one each
+    std::vector<SoapySDR::KwargsList> found(servers.size());
+    std::vector<int> answered(servers.size());
+    std::vector<std::thread> askers;
+    for (size_t i=0; i<servers.size(); ++i) {
+        askers.push_back(std::thread([&, i]() {
+            std::string addr;
+            int port;
+            splitAddress(servers[i], addr, port);
+            answered[i] = enumerateServer(addr, std::to_string(port), filter, timeoutMs*1000, found[i]);
+        }));
+    }
+    for (auto &t: askers)
+        t.join();
+    for (size_t i=0; i<servers.size(); ++i) {
+        splitAddress(servers[i], address, port);
+        // an older server can't say, but a configured driver is there to try
+        if (0==answered[i] && !driver.empty()) {
+            SoapySDR::Kwargs remote;
+            remote["driver"] = driver;
+            found[i].push_back(remote);
+        }
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "findTCPRemote: %s: %zu devices", servers[i].c_str(), found[i].size());
+        for (auto &remote: found[i]) {
+            if (!remote.count("driver"))
+                continue;
+            SoapySDR::Kwargs soapyInfo;
+            soapyInfo["device"] = "TCP remote: "+address;
+            soapyInfo["address"] = address;
+            soapyInfo["port"] = std::to_string(port);
+            soapyInfo["tcpremote:driver"] = remote.at("driver");
+            // the remote device's args identify it (loadRpc splits them at '/'), then any of ours
+            std::string remargs;
+            for (auto &kv: remote) {
+                if (kv.first=="driver" || kv.first=="label" || kv.first.find('/')!=std::string::npos ||
+                    kv.second.find('/')!=std::string::npos)
+                    continue;
+                remargs += (remargs.empty() ? "" : "/")+kv.first+"="+kv.second;
+            }
+            if (!extra.empty())
+                remargs += (remargs.empty() ? "" : "/")+extra;
+            soapyInfo["tcpremote:args"] = remargs;
+            soapyInfo["label"] = (remote.count("label") ? remote.at("label") : remote.at("driver"))+" @ "+servers[i];
+            results.push_back(soapyInfo);
+        }
+    }
+    if (cacheMs>0) {
+        std::lock_guard<std::mutex> lock(s_foundLock);
+        s_found[key] = { now+std::chrono::milliseconds(cacheMs), results };
     }
-    SoapySDR_logf(SOAPY_SDR_TRACE, "findTCPRemote parsed: address=%s port=%u", address.c_str(), port);
-    SoapySDR::Kwargs soapyInfo;
-    // This is the name that shows up.
-    soapyInfo["device"] = "TCP remote: "+address;
-    soapyInfo["address"] = address;
-    soapyInfo["port"] = std::to_string(port);
-    soapyInfo["tcpremote:driver"] = driver;
-    if (args.find("tcpremote:args")!=args.end())
-        soapyInfo["tcpremote:args"] = args.at("tcpremote:args");
-    else
-        soapyInfo["tcpremote:args"] = getConfValue("args");
-    results.push_back(soapyInfo);
     return results;
 }
 
@@ -937,7 +2427,13 @@ SoapySDR::Device *makeTCPRemote(const SoapySDR::Kwargs &args)
     std::string port = args.at("port");
     std::string remdriver = args.at("tcpremote:driver");
     std::string remargs = args.at("tcpremote:args");
-    return (SoapySDR::Device*) new SoapyTCPRemote(address, port, remdriver, remargs);
+    // pass through any other tcpremote:xxx options
+    SoapySDR::Kwargs options;
+    for (auto &kv: args) {
+        if (kv.first.compare(0, 10, "tcpremote:")==0)
+            options[kv.first] = kv.second;
+    }
+    return (SoapySDR::Device*) new SoapyTCPRemote(address, port, remdriver, remargs, options);
 }
 
 /* Register this driver */
@@ -5,6 +5,8 @@
 #ifndef SoapyTCPRemote_hpp
 #define SoapyTCPRemote_hpp
 
+#include <atomic>
+#include <mutex>
 #include <thread>
 
 #include <SoapySDR/Device.hpp>
@@ -22,23 +24,59 @@ private:
     const std::string remotePort;
     const std::string remoteDriver;
     const std::string remoteArgs;
+    // tcpremote:xxx options for ourselves
+    const SoapySDR::Kwargs remoteOptions;
     // requested & wire formats, as we may choose smaller native format
     std::string fmtout;
     std::string fmtwire;
-    // network connect
-    int connect() const;
+    // network connect (waiting at most timeoutUs if not negative)
+    int connect(long timeoutUs = -1) const;
     // RPC handler
     SoapyRPC *rpc;
-    // Log stream, ID and thread
+    // Log stream, ID and thread (which ends with the connection)
     FILE *log;
     int logId;
     std::thread logThread;
+    SoapySDRLogLevel logLevel;
+    std::atomic<bool> logEnded;
+    // resumable session (tcpremote:resume=<secs>): the server's token & our RPC connection ID,
+    // how long it holds on for us, and one RPC resume at a time
+    std::string sessionToken;
+    int sessionId;
+    double sessionHold;
+    std::mutex resumeLock;
+    bool resumeRpc();
+    int resumeStream(SoapySDR::Stream *stream, const long timeoutUs);
+    // cached constant metadata (see describe()), per direction (TX, RX) and channel
+    struct ChannelMeta {
+        std::string nativeFormat;
+        double fullScale;
+        std::vector<std::string> formats;
+        std::vector<std::string> gains;
+        SoapySDR::Range gainRange;
+        std::map<std::string, SoapySDR::Range> gainRanges;
+        SoapySDR::RangeList freqRange;
+        SoapySDR::RangeList rateRange;
+    };
+    mutable bool metaEnabled;
+    mutable bool metaValid;
+    mutable std::string metaHardwareKey;
+    mutable SoapySDR::Kwargs metaHardwareInfo;
+    mutable std::vector<ChannelMeta> meta[2];
+    bool describe() const;
+    bool haveMeta(const int direction) const;
+    const ChannelMeta *getMeta(const int direction, const size_t channel) const;
+    // open streams (for stats)
+    std::vector<SoapySDR::Stream *> streams;
     // helpers
+    SoapySDR::RangeList readRangeList() const;
     int loadRemoteDriver() const;
+    void writeSettingFields(const SoapyRPCSetting &set);
+    int setBatch(const std::vector<SoapyRPCSetting> &batch);
     int connectLogStream(SoapySDRLogLevel level);
     static void processLogStream(SoapyTCPRemote *rem);
 public:
-    SoapyTCPRemote(const std::string &address, const std::string &port, const std::string &remdriver, const std::string &remargs);
+    SoapyTCPRemote(const std::string &address, const std::string &port, const std::string &remdriver, const std::string &remargs, const SoapySDR::Kwargs &options);
     ~SoapyTCPRemote();
 
     // Identification API (driver local, others remote)
@@ -137,7 +175,23 @@ public:
     std::vector<double> listSampleRates(const int direction, const size_t channel) const;
     SoapySDR::RangeList getSampleRateRange(const int direction, const size_t channel) const;
 
-    // Bandwidth, Clocking, Time, Sensor, Register, Settings, GPIO, I2C, SPI, UART APIs (not yet!)
+    // Clocking API (rate only so far)
+    void setMasterClockRate(const double rate);
+    double getMasterClockRate(void) const;
+
+    // Bandwidth API (all remote, list & range not yet!)
+    void setBandwidth(const int direction, const size_t channel, const double bw);
+    double getBandwidth(const int direction, const size_t channel) const;
+
+    // Settings API (local tcpremote:xxx only)
+    void writeSetting(const std::string &key, const std::string &value);
+
+    // Sensor API (local tcpremote:stats only)
+    std::vector<std::string> listSensors(void) const;
+    SoapySDR::ArgInfo getSensorInfo(const std::string &key) const;
+    std::string readSensor(const std::string &key) const;
+
+    // Time, Register, GPIO, I2C, SPI, UART APIs (not yet!)
 };
 
 #endif /* SoapyTCPRemote_hpp */
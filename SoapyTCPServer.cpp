@@ -5,36 +5,132 @@
 // Design approach is KISS, main thread accepts connections into a
 // map, handles RPCs. Log connections exist separately (allowing
 // custom network loggers).
+// The main thread is event driven (epoll), it never waits on one
+// client: input is absorbed as it arrives and requests are only
+// processed once they are completely buffered (see SoapyRPC no-wait).
+// Each RPC connection (and thus device) has a worker thread, which
+// processes requests when the main thread sees input, so slow calls on
+// one device do not hold up the others.
 // Worker threads are created per data stream to pump in/out.
+// Devices may be shared by several RPC connections (opt-in, see
+// SharedDevice), receive streams on a shared device are fanned out
+// from one device stream to every client asking for the same thing.
+// Devices may also outlive their clients for a while (-k, see the device
+// pool), so a reconnecting client does not pay for Device::make again.
+// Connections may outlive a network outage (opt-in, see Session), the
+// client reattaching to its device & running streams.
 #include <SoapySDR/Device.hpp>
 #include "SoapyRPC.hpp"
 #include "SoapyLog.hpp"
+#include "SoapyPipe.hpp"
+#include "SoapyBroadcast.hpp"
+#include "SoapyConvert.hpp"
+#include "SoapyStats.hpp"
+#include "SoapySocket.hpp"
+#include "SoapyDSP.hpp"
+#include "SoapyDatagram.hpp"
+#include "SoapyShm.hpp"
+#include "SoapySigMF.hpp"
+#include "SoapyURing.hpp"
+#include "SoapySched.hpp"
 #include <signal.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
 #include <netdb.h>
+#include <algorithm>
 #include <unordered_set>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
+#include <random>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
 
-struct pipebuf_t {
-    void *buf;
-    int len, in, out;
-    pthread_mutex_t mutex;
-    pthread_cond_t rd, wr;
+// RPC connection executor: the main thread waits for input (one-shot), hands
+// the events over, and the worker processes them then re-arms the socket.
+struct RpcWorker
+{
+    int fd;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    // pending events (zero if none), set by main thread
+    uint32_t events;
+    // connection has gone, worker cleans up & exits
+    bool dropped;
+    // ..or is waiting for the client to resume its session until 'expires' (CLOCK_REALTIME),
+    // and the client's new socket (-1 if none), set by main thread
+    bool parked;
+    struct timespec expires;
+    int resumeSock;
+};
+
+struct SharedDevice;
+struct SharedStream;
+
+// Resumable sessions (device arg tcpremote:resume=<secs>, binary RPC only, see
+// TCPREMOTE_OPEN_SESSION): when the RPC connection is lost, we hold on to it, the device &
+// any running streams for that long, waiting for the client to come back with the token.
+// Design notes:
+// - the client's new sockets are moved onto the old descriptors (dup2), so connection IDs
+//   (our map keys, the client's remoteIds) stay the same and nothing else needs to know.
+// - a socket is only replaced by the thread using it: the RPC worker, or the stream's pump
+//   at a block boundary (abandoning a part sent block), so nobody's write is redirected.
+// - receive pumps keep reading the device meanwhile, the pipe holds the backlog (sized by
+//   tcpremote:backlog=<msecs>, default 500), beyond that the newest data is lost as usual.
+//   On resume the pump tells the client how many frames it will never see (for transmit,
+//   how many arrived), framed streams also see the gap in the frame count.
+// - the session expires (and is dropped as if closed) once the RPC connection has been gone
+//   for the hold time, without any of its TCP data streams reattached.
+struct Session
+{
+    std::string token;
+    double hold;
+    // guards the resume fields of the session's data connections
+    std::mutex lock;
+    std::condition_variable cond;
 };
+// longest a session is held for a client that has gone (secs)
+#define TCPREMOTE_SESSION_MAX 300.0
+// receive backlog held for a client that has gone (msecs, see backlogSize), and its limit (bytes)
+#define TCPREMOTE_BACKLOG_MS 500.0
+#define TCPREMOTE_BACKLOG_MAX (256*1024*1024)
+// most moved from a pipe to the network (or back) per system call (bytes), and io_uring
+// send buffers (see SoapyURing.hpp)
+#define TCPREMOTE_NET_BATCH (256*1024)
+#define TCPREMOTE_URING_SLOTS 4
+// how often an idle transmit pump looks for device stream events (usecs), and the most
+// of them waiting for a client that isn't reading them (see reportStatus)
+#define TCPREMOTE_STATUS_US 10000
+#define TCPREMOTE_STATUS_MAX 64
+// longest we wait for a device discovery request's args (secs, see enumerateWorker)
+#define TCPREMOTE_ENUM_WAIT_SECS 5
 
 struct ConnectionInfo
 {
 // default constructor clears all values
-    ConnectionInfo(): rpc(nullptr), dev(nullptr), netSock(0), netPipe(nullptr), direction(0), stream(nullptr), pid(0), log(nullptr), level(SOAPY_SDR_INFO) {}
+    ConnectionInfo(): rpc(nullptr), worker(nullptr), dev(nullptr), shared(nullptr), session(nullptr), netSock(0), netPipe(nullptr), direction(0), scale(1.0), framed(false), planar(false), latency(0), maxQueued(0), decim(1), shift(0), rate(0), udpSock(-1), udpFrames(0), udpGso(false), shmPipe(nullptr), shmMap(0), recorder(nullptr), resumeSock(-1), resumeGot(0), attachLost(0), detached(false), inhibitWrite(false), inhibitPipe(false), stats(nullptr), stream(nullptr), fanout(nullptr), pid(0), log(nullptr), level(SOAPY_SDR_INFO) {}
 // RPC connection bits
     // NB: existance of an rpc object implies this is an RPC connection, otherwise data stream
     SoapyRPC *rpc;
+    // the thread looking after it
+    RpcWorker *worker;
     // our underlying real device
     SoapySDR::Device *dev;
+    // ..when shared with other connections (tcpremote:share), else null
+    SharedDevice *shared;
+    // device key (driver & args, see deviceKey), to pool it when done
+    std::string devKey;
+    // resumable session (owned by the RPC connection, shared with its data streams), else null
+    Session *session;
     // a set of data connections / streams for this device
     std::unordered_set<int> dataIds;
 // data connection bits
@@ -44,12 +140,55 @@ struct ConnectionInfo
     pipebuf_t *netPipe;
     // which way are we going
     int direction;
-    // selected stream format
+    // selected stream format, and wire format (if quantising, see tcpremote:wire)
     std::string format;
+    std::string wire;
+    double scale;
+    // framed data mode (see SoapyRPCDataHeader), optionally with planar blocks (channel after channel)
+    bool framed;
+    bool planar;
+    // low latency profile (tcpremote:latency): delay budget in msecs (zero if not), and
+    // the most we let wait in the pipe before dropping the oldest (see dropStale)
+    double latency;
+    size_t maxQueued;
+    // receive DSP (tcpremote:decim / tcpremote:shift, see SoapyDSP.hpp), the device stream is
+    // then CF32 at the device rate, and we send 'wire' samples at the rate / decim
+    size_t decim;
+    double shift;
+    // device sample rate when activated (for DSP in a tuned subscriber, see fanoutPump)
+    double rate;
+    // UDP transport (tcpremote:udp, see SoapyDatagram.hpp): connected socket (-1 if not),
+    // frames per datagram & GSO while it works
+    int udpSock;
+    size_t udpFrames;
+    bool udpGso;
+    // shared memory transport (tcpremote:shm, see SoapyShm.hpp): the client's pipe, written
+    // in place of netPipe (null if not), and our mapping's length
+    pipebuf_t *shmPipe;
+    size_t shmMap;
+    // recording (tcpremote:record, see SoapySigMF.hpp): written in place of sending, else null
+    SigMFRecorder *recorder;
+    // resuming client (see Session): its new socket (-1 if none) & what it had from us on the
+    // old one (bytes received, or frames sent when transmitting), guarded by session->lock, and
+    // our lost count when last attached. Detached while waiting for it (quietens overrun logs).
+    volatile int resumeSock;
+    uint64_t resumeGot;
+    uint64_t attachLost;
+    volatile bool detached;
+    // debug switches (INHIBIT_WRITE / INHIBIT_PIPE in the environment), read once at setup
+    bool inhibitWrite;
+    bool inhibitPipe;
+    // counters, from setup until the stream is closed
+    StreamStats *stats;
     // selected channels
     std::vector<size_t> channels;
-    // our underlying device stream
+    // our stream options (tcpremote:xxx args, not passed to device)
+    SoapySDR::Kwargs options;
+    // our underlying device stream, and how it was set up (see takeWarmStream)
     SoapySDR::Stream *stream;
+    std::string streamKey;
+    // shared stream we subscribe to (or feed, if we are its source), else null
+    SharedStream *fanout;
     // thread ID (for data pump)
     volatile pthread_t pid;
 // log stream bits
@@ -57,115 +196,393 @@ struct ConnectionInfo
     SoapySDRLogLevel level;
 };
 
-pipebuf_t *newpipe(int size) {
-    pipebuf_t *pipe = (pipebuf_t *)malloc(sizeof(pipebuf_t)+size);
-    pipe->buf = pipe+1;
-    pipe->len = size;
-    pipe->in = pipe->out = 0;
-    pthread_mutex_init(&pipe->mutex, NULL);
-    pthread_cond_init(&pipe->rd, NULL);
-    pthread_cond_init(&pipe->wr, NULL);
-    return pipe;
-}
-
-// blocking/failing write, allows thread switching
-int pipewrite(void *src, int sz, int num, pipebuf_t *pipe, bool block = true) {
-    int rv = -1;
-    // args check
-    if (!src || !sz || !num || !pipe)
-        return -1;
-    // gain exclusive access to the pipe..
-    pthread_mutex_lock(&pipe->mutex);
-    // wait for space..
-    int av=0;
-    do {
-        // calculate pipe space used & available..
-        int us = pipe->in-pipe->out;
-        if (us<0) us += pipe->len;
-        av = pipe->len-us-1;
-        if (av<sz) {
-            // block or fail?
-            if (block)
-                pthread_cond_wait(&pipe->rd, &pipe->mutex);
-            else {
-                pthread_mutex_unlock(&pipe->mutex);
-                return rv;
+static std::map<int, ConnectionInfo> s_connections;
+// s_connections is shared between the main thread, RPC workers and logging from any thread,
+// so changes & lookups are locked. Entries themselves are only changed by their owner (the
+// worker for an RPC connection and its data streams, the main thread for log streams).
+static std::recursive_mutex s_lock;
+
+static ConnectionInfo *findConnection(int fd) {
+    std::lock_guard<std::recursive_mutex> lock(s_lock);
+    auto it = s_connections.find(fd);
+    return it!=s_connections.end() ? &(it->second) : nullptr;
+}
+
+static ConnectionInfo &addConnection(int fd, const ConnectionInfo &conn) {
+    std::lock_guard<std::recursive_mutex> lock(s_lock);
+    s_connections[fd] = conn;
+    return s_connections.at(fd);
+}
+
+static void eraseConnection(int fd) {
+    std::lock_guard<std::recursive_mutex> lock(s_lock);
+    s_connections.erase(fd);
+}
+
+// One receive stream from a shared device, fanned out to subscribers (data connections
+// that asked for the same format, channels & wire options). The source runs the usual
+// dataPump into a broadcast ring while any subscriber is active, each of those runs a
+// fanoutPump from the ring to its socket, with its own cursor and drop accounting.
+// Tuned subscribers (DSP) share the wideband stream (framed CF32) and cut their own
+// channel from it in the fanoutPump, a channeliser with one thread per channel.
+struct SharedStream
+{
+    std::string key;
+    // device stream & producer state (never in s_connections)
+    ConnectionInfo source;
+    std::atomic<bcastbuf_t *> ring;
+    // subscribers set up, and activated
+    int subscribers;
+    int active;
+};
+
+// A device opened by more than one RPC connection (device arg tcpremote:share=1 from every
+// client), made once per driver & args. Requests from the sharing connections are run one
+// at a time (lock), so the driver sees one caller as usual, and since that includes stream
+// setup & teardown the shared streams are looked after under the same lock.
+struct SharedDevice
+{
+    std::string key;
+    SoapySDR::Device *dev;
+    int refs;
+    std::mutex lock;
+    std::map<std::string, SharedStream *> streams;
+};
+
+// Device pool: with -k <secs> a device whose last user has gone is kept open (idle) for that
+// long, and handed to the next connection asking for the same driver & args (shared or not)
+// instead of making another, so watchdog restarts don't reload firmware or re-enumerate USB.
+// Nothing about the previous session follows the device except its settings (streams are
+// closed, each connection has its own state). With -w the device streams closed by clients
+// are also kept set up (deactivated) as warm streams, and the first setupStream asking for
+// the same direction, format, channels & args gets one back, any others are closed first,
+// as drivers often allow only one. A reaper thread closes devices idle for too long.
+static double s_poolKeep = 0;
+static bool s_poolWarm = false;
+// where recordings go, and replays come from (-r <dir>, see SoapySigMF.hpp), empty if nowhere
+static std::string s_recordDir;
+// pump thread placement (see SoapySched.hpp) for streams that don't ask: device pump & network
+// pump CPUs (-a, -n), scheduling (-s, -S) and NUMA node (-N), empty for the defaults
+static std::string s_pumpCpus, s_netCpus, s_pumpSched, s_netSched, s_numaNode;
+// ..and as the server started, for those left unset
+static std::string s_startCpus, s_startSched;
+struct PooledDevice
+{
+    SoapySDR::Device *dev;
+    std::chrono::steady_clock::time_point expires;
+};
+static std::multimap<std::string, PooledDevice> s_pool;
+// warm streams of every device (pooled or in use)
+static std::map<SoapySDR::Device *, std::multimap<std::string, SoapySDR::Stream *>> s_warm;
+static std::mutex s_poolLock;
+static std::condition_variable s_poolCond;
+
+// normalised driver & args (Kwargs are sorted), identifies a device to share or reuse
+static std::string deviceKey(const SoapySDR::Kwargs &kwargs) {
+    std::string key;
+    for (auto &kv: kwargs)
+        key += kv.first+"="+kv.second+"/";
+    return key;
+}
+
+// close any warm streams a device has (it is about to go, or needs its streams back)
+static void closeWarm(SoapySDR::Device *dev) {
+    std::multimap<std::string, SoapySDR::Stream *> warm;
+    {
+        std::lock_guard<std::mutex> lock(s_poolLock);
+        auto it = s_warm.find(dev);
+        if (it==s_warm.end())
+            return;
+        warm.swap(it->second);
+        s_warm.erase(it);
+    }
+    for (auto &kv: warm)
+        dev->closeStream(kv.second);
+}
+
+// a device stream set up as 'key' kept warm, or null (having closed any others)
+static SoapySDR::Stream *takeWarmStream(SoapySDR::Device *dev, const std::string &key) {
+    {
+        std::lock_guard<std::mutex> lock(s_poolLock);
+        auto it = s_warm.find(dev);
+        if (it==s_warm.end())
+            return nullptr;
+        auto st = it->second.find(key);
+        if (st!=it->second.end()) {
+            SoapySDR::Stream *stream = st->second;
+            it->second.erase(st);
+            if (it->second.empty())
+                s_warm.erase(it);
+            SoapySDR_logf(SOAPY_SDR_INFO, "setupStream: reusing warm stream %s", key.c_str());
+            return stream;
+        }
+    }
+    closeWarm(dev);
+    return nullptr;
+}
+
+// instead of closing a (deactivated) device stream, keep it warm if asked to, true if kept
+static bool keepWarmStream(SoapySDR::Device *dev, const std::string &key, SoapySDR::Stream *stream) {
+    if (!s_poolWarm || key.empty() || !stream)
+        return false;
+    std::lock_guard<std::mutex> lock(s_poolLock);
+    s_warm[dev].insert(std::make_pair(key, stream));
+    return true;
+}
+
+// a pooled device for kwargs, or a new one (may throw, as Device::make does)
+static SoapySDR::Device *makeDevice(const SoapySDR::Kwargs &kwargs) {
+    std::string key = deviceKey(kwargs);
+    {
+        std::lock_guard<std::mutex> lock(s_poolLock);
+        auto it = s_pool.find(key);
+        if (it!=s_pool.end()) {
+            SoapySDR::Device *dev = it->second.dev;
+            s_pool.erase(it);
+            SoapySDR_logf(SOAPY_SDR_INFO, "Reusing pooled device: %s", key.c_str());
+            return dev;
+        }
+    }
+    return SoapySDR::Device::make(kwargs);
+}
+
+// done with a device: pool it for a while, or close it now
+static void unmakeDevice(const std::string &key, SoapySDR::Device *dev) {
+    if (s_poolKeep>0) {
+        std::lock_guard<std::mutex> lock(s_poolLock);
+        auto expires = std::chrono::steady_clock::now() +
+            std::chrono::microseconds((long long)(s_poolKeep*1e6));
+        s_pool.insert(std::make_pair(key, PooledDevice{ dev, expires }));
+        s_poolCond.notify_one();
+        SoapySDR_logf(SOAPY_SDR_INFO, "Pooled device: %s (idle for up to %g secs)", key.c_str(), s_poolKeep);
+        return;
+    }
+    closeWarm(dev);
+    SoapySDR::Device::unmake(dev);
+}
+
+// closes pooled devices once idle for too long
+static void *poolReaper(void *) {
+    std::unique_lock<std::mutex> lock(s_poolLock);
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+        auto next = now + std::chrono::hours(1);
+        std::vector<std::pair<std::string, SoapySDR::Device *>> expired;
+        for (auto it = s_pool.begin(); it!=s_pool.end(); ) {
+            if (it->second.expires<=now) {
+                expired.push_back(std::make_pair(it->first, it->second.dev));
+                it = s_pool.erase(it);
+            } else {
+                if (it->second.expires<next)
+                    next = it->second.expires;
+                ++it;
             }
         }
-    } while (av<sz);
-    // calculate how many items of sz will fit (up to num)
-    int ft = av/sz;
-    if (ft>num) ft=num;
-    // in bytes..
-    int by = ft*sz;
-    // move those bytes!
-    char *p = (char *)src;
-    while (by--) {
-        ((char *)pipe->buf)[pipe->in++]=*p++;
-        if (pipe->in>=pipe->len)
-            pipe->in=0;
-    }
-    // assign return value = number of items written
-    rv = ft;
-    // release access under all exit conditions
-    pthread_mutex_unlock(&pipe->mutex);
-    // signal a write has occurred
-    pthread_cond_signal(&pipe->wr);
-    return rv;
+        if (expired.empty()) {
+            s_poolCond.wait_until(lock, next);
+            continue;
+        }
+        // closing may be slow, others can use the pool meanwhile
+        lock.unlock();
+        for (auto &kv: expired) {
+            SoapySDR_logf(SOAPY_SDR_INFO, "Closing idle device: %s", kv.first.c_str());
+            closeWarm(kv.second);
+            SoapySDR::Device::unmake(kv.second);
+        }
+        lock.lock();
+    }
+    return nullptr;
 }
 
-// blocking/failing read, allows thread switching
-int piperead(void *dst, int sz, int num, pipebuf_t *pipe, bool block = true) {
-    int rv = -1;
-    // args check
-    if (!dst || !sz || !num || !pipe)
-        return -1;
-    // gain exclusive access to the pipe..
-    pthread_mutex_lock(&pipe->mutex);
-    // wait for data..
-    int us=0;
-    do {
-        // calculate pipe space used
-        us = pipe->in-pipe->out;
-        if (us<0) us += pipe->len;
-        if (us<sz) {
-            if (block)
-                pthread_cond_wait(&pipe->wr, &pipe->mutex);
-            else {
-                pthread_mutex_unlock(&pipe->mutex);
-                return 0;
+static std::map<std::string, SharedDevice *> s_shared;
+static std::mutex s_sharedLock;
+
+static SharedDevice *acquireShared(const SoapySDR::Kwargs &kwargs) {
+    std::string key = deviceKey(kwargs);
+    std::lock_guard<std::mutex> lock(s_sharedLock);
+    auto it = s_shared.find(key);
+    if (it!=s_shared.end()) {
+        it->second->refs++;
+        SoapySDR_logf(SOAPY_SDR_INFO, "Sharing device: %s (%d users)", key.c_str(), it->second->refs);
+        return it->second;
+    }
+    // NB: not caught here, so the caller reports it as for any other device
+    SoapySDR::Device *dev = makeDevice(kwargs);
+    if (!dev)
+        return nullptr;
+    SharedDevice *sd = new SharedDevice();
+    sd->key = key;
+    sd->dev = dev;
+    sd->refs = 1;
+    s_shared[key] = sd;
+    return sd;
+}
+
+static void releaseShared(SharedDevice *sd) {
+    std::lock_guard<std::mutex> lock(s_sharedLock);
+    if (--sd->refs>0)
+        return;
+    s_shared.erase(sd->key);
+    unmakeDevice(sd->key, sd->dev);
+    delete sd;
+}
+// accepted sockets, waiting for their connection type
+static std::unordered_set<int> s_accepted;
+// event handling & registration of sockets we wait on (RPC, LOG, accepted)
+static int s_epoll = -1;
+
+static void watchSocket(int sock, bool oneshot = false) {
+    struct epoll_event ev;
+    ev.events = oneshot ? (EPOLLIN | EPOLLONESHOT) : EPOLLIN;
+    ev.data.fd = sock;
+    if (epoll_ctl(s_epoll, EPOLL_CTL_ADD, sock, &ev))
+        SoapySDR_logf(SOAPY_SDR_ERROR, "watchSocket(%d): %s", sock, strerror(errno));
+}
+
+static void rearmSocket(int sock) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.fd = sock;
+    if (epoll_ctl(s_epoll, EPOLL_CTL_MOD, sock, &ev))
+        SoapySDR_logf(SOAPY_SDR_ERROR, "rearmSocket(%d): %s", sock, strerror(errno));
+}
+
+static void unwatchSocket(int sock) {
+    epoll_ctl(s_epoll, EPOLL_CTL_DEL, sock, nullptr);
+}
+
+int handleRPC(int fd, uint32_t events, ConnectionInfo &conn);
+int dropRPC(ConnectionInfo &conn, int fd);
+int lostRPC(ConnectionInfo &conn, int fd);
+
+// a parked session is kept while any of its TCP data streams is attached (pumping, not
+// waiting for the client), they may come back before the RPC connection does
+static bool sessionInUse(ConnectionInfo &conn) {
+    for (int id: conn.dataIds) {
+        ConnectionInfo *data = findConnection(id);
+        if (data && data->pid!=0 && !data->detached && data->udpSock<0 && !data->shmPipe)
+            return true;
+    }
+    return false;
+}
+
+// the client is back (see Session): take its socket in place of the old one, reply with our
+// ID, as loadRpc does, and carry on listening
+static void resumeRPC(ConnectionInfo &conn, int fd, int sock) {
+    RpcWorker *w = conn.worker;
+    // (a connection we had not seen fail is just replaced)
+    if (!w->parked)
+        unwatchSocket(fd);
+    w->parked = false;
+    if (!conn.rpc->resume(sock)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "resumeRPC(%d): %s", fd, strerror(errno));
+        close(sock);
+        dropRPC(conn, fd);
+        return;
+    }
+    setNoDelay(fd);
+    conn.rpc->writeInteger(fd);
+    conn.rpc->flush();
+    SoapySDR_logf(SOAPY_SDR_INFO, "Resumed session: %d", fd);
+    watchSocket(fd, true);
+}
+
+static void *rpcWorker(void *ctx) {
+    RpcWorker *w = (RpcWorker *)ctx;
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "rpcWorker: start: %d", w->fd);
+    while (!w->dropped) {
+        pthread_mutex_lock(&w->lock);
+        bool expired = false;
+        while (!w->events && w->resumeSock<0 && !expired) {
+            if (w->parked)
+                expired = ETIMEDOUT==pthread_cond_timedwait(&w->cond, &w->lock, &w->expires);
+            else
+                pthread_cond_wait(&w->cond, &w->lock);
+        }
+        uint32_t events = w->events;
+        int sock = w->resumeSock;
+        w->events = 0;
+        w->resumeSock = -1;
+        pthread_mutex_unlock(&w->lock);
+        ConnectionInfo *conn = findConnection(w->fd);
+        if (!conn) {
+            if (sock>=0)
+                close(sock);
+            break;
+        }
+        if (sock>=0) {
+            resumeRPC(*conn, w->fd, sock);
+            continue;
+        }
+        if (w->parked) {
+            // (anything else is left over from the lost connection)
+            if (!expired)
+                continue;
+            if (sessionInUse(*conn)) {
+                w->expires.tv_sec += (time_t)ceil(conn->session->hold);
+                continue;
             }
+            SoapySDR_logf(SOAPY_SDR_INFO, "Session expired: %d", w->fd);
+            dropRPC(*conn, w->fd);
+            continue;
         }
-    } while (us<sz);
-    // calculate how many items of sz are in the pipe (up to num)
-    int nm = us/sz;
-    if (nm>num) nm=num;
-    // in bytes..
-    int by = nm*sz;
-    // move those bytes!
-    char *p = (char *)dst;
-    while (by--) {
-        *p++ = ((char *)pipe->buf)[pipe->out++];
-        if (pipe->out>=pipe->len)
-            pipe->out=0;
-    }
-    // assign return value = number of items read
-    rv = nm;
-    // release access under all exit conditions
-    pthread_mutex_unlock(&pipe->mutex);
-    // signal that a read has occurred
-    pthread_cond_signal(&pipe->rd);
-    return rv;
+        // fatal errors only lose this connection
+        if (handleRPC(w->fd, events, *conn)<0 && !w->dropped)
+            dropRPC(*conn, w->fd);
+        if (!w->dropped && !w->parked)
+            rearmSocket(w->fd);
+    }
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "rpcWorker: stop: %d", w->fd);
+    if (w->resumeSock>=0)
+        close(w->resumeSock);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    delete w;
+    return nullptr;
 }
 
-static std::map<int, ConnectionInfo> s_connections;
+static void postWorker(RpcWorker *w, uint32_t events) {
+    pthread_mutex_lock(&w->lock);
+    w->events |= events;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
 
 int createRpc(int sock) {
     SoapySDR_log(SOAPY_SDR_DEBUG, "createRpc()");
+    // the device is loaded once driver & args have arrived (see loadRpc)
     ConnectionInfo conn;
+    setNoDelay(sock);
     conn.rpc = new SoapyRPC(sock);
+    conn.rpc->setNoWait(true);
     conn.log = nullptr;     // ensure we aren't treated as LOG stream
-    // read driver and args..
+    conn.netSock = sock;
+    RpcWorker *w = new RpcWorker;
+    w->fd = sock;
+    pthread_mutex_init(&w->lock, nullptr);
+    pthread_cond_init(&w->cond, nullptr);
+    w->events = 0;
+    w->dropped = false;
+    w->parked = false;
+    w->resumeSock = -1;
+    conn.worker = w;
+    addConnection(sock, conn);
+    pthread_t pid;
+    if (pthread_create(&pid, nullptr, rpcWorker, w)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "createRpc: failed to create worker thread: %s", strerror(errno));
+        eraseConnection(sock);
+        delete conn.rpc;
+        delete w;
+        return -1;
+    }
+    pthread_detach(pid);
+    watchSocket(sock, true);
+    return 0;
+}
+
+int loadRpc(ConnectionInfo &conn, int sock) {
+    SoapySDR_log(SOAPY_SDR_DEBUG, "loadRpc()");
+    // read driver and args.. (throws until both are buffered)
     SoapySDR::Kwargs kwargs;
     std::string drv = conn.rpc->readString();
     std::string fix = drv;
@@ -195,9 +612,21 @@ int createRpc(int sock) {
             kwargs[arg.substr(0,off)]=arg.substr(off+1);
         }
     } while (nxt != std::string::npos);
+    // our own option: share the device with other connections asking for the same (and to share)
+    bool share = kwargs.count("tcpremote:share") && kwargs.at("tcpremote:share")!="0";
+    kwargs.erase("tcpremote:share");
+    // replays come from our recordings directory, not one of the client's choosing
+    if ("tcpreplay"==kwargs["driver"])
+        kwargs["dir"] = s_recordDir;
     // make the device
     try {
-        conn.dev = SoapySDR::Device::make(kwargs);
+        if (share) {
+            conn.shared = acquireShared(kwargs);
+            conn.dev = conn.shared ? conn.shared->dev : nullptr;
+        } else {
+            conn.dev = makeDevice(kwargs);
+            conn.devKey = deviceKey(kwargs);
+        }
     } catch(const std::exception &ex) {
         conn.dev = nullptr;
         SoapySDR_logf(SOAPY_SDR_ERROR,"exception from Device::make(): %s", ex.what());
@@ -206,11 +635,13 @@ int createRpc(int sock) {
         // oops - report failure to client and drop connection
         SoapySDR_logf(SOAPY_SDR_ERROR,"failed to create SoapySDR::Device: %s", kwargs["driver"].c_str());
         conn.rpc->writeInteger(-1);
+        unwatchSocket(sock);
+        conn.worker->dropped = true;
         delete conn.rpc;
+        eraseConnection(sock);
         return 0;
     }
-    // all good - add to map and respond with map key
-    s_connections[sock] = conn;
+    // all good - respond with map key
     conn.rpc->writeInteger(sock);
     SoapySDR_logf(SOAPY_SDR_INFO, "New RPC connection: %d", sock);
     return 0;
@@ -224,7 +655,7 @@ int createData(int sock, int type) {
     conn.netSock = sock;
     // all good - add to map and respond with map key
     // NB: we write to raw socket as stdio stream may be read-only..
-    s_connections[sock] = conn;
+    addConnection(sock, conn);
     char id[10];
     int ilen = sprintf(id,"%d\n",sock);
     write(sock, id, ilen);
@@ -232,26 +663,77 @@ int createData(int sock, int type) {
     return 0;
 }
 
+// device discovery (see findTCPRemote), on a thread of its own as drivers can take a while:
+// read the client's filter args, reply with what Device::enumerate finds, a count then each
+// result, and close. Never our own tcpremote driver, which would ask the servers it knows.
+static void *enumerateWorker(void *ctx) {
+    int sock = (int)(intptr_t)ctx;
+    // (a client that never sends its args is not waited for)
+    struct timeval tv = { TCPREMOTE_ENUM_WAIT_SECS, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    SoapyRPC rpc(sock);
+    SoapySDR::Kwargs args = rpc.readKwargs();
+    if (rpc.isError()) {
+        SoapySDR_log(SOAPY_SDR_ERROR, "enumerate: failed to read args");
+        return nullptr;
+    }
+    SoapySDR::KwargsList found;
+    try {
+        found = SoapySDR::Device::enumerate(args);
+    } catch (const std::exception &ex) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "enumerate: exception from Device::enumerate(): %s", ex.what());
+    }
+    found.erase(std::remove_if(found.begin(), found.end(), [](const SoapySDR::Kwargs &kw) {
+        return kw.count("driver") && "tcpremote"==kw.at("driver");
+    }), found.end());
+    rpc.writeInteger((int)found.size());
+    for (auto &kw: found)
+        rpc.writeKwargs(kw);
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "enumerate: %zu devices", found.size());
+    return nullptr;
+}
+
+int createEnumerate(int sock) {
+    SoapySDR_log(SOAPY_SDR_DEBUG, "createEnumerate()");
+    pthread_t pid;
+    if (pthread_create(&pid, nullptr, enumerateWorker, (void *)(intptr_t)sock)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "createEnumerate: failed to create thread: %s", strerror(errno));
+        close(sock);
+        return 0;
+    }
+    pthread_detach(pid);
+    return 0;
+}
+
 static SoapySDRLogLevel s_defaultLogLevel;
 
-int createLog(int sock) {
+// collect messages at the most verbose level anyone (us or a log stream) wants,
+// so nothing is formatted or passed around when nobody is listening
+static std::atomic<int> s_streamLogLevel(-1);
+static void updateLogLevel() {
+    int level = -1;
+    std::lock_guard<std::recursive_mutex> lock(s_lock);
+    for (auto &kv: s_connections) {
+        if (kv.second.log && kv.second.level > level)
+            level = kv.second.level;
+    }
+    s_streamLogLevel = level;
+    setLogLevel((SoapySDRLogLevel)(level > s_defaultLogLevel ? level : s_defaultLogLevel));
+}
+
+int createLog(int sock, int level) {
     SoapySDR_log(SOAPY_SDR_DEBUG, "createLog()");
     ConnectionInfo conn;
     conn.rpc = nullptr;     // ensure we aren't treated as RPC stream
     conn.netSock = sock;
+    setNoDelay(sock);
     conn.log = fdopen(sock, "r+");
     setlinebuf(conn.log);
-    // read log level from client
-    int level = (SoapySDRLogLevel)SOAPY_SDR_INFO;
-    char buf[10];
-    if(!fgets(buf, sizeof(buf), conn.log)) {
-        SoapySDR_logf(SOAPY_SDR_ERROR, "fgets() on log stream: %s", strerror(errno));
-        fclose(conn.log);
-        return -1;
-    }
-    sscanf(buf, "%d", (int*)&level);
+    // log level from client (already read by handleAccepted)
     conn.level = (SoapySDRLogLevel)level;
-    s_connections[sock] = conn;
+    addConnection(sock, conn);
+    updateLogLevel();
+    watchSocket(sock);
     fprintf(conn.log, "%d\n", sock);    // write our id (map key)
     SoapySDR_logf(SOAPY_SDR_INFO, "New log connection: %d @ %d", sock, level);
     return 0;
@@ -263,37 +745,955 @@ long tsdiff(struct timespec *t1, struct timespec *t2) {
     r += (t2->tv_nsec-t1->tv_nsec)/1000;
     return r;
 }
+// size of the framed block (header & samples) at the head of a pipe, zero if there is none (or closed)
+static size_t pipeBlock(pipebuf_t *pipe, size_t frameSize, bool block) {
+    uint8_t raw[TCPREMOTE_DATA_HDR];
+    if (pipeavail(pipe, sizeof(raw), block)<sizeof(raw) || !pipepeek(raw, sizeof(raw), pipe))
+        return 0;
+    SoapyRPCDataHeader hdr;
+    getDataHeader(raw, hdr);
+    return sizeof(raw) + hdr.elems*frameSize;
+}
+
+// low latency receive: called by the pipe consumer, keeps no more than maxQueued bytes waiting
+// by discarding the oldest whole items (frames, or framed blocks), newer data is worth more.
+static void dropStale(ConnectionInfo *conn, size_t frameSize) {
+    pipebuf_t *pipe = conn->netPipe;
+    size_t used = pipeused(pipe);
+    if (used<=conn->maxQueued)
+        return;
+    size_t drop = 0;
+    if (conn->framed) {
+        size_t len;
+        while (used-drop>conn->maxQueued && (len=pipeBlock(pipe, frameSize, false))>0) {
+            pipeskip(pipe, len);
+            drop += len;
+        }
+    } else {
+        drop = (used-conn->maxQueued+frameSize-1)/frameSize*frameSize;
+        pipeskip(pipe, drop);
+    }
+    SoapySDR_logf(SOAPY_SDR_WARNING, "dataPump: stale data in pipe, dropped oldest %zu bytes (used=%zu/%zu)",
+        drop, used, pipe->len);
+    statsAdd(conn->stats->overruns, 1);
+}
+
+// (pump threads) a resuming client's socket replaces ours between blocks (see Session): take
+// it if there is one, or with 'wait' (ours has failed) wait for one while the stream runs.
+// 'count' is what we have moved since last attached (bytes taken to send, or received), the
+// client is told the frames it has lost (or when transmitting, that arrived). False if none.
+static bool resumeData(ConnectionInfo *conn, bool wait, uint64_t &count) {
+    Session *s = conn->session;
+    if (!s || (!wait && conn->resumeSock<0) || conn->udpSock>=0 || conn->shmPipe)
+        return false;
+    std::unique_lock<std::mutex> lock(s->lock);
+    if (conn->resumeSock<0) {
+        SoapySDR_logf(SOAPY_SDR_INFO, "Stream waiting for client: %d", conn->netSock);
+        conn->detached = true;
+        while (conn->resumeSock<0 && conn->pid!=0)
+            s->cond.wait_for(lock, std::chrono::milliseconds(100));
+        if (conn->resumeSock<0)
+            return false;
+    }
+    int sock = conn->resumeSock;
+    uint64_t got = conn->resumeGot;
+    conn->resumeSock = -1;
+    lock.unlock();
+    if (dup2(sock, conn->netSock)<0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "resumeData(%d): %s", conn->netSock, strerror(errno));
+        close(sock);
+        return false;
+    }
+    close(sock);
+    size_t frameSize = g_frameSizes.at(conn->wire)*conn->channels.size();
+    tuneDataSocket(conn->netSock, SOAPY_SDR_RX==conn->direction, conn->rate/conn->decim*frameSize,
+        getSocketTuning(conn->options));
+    uint64_t reply = count/frameSize;
+    if (SOAPY_SDR_RX==conn->direction) {
+        // dropped here, and (unframed, where we can tell) taken but not received whole
+        uint64_t whole = got/frameSize*frameSize;
+        reply = conn->stats->lost.load() - conn->attachLost;
+        if (!conn->framed && count>whole)
+            reply += (count-whole)/frameSize;
+    }
+    char line[32];
+    int len = snprintf(line, sizeof(line), "%llu\n", (unsigned long long)reply);
+    send(conn->netSock, line, len, MSG_NOSIGNAL);
+    SoapySDR_logf(SOAPY_SDR_INFO, "Resumed stream: %d (%llu frames %s)", conn->netSock, (unsigned long long)reply,
+        SOAPY_SDR_RX==conn->direction ? "lost" : "arrived");
+    count = 0;
+    conn->attachLost = conn->stats->lost.load();
+    conn->detached = false;
+    statsAdd(conn->stats->resumes, 1);
+    return true;
+}
+
+// place the calling pump thread (see SoapySched.hpp), device side (dataPump) or network side,
+// by the stream's options, else the server's, else the device pump at fifo:1 where allowed
+static void placePump(ConnectionInfo *conn, const char *who, bool net) {
+    auto option = [conn](const char *key, const std::string &def) {
+        return conn->options.count(key) ? conn->options.at(key) : def;
+    };
+    SchedPlacement place;
+    place.cpus = option(net ? "tcpremote:netcpus" : "tcpremote:cpus", net ? s_netCpus : s_pumpCpus);
+    place.sched = option(net ? "tcpremote:netsched" : "tcpremote:sched", net ? s_netSched : s_pumpSched);
+    place.numa = option("tcpremote:numa", s_numaNode);
+    place.quiet = place.cpus.empty() && place.sched.empty() && place.numa.empty();
+    // (a NUMA node without CPUs runs on the node's, see schedPlace)
+    if (place.cpus.empty() && place.numa.empty())
+        place.cpus = s_startCpus;
+    if (place.sched.empty())
+        place.sched = net ? s_startSched : "fifo:1";
+    schedPlace(who, place);
+}
+
+// receive pipe size: a resumable stream's also holds the backlog while the client is away
+static size_t backlogSize(ConnectionInfo *conn, size_t pipeSize, size_t frameSize) {
+    // (a recording's holds what arrives while a chunk is written, see SoapySigMF.hpp)
+    if (conn->recorder)
+        return 2*conn->recorder->chunkSize()>pipeSize ? 2*conn->recorder->chunkSize() : pipeSize;
+    if (!conn->session || conn->latency>0 || conn->udpSock>=0 || conn->shmPipe)
+        return pipeSize;
+    double ms = conn->options.count("tcpremote:backlog") ? atof(conn->options.at("tcpremote:backlog").c_str()) : TCPREMOTE_BACKLOG_MS;
+    double want = conn->rate/conn->decim*frameSize*ms/1000.0;
+    if (want>TCPREMOTE_BACKLOG_MAX)
+        want = TCPREMOTE_BACKLOG_MAX;
+    return want>pipeSize ? (size_t)want : pipeSize;
+}
+
+// write all of buf to the data socket, waiting for room while the pump is running, so a
+// client that has stopped reading (full socket) cannot stop us being stopped. False on
+// network error, or if told to stop (or the client has resumed, see Session) first.
+static bool sendAll(ConnectionInfo *conn, const uint8_t *buf, size_t len) {
+    while (len>0) {
+        ssize_t nw = send(conn->netSock, buf, len, MSG_DONTWAIT|MSG_NOSIGNAL);
+        if (nw>0) {
+            buf += nw;
+            len -= nw;
+            continue;
+        }
+        if (nw<0 && EINTR==errno)
+            continue;
+        if (nw<0 && EAGAIN!=errno && EWOULDBLOCK!=errno)
+            return false;
+        if (conn->pid==0 || conn->resumeSock>=0)
+            return false;
+        struct pollfd pfd = { conn->netSock, POLLOUT, 0 };
+        poll(&pfd, 1, 100);
+    }
+    return true;
+}
+
+// send one framed block as datagrams (see SoapyDatagram.hpp) in as few system calls as we
+// can: with GSO each message carries a run of datagrams, and sendmmsg sends many messages.
+// As sendAll, waits for room while running, false on error or if told to stop.
+static bool sendDatagrams(ConnectionInfo *conn, const uint8_t *blk) {
+    static thread_local std::vector<uint8_t> dbuf;
+    size_t seg;
+    dgramSplit(dbuf, seg, blk, g_frameSizes.at(conn->wire), conn->channels.size(), conn->planar,
+        conn->udpFrames, conn->rate/conn->decim);
+    size_t total = dbuf.size();
+    size_t off = 0;
+    struct mmsghdr msgs[TCPREMOTE_UDP_BATCH];
+    struct iovec iov[TCPREMOTE_UDP_BATCH];
+#ifdef __linux__
+    union {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } ctrl[TCPREMOTE_UDP_BATCH];
+#endif
+    while (off<total) {
+        size_t per = 1;
+        if (conn->udpGso) {
+            per = TCPREMOTE_UDP_GSO_MAX/seg;
+            if (per>TCPREMOTE_UDP_GSO_SEGS)
+                per = TCPREMOTE_UDP_GSO_SEGS;
+            if (per<1)
+                per = 1;
+        }
+        int num = 0;
+        memset(msgs, 0, sizeof(msgs));
+        for (size_t o=off; o<total && num<TCPREMOTE_UDP_BATCH; ++num) {
+            size_t len = per*seg<total-o ? per*seg : total-o;
+            iov[num].iov_base = dbuf.data()+o;
+            iov[num].iov_len = len;
+            msgs[num].msg_hdr.msg_iov = &iov[num];
+            msgs[num].msg_hdr.msg_iovlen = 1;
+#ifdef __linux__
+            if (len>seg) {
+                msgs[num].msg_hdr.msg_control = ctrl[num].buf;
+                msgs[num].msg_hdr.msg_controllen = sizeof(ctrl[num].buf);
+                struct cmsghdr *cm = CMSG_FIRSTHDR(&msgs[num].msg_hdr);
+                cm->cmsg_level = SOL_UDP;
+                cm->cmsg_type = UDP_SEGMENT;
+                cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t sz = (uint16_t)seg;
+                memcpy(CMSG_DATA(cm), &sz, sizeof(sz));
+            }
+#endif
+            o += len;
+        }
+        int ns = sendmmsg(conn->udpSock, msgs, num, MSG_DONTWAIT|MSG_NOSIGNAL);
+        if (ns>0) {
+            for (int i=0; i<ns; ++i)
+                off += iov[i].iov_len;
+            continue;
+        }
+        if (EINTR==errno)
+            continue;
+        // no GSO here (or not for this route), one datagram per message from now on
+        if (conn->udpGso && (EIO==errno || EINVAL==errno || ENOPROTOOPT==errno || EOPNOTSUPP==errno)) {
+            SoapySDR_logf(SOAPY_SDR_DEBUG, "sendDatagrams: GSO unavailable (%s), using sendmmsg only", strerror(errno));
+            conn->udpGso = false;
+            continue;
+        }
+        // nobody listening (unicast): the block is lost, as it would be on the wire
+        if (ECONNREFUSED==errno)
+            return true;
+        if (EAGAIN!=errno && EWOULDBLOCK!=errno && ENOBUFS!=errno)
+            return false;
+        if (conn->pid==0)
+            return false;
+        struct pollfd pfd = { conn->udpSock, POLLOUT, 0 };
+        poll(&pfd, 1, 100);
+    }
+    return true;
+}
+
+// one block (or run of frames) to the client, as datagrams, into shared memory (where a
+// full ring loses it, seen as a gap by a framed client) or down the data connection, or
+// to disk when recording
+static bool sendBlock(ConnectionInfo *conn, const uint8_t *buf, size_t len) {
+    if (conn->recorder)
+        return conn->recorder->write(buf, len);
+    if (conn->shmPipe) {
+        if (pipewrite(buf, len, 1, conn->shmPipe, false)!=1)
+            statsAdd(conn->stats->overruns, 1);
+        return true;
+    }
+    if (conn->udpSock>=0)
+        return sendDatagrams(conn, buf);
+    return sendAll(conn, buf, len);
+}
+
+#ifdef TCPREMOTE_IO_URING
+// netPump through io_uring (tcpremote:uring=1, see SoapyURing.hpp): the pipe is read into
+// the sender's free slots (as many whole blocks as fit in each, when framed) while the last
+// run of them is written, waiting on the pipe only when there is nothing to send. False if
+// io_uring is not available here, before anything is taken from the pipe.
+static bool uringPump(ConnectionInfo *conn, size_t frameSize, bool whole) {
+    URingSender tx;
+    if (!tx.open(conn->netSock, TCPREMOTE_NET_BATCH, TCPREMOTE_URING_SLOTS)) {
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "netPump: io_uring unavailable (%s), using send", strerror(errno));
+        return false;
+    }
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "netPump: io_uring: %d", conn->netSock);
+    size_t elemSize = conn->framed ? 1 : frameSize;
+    std::vector<uint8_t> big;
+    uint64_t taken = 0;
+    uint64_t written = 0;
+    struct timespec lt;
+    clock_gettime(CLOCK_MONOTONIC, &lt);
+    while (conn->pid!=0) {
+        // a resuming client's socket replaces ours, what was in flight on the old one is lost
+        if (conn->resumeSock>=0) {
+            tx.cancel();
+            resumeData(conn, false, taken);
+        }
+        uint8_t *slot;
+        size_t over = 0;
+        while ((slot = tx.slot())!=nullptr) {
+            size_t len = 0;
+            if (whole) {
+                size_t blk;
+                while ((blk = pipeBlock(conn->netPipe, frameSize, !tx.busy() && 0==len))>0) {
+                    // (a block bigger than a slot goes on its own, once the rest have)
+                    if (len+blk>tx.size()) {
+                        if (0==len)
+                            over = blk;
+                        break;
+                    }
+                    piperead(slot+len, blk, 1, conn->netPipe);
+                    len += blk;
+                }
+            } else {
+                int nrd = piperead(slot, elemSize, tx.size()/elemSize, conn->netPipe, !tx.busy());
+                len = nrd>0 ? nrd*elemSize : 0;
+            }
+            if (0==len)
+                break;
+            taken += len;
+            tx.fill(len);
+        }
+        // nothing to send after waiting on the pipe: closed
+        if (!tx.busy() && 0==over)
+            break;
+        uint64_t t0 = statsNow();
+        int rv;
+        if (tx.busy()) {
+            rv = tx.send(100000);
+        } else {
+            big.resize(over);
+            piperead(big.data(), over, 1, conn->netPipe);
+            taken += over;
+            rv = sendAll(conn, big.data(), over) ? 1 : -1;
+            statsAdd(conn->stats->netBytes, over);
+        }
+        statsAdd(conn->stats->stallNs, statsNow()-t0);
+        statsAdd(conn->stats->netBytes, tx.written()-written);
+        written = tx.written();
+        if (logEnabled(SOAPY_SDR_TRACE)) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            TCPREMOTE_TRACE("%ld: netPump: io_uring: %d<=%llu",
+                tsdiff(&lt, &ts), conn->netSock, (unsigned long long)written);
+            lt = ts;
+        }
+        // (timed out: check we are still running)
+        if (rv>=0)
+            continue;
+        tx.cancel();
+        // carry on once the client is back (see Session)
+        if (resumeData(conn, true, taken))
+            continue;
+        if (conn->pid!=0)
+            SoapySDR_logf(SOAPY_SDR_ERROR, "netPump: unable to write to network: %s", strerror(errno));
+        break;
+    }
+    return true;
+}
+#endif
+
 void *netPump(void *ctx) {
     ConnectionInfo *conn = (ConnectionInfo *)ctx;
+    placePump(conn, "netPump", true);
     // you had 1 job... read that pipe and stuff down network
-    size_t elemSize = g_frameSizes.at(conn->format)*conn->channels.size();
-    size_t numElems = BUFSIZ/elemSize;
-    uint8_t wrbuf[numElems*elemSize];
+    // framed data is just bytes to us, the headers keep it in whole blocks (except
+    // at low latency, where we send block by block, so stale ones can be dropped whole,
+    // over UDP, where each block is split into datagrams, or when resumable, so the client
+    // picks up at a block)
+    size_t frameSize = g_frameSizes.at(conn->wire)*conn->channels.size();
+    size_t elemSize = conn->framed ? 1 : frameSize;
+    size_t numElems = TCPREMOTE_NET_BATCH/elemSize;
+    bool whole = conn->framed && (conn->maxQueued>0 || conn->udpSock>=0 || conn->session);
+    std::vector<uint8_t> wrbuf(numElems*elemSize);
     int nrd;
     SoapySDR_logf(SOAPY_SDR_DEBUG, "netPump: start: %d", conn->netSock);
     struct timespec lt;
     clock_gettime(CLOCK_MONOTONIC, &lt);
     // ignore SIGPIPE, so we get EPIPE returned
     signal(SIGPIPE, SIG_IGN);
-    while ((nrd=piperead(wrbuf, elemSize, numElems, conn->netPipe))>0 && conn->pid!=0) {
-        if (nullptr==getenv("INHIBIT_WRITE") &&
-            write(conn->netSock, wrbuf, elemSize*nrd)!=(int)elemSize*nrd) {
-            SoapySDR_logf(SOAPY_SDR_ERROR, "netPump: unable to write to network: %s", strerror(errno));
+#ifdef TCPREMOTE_IO_URING
+    // (plain TCP only: low latency drops stale blocks from the pipe, which wants it unread)
+    if (conn->options.count("tcpremote:uring") && conn->options.at("tcpremote:uring")!="0" && !conn->recorder &&
+        !conn->shmPipe && conn->udpSock<0 && 0==conn->maxQueued && !conn->inhibitWrite && uringPump(conn, frameSize, whole)) {
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "netPump: stop: %d", conn->netSock);
+        return nullptr;
+    }
+#endif
+    uint64_t taken = 0;
+    while (conn->pid!=0) {
+        resumeData(conn, false, taken);
+        if (conn->maxQueued>0)
+            dropStale(conn, frameSize);
+        if (whole) {
+            size_t len = pipeBlock(conn->netPipe, frameSize, true);
+            if (0==len)
+                break;
+            if (wrbuf.size()<len)
+                wrbuf.resize(len);
+            elemSize = len;
+            nrd = piperead(wrbuf.data(), len, 1, conn->netPipe);
+        } else {
+            nrd = piperead(wrbuf.data(), elemSize, numElems, conn->netPipe);
+        }
+        if (nrd<=0 || conn->pid==0)
+            break;
+        taken += elemSize*nrd;
+        uint64_t t0 = statsNow();
+        if (!conn->inhibitWrite && !sendBlock(conn, wrbuf.data(), elemSize*nrd)) {
+            // carry on with the next block once the client is back (see Session)
+            if (resumeData(conn, true, taken))
+                continue;
+            if (conn->pid!=0 && !conn->recorder)
+                SoapySDR_logf(SOAPY_SDR_ERROR, "netPump: unable to write to network: %s", strerror(errno));
             break;
         }
-        struct timespec ts;
-        clock_gettime(CLOCK_MONOTONIC, &ts);
-        SoapySDR_logf(SOAPY_SDR_TRACE, "%ld: netPump: write: %d<=%d",
-            tsdiff(&lt, &ts), conn->netSock, nrd*elemSize);
-        lt = ts;
+        statsAdd(conn->stats->stallNs, statsNow()-t0);
+        statsAdd(conn->stats->netBytes, elemSize*nrd);
+        if (logEnabled(SOAPY_SDR_TRACE)) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            TCPREMOTE_TRACE("%ld: netPump: write: %d<=%zu",
+                tsdiff(&lt, &ts), conn->netSock, nrd*elemSize);
+            lt = ts;
+        }
     }
     SoapySDR_logf(SOAPY_SDR_DEBUG, "netPump: stop: %d", conn->netSock);
     return nullptr;
 }
 
+// Receive blocks for the wire, used by dataPump (and fanoutPump when tuned): per channel
+// buffers of device format samples in, interleaved frames (or planar blocks, one channel
+// after another) out, quantised when the wire format differs, with room for a header.
+struct WirePacker
+{
+    size_t numChans, numElems, fSize, wfSize;
+    bool planar;
+    convert_t quant;
+    float qscale;
+    bool rescale;
+    interleave_t ilv, ilvNative;
+    std::vector<uint8_t> pbufh, qbufh;
+
+    WirePacker(const ConnectionInfo *conn, size_t maxElems) {
+        numChans = conn->channels.size();
+        numElems = maxElems;
+        fSize = g_frameSizes.at(conn->format);
+        wfSize = g_frameSizes.at(conn->wire);
+        planar = conn->planar;
+        // quantising for the wire? elements shrink, samples pass through the converter..
+        quant = nullptr;
+        if (conn->wire!=conn->format)
+            quant = getConverter(conn->format, conn->wire);
+        qscale = (float)(1.0/conn->scale);
+        rescale = quant && conn->format=="CF32" && qscale!=1.0f;
+        // ..while interleaving where the pair is known, else interleave then quantise (CS12)
+        ilv = getInterleaver(conn->format, conn->wire);
+        ilvNative = getInterleaver(conn->format, conn->format);
+        pbufh.resize(TCPREMOTE_DATA_HDR+numElems*fSize*numChans);
+        qbufh.resize(TCPREMOTE_DATA_HDR+(quant ? numElems*wfSize*numChans : 0));
+    }
+    // bytes per wire frame
+    size_t elemSize() const { return wfSize*numChans; }
+    // planar reads can land straight in the output, channel after channel
+    void *plane(size_t c) { return pbufh.data()+TCPREMOTE_DATA_HDR+c*numElems*fSize; }
+    // pack nread samples of each channel (floats are rescaled in place), returns the block
+    // of elemSize()*nread bytes, with TCPREMOTE_DATA_HDR bytes free in front of it
+    uint8_t *pack(void * const *buffs, size_t nread) {
+        uint8_t *pbuf = pbufh.data()+TCPREMOTE_DATA_HDR;
+        uint8_t *pout = quant ? qbufh.data()+TCPREMOTE_DATA_HDR : pbuf;
+        // interleave samples across channels for network format:
+        // Soapy readStream (channelized) format:
+        //            <--------- nread -------//--->
+        //            +-----------------//---+  -+    ^
+        // buffs[0]-> | channel 0 samples..  |   |    |
+        //            +-----------------//---+   |    |
+        // buffs[1]-> | channel 1 samples..  |   |    |
+        //            +-----------------//---+ cbuf   |
+        // ...        | ...                  |   |  numChans
+        //            +-----------------//---+   |    |
+        // buffs[n]-> | channel n samples..  |   |    |
+        //            +-----------------//---+   v    v
+        //
+        // Our network (interleaved) format:
+        //            <---- numChans -//--->
+        // one sample +---------------//---+  -+    ^
+        // frame per  | ch0, ch1, ..., chN |   |    |
+        // channel    +---------------//---+  pbuf  |
+        //            | ...                |   |   nread
+        //            +---------------//---+   v    v
+        //
+        // WHY? Because we would like to reduce latency of delivery,
+        // while transferring data as a byte stream in variable sized
+        // (smallish) chunks over memory pipes and TCP/IP.
+        // The readStream() API at the receiver requires us to return
+        // an equal number of samples from each channel, so we choose
+        // to send one sample from each channel through the plumbing
+        // for all nread blocks. A receiver can then deliver data to
+        // clients after every block.
+        // Planar mode (always framed) skips this: the block header
+        // says how many samples follow for each channel in turn, and
+        // the receiver holds the whole block.
+        if (rescale) {
+            for (size_t c=0; c<numChans; ++c)
+                scaleBlock(buffs[c], nread*2, qscale);
+        }
+        if (planar) {
+            // quantise each channel into place, or close up the gaps (after a short read,
+            // or from buffers elsewhere)
+            for (size_t c=0; c<numChans; ++c) {
+                if (quant) {
+                    void *qd[1] = { pout + c*nread*wfSize };
+                    quant(qd, 0, buffs[c], 1, nread);
+                } else if (buffs[c]!=pbuf + c*nread*fSize) {
+                    memmove(pbuf + c*nread*fSize, buffs[c], nread*fSize);
+                }
+            }
+        } else if (ilv) {
+            ilv(pout, buffs, 0, numChans, nread);
+        } else {
+            // quantise the whole interleaved block as one channel
+            void *qbuffs[1] = { pout };
+            ilvNative(pbuf, buffs, 0, numChans, nread);
+            quant(qbuffs, 0, pbuf, 1, nread*numChans);
+        }
+        return pout;
+    }
+};
+
+void *fanoutPump(void *ctx) {
+    ConnectionInfo *conn = (ConnectionInfo *)ctx;
+    placePump(conn, "fanoutPump", true);
+    // a subscriber to a shared stream: copy each item (frames, or one framed block) from the
+    // ring and stuff down network. We start with the next item published, and when lapped
+    // (too slow) lose the oldest, which is flagged in the next header when framed.
+    SharedStream *ss = conn->fanout;
+    size_t numChans = conn->channels.size();
+    size_t frameSize = g_frameSizes.at(conn->wire)*numChans;
+    std::vector<uint8_t> wrbuf;
+    uint64_t cursor = 0;
+    uint64_t base = 0;
+    bool first = true;
+    bool lost = false;
+    // a tuned subscriber (tcpremote:shift / decim) reads the wideband stream (framed CF32
+    // frames) and makes its own channel: split, mix & decimate each device channel, then
+    // pack for the wire, all here on our own thread
+    bool tuned = conn->decim!=1 || conn->shift!=0;
+    convert_t split = getConverter("CF32", "CF32");
+    std::vector<DspState> dsp(tuned ? numChans : 0);
+    std::vector<std::vector<float>> chanbufs(dsp.size());
+    std::vector<void *> buffs(dsp.size());
+    std::unique_ptr<WirePacker> packer;
+    uint64_t count = 0;
+    uint64_t taken = 0;
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "fanoutPump: start: %d", conn->netSock);
+    signal(SIGPIPE, SIG_IGN);
+    // a multicast stream is sent once, by the source (see handleSetupStream), we only keep
+    // it running while we are active
+    while (ss->source.udpSock>=0 && conn->pid!=0) {
+        struct timespec ts = { 0, 10000000 };
+        nanosleep(&ts, nullptr);
+    }
+    while (conn->pid!=0) {
+        // the source makes the ring once it knows the block size
+        bcastbuf_t *ring = ss->ring.load(std::memory_order_acquire);
+        if (!ring) {
+            struct timespec ts = { 0, 1000000 };
+            nanosleep(&ts, nullptr);
+            continue;
+        }
+        if (wrbuf.size()<ring->slotSize) {
+            wrbuf.resize(ring->slotSize);
+            cursor = bcastnext(ring);
+            if (tuned) {
+                size_t maxElems = (ring->slotSize-TCPREMOTE_DATA_HDR)/(g_frameSizes.at("CF32")*numChans);
+                for (size_t c=0; c<numChans; ++c) {
+                    dspInit(dsp[c], conn->shift, conn->rate, conn->decim);
+                    chanbufs[c].resize(2*maxElems);
+                    buffs[c] = chanbufs[c].data();
+                }
+                packer.reset(new WirePacker(conn, maxElems));
+                SoapySDR_logf(SOAPY_SDR_DEBUG, "fanoutPump: tuned: shift %f Hz, decim %zu, %zu taps",
+                    conn->shift, conn->decim, dsp[0].taps2.size()/2);
+            }
+        }
+        resumeData(conn, false, taken);
+        size_t len = 0;
+        uint64_t missed = 0;
+        int rv = bcastread(ring, &cursor, wrbuf.data(), &len, &missed);
+        if (missed>0) {
+            if (!conn->detached)
+                SoapySDR_logf(SOAPY_SDR_WARNING, "fanoutPump: subscriber %d too slow, data loss (%llu blocks)",
+                    conn->netSock, (unsigned long long)missed);
+            statsAdd(conn->stats->overruns, 1);
+            // (blocks are normally full slots)
+            size_t slotElems = (ring->slotSize-(ss->source.framed ? TCPREMOTE_DATA_HDR : 0))/(g_frameSizes.at(ss->source.wire)*numChans);
+            statsAdd(conn->stats->lost, missed*slotElems/conn->decim);
+            lost = true;
+        }
+        if (rv<0)
+            break;
+        if (0==rv || conn->pid==0)
+            continue;
+        uint8_t *out = wrbuf.data();
+        size_t elems = len/frameSize;
+        if (tuned) {
+            SoapyRPCDataHeader hdr;
+            getDataHeader(wrbuf.data(), hdr);
+            statsAdd(conn->stats->samplesIn, hdr.elems);
+            // loss upstream (driver or source) is ours too
+            if (hdr.flags & TCPREMOTE_FLAG_OVERFLOW)
+                lost = true;
+            split(buffs.data(), 0, wrbuf.data()+TCPREMOTE_DATA_HDR, numChans, hdr.elems);
+            size_t skip = 0;
+            elems = 0;
+            for (size_t c=0; c<numChans; ++c) {
+                dspMix(dsp[c], (float *)buffs[c], hdr.elems);
+                elems = dspDecimate(dsp[c], (float *)buffs[c], hdr.elems, skip);
+            }
+            if (0==elems)
+                continue;
+            out = packer->pack(buffs.data(), elems);
+            len = packer->elemSize()*elems;
+            if (conn->framed) {
+                hdr.elems = elems;
+                hdr.flags = (hdr.flags & ~TCPREMOTE_FLAG_OVERFLOW) | (lost ? TCPREMOTE_FLAG_OVERFLOW : 0);
+                if (conn->rate>0)
+                    hdr.timeNs += (int64_t)(skip*1e9/conn->rate);
+                hdr.count = count;
+                count += elems;
+                out -= TCPREMOTE_DATA_HDR;
+                len += TCPREMOTE_DATA_HDR;
+                putDataHeader(out, hdr);
+            }
+        } else {
+            if (conn->framed) {
+                // our frame count starts at zero, as for an unshared stream
+                SoapyRPCDataHeader hdr;
+                getDataHeader(wrbuf.data(), hdr);
+                if (first)
+                    base = hdr.count;
+                hdr.count -= base;
+                if (lost)
+                    hdr.flags |= TCPREMOTE_FLAG_OVERFLOW;
+                putDataHeader(wrbuf.data(), hdr);
+                elems = hdr.elems;
+            }
+            statsAdd(conn->stats->samplesIn, elems);
+        }
+        first = false;
+        lost = false;
+        taken += len;
+        uint64_t t0 = statsNow();
+        if (!conn->inhibitWrite && !sendBlock(conn, out, len)) {
+            if (resumeData(conn, true, taken))
+                continue;
+            if (conn->pid!=0 && !conn->recorder)
+                SoapySDR_logf(SOAPY_SDR_ERROR, "fanoutPump: unable to write to network: %s", strerror(errno));
+            break;
+        }
+        statsAdd(conn->stats->stallNs, statsNow()-t0);
+        statsAdd(conn->stats->netBytes, len);
+        statsAdd(conn->stats->samplesOut, elems);
+    }
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "fanoutPump: stop: %d", conn->netSock);
+    return nullptr;
+}
+
+// (netReader) pass one part of a block to the device writer, header first (see dataPump),
+// false if the pipe has been closed
+static bool pipeBlockPart(ConnectionInfo *conn, const SoapyRPCDataHeader &hdr, const uint8_t *frames, size_t elemSize) {
+    uint8_t raw[TCPREMOTE_DATA_HDR];
+    putDataHeader(raw, hdr);
+    if (pipewrite(raw, sizeof(raw), 1, conn->netPipe)!=1)
+        return false;
+    size_t done = 0;
+    while (done<hdr.elems) {
+        int nw = pipewrite(frames+done*elemSize, elemSize, hdr.elems-done, conn->netPipe);
+        if (nw<0)
+            return false;
+        done += nw;
+    }
+    return true;
+}
+
+void *netReader(void *ctx) {
+    ConnectionInfo *conn = (ConnectionInfo *)ctx;
+    placePump(conn, "netReader", true);
+    // the other way: read the network and stuff into the pipe, in whole elements
+    size_t elemSize = g_frameSizes.at(conn->wire)*conn->channels.size();
+    std::vector<uint8_t> buf((TCPREMOTE_NET_BATCH/elemSize+1)*elemSize + TCPREMOTE_DATA_HDR);
+    uint8_t *rdbuf = buf.data();
+    size_t bufSize = buf.size();
+    size_t have = 0;
+    uint64_t received = 0;
+    // framed: the block arriving (frames still to come, its flags & time), each part of it
+    // is passed on as it arrives, with the time on the first part and end of burst on the
+    // last, unframed data is passed on in parts with neither
+    SoapyRPCDataHeader blk = { 0, 0, 0, 0 };
+    size_t left = 0;
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "netReader: start: %d", conn->netSock);
+    while (conn->pid!=0) {
+        // a resuming client starts afresh, with whole frames (and a new header, see Session)
+        if (resumeData(conn, false, received))
+            have = left = 0;
+        // take what has arrived, only waiting (and waking up regularly to check if we
+        // should stop) when there is nothing
+        ssize_t nrd = recv(conn->netSock, rdbuf+have, bufSize-have, MSG_DONTWAIT);
+        if (nrd<0 && (EAGAIN==errno || EWOULDBLOCK==errno)) {
+            struct pollfd pfd = { conn->netSock, POLLIN, 0 };
+            int rv = poll(&pfd, 1, 100);
+            if (rv<0 && EINTR!=errno) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "netReader: poll error: %s", strerror(errno));
+                break;
+            }
+            continue;
+        }
+        if (nrd<=0) {
+            if (nrd<0 && EINTR==errno)
+                continue;
+            if (resumeData(conn, true, received)) {
+                have = left = 0;
+                continue;
+            }
+            if (nrd<0)
+                SoapySDR_logf(SOAPY_SDR_ERROR, "netReader: unable to read from network: %s", strerror(errno));
+            break;
+        }
+        have += nrd;
+        statsAdd(conn->stats->netBytes, nrd);
+        // pass on whole elements (blocking, so TCP pushes back on the sender), keep any partial
+        // one (or header)
+        size_t pos = 0;
+        bool closed = false;
+        while (!closed) {
+            if (conn->framed && 0==left) {
+                if (have-pos<TCPREMOTE_DATA_HDR)
+                    break;
+                getDataHeader(rdbuf+pos, blk);
+                pos += TCPREMOTE_DATA_HDR;
+                left = blk.elems;
+                // (no frames: just the end of a burst)
+                if (0==left)
+                    closed = !pipeBlockPart(conn, blk, nullptr, elemSize);
+                continue;
+            }
+            size_t num = (have-pos)/elemSize;
+            if (conn->framed && num>left)
+                num = left;
+            if (0==num)
+                break;
+            SoapyRPCDataHeader part = blk;
+            part.elems = num;
+            if (conn->framed) {
+                left -= num;
+                if (left>0)
+                    part.flags &= ~SOAPY_SDR_END_BURST;
+                blk.flags &= ~SOAPY_SDR_HAS_TIME;
+            }
+            closed = !pipeBlockPart(conn, part, rdbuf+pos, elemSize);
+            pos += num*elemSize;
+            received += num*elemSize;
+            statsAdd(conn->stats->samplesIn, num);
+        }
+        statsMax(conn->stats->pipeHigh, conn->netPipe->hiwater.load(std::memory_order_relaxed));
+        if (closed)
+            break;
+        have -= pos;
+        memmove(rdbuf, rdbuf+pos, have);
+    }
+    // wake the device writer if it is waiting for us
+    pipeclose(conn->netPipe);
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "netReader: stop: %d", conn->netSock);
+    return nullptr;
+}
+
+// Zero-copy direct buffer pump: device buffers are handed straight to the
+// kernel with MSG_ZEROCOPY, and only released back to the driver when the
+// kernel reports (via the socket error queue) that it has finished with them.
+// Falls back to plain blocking send() (then immediate release) if the kernel
+// or socket does not support zero-copy.
+struct zcbuf_t {
+    size_t handle;
+    uint32_t lastId;
+};
+
+// collect zero-copy completions, waiting up to timeout (mSecs), returns -1 on error
+static int reapZeroCopy(int sock, uint32_t &done, int timeout) {
+#ifdef __linux__
+    struct pollfd pfd = { sock, 0, 0 };
+    if (timeout && poll(&pfd, 1, timeout)<0)
+        return -1;
+    while (true) {
+        char ctrl[CMSG_SPACE(sizeof(struct sock_extended_err))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE)<0) {
+            if (EAGAIN==errno || EWOULDBLOCK==errno)
+                return 0;
+            return -1;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err *ee = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (ee->ee_errno!=0 || ee->ee_origin!=SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            // completions arrive in order for TCP, ee_data is the highest completed ID
+            done = ee->ee_data+1;
+        }
+    }
+#else
+    return -1;
+#endif
+}
+
+static void zeroCopyPump(ConnectionInfo *conn, size_t fSize) {
+    int one = 1;
+    bool zc = false;
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    zc = setsockopt(conn->netSock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one))==0;
+#endif
+    if (!zc)
+        SoapySDR_logf(SOAPY_SDR_WARNING, "dataPump: zero-copy unavailable (%s), using direct send", strerror(errno));
+    // hold at most half the driver's buffers while the kernel is sending
+    size_t maxHeld = conn->dev->getNumDirectAccessBuffers(conn->stream)/2;
+    if (maxHeld<1) maxHeld = 1;
+    std::deque<zcbuf_t> held;
+    uint32_t nextId = 0, doneId = 0;
+    while (conn->pid!=0) {
+        // release any buffers the kernel has finished with
+        if (zc) {
+            if (reapZeroCopy(conn->netSock, doneId, held.size()>=maxHeld? 100: 0)<0) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "dataPump: zero-copy completion error: %s", strerror(errno));
+                break;
+            }
+            while (!held.empty() && (int32_t)(held.front().lastId-doneId)<0) {
+                conn->dev->releaseReadBuffer(conn->stream, held.front().handle);
+                held.pop_front();
+            }
+            if (held.size()>=maxHeld)
+                continue;
+        }
+        // map a buffer, send it, repeat => simples :)
+        size_t handle;
+        const void *pBuf;
+        int flags = 0;
+        long long timeNs;
+        long timeoutUs = 1000000;
+        uint64_t t0 = statsNow();
+        int err = conn->dev->acquireReadBuffer(conn->stream, handle, &pBuf, flags, timeNs, timeoutUs);
+        statsDeviceCall(conn->stats, statsNow()-t0);
+        if (err<0) {
+            // non-fatal overflow, retry
+            if (SOAPY_SDR_OVERFLOW==err) {
+                SoapySDR_log(SOAPY_SDR_WARNING, "dataPump: overrun direct buffer, data loss");
+                statsAdd(conn->stats->drops, 1);
+                continue;
+            }
+            SoapySDR_logf(SOAPY_SDR_ERROR, "dataPump: error mapping direct buffer: %s", SoapySDR_errToStr(err));
+            break;
+        }
+        // send all of it, blocking (partial writes would break framing)
+        const uint8_t *p = (const uint8_t *)pBuf;
+        size_t len = err*fSize, off = 0;
+        uint32_t firstId = nextId;
+        statsAdd(conn->stats->samplesIn, err);
+        t0 = statsNow();
+        while (off<len) {
+            ssize_t n = send(conn->netSock, p+off, len-off, zc? MSG_ZEROCOPY: 0);
+            if (n<0) {
+                if (EINTR==errno)
+                    continue;
+                // out of option memory, wait for some completions
+                if (zc && ENOBUFS==errno && reapZeroCopy(conn->netSock, doneId, 10)==0)
+                    continue;
+                break;
+            }
+            off += n;
+            if (zc)
+                ++nextId;
+        }
+        statsAdd(conn->stats->stallNs, statsNow()-t0);
+        statsAdd(conn->stats->netBytes, off);
+        if (off==len)
+            statsAdd(conn->stats->samplesOut, err);
+        if (nextId!=firstId)
+            held.push_back({ handle, (uint32_t)(nextId-1) });
+        else
+            conn->dev->releaseReadBuffer(conn->stream, handle);
+        if (off<len) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "dataPump: direct write error: %s", strerror(errno));
+            break;
+        }
+    }
+    // wait (briefly) for outstanding sends, then hand everything back
+    for (int tries=0; zc && !held.empty() && (int32_t)(held.back().lastId-doneId)>=0 && tries<10; ++tries) {
+        if (reapZeroCopy(conn->netSock, doneId, 100)<0)
+            break;
+    }
+    while (!held.empty()) {
+        conn->dev->releaseReadBuffer(conn->stream, held.front().handle);
+        held.pop_front();
+    }
+}
+
+// receive output for dataPump: the client's shared memory pipe, or a new pipe drained to
+// the network by netPump, -1 if neither can be had
+static int openOutput(ConnectionInfo *conn, size_t pipeSize, pthread_t &fpid) {
+    if (conn->shmPipe) {
+        conn->netPipe = conn->shmPipe;
+    } else {
+        conn->netPipe = newpipe(pipeSize);
+        int rv = conn->netPipe ? pthread_create(&fpid, nullptr, netPump, conn) : ENOMEM;
+        if (rv) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "dataPump: failed to start network pump: %s", strerror(rv));
+            freepipe(conn->netPipe);
+            conn->netPipe = nullptr;
+            return -1;
+        }
+    }
+    conn->stats->pipeSize = conn->netPipe->len;
+    return 0;
+}
+
+static void closeOutput(ConnectionInfo *conn, pthread_t fpid) {
+    // close pipe to ensure netPump wakes up and terminates, the shared memory pipe lasts
+    // as long as the stream (see internalCloseStream)
+    if (!conn->shmPipe) {
+        pipeclose(conn->netPipe);
+        pthread_join(fpid, nullptr);
+        freepipe(conn->netPipe);
+    }
+    conn->netPipe = nullptr;
+}
+
+// (transmit dataPump) stream events on their way back to the client: headers (or the rest of
+// one) not yet sent, for the connection as it was at that many resumes
+struct StatusReports
+{
+    std::string unsent;
+    uint64_t resumes;
+};
+
+// take a device stream event (underflow, burst sent, ...) and pass it back to a framed client
+// as a header on the data connection (see SoapyRPCDataHeader), along with any not yet sent,
+// false if the driver can't tell us
+static bool reportStatus(ConnectionInfo *conn, StatusReports &reports, unsigned long &underflows) {
+    size_t mask = 0;
+    int flags = 0;
+    long long timeNs = 0;
+    int err = conn->dev->readStreamStatus(conn->stream, mask, flags, timeNs, 0);
+    if (SOAPY_SDR_NOT_SUPPORTED==err)
+        return false;
+    if (SOAPY_SDR_UNDERFLOW==err) {
+        ++underflows;
+        SoapySDR_logf(SOAPY_SDR_WARNING, "dataPump: underflow in underlying stream (underflows=%lu)", underflows);
+        statsAdd(conn->stats->drops, 1);
+    }
+    if (!conn->framed)
+        return true;
+    // (a resumed client starts afresh)
+    if (reports.resumes!=conn->stats->resumes.load()) {
+        reports.resumes = conn->stats->resumes.load();
+        reports.unsent.clear();
+    }
+    std::string &unsent = reports.unsent;
+    if (SOAPY_SDR_TIMEOUT!=err) {
+        // (a client that isn't reading them misses the newest)
+        if (unsent.size()<TCPREMOTE_STATUS_MAX*TCPREMOTE_DATA_HDR) {
+            SoapyRPCDataHeader hdr = { (uint32_t)mask, flags, timeNs, (uint64_t)(int64_t)err };
+            char raw[TCPREMOTE_DATA_HDR];
+            putDataHeader((uint8_t *)raw, hdr);
+            unsent.append(raw, sizeof(raw));
+        } else {
+            SoapySDR_logf(SOAPY_SDR_DEBUG, "dataPump: stream event not sent: %s", SoapySDR_errToStr(err));
+        }
+    }
+    if (!unsent.empty()) {
+        ssize_t nw = send(conn->netSock, unsent.data(), unsent.size(), MSG_DONTWAIT|MSG_NOSIGNAL);
+        if (nw>0)
+            unsent.erase(0, nw);
+    }
+    return true;
+}
+
 void *dataPump(void *ctx) {
     ConnectionInfo *conn = (ConnectionInfo *)ctx;
     SoapySDR_logf(SOAPY_SDR_DEBUG, "dataPump: start: %d", conn->netSock);
+    // before anything is allocated, so the pipes & work areas are local
+    placePump(conn, "dataPump", false);
     // first - activate the underlying stream
     if (conn->dev->activateStream(conn->stream)) {
         SoapySDR_log(SOAPY_SDR_ERROR, "dataPump: failed to activate underlying stream");
@@ -301,25 +1701,33 @@ void *dataPump(void *ctx) {
     }
     // special case: one channel, in native format, with direct buffers supported - we can avoid lots of work
     double full;
-    if (1==conn->channels.size()
+    if (SOAPY_SDR_RX==conn->direction
+        && 1==conn->channels.size()
+        && conn->wire==conn->format
+        && !conn->framed
+        && 0==conn->latency
+        && !conn->fanout
+        && 1==conn->decim && 0==conn->shift
         && conn->dev->getNativeStreamFormat(conn->direction, conn->channels.at(0), full)==conn->format
         && conn->dev->getNumDirectAccessBuffers(conn->stream) > 0) {
         SoapySDR_log(SOAPY_SDR_DEBUG, "dataPump: using direct buffers");
-        if (SOAPY_SDR_RX!=conn->direction) {
-            SoapySDR_log(SOAPY_SDR_ERROR, "dataPump: transmit not supported - sorry :=(");
+        size_t fSize = g_frameSizes.at(conn->format);
+        // send straight from device buffers if asked to use direct write
+        bool zerocopy = conn->options.count("tcpremote:zerocopy") ? conn->options.at("tcpremote:zerocopy")!="0" :
+            nullptr!=getenv("SOAPY_TCPREMOTE_DIRECT_WRITE");
+        if (!conn->shmPipe && !conn->recorder && zerocopy) {
+            zeroCopyPump(conn, fSize);
             conn->dev->deactivateStream(conn->stream);
+            SoapySDR_logf(SOAPY_SDR_DEBUG, "dataPump: stop: %d", conn->netSock);
             return nullptr;
         }
-        // make the network output pipe (10x MTU for jitter buffering)
-        size_t fSize = g_frameSizes.at(conn->format);
+        // make the network output pipe (10x MTU for jitter buffering) & start network pump
         size_t mtu = conn->dev->getStreamMTU(conn->stream);
-        size_t pipeSize = mtu * fSize * 10;
-        conn->netPipe = newpipe(pipeSize);
-        // start network pump, unless asked to use direct write
-        bool bDirect = nullptr!=getenv("SOAPY_TCPREMOTE_DIRECT_WRITE");
+        size_t pipeSize = backlogSize(conn, mtu * fSize * 10, fSize);
         pthread_t fpid;
-        if (!bDirect) {
-            pthread_create(&fpid, nullptr, netPump, conn);
+        if (openOutput(conn, pipeSize, fpid)) {
+            conn->dev->deactivateStream(conn->stream);
+            return nullptr;
         }
         while (conn->pid!=0) {
             // map a buffer, copy to pipe, repeat => simples :)
@@ -328,33 +1736,33 @@ void *dataPump(void *ctx) {
             int flags = 0;
             long long timeNs;
             long timeoutUs = 1000000;
+            uint64_t t0 = statsNow();
             int err = conn->dev->acquireReadBuffer(conn->stream, handle, &pBuf, flags, timeNs, timeoutUs);
+            statsDeviceCall(conn->stats, statsNow()-t0);
             if (err<0) {
                 // non-fatal overflow, retry
                 if (SOAPY_SDR_OVERFLOW==err) {
                     SoapySDR_log(SOAPY_SDR_WARNING, "dataPump: overrun direct buffer, data loss");
+                    statsAdd(conn->stats->drops, 1);
                     continue;
                 }
                 SoapySDR_logf(SOAPY_SDR_ERROR, "dataPump: error mapping direct buffer: %s", SoapySDR_errToStr(err));
                 break;
             }
-            if (bDirect) {
-                if (send(conn->netSock, pBuf, err*fSize, MSG_DONTWAIT)!=(int)(err*fSize)) {
-                    SoapySDR_logf(SOAPY_SDR_WARNING, "dataPump: direct write error: %s", strerror(errno));
-                }
-            } else {
-                if (pipewrite((void *)pBuf, fSize, err, conn->netPipe, false)<0) {
-                    SoapySDR_log(SOAPY_SDR_WARNING, "dataPump: overrun network pipe, data loss");
-                }
+            statsAdd(conn->stats->samplesIn, err);
+            int nw = pipewrite(pBuf, fSize, err, conn->netPipe, false);
+            if (nw!=err) {
+                if (!conn->detached)
+                    SoapySDR_logf(SOAPY_SDR_WARNING, "dataPump: overrun network pipe, data loss (overruns=%lu, used=%zu/%zu)",
+                        conn->netPipe->overruns.load(), pipeused(conn->netPipe), conn->netPipe->len);
+                statsAdd(conn->stats->overruns, 1);
+                statsAdd(conn->stats->lost, err-(nw>0 ? nw : 0));
             }
+            statsAdd(conn->stats->samplesOut, nw>0 ? nw : 0);
+            statsMax(conn->stats->pipeHigh, conn->netPipe->hiwater.load(std::memory_order_relaxed));
             conn->dev->releaseReadBuffer(conn->stream, handle);
         }
-        if (!bDirect) {
-            // final write to ensure netPump wakes up and terminates
-            pipewrite((void *)".", 1, 1, conn->netPipe, false);
-            pthread_join(fpid, nullptr);
-        }
-        free(conn->netPipe);
+        closeOutput(conn, fpid);
         // stop the byte flood :=)
         conn->dev->deactivateStream(conn->stream);
         SoapySDR_logf(SOAPY_SDR_DEBUG, "dataPump: stop: %d", conn->netSock);
@@ -364,24 +1772,74 @@ void *dataPump(void *ctx) {
     if (SOAPY_SDR_RX==conn->direction) {
         // use maximum number of elements/samples per read supported by the underlying driver
         size_t numElems = conn->dev->getStreamMTU(conn->stream);
+        double rate = 0;
+        if (conn->latency>0) {
+            // low latency: smaller reads, a quarter of the budget
+            rate = conn->dev->getSampleRate(conn->direction, conn->channels.at(0));
+            size_t want = (size_t)(rate*conn->latency/4000.0);
+            if (want>0 && want<numElems)
+                numElems = want;
+        }
         size_t fSize = g_frameSizes.at(conn->format);
         size_t numChans = conn->channels.size();
-        size_t elemSize = fSize * numChans;
         size_t chnSize = numElems * fSize;
         size_t readSize = chnSize * numChans;
-        // inter-thread pipe large enough to hold 10xMTU, should cope with TCP jitter
-        size_t pipeSize = readSize * 10;
+        // DSP state for each channel, timestamps move to the first sample kept
+        std::vector<DspState> dsp;
+        if (conn->decim!=1 || conn->shift!=0) {
+            rate = conn->dev->getSampleRate(conn->direction, conn->channels.at(0));
+            dsp.resize(numChans);
+            for (auto &st: dsp)
+                dspInit(st, conn->shift, rate, conn->decim);
+            SoapySDR_logf(SOAPY_SDR_DEBUG, "dataPump: DSP: shift %f Hz, decim %zu, %zu taps",
+                conn->shift, conn->decim, dsp[0].taps2.size()/2);
+        }
+        // wire packing (and quantising), see WirePacker
+        WirePacker packer(conn, numElems);
+        size_t elemSize = packer.elemSize();
+        // inter-thread pipe large enough to hold 10xMTU, should cope with TCP jitter..
+        size_t pipeSize = (elemSize * numElems + TCPREMOTE_DATA_HDR) * 10;
+        // ..or at low latency, sized by time: half the budget may wait (the oldest is dropped
+        // beyond that, see dropStale), with room for as much again
+        conn->maxQueued = 0;
+        if (conn->latency>0 && rate>0) {
+            size_t item = elemSize * numElems + TCPREMOTE_DATA_HDR;
+            conn->maxQueued = (size_t)(rate/conn->decim*elemSize*conn->latency/2000.0);
+            if (conn->maxQueued<item)
+                conn->maxQueued = item;
+            pipeSize = conn->maxQueued*2 + item;
+        }
+        pipeSize = backlogSize(conn, pipeSize, elemSize);
         // allocate buffers & pointers to them
-        void *buffs[numChans];
-        uint8_t cbuf[readSize];
-        uint8_t pbuf[readSize];
-        conn->netPipe = newpipe(pipeSize);
+        std::vector<void *> buffs(numChans);
+        std::vector<uint8_t> cbuf(readSize);
+        // running frame count & loss flag for framed mode
+        uint64_t count = 0;
+        bool lost = false;
+        // planar blocks are read straight into the output, channel after channel
         for (size_t c=0; c<numChans; ++c)
-            buffs[c] = cbuf+(c*chnSize);
-        SoapySDR_logf(SOAPY_SDR_TRACE, "dataPump: numElems=%d", numElems);
-        // start network pump
+            buffs[c] = conn->planar ? packer.plane(c) : cbuf.data()+(c*chnSize);
+        TCPREMOTE_TRACE("dataPump: numElems=%zu", numElems);
+        // a shared stream source feeds the broadcast ring (as many whole blocks as the pipe
+        // would hold), subscribers take it from there, otherwise (or when multicasting
+        // itself) start network pump (or write the client's shared memory)
+        bcastbuf_t *ring = nullptr;
         pthread_t fpid;
-        pthread_create(&fpid, nullptr, netPump, conn);
+        if (conn->fanout && conn->udpSock<0) {
+            size_t item = elemSize * numElems + TCPREMOTE_DATA_HDR;
+            size_t slots = pipeSize/item;
+            ring = newbcast(slots<4 ? 4 : slots, item);
+            if (!ring) {
+                SoapySDR_log(SOAPY_SDR_ERROR, "dataPump: failed to allocate shared stream ring");
+                conn->dev->deactivateStream(conn->stream);
+                return nullptr;
+            }
+            conn->stats->pipeSize = ring->slots*item;
+            conn->fanout->ring.store(ring, std::memory_order_release);
+        } else if (openOutput(conn, pipeSize, fpid)) {
+            conn->dev->deactivateStream(conn->stream);
+            return nullptr;
+        }
         // pump until told to stop!
         struct timespec lt;
         clock_gettime(CLOCK_MONOTONIC, &lt);
@@ -389,111 +1847,370 @@ void *dataPump(void *ctx) {
             int flags = 0;
             long long time = 0;
             long timeout = 1000000; // 1 second
-            int nread = conn->dev->readStream(conn->stream, buffs, numElems, flags, time, timeout);
+            uint64_t t0 = statsNow();
+            int nread = conn->dev->readStream(conn->stream, buffs.data(), numElems, flags, time, timeout);
+            statsDeviceCall(conn->stats, statsNow()-t0);
             if (nread<0) {
                 SoapySDR_logf(SOAPY_SDR_ERROR,
                     "dataPump: error reading underlying stream: %s", SoapySDR_errToStr(nread));
                 // non-fatal overflow
-                if (nread==SOAPY_SDR_OVERFLOW)
+                if (nread==SOAPY_SDR_OVERFLOW) {
+                    statsAdd(conn->stats->drops, 1);
+                    lost = true;
                     continue;
+                }
                 break;
             }
-            // interleave samples across channels for network format:
-            // Soapy readStream (channelized) format:
-            //            <--------- nread -------//--->
-            //            +-----------------//---+  -+    ^
-            // buffs[0]-> | channel 0 samples..  |   |    |
-            //            +-----------------//---+   |    |
-            // buffs[1]-> | channel 1 samples..  |   |    |
-            //            +-----------------//---+ cbuf   |
-            // ...        | ...                  |   |  numChans
-            //            +-----------------//---+   |    |
-            // buffs[n]-> | channel n samples..  |   |    |
-            //            +-----------------//---+   v    v
-            //
-            // Our network (interleaved) format:
-            //            <---- numChans -//--->
-            // one sample +---------------//---+  -+    ^
-            // frame per  | ch0, ch1, ..., chN |   |    |
-            // channel    +---------------//---+  pbuf  |
-            //            | ...                |   |   nread
-            //            +---------------//---+   v    v
-            //
-            // WHY? Because we would like to reduce latency of delivery,
-            // while transferring data as a byte stream in variable sized
-            // (smallish) chunks over memory pipes and TCP/IP.
-            // The readStream() API at the receiver requires us to return
-            // an equal number of samples from each channel, so we choose
-            // to send one sample from each channel through the plumbing
-            // for all nread blocks. A receiver can then deliver data to
-            // clients after every block.
-            uint8_t *pn = pbuf;
-            for (int idx=0; idx<nread; ++idx) {
-                size_t eoff = idx*fSize;
+            statsAdd(conn->stats->samplesIn, nread);
+            if (!dsp.empty()) {
+                size_t first = 0;
+                size_t nout = 0;
                 for (size_t c=0; c<numChans; ++c) {
-                    uint8_t *pc = (uint8_t *)buffs[c];
-                    memcpy(pn, pc+eoff, fSize);
-                    pn += fSize;
+                    dspMix(dsp[c], (float *)buffs[c], nread);
+                    nout = dspDecimate(dsp[c], (float *)buffs[c], nread, first);
                 }
+                if (rate>0)
+                    time += (long long)(first*1e9/rate);
+                nread = (int)nout;
+                if (0==nread)
+                    continue;
+            }
+            uint8_t *pout = packer.pack(buffs.data(), nread);
+            if (logEnabled(SOAPY_SDR_TRACE)) {
+                struct timespec ts;
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                TCPREMOTE_TRACE("%ld: dataPump: p<=%zu",
+                    tsdiff(&lt, &ts), elemSize*nread);
+                lt = ts;
+            }
+            if (conn->framed) {
+                // push header & block to pipe as one item (all or nothing)
+                SoapyRPCDataHeader hdr;
+                hdr.elems = nread;
+                hdr.flags = flags | (lost ? TCPREMOTE_FLAG_OVERFLOW : 0);
+                hdr.timeNs = time;
+                hdr.count = count;
+                count += nread;
+                putDataHeader(pout-TCPREMOTE_DATA_HDR, hdr);
+                if (ring) {
+                    bcastwrite(ring, pout-TCPREMOTE_DATA_HDR, TCPREMOTE_DATA_HDR+elemSize*nread);
+                    statsAdd(conn->stats->samplesOut, nread);
+                    lost = false;
+                } else if (pipewrite(pout-TCPREMOTE_DATA_HDR, TCPREMOTE_DATA_HDR+elemSize*nread, 1, conn->netPipe, false)!=1) {
+                    if (!conn->detached)
+                        SoapySDR_logf(SOAPY_SDR_WARNING, "dataPump: overrun network pipe, data loss (overruns=%lu, used=%zu/%zu)",
+                            conn->netPipe->overruns.load(), pipeused(conn->netPipe), conn->netPipe->len);
+                    statsAdd(conn->stats->overruns, 1);
+                    statsAdd(conn->stats->lost, nread);
+                    lost = true;
+                } else {
+                    statsAdd(conn->stats->samplesOut, nread);
+                    lost = false;
+                }
+            }
+            // shared: the block is one item for every subscriber
+            else if (ring) {
+                bcastwrite(ring, pout, elemSize*nread);
+                statsAdd(conn->stats->samplesOut, nread);
             }
-            struct timespec ts;
-            clock_gettime(CLOCK_MONOTONIC, &ts);
-            SoapySDR_logf(SOAPY_SDR_TRACE, "%ld: dataPump: p<=%d",
-                tsdiff(&lt, &ts), elemSize*nread);
-            lt = ts;
             // push to pipe in multiples of element size
-            if (nullptr==getenv("INHIBIT_PIPE") && pipewrite(pbuf, elemSize, nread, conn->netPipe, false)<0) {
-                SoapySDR_log(SOAPY_SDR_WARNING, "dataPump: overrun network pipe, data loss");
+            else if (!conn->inhibitPipe) {
+                int nw = pipewrite(pout, elemSize, nread, conn->netPipe, false);
+                if (nw!=nread) {
+                    if (!conn->detached)
+                        SoapySDR_logf(SOAPY_SDR_WARNING, "dataPump: overrun network pipe, data loss (overruns=%lu, used=%zu/%zu)",
+                            conn->netPipe->overruns.load(), pipeused(conn->netPipe), conn->netPipe->len);
+                    statsAdd(conn->stats->overruns, 1);
+                    statsAdd(conn->stats->lost, nread-(nw>0 ? nw : 0));
+                }
+                statsAdd(conn->stats->samplesOut, nw>0 ? nw : 0);
             }
+            if (!ring)
+                statsMax(conn->stats->pipeHigh, conn->netPipe->hiwater.load(std::memory_order_relaxed));
+        }
+        // close pipe (or ring) to ensure netPump (or subscribers) wake up and terminate,
+        // the ring is freed once the subscribers have gone (see stopFanout)
+        if (ring)
+            bcastclose(ring);
+        else
+            closeOutput(conn, fpid);
+    } else {
+        // write MTU sized chunks to the underlying driver
+        size_t numElems = conn->dev->getStreamMTU(conn->stream);
+        double rate = 0;
+        if (conn->latency>0) {
+            // low latency: smaller writes, a quarter of the budget
+            rate = conn->dev->getSampleRate(conn->direction, conn->channels.at(0));
+            size_t want = (size_t)(rate*conn->latency/4000.0);
+            if (want>0 && want<numElems)
+                numElems = want;
+        }
+        size_t fSize = g_frameSizes.at(conn->format);
+        size_t numChans = conn->channels.size();
+        size_t elemSize = fSize * numChans;
+        size_t chnSize = numElems * fSize;
+        // pipe holds 10xMTU, as receive, or at low latency is sized by time: half the budget,
+        // nothing is dropped, a full pipe pushes back through TCP to the client's writeStream()
+        size_t pipeSize = elemSize * numElems * 10;
+        conn->maxQueued = 0;
+        if (conn->latency>0 && rate>0)
+            pipeSize = (size_t)(rate*elemSize*conn->latency/2000.0) + elemSize*numElems;
+        std::vector<void *> buffs(numChans);
+        std::vector<const void *> wbuffs(numChans);
+        std::vector<uint8_t> cbuf(chnSize * numChans);
+        std::vector<uint8_t> pbuf(elemSize * numElems);
+        for (size_t c=0; c<numChans; ++c)
+            buffs[c] = cbuf.data()+(c*chnSize);
+        // de-interleave is the identity conversion
+        convert_t split = getConverter(conn->format, conn->format);
+        conn->netPipe = newpipe(pipeSize);
+        TCPREMOTE_TRACE("dataPump: numElems=%zu", numElems);
+        // start network reader
+        pthread_t fpid;
+        int rv = conn->netPipe ? pthread_create(&fpid, nullptr, netReader, conn) : ENOMEM;
+        if (rv) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "dataPump: failed to start network reader: %s", strerror(rv));
+            freepipe(conn->netPipe);
+            conn->netPipe = nullptr;
+            conn->dev->deactivateStream(conn->stream);
+            return nullptr;
+        }
+        conn->stats->pipeSize = conn->netPipe->len;
+        unsigned long underflows = 0;
+        bool flowing = false;
+        bool status = true;
+        bool failed = false;
+        StatusReports reports;
+        reports.resumes = conn->stats->resumes.load();
+        // the pipe holds parts of blocks, each a header (its flags & time, see netReader) then
+        // its frames, which go to the driver an MTU at a time: time on the first write, end
+        // of burst with the last
+        while (conn->pid!=0 && !failed) {
+            uint8_t raw[TCPREMOTE_DATA_HDR];
+            // try for data without waiting, if there is none mid-burst, the device is starved
+            if (piperead(raw, sizeof(raw), 1, conn->netPipe, false)<1) {
+                if (flowing) {
+                    ++underflows;
+                    SoapySDR_logf(SOAPY_SDR_WARNING, "dataPump: underrun network pipe (underflows=%lu)", underflows);
+                    statsAdd(conn->stats->underruns, 1);
+                    flowing = false;
+                }
+                // wait for more, passing on the device's events (a burst sent, say) meanwhile,
+                // until closed (network gone, or told to stop)
+                while (conn->pid!=0 && pipewait(conn->netPipe, sizeof(raw), status ? TCPREMOTE_STATUS_US : 100000)<sizeof(raw) &&
+                    !conn->netPipe->closed.load(std::memory_order_acquire))
+                    status = status && reportStatus(conn, reports, underflows);
+                if (conn->pid==0 || piperead(raw, sizeof(raw), 1, conn->netPipe, false)<1)
+                    break;
+            }
+            SoapyRPCDataHeader hdr;
+            getDataHeader(raw, hdr);
+            flowing = !(hdr.flags & SOAPY_SDR_END_BURST);
+            int flags = hdr.flags;
+            size_t left = hdr.elems;
+            do {
+                int nrd = 0;
+                if (left>0) {
+                    nrd = piperead(pbuf.data(), elemSize, left<numElems ? left : numElems, conn->netPipe);
+                    if (nrd<=0)
+                        break;
+                    split(buffs.data(), 0, pbuf.data(), numChans, nrd);
+                    left -= nrd;
+                }
+                int wflags = left>0 ? flags & ~SOAPY_SDR_END_BURST : flags;
+                int sent = 0;
+                do {
+                    for (size_t c=0; c<numChans; ++c)
+                        wbuffs[c] = (uint8_t *)buffs[c] + sent*fSize;
+                    long timeout = 1000000; // 1 second
+                    uint64_t t0 = statsNow();
+                    int nwrt = conn->dev->writeStream(conn->stream, wbuffs.data(), nrd-sent, wflags, hdr.timeNs, timeout);
+                    statsDeviceCall(conn->stats, statsNow()-t0);
+                    if (nwrt<0) {
+                        // non-fatal underflow / timeout, retry
+                        if (SOAPY_SDR_UNDERFLOW==nwrt || SOAPY_SDR_TIMEOUT==nwrt) {
+                            if (SOAPY_SDR_UNDERFLOW==nwrt)
+                                statsAdd(conn->stats->drops, 1);
+                            SoapySDR_logf(SOAPY_SDR_WARNING, "dataPump: writing underlying stream: %s", SoapySDR_errToStr(nwrt));
+                            continue;
+                        }
+                        SoapySDR_logf(SOAPY_SDR_ERROR, "dataPump: error writing underlying stream: %s", SoapySDR_errToStr(nwrt));
+                        failed = true;
+                        break;
+                    }
+                    sent += nwrt;
+                    wflags &= ~SOAPY_SDR_HAS_TIME;
+                    statsAdd(conn->stats->samplesOut, nwrt);
+                } while (sent<nrd && conn->pid!=0);
+                flags &= ~SOAPY_SDR_HAS_TIME;
+                // report driver side underflows (and the rest), if the driver can tell us
+                if (status)
+                    status = reportStatus(conn, reports, underflows);
+            } while (left>0 && !failed && conn->pid!=0);
+        }
+        // close pipe to ensure netReader gives up and terminates
+        pipeclose(conn->netPipe);
+        pthread_join(fpid, nullptr);
+        freepipe(conn->netPipe);
+        conn->netPipe = nullptr;
+    }
+    // dropping out - deactivate underlying stream
+    conn->dev->deactivateStream(conn->stream);
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "dataPump: stop: %d", conn->netSock);
+    return nullptr;
+}
+
+int handleListen(int lsock, uint32_t events) {
+    // oops before expected..
+    if (events & (EPOLLERR|EPOLLHUP)) {
+        SoapySDR_log(SOAPY_SDR_ERROR,"EOF or error in listen socket");
+        return -1;
+    }
+    // connect pending, we wait for the connection type without blocking anyone
+    struct sockaddr addr;
+    socklen_t len = sizeof(addr);
+    int sock = accept(lsock, &addr, &len);
+    if (sock<0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"error accepting connection: %s", strerror(errno));
+        return 0;
+    }
+    s_accepted.insert(sock);
+    watchSocket(sock);
+    return 0;
+}
+
+// Prometheus metrics connections: any request gets the counters for all streams, then we close
+static std::unordered_set<int> s_metrics;
+
+int handleMetricsListen(int msock) {
+    int sock = accept(msock, nullptr, nullptr);
+    if (sock<0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"error accepting metrics connection: %s", strerror(errno));
+        return 0;
+    }
+    s_metrics.insert(sock);
+    watchSocket(sock);
+    return 0;
+}
+
+int handleMetrics(int sock) {
+    // we don't care what was asked for (path, headers), just that something arrived
+    char req[1024];
+    recv(sock, req, sizeof(req), MSG_DONTWAIT);
+    std::string body;
+    {
+        std::lock_guard<std::recursive_mutex> lock(s_lock);
+        StatsList list;
+        for (auto &kv: s_connections) {
+            ConnectionInfo &ci = kv.second;
+            if (!ci.stats)
+                continue;
+            list.push_back(std::make_pair("stream=\""+std::to_string(kv.first)+"\",direction=\""+
+                (SOAPY_SDR_RX==ci.direction ? "rx" : "tx")+"\",format=\""+ci.wire+"\"", ci.stats));
         }
-        // final write to ensure netPump wakes up and terminates
-        pipewrite(pbuf, elemSize, 1, conn->netPipe, false);
-        pthread_join(fpid, nullptr);
-        free(conn->netPipe);
-    } else {
-        // TODO:XXX:
-        SoapySDR_log(SOAPY_SDR_ERROR, "dataPump: unimplemented data receive funtion :=(");
+        body = statsPrometheus(list);
     }
-    // dropping out - deactivate underlying stream
-    conn->dev->deactivateStream(conn->stream);
-    SoapySDR_logf(SOAPY_SDR_DEBUG, "dataPump: stop: %d", conn->netSock);
-    return nullptr;
+    std::string rsp = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "+
+        std::to_string(body.length())+"\r\nConnection: close\r\n\r\n"+body;
+    if (send(sock, rsp.data(), rsp.length(), MSG_NOSIGNAL)!=(ssize_t)rsp.length())
+        SoapySDR_logf(SOAPY_SDR_WARNING, "metrics: short write: %s", strerror(errno));
+    unwatchSocket(sock);
+    s_metrics.erase(sock);
+    close(sock);
+    return 0;
 }
 
-int handleListen(struct pollfd *pfd) {
-    // oops before expected..
-    if (pfd->revents & (POLLERR|POLLHUP)) {
-        SoapySDR_log(SOAPY_SDR_ERROR,"EOF or error in listen socket");
-        return -1;
+// a client coming back to its session (see Session) on a new socket, the line after the
+// type is "<rpc ID> <token>", or for a stream "<data ID> <token> <count>" (bytes received,
+// or frames sent when transmitting). The socket goes to whoever uses the connection: the RPC
+// worker, or the stream's pump (which answers), anything else is refused with -1.
+static int resumeConnection(int sock, int type, const char *line) {
+    int id = -1;
+    char token[64] = "";
+    unsigned long long got = 0;
+    sscanf(line, "%d %63s %llu", &id, token, &got);
+    std::lock_guard<std::recursive_mutex> lock(s_lock);
+    ConnectionInfo *conn = findConnection(id);
+    if (!conn || !conn->session || conn->session->token!=token ||
+        (TCPREMOTE_RPC_RESUME==type) != (conn->rpc!=nullptr)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "resume: no such session: %d", id);
+        send(sock, "-1\n", 3, MSG_NOSIGNAL);
+        close(sock);
+        return 0;
     }
-    // connect pending
-    if (pfd->revents & POLLIN) {
-        struct sockaddr addr;
-        socklen_t len = sizeof(addr);
-        int sock = accept(pfd->fd, &addr, &len);
-        if (sock<0) {
-            SoapySDR_logf(SOAPY_SDR_ERROR,"error accepting connection: %s", strerror(errno));
-            return -1;
-        }
-        // now we read an integer which types the connection
-        char buf[2];
-        if (read(sock, buf, 2)<=0) {
-            SoapySDR_logf(SOAPY_SDR_ERROR,"error reading connection type: %s", strerror(errno));
-            close(sock);
-            return -1;
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "resume: %s %d", conn->rpc ? "RPC" : "data", id);
+    if (conn->rpc) {
+        RpcWorker *w = conn->worker;
+        pthread_mutex_lock(&w->lock);
+        if (w->resumeSock>=0)
+            close(w->resumeSock);
+        w->resumeSock = sock;
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+        return 0;
+    }
+    std::lock_guard<std::mutex> slock(conn->session->lock);
+    if (conn->resumeSock>=0)
+        close(conn->resumeSock);
+    conn->resumeSock = sock;
+    conn->resumeGot = got;
+    conn->session->cond.notify_all();
+    return 0;
+}
+
+int handleAccepted(int sock) {
+    // peek for the integer which types the connection (and the line after it for log streams,
+    // and resumes), only consuming it once it is all here
+    char buf[96];
+    ssize_t n = recv(sock, buf, sizeof(buf)-1, MSG_PEEK|MSG_DONTWAIT);
+    if (n<0 && (EAGAIN==errno || EWOULDBLOCK==errno || EINTR==errno))
+        return 0;
+    size_t use = 2;
+    int type = n>0 ? buf[0]-'0' : -1;
+    bool line = TCPREMOTE_LOG_STREAM==type || TCPREMOTE_RPC_RESUME==type || TCPREMOTE_DATA_RESUME==type;
+    if (n>=2 && line) {
+        char *nl = (char *)memchr(buf+2, '\n', n-2);
+        if (!nl) {
+            // keep waiting, unless it is too long
+            if (n<(ssize_t)sizeof(buf)-1)
+                return 0;
+            type = -1;
+        } else {
+            use = nl-buf+1;
         }
-        int type = buf[0]-'0';
-        // create appropriate ConnectionInfo and insert into map..
-        if (TCPREMOTE_RPC_LOAD==type)
-            return createRpc(sock);
-        else if (TCPREMOTE_LOG_STREAM==type)
-            return createLog(sock);
-        else if (TCPREMOTE_DATA_SEND==type || TCPREMOTE_DATA_RECV==type)
-            return createData(sock, type);
-        // ..or drop it as unknown.
-        SoapySDR_logf(SOAPY_SDR_ERROR, "unknown connection type: %d", type);
+    } else if (n==1) {
+        return 0;
+    }
+    s_accepted.erase(sock);
+    unwatchSocket(sock);
+    if (n<=0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"error reading connection type: %s", n<0? strerror(errno): "EOF");
+        close(sock);
+        return 0;
+    }
+    if (read(sock, buf, use)!=(ssize_t)use) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"error reading connection type: %s", strerror(errno));
         close(sock);
+        return 0;
+    }
+    buf[use-1] = 0;
+    // create appropriate ConnectionInfo and insert into map..
+    if (TCPREMOTE_RPC_LOAD==type)
+        return createRpc(sock);
+    else if (TCPREMOTE_LOG_STREAM==type) {
+        int level = SOAPY_SDR_INFO;
+        sscanf(buf+2, "%d", &level);
+        return createLog(sock, level);
     }
+    else if (TCPREMOTE_DATA_SEND==type || TCPREMOTE_DATA_RECV==type)
+        return createData(sock, type);
+    else if (TCPREMOTE_RPC_RESUME==type || TCPREMOTE_DATA_RESUME==type)
+        return resumeConnection(sock, type, buf+2);
+    else if (TCPREMOTE_ENUMERATE==type)
+        return createEnumerate(sock);
+    // ..or drop it as unknown.
+    SoapySDR_logf(SOAPY_SDR_ERROR, "unknown connection type: %d", type);
+    close(sock);
     return 0;
 }
 
@@ -593,6 +2310,82 @@ int handleGetStreamArgsInfo(ConnectionInfo &conn) {
     return 0;
 }
 
+// UDP transport for a receive stream (tcpremote:udp), sized for the path to 'addr', with
+// tcpremote:mtu (link MTU cap), tcpremote:ttl (multicast hops) & tcpremote:gso=0 options
+static int openDatagrams(ConnectionInfo &data, const struct sockaddr_storage &addr, socklen_t len) {
+    int ttl = data.options.count("tcpremote:ttl") ? atoi(data.options.at("tcpremote:ttl").c_str()) : 1;
+    size_t mtu = data.options.count("tcpremote:mtu") ? atol(data.options.at("tcpremote:mtu").c_str()) : TCPREMOTE_UDP_MTU;
+    int sock = dgramConnect(addr, len, ttl);
+    if (sock<0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: unable to open UDP socket: %s", strerror(errno));
+        return -1;
+    }
+    size_t payload = dgramPayload(sock, addr.ss_family, mtu);
+    size_t frameSize = g_frameSizes.at(data.wire)*data.channels.size();
+    if (payload<TCPREMOTE_DATA_HDR+frameSize) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: datagrams too small (%zu bytes) for %zu byte frames", payload, frameSize);
+        close(sock);
+        return -1;
+    }
+    data.udpSock = sock;
+    data.udpFrames = (payload-TCPREMOTE_DATA_HDR)/frameSize;
+#ifdef __linux__
+    data.udpGso = !data.options.count("tcpremote:gso") || data.options.at("tcpremote:gso")!="0";
+#endif
+    SoapySDR_logf(SOAPY_SDR_INFO, "setupStream: UDP to %s, %zu frames per datagram%s",
+        data.options.at("tcpremote:udp").c_str(), data.udpFrames, data.udpGso ? " (GSO)" : "");
+    return 0;
+}
+
+// shared memory transport for a receive stream (tcpremote:shm, see SoapyShm.hpp): a pipe
+// sized as the socket buffers would be (tcpremote:buffer / sockbuf, at the rate when set
+// up), passed to the client over the data connection
+static int openSharedMemory(ConnectionInfo &data, int dataId) {
+    SocketTuning t = getSocketTuning(data.options);
+    size_t frameSize = g_frameSizes.at(data.wire)*data.channels.size();
+    double rate = data.dev->getSampleRate(data.direction, data.channels.at(0))/data.decim;
+    size_t size = t.sockBuf>0 ? (size_t)t.sockBuf : (size_t)(rate*frameSize*t.bufferMs/1000.0);
+    // room for a few of the largest blocks, whatever the rate
+    size_t least = 4*(data.dev->getStreamMTU(data.stream)*frameSize + TCPREMOTE_DATA_HDR);
+    if (least<TCPREMOTE_SHM_MIN)
+        least = TCPREMOTE_SHM_MIN;
+    size = size<least ? least : size>TCPREMOTE_SHM_MAX ? TCPREMOTE_SHM_MAX : size;
+    int fd;
+    data.shmPipe = shmCreate(size, fd, data.shmMap);
+    if (!data.shmPipe) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: unable to create shared memory: %s", strerror(errno));
+        return -1;
+    }
+    int rv = shmSendFd(dataId, fd);
+    close(fd);
+    if (rv) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: unable to pass shared memory: %s", strerror(errno));
+        shmDetach(data.shmPipe, data.shmMap);
+        data.shmPipe = nullptr;
+        return -1;
+    }
+    SoapySDR_logf(SOAPY_SDR_INFO, "setupStream: shared memory, %zu byte ring", data.shmPipe->len);
+    return 0;
+}
+
+// record instead of sending (tcpremote:record, see SoapySigMF.hpp), rotating files every
+// tcpremote:record_size MiB if asked, -1 if there is a recording of that name already
+static int openRecorder(ConnectionInfo &data, const std::string &name) {
+    uint64_t rotate = data.options.count("tcpremote:record_size") ?
+        (uint64_t)(atof(data.options.at("tcpremote:record_size").c_str())*1024*1024) : 0;
+    data.recorder = new SigMFRecorder(s_recordDir, name, g_frameSizes.at(data.wire)*data.channels.size(), rotate);
+    if (data.recorder->exists()) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: recording exists: %s", name.c_str());
+        return -1;
+    }
+    data.recorder->datatype = sigmfDatatype(data.wire);
+    data.recorder->numChans = data.channels.size();
+    data.recorder->hardware = data.dev->getHardwareKey();
+    // (the client is not waiting for anything, so has nothing to resume)
+    data.session = nullptr;
+    return 0;
+}
+
 int handleSetupStream(ConnectionInfo &conn) {
     // The actually complex(ish) bit..
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetupStream()");
@@ -601,8 +2394,18 @@ int handleSetupStream(ConnectionInfo &conn) {
     std::string fmt = conn.rpc->readString();
     std::string chans = conn.rpc->readString();
     SoapySDR::Kwargs args = conn.rpc->readKwargs();
+    // split out our own options, the device doesn't want them
+    SoapySDR::Kwargs opts;
+    for (auto it=args.begin(); it!=args.end(); ) {
+        if (it->first.compare(0, 10, "tcpremote:")==0) {
+            opts[it->first] = it->second;
+            it = args.erase(it);
+        } else {
+            ++it;
+        }
+    }
     // find the data stream (client must connect a data stream first)
-    if (s_connections.find(dataId)==s_connections.end()) {
+    if (!findConnection(dataId)) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: no such data stream ID: %d", dataId);
         conn.rpc->writeInteger(-1);
         return 0;
@@ -613,6 +2416,67 @@ int handleSetupStream(ConnectionInfo &conn) {
         conn.rpc->writeInteger(-2);
         return 0;
     }
+    // optional receive DSP, which reads floats from the device, sending the requested format
+    long decim = opts.find("tcpremote:decim")!=opts.end() ? atol(opts.at("tcpremote:decim").c_str()) : 1;
+    double shift = opts.find("tcpremote:shift")!=opts.end() ? atof(opts.at("tcpremote:shift").c_str()) : 0;
+    bool dsp = decim!=1 || shift!=0;
+    if (dsp && (SOAPY_SDR_RX!=direction || decim<1)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: unsupported DSP: decim %ld, shift %f (receive only)", decim, shift);
+        conn.rpc->writeInteger(-5);
+        return 0;
+    }
+    std::string devfmt = dsp ? "CF32" : fmt;
+    // optional wire quantisation, with the full scale for floats
+    std::string wire = fmt;
+    double scale = 1.0;
+    if (opts.find("tcpremote:wire")!=opts.end()) {
+        wire = opts.at("tcpremote:wire");
+        if (opts.find("tcpremote:scale")!=opts.end())
+            scale = atof(opts.at("tcpremote:scale").c_str());
+        if (SOAPY_SDR_RX!=direction || !getConverter(devfmt, wire) || g_frameSizes.find(wire)==g_frameSizes.end() || scale<=0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: unsupported wire format: %s (from %s, scale %f)",
+                wire.c_str(), devfmt.c_str(), scale);
+            conn.rpc->writeInteger(-3);
+            return 0;
+        }
+    } else if (dsp && !getConverter(devfmt, wire)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: unsupported format after DSP: %s", wire.c_str());
+        conn.rpc->writeInteger(-3);
+        return 0;
+    }
+    // optional UDP transport (receive, always framed): to the client's address, at the port
+    // it chose, or to a multicast group
+    struct sockaddr_storage udpAddr;
+    socklen_t udpLen = 0;
+    if (opts.find("tcpremote:udp")!=opts.end()) {
+        struct sockaddr_storage peer;
+        socklen_t plen = sizeof(peer);
+        if (SOAPY_SDR_RX!=direction || getpeername(dataId, (struct sockaddr *)&peer, &plen) ||
+            !dgramAddress(opts.at("tcpremote:udp"), &peer, udpAddr, udpLen)) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: unsupported UDP destination: %s (receive only)",
+                opts.at("tcpremote:udp").c_str());
+            conn.rpc->writeInteger(-6);
+            return 0;
+        }
+    }
+    // optional shared memory transport (receive, client on this host)
+    bool shm = opts.find("tcpremote:shm")!=opts.end() && opts.at("tcpremote:shm")!="0";
+    if (shm && (SOAPY_SDR_RX!=direction || AF_UNIX!=sockFamily(dataId) || udpLen>0)) {
+        SoapySDR_log(SOAPY_SDR_ERROR, "setupStream: unsupported shared memory stream (receive, over a Unix socket only)");
+        conn.rpc->writeInteger(-7);
+        return 0;
+    }
+    // optional recording (receive, unframed, over TCP), in place of sending
+    std::string record = opts.count("tcpremote:record") ? opts.at("tcpremote:record") : "";
+    if (!record.empty() && (SOAPY_SDR_RX!=direction || s_recordDir.empty() || !sigmfName(record) ||
+        sigmfDatatype(wire).empty() || udpLen>0 || shm || getLatencyMs(opts)>0 ||
+        (opts.count("tcpremote:framed") && opts.at("tcpremote:framed")!="0") ||
+        (opts.count("tcpremote:planar") && opts.at("tcpremote:planar")!="0"))) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: unsupported recording: %s (receive only, CS8/CS16/CF32, not "
+            "framed, UDP, shared memory or low latency, server run with -r)", record.c_str());
+        conn.rpc->writeInteger(-8);
+        return 0;
+    }
     // parse the channel list
     std::vector<size_t> channels;
     size_t cur;
@@ -623,23 +2487,135 @@ int handleSetupStream(ConnectionInfo &conn) {
         channels.push_back(atoi(chans.substr(cur, nxt-cur).c_str()));
     } while (nxt!=std::string::npos);
     // fill out the connection details
-    ConnectionInfo &data = s_connections.at(dataId);
+    ConnectionInfo &data = *findConnection(dataId);
     data.dev = conn.dev;
     data.direction = direction;
-    data.format = fmt;
+    data.format = devfmt;
+    data.wire = wire;
+    data.scale = scale;
+    data.framed = opts.find("tcpremote:framed")!=opts.end() && opts.at("tcpremote:framed")!="0";
+    data.planar = SOAPY_SDR_RX==direction && opts.find("tcpremote:planar")!=opts.end() && opts.at("tcpremote:planar")!="0";
+    // planar blocks need the header to say how long they are, as do datagrams
+    if (data.planar || udpLen>0)
+        data.framed = true;
+    data.latency = getLatencyMs(opts);
+    data.decim = decim;
+    data.shift = shift;
+    data.inhibitWrite = getenv("INHIBIT_WRITE")!=nullptr;
+    data.inhibitPipe = getenv("INHIBIT_PIPE")!=nullptr;
     data.channels = channels;
-    // open the underlying stream
-    data.stream = conn.dev->setupStream(direction, fmt, channels, args);
+    data.options = opts;
+    data.session = conn.session;
+    // a multicast stream from a shared device is sent once, by the device stream, to every
+    // subscriber asking for that group (other than tuned ones, which are all different)
+    bool groupSend = conn.shared && udpLen>0 && dgramIsMulticast(udpAddr) && !dsp;
+    if (udpLen>0 && !groupSend && openDatagrams(data, udpAddr, udpLen)) {
+        conn.rpc->writeInteger(-6);
+        return 0;
+    }
+    // receiving from a shared device? subscribe to the same stream as others, or start one,
+    // tuned streams (DSP) all subscribe to the wideband stream (framed CF32) and each cut
+    // their own channel from it (see fanoutPump)
+    if (conn.shared && SOAPY_SDR_RX==direction) {
+        ConnectionInfo src = data;
+        if (dsp) {
+            src.format = src.wire = "CF32";
+            src.scale = 1.0;
+            src.framed = true;
+            src.planar = false;
+            src.decim = 1;
+            src.shift = 0;
+        }
+        char key[256];
+        snprintf(key, sizeof(key), "%s/%s/%s/%g/%d/%d/%g%s%s", src.format.c_str(), src.wire.c_str(), chans.c_str(),
+            src.scale, src.framed, src.planar, src.latency, groupSend ? "/udp=" : "",
+            groupSend ? opts.at("tcpremote:udp").c_str() : "");
+        auto it = conn.shared->streams.find(key);
+        SharedStream *ss;
+        if (it!=conn.shared->streams.end()) {
+            ss = it->second;
+        } else {
+            if (groupSend && openDatagrams(src, udpAddr, udpLen)) {
+                conn.rpc->writeInteger(-6);
+                return 0;
+            }
+            closeWarm(conn.dev);
+            SoapySDR::Stream *stream = conn.dev->setupStream(direction, devfmt, channels, args);
+            if (!stream) {
+                SoapySDR_log(SOAPY_SDR_ERROR, "setupStream: failed to create underlying stream");
+                if (src.udpSock>=0)
+                    close(src.udpSock);
+                conn.rpc->writeInteger(-4);
+                return 0;
+            }
+            ss = new SharedStream();
+            ss->key = key;
+            ss->source = src;
+            ss->source.netSock = -1;
+            ss->source.session = nullptr;
+            ss->source.stream = stream;
+            ss->source.fanout = ss;
+            ss->source.stats = new StreamStats();
+            ss->ring = nullptr;
+            ss->subscribers = 0;
+            ss->active = 0;
+            conn.shared->streams[key] = ss;
+        }
+        ss->subscribers++;
+        data.stream = ss->source.stream;
+        data.fanout = ss;
+        data.stats = new StreamStats();
+        conn.dataIds.insert(dataId);
+        if (dsp)
+            SoapySDR_logf(SOAPY_SDR_INFO, "setupStream: shared stream %s (%d subscribers), tuned: shift %g Hz, decim %ld",
+                key, ss->subscribers, shift, decim);
+        else
+            SoapySDR_logf(SOAPY_SDR_INFO, "setupStream: shared stream %s (%d subscribers)", key, ss->subscribers);
+        conn.rpc->writeInteger(shm && openSharedMemory(data, dataId) ? -7 : record.length() && openRecorder(data, record) ? -8 : dataId);
+        return 0;
+    }
+    // open the underlying stream (or take one kept warm, see the device pool)
+    data.streamKey = std::to_string(direction)+"/"+devfmt+"/"+chans+"/"+deviceKey(args);
+    data.stream = takeWarmStream(conn.dev, data.streamKey);
+    if (!data.stream)
+        data.stream = conn.dev->setupStream(direction, devfmt, channels, args);
     if (!data.stream) {
         SoapySDR_log(SOAPY_SDR_ERROR, "setupStream: failed to create underlying stream");
         conn.rpc->writeInteger(-4);
+        return 0;
     }
     // all good!
+    data.stats = new StreamStats();
     conn.dataIds.insert(dataId);
-    conn.rpc->writeInteger(dataId);
+    conn.rpc->writeInteger(shm && openSharedMemory(data, dataId) ? -7 : record.length() && openRecorder(data, record) ? -8 : dataId);
+    return 0;
+}
+
+// data pump threads place themselves as they start (see placePump)
+static int startPump(ConnectionInfo &data, void *(*pump)(void *)) {
+    data.pid = (pthread_t)-1;  // non-zero, to prevent thread terminating if it's scheduled before we can copy in real value!
+    pthread_t pid;
+    int rv = pthread_create(&pid, nullptr, pump, &data);
+    if (rv) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "startPump: failed to create data pump thread: %s", strerror(rv));
+        data.pid = 0;
+        return -1;
+    }
+    data.pid = pid;
     return 0;
 }
 
+int internalStopPumps(ConnectionInfo &data);
+
+// last subscriber gone: stop the source, then free the ring nobody is reading
+static int stopFanout(SharedStream *ss) {
+    if (--ss->active>0)
+        return 0;
+    int rv = internalStopPumps(ss->source);
+    freebcast(ss->ring.exchange(nullptr));
+    return rv;
+}
+
 int internalStopPumps(ConnectionInfo &data) {
     if (data.pid) {
         pthread_t pid = data.pid;
@@ -648,19 +2624,51 @@ int internalStopPumps(ConnectionInfo &data) {
             SoapySDR_logf(SOAPY_SDR_ERROR, "internalStopPumps: failed to join data pump thread: %s", strerror(errno));
             return -1;
         }
+        if (data.fanout && &data.fanout->source!=&data)
+            return stopFanout(data.fanout);
     }
     return 0;
 }
 
 int internalCloseStream(ConnectionInfo &conn, int dataId) {
-    if (s_connections.find(dataId)==s_connections.end()) {
+    if (!findConnection(dataId)) {
         SoapySDR_logf(SOAPY_SDR_WARNING, "closeStream: no such data stream ID: %d", dataId);
         return 0;
     }
-    ConnectionInfo &data = s_connections.at(dataId);
+    ConnectionInfo &data = *findConnection(dataId);
     internalStopPumps(data);
-    data.dev->closeStream(data.stream);
-    s_connections.erase(dataId);
+    // shared streams are closed by the last subscriber, a setup that failed part way (the
+    // client still closes it) may have no device or stream yet
+    SharedStream *ss = data.fanout;
+    if (!ss) {
+        if (data.dev && data.stream && !keepWarmStream(data.dev, data.streamKey, data.stream))
+            data.dev->closeStream(data.stream);
+    } else if (--ss->subscribers==0) {
+        data.dev->closeStream(ss->source.stream);
+        if (ss->source.udpSock>=0)
+            close(ss->source.udpSock);
+        conn.shared->streams.erase(ss->key);
+        delete ss->source.stats;
+        delete ss;
+    }
+    if (data.udpSock>=0)
+        close(data.udpSock);
+    if (data.session) {
+        std::lock_guard<std::mutex> lock(data.session->lock);
+        if (data.resumeSock>=0)
+            close(data.resumeSock);
+        data.resumeSock = -1;
+    }
+    if (data.shmPipe) {
+        // wakes a waiting client, which then sees the stream closed
+        pipeclose(data.shmPipe);
+        shmDetach(data.shmPipe, data.shmMap);
+    }
+    // (finishing the recording's last file)
+    delete data.recorder;
+    StreamStats *stats = data.stats;
+    eraseConnection(dataId);
+    delete stats;
     close(dataId);
     conn.dataIds.erase(dataId);
     SoapySDR_logf(SOAPY_SDR_INFO, "Closed data connection: %d", dataId);
@@ -679,41 +2687,64 @@ int handleGetStreamMTU(ConnectionInfo &conn) {
     // pass-thru
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetStreamMTU()");
     int dataId = conn.rpc->readInteger();
-    if (s_connections.find(dataId)==s_connections.end()) {
+    if (!findConnection(dataId)) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "getStreamMTU: no such data stream ID: %d", dataId);
         conn.rpc->writeInteger(-1);
         return 0;
     }
-    return conn.rpc->writeInteger(conn.dev->getStreamMTU(s_connections.at(dataId).stream));
+    return conn.rpc->writeInteger(conn.dev->getStreamMTU(findConnection(dataId)->stream));
 }
 
 int handleActivateStream(ConnectionInfo &conn) {
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleActivateStream()");
     int dataId = conn.rpc->readInteger();
-    if (s_connections.find(dataId)==s_connections.end()) {
+    if (!findConnection(dataId)) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "activateStream: no such data stream ID: %d", dataId);
         conn.rpc->writeInteger(-1);
         return 0;
     }
     // start data pump thread
-    ConnectionInfo &data = s_connections.at(dataId);
-    data.pid = reinterpret_cast<pthread_t>(-1);  // non-zero, to prevent thread terminating if it's scheduled before we can copy in real value!
-    // create ourselves a real-time thread to read the data..
-    pthread_attr_t pat;
-    pthread_attr_init(&pat);
-    pthread_attr_setschedpolicy(&pat, SCHED_FIFO);
-    struct sched_param sch;
-    sch.sched_priority = 1;
-    pthread_attr_setschedparam(&pat, &sch);
-    pthread_t pid;
-    if (pthread_create(&pid, &pat, dataPump, &data)) {
-        SoapySDR_logf(SOAPY_SDR_ERROR, "activateStream: failed to create data pump thread: %s", strerror(errno));
-        data.pid = 0;
+    ConnectionInfo &data = *findConnection(dataId);
+    // size socket buffers for the rate (see SoapySocket.hpp)
+    data.rate = conn.dev->getSampleRate(data.direction, data.channels.at(0));
+    double rate = data.rate/data.decim;
+    tuneDataSocket(data.udpSock>=0 ? data.udpSock : data.netSock, SOAPY_SDR_RX==data.direction,
+        rate*g_frameSizes.at(data.wire)*data.channels.size(), getSocketTuning(data.options));
+    if (data.pid) {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "activateStream: already active: %d", dataId);
+        return conn.rpc->writeInteger(0);
+    }
+    // recording? a capture segment for each activation
+    if (data.recorder) {
+        data.recorder->rate = rate;
+        if (!data.recorder->start(conn.dev->getFrequency(SOAPY_SDR_RX, data.channels.at(0))+data.shift)) {
+            conn.rpc->writeInteger(-3);
+            return 0;
+        }
+    }
+    // create ourselves a real-time thread to read the data.. or for a shared stream, to
+    // read the ring, with the source started by the first subscriber
+    SharedStream *ss = data.fanout;
+    if (ss) {
+        if (0==ss->active) {
+            // ..which may be multicasting, by itself
+            ss->source.rate = data.rate;
+            if (ss->source.udpSock>=0)
+                tuneDataSocket(ss->source.udpSock, true, rate*g_frameSizes.at(ss->source.wire)*data.channels.size(),
+                    getSocketTuning(ss->source.options));
+            if (startPump(ss->source, dataPump)) {
+                conn.rpc->writeInteger(-2);
+                return 0;
+            }
+        }
+        ss->active++;
+    }
+    if (startPump(data, ss ? fanoutPump : dataPump)) {
+        if (ss)
+            stopFanout(ss);
         conn.rpc->writeInteger(-2);
         return 0;
     }
-    pthread_attr_destroy(&pat);
-    data.pid = pid;
     conn.rpc->writeInteger(0);
     return 0;
 }
@@ -721,13 +2752,13 @@ int handleActivateStream(ConnectionInfo &conn) {
 int handleDeactivateStream(ConnectionInfo &conn) {
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleDeactivateStream()");
     int dataId = conn.rpc->readInteger();
-    if (s_connections.find(dataId)==s_connections.end()) {
+    if (!findConnection(dataId)) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "deactivateStream: no such data stream ID: %d", dataId);
         conn.rpc->writeInteger(-1);
         return 0;
     }
     // stop data pump thread
-    ConnectionInfo &data = s_connections.at(dataId);
+    ConnectionInfo &data = *findConnection(dataId);
     if (internalStopPumps(data))
         conn.rpc->writeInteger(-2);
     else
@@ -1001,6 +3032,42 @@ int handleGetSampleRateRange(ConnectionInfo &conn) {
     return 0;
 }
 
+int handleSetBandwidth(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetBandwidth()");
+    int dir = conn.rpc->readInteger();
+    int chn = conn.rpc->readInteger();
+    double bw = conn.rpc->readDouble();
+    conn.dev->setBandwidth(dir,chn,bw);
+    conn.rpc->writeInteger(0);
+    return 0;
+}
+
+int handleGetBandwidth(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetBandwidth()");
+    int dir = conn.rpc->readInteger();
+    int chn = conn.rpc->readInteger();
+    conn.rpc->writeDouble(conn.dev->getBandwidth(dir,chn));
+    return 0;
+}
+
+int handleSetMasterClockRate(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetMasterClockRate()");
+    double rate = conn.rpc->readDouble();
+    conn.dev->setMasterClockRate(rate);
+    conn.rpc->writeInteger(0);
+    return 0;
+}
+
+int handleGetMasterClockRate(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetMasterClockRate()");
+    conn.rpc->writeDouble(conn.dev->getMasterClockRate());
+    return 0;
+}
+
 int handleHasFrequencyCorrection(ConnectionInfo &conn) {
     // pass-thru
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleHasFrequencyCorrection()");
@@ -1030,36 +3097,296 @@ int handleGetFrequencyCorrection(ConnectionInfo &conn) {
     return 0;    
 }
 
+int handleSetBatch(ConnectionInfo &conn) {
+    // read all the settings first, so we apply none if the batch is bad,
+    // then apply them back to back, and reply once with the failure count
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetBatch()");
+    int num = conn.rpc->readInteger();
+    std::vector<SoapyRPCSetting> batch;
+    bool bad = false;
+    for (int n=0; n<num && !conn.rpc->isError(); ++n) {
+        SoapyRPCSetting set;
+        set.call = conn.rpc->readInteger();
+        set.direction = conn.rpc->readInteger();
+        set.channel = conn.rpc->readInteger();
+        set.value = 0.0;
+        switch (set.call) {
+        case TCPREMOTE_SET_FREQUENCY:
+            set.value = conn.rpc->readDouble();
+            set.args = conn.rpc->readKwargs();
+            break;
+        case TCPREMOTE_SET_FREQUENCY_NAMED:
+            set.name = conn.rpc->readString();
+            set.value = conn.rpc->readDouble();
+            set.args = conn.rpc->readKwargs();
+            break;
+        case TCPREMOTE_SET_GAIN_NAMED:
+            set.name = conn.rpc->readString();
+            set.value = conn.rpc->readDouble();
+            break;
+        case TCPREMOTE_SET_GAIN_MODE:
+            set.value = conn.rpc->readInteger();
+            break;
+        case TCPREMOTE_SET_ANTENNA:
+            set.name = conn.rpc->readString();
+            break;
+        case TCPREMOTE_SET_GAIN:
+        case TCPREMOTE_SET_SAMPLE_RATE:
+        case TCPREMOTE_SET_BANDWIDTH:
+        case TCPREMOTE_SET_FREQUENCY_CORRECTION:
+            set.value = conn.rpc->readDouble();
+            break;
+        default:
+            // we cannot know how to skip it, so the rest is garbage
+            SoapySDR_logf(SOAPY_SDR_ERROR, "setBatch: unsupported call in batch: %d", set.call);
+            bad = true;
+            break;
+        }
+        if (bad)
+            break;
+        batch.push_back(set);
+    }
+    if (bad || conn.rpc->isError()) {
+        conn.rpc->writeInteger(-1);
+        return 0;
+    }
+    int failed = 0;
+    for (auto &set: batch) {
+        try {
+            switch (set.call) {
+            case TCPREMOTE_SET_FREQUENCY:
+                conn.dev->setFrequency(set.direction, set.channel, set.value, set.args);
+                break;
+            case TCPREMOTE_SET_FREQUENCY_NAMED:
+                conn.dev->setFrequency(set.direction, set.channel, set.name, set.value, set.args);
+                break;
+            case TCPREMOTE_SET_GAIN:
+                conn.dev->setGain(set.direction, set.channel, set.value);
+                break;
+            case TCPREMOTE_SET_GAIN_NAMED:
+                conn.dev->setGain(set.direction, set.channel, set.name, set.value);
+                break;
+            case TCPREMOTE_SET_GAIN_MODE:
+                conn.dev->setGainMode(set.direction, set.channel, set.value>0);
+                break;
+            case TCPREMOTE_SET_ANTENNA:
+                conn.dev->setAntenna(set.direction, set.channel, set.name);
+                break;
+            case TCPREMOTE_SET_SAMPLE_RATE:
+                conn.dev->setSampleRate(set.direction, set.channel, set.value);
+                break;
+            case TCPREMOTE_SET_BANDWIDTH:
+                conn.dev->setBandwidth(set.direction, set.channel, set.value);
+                break;
+            case TCPREMOTE_SET_FREQUENCY_CORRECTION:
+                conn.dev->setFrequencyCorrection(set.direction, set.channel, set.value);
+                break;
+            }
+        } catch (const std::exception &ex) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "setBatch: call=%d failed: %s", set.call, ex.what());
+            ++failed;
+        }
+    }
+    conn.rpc->writeInteger(failed);
+    return 0;
+}
+
+static void writeRangeList(SoapyRPC *rpc, const SoapySDR::RangeList &list) {
+    for (auto r: list) {
+        rpc->writeDouble(r.minimum());
+        rpc->writeDouble(r.maximum());
+        rpc->writeDouble(r.step());
+    }
+    rpc->writeDouble(0);
+    rpc->writeDouble(0);
+    rpc->writeDouble(-1.0);
+}
+
+int handleDescribe(ConnectionInfo &conn) {
+    // everything a client is likely to ask more than once, in one reply:
+    // status, hardware key & info, then per direction (TX, RX) the number of
+    // channels, and per channel: native format & full scale, formats, gains,
+    // overall gain range, named gain ranges, frequency range, sample rate range.
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleDescribe()");
+    conn.rpc->writeInteger(0);
+    conn.rpc->writeString(conn.dev->getHardwareKey());
+    conn.rpc->writeKwargs(conn.dev->getHardwareInfo());
+    for (int dir=SOAPY_SDR_TX; dir<=SOAPY_SDR_RX; ++dir) {
+        size_t num = conn.dev->getNumChannels(dir);
+        conn.rpc->writeInteger(num);
+        for (size_t chn=0; chn<num; ++chn) {
+            double fullScale = 0.0;
+            conn.rpc->writeString(conn.dev->getNativeStreamFormat(dir,chn,fullScale));
+            conn.rpc->writeDouble(fullScale);
+            conn.rpc->writeStrVector(conn.dev->getStreamFormats(dir,chn));
+            std::vector<std::string> gains = conn.dev->listGains(dir,chn);
+            conn.rpc->writeStrVector(gains);
+            SoapySDR::Range r = conn.dev->getGainRange(dir,chn);
+            conn.rpc->writeDouble(r.minimum());
+            conn.rpc->writeDouble(r.maximum());
+            conn.rpc->writeDouble(r.step());
+            for (auto &nam: gains) {
+                r = conn.dev->getGainRange(dir,chn,nam);
+                conn.rpc->writeDouble(r.minimum());
+                conn.rpc->writeDouble(r.maximum());
+                conn.rpc->writeDouble(r.step());
+            }
+            writeRangeList(conn.rpc, conn.dev->getFrequencyRange(dir,chn));
+            writeRangeList(conn.rpc, conn.dev->getSampleRateRange(dir,chn));
+        }
+    }
+    return 0;
+}
+
 int dropRPC(ConnectionInfo &conn, int fd) {
     SoapySDR_logf(SOAPY_SDR_INFO,"Dropping connection: %d", fd);
+    unwatchSocket(fd);
     delete conn.rpc;
-    while (!conn.dataIds.empty()) {
-        int dataId = *(conn.dataIds.begin());
-        internalCloseStream(conn, dataId);
+    {
+        // other connections may still be using a shared device
+        std::unique_lock<std::mutex> lock;
+        if (conn.shared)
+            lock = std::unique_lock<std::mutex>(conn.shared->lock);
+        while (!conn.dataIds.empty()) {
+            int dataId = *(conn.dataIds.begin());
+            internalCloseStream(conn, dataId);
+        }
     }
-    SoapySDR::Device::unmake(conn.dev);
-    s_connections.erase(fd);
+    if (conn.shared)
+        releaseShared(conn.shared);
+    else if (conn.dev)
+        unmakeDevice(conn.devKey, conn.dev);
+    conn.worker->dropped = true;
+    // (a resuming client looks the session up under the connections lock, see resumeConnection)
+    Session *session = conn.session;
+    eraseConnection(fd);
+    delete session;
     return 0;
 }
 
-int handleRPC(struct pollfd *pfd, ConnectionInfo &conn) {
-    // oops before expected..
-    if (pfd->revents & (POLLERR|POLLHUP)) {
-        SoapySDR_log(SOAPY_SDR_ERROR,"ERR or HUP on RPC socket");
-        return dropRPC(conn, pfd->fd);
-    }
-    // ensure we have a separator
-    if (conn.rpc->readString() != TCPREMOTE_RPC_SEP) {
-        SoapySDR_log(SOAPY_SDR_ERROR,"Missing separator on RPC socket (out of sync?)");
-        return dropRPC(conn, pfd->fd);
-    }
-    // dispatch requested RPC..
-    int call = conn.rpc->readInteger();
-    if (call<0) {
+// the RPC connection has failed: drop it, or for a resumable session hold everything for the
+// client to come back, the worker drops it if nobody has by the time it expires (see Session)
+int lostRPC(ConnectionInfo &conn, int fd) {
+    if (!conn.session)
+        return dropRPC(conn, fd);
+    SoapySDR_logf(SOAPY_SDR_INFO, "Holding session: %d (%gs)", fd, conn.session->hold);
+    unwatchSocket(fd);
+    RpcWorker *w = conn.worker;
+    w->parked = true;
+    clock_gettime(CLOCK_REALTIME, &w->expires);
+    w->expires.tv_sec += (time_t)ceil(conn.session->hold);
+    return 0;
+}
+
+int handleOpenSession(ConnectionInfo &conn) {
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleOpenSession()");
+    double hold = conn.rpc->readDouble();
+    // resuming carries binary framing on, so it is needed from the start
+    if (!conn.rpc->isBinary() || !(hold>0)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "openSession: unsupported: hold %g (binary RPC only)", hold);
+        return conn.rpc->writeInteger(-1);
+    }
+    if (!conn.session) {
+        conn.session = new Session();
+        std::random_device rd;
+        char tok[33];
+        for (int i=0; i<4; ++i)
+            snprintf(tok+8*i, 9, "%08x", (unsigned)rd());
+        conn.session->token = tok;
+    }
+    conn.session->hold = hold<TCPREMOTE_SESSION_MAX ? hold : TCPREMOTE_SESSION_MAX;
+    SoapySDR_logf(SOAPY_SDR_INFO, "Resumable session: %d (%gs)", conn.netSock, conn.session->hold);
+    conn.rpc->writeInteger(0);
+    return conn.rpc->writeString(conn.session->token);
+}
+
+int handleGetStreamStats(ConnectionInfo &conn) {
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetStreamStats()");
+    int dataId = conn.rpc->readInteger();
+    ConnectionInfo *data = findConnection(dataId);
+    if (!data || !data->stats) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "getStreamStats: no such data stream ID: %d", dataId);
+        return conn.rpc->writeKwargs(SoapySDR::Kwargs());
+    }
+    SoapySDR::Kwargs kw = statsToKwargs(*data->stats);
+    // subscribers to a shared stream are counted from the ring on, the device side is the source
+    if (data->fanout) {
+        for (auto &kv: statsToKwargs(*data->fanout->source.stats))
+            kw["source_"+kv.first] = kv.second;
+        kw["subscribers"] = std::to_string(data->fanout->subscribers);
+    }
+    // whole process CPU time, so a client can work out our cost per sample
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    kw["server_cpu_us"] = std::to_string((ru.ru_utime.tv_sec+ru.ru_stime.tv_sec)*1000000LL + ru.ru_utime.tv_usec+ru.ru_stime.tv_usec);
+    return conn.rpc->writeKwargs(kw);
+}
+
+int handleRPCBinary(ConnectionInfo &conn) {
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleRPCBinary()");
+    // acknowledge in text, then switch
+    conn.rpc->writeInteger(1);
+    conn.rpc->setBinary();
+    return 0;
+}
+
+int dispatchRPC(ConnectionInfo &conn, int fd, int call);
+
+int handleRPC(int fd, uint32_t events, ConnectionInfo &conn) {
+    // NB: conn is gone once dropped, so keep hold of our worker
+    RpcWorker *w = conn.worker;
+    // take everything that has arrived, a closed connection may still have requests buffered
+    bool open = conn.rpc->absorb() && !(events & EPOLLERR);
+    // process every complete request already buffered (clients may pipeline),
+    // then send all the replies together (binary framing, text goes line by line). NB: handlers read all their arguments
+    // before acting, so an incomplete request can simply be retried later.
+    while (true) {
+        size_t mark = conn.rpc->mark();
+        try {
+            // not loaded a device yet? that's the first request
+            if (!conn.dev) {
+                loadRpc(conn, fd);
+                if (w->dropped)
+                    return 0;
+                continue;
+            }
+            // read the next call (checks separator or frame)
+            int call = conn.rpc->readCall();
+            if (call<0) {
+                SoapySDR_log(SOAPY_SDR_ERROR, "EOF or error on RPC socket");
+                return lostRPC(conn, fd);
+            }
+            SoapySDR_logf(SOAPY_SDR_DEBUG, "handleRPC: call=%d", call);
+            // dispatch requested RPC, report (rather than die from) device exceptions, one
+            // at a time for a shared device (dropping takes the lock itself, see dropRPC)
+            int rv;
+            try {
+                std::unique_lock<std::mutex> lock;
+                if (conn.shared && TCPREMOTE_DROP_RPC!=call)
+                    lock = std::unique_lock<std::mutex>(conn.shared->lock);
+                rv = dispatchRPC(conn, fd, call);
+            } catch (const std::exception &ex) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "handleRPC: call=%d failed: %s", call, ex.what());
+                conn.rpc->writeInteger(-1);
+                rv = 0;
+            }
+            // dropped connection, or fatal error?
+            if (w->dropped || rv<0)
+                return rv;
+        } catch (const SoapyRPCIncomplete &) {
+            conn.rpc->rewind(mark);
+            break;
+        }
+    }
+    conn.rpc->flush();
+    if (!open) {
         SoapySDR_log(SOAPY_SDR_ERROR, "EOF or error on RPC socket");
-        return dropRPC(conn, pfd->fd);
+        return lostRPC(conn, fd);
     }
-    SoapySDR_logf(SOAPY_SDR_DEBUG, "handleRPC: call=%d", call);
+    return 0;
+}
+
+int dispatchRPC(ConnectionInfo &conn, int fd, int call) {
     switch (call) {
     // unknown
     default:
@@ -1068,7 +3395,13 @@ int handleRPC(struct pollfd *pfd, ConnectionInfo &conn) {
         return 0;
     // special - dropping connection
     case TCPREMOTE_DROP_RPC:
-        return dropRPC(conn, pfd->fd);
+        return dropRPC(conn, fd);
+    // special - switch to binary framing
+    case TCPREMOTE_RPC_BINARY:
+        return handleRPCBinary(conn);
+    // special - hold on to us if the connection is lost
+    case TCPREMOTE_OPEN_SESSION:
+        return handleOpenSession(conn);
     // identification API
     case TCPREMOTE_GET_HARDWARE_KEY:
         return handleGetHardwareKey(conn);
@@ -1154,6 +3487,16 @@ int handleRPC(struct pollfd *pfd, ConnectionInfo &conn) {
         return handleGetSampleRate(conn);
     case TCPREMOTE_GET_SAMPLE_RATE_RANGE:
         return handleGetSampleRateRange(conn);
+    // bandwidth API
+    case TCPREMOTE_SET_BANDWIDTH:
+        return handleSetBandwidth(conn);
+    case TCPREMOTE_GET_BANDWIDTH:
+        return handleGetBandwidth(conn);
+    // clocking API
+    case TCPREMOTE_SET_MASTER_CLOCK_RATE:
+        return handleSetMasterClockRate(conn);
+    case TCPREMOTE_GET_MASTER_CLOCK_RATE:
+        return handleGetMasterClockRate(conn);
     // frontend corrections API
     case TCPREMOTE_HAS_FREQUENCY_CORRECTION:
         return handleHasFrequencyCorrection(conn);
@@ -1161,6 +3504,15 @@ int handleRPC(struct pollfd *pfd, ConnectionInfo &conn) {
         return handleSetFrequencyCorrection(conn);
     case TCPREMOTE_GET_FREQUENCY_CORRECTION:
         return handleGetFrequencyCorrection(conn);
+    // batch API
+    case TCPREMOTE_SET_BATCH:
+        return handleSetBatch(conn);
+    // describe API
+    case TCPREMOTE_DESCRIBE:
+        return handleDescribe(conn);
+    // stats API
+    case TCPREMOTE_GET_STREAM_STATS:
+        return handleGetStreamStats(conn);
     /* NOT IMPLEMENTED ON CLIENT YET!
     TCPREMOTE_HAS_DC_OFFSET_MODE,
     TCPREMOTE_SET_DC_OFFSET_MODE,
@@ -1171,14 +3523,9 @@ int handleRPC(struct pollfd *pfd, ConnectionInfo &conn) {
     TCPREMOTE_HAS_IQ_BALANCE,
     TCPREMOTE_SET_IQ_BALANCE,
     TCPREMOTE_GET_IQ_BALANCE,
-    // bandwidth API
-    TCPREMOTE_SET_BANDWIDTH,
-    TCPREMOTE_GET_BANDWIDTH,
     // list bandwidths deprecated, we emulate in client side
     TCPREMOTE_GET_BANDWIDTH_RANGE,
     // clocking API
-    TCPREMOTE_SET_MASTER_CLOCK_RATE,
-    TCPREMOTE_GET_MASTER_CLOCK_RATE,
     TCPREMOTE_GET_MASTER_CLOCK_RATES,
     TCPREMOTE_LIST_CLOCK_SOURCES,
     TCPREMOTE_SET_CLOCK_SOURCE,
@@ -1237,14 +3584,17 @@ static bool s_logged;
 static void handleLog(const SoapySDRLogLevel level, const char *message) {
     // pass to all connected log streams if level is appropriate
     s_logged = true;
-    for (auto it = s_connections.begin(); it!=s_connections.end(); ++it) {
-        ConnectionInfo &ci = (*it).second;
-        if (ci.log && ci.level) {
-            // it's a log stream
-            if (level > ci.level)
-                continue;
-            // send level then original message
-            fprintf(ci.log, "%d:%s\n", level, message);
+    if ((int)level <= s_streamLogLevel) {
+        std::lock_guard<std::recursive_mutex> lock(s_lock);
+        for (auto it = s_connections.begin(); it!=s_connections.end(); ++it) {
+            ConnectionInfo &ci = (*it).second;
+            if (ci.log && ci.level) {
+                // it's a log stream
+                if (level > ci.level)
+                    continue;
+                // send level then original message
+                fprintf(ci.log, "%d:%s\n", level, message);
+            }
         }
     }
     // now our own log
@@ -1254,13 +3604,60 @@ static void handleLog(const SoapySDRLogLevel level, const char *message) {
 }
 
 int usage() {
-    puts("usage: SoapyTCPServer [-?|--help] [-l <listen host/IP:default *>] [-p <listen port: default 20655>]");
+    puts("usage: SoapyTCPServer [-?|--help] [-l <listen host/IP:default *>] [-p <listen port: default 20655>]"
+        " [-m <metrics port: default none>] [-u <unix socket path: default none>]"
+        " [-k <keep idle devices secs: default 0>] [-w (keep warm streams too)]"
+        " [-r <recordings directory: default none>] [-a <device pump CPUs: default any>]"
+        " [-n <network pump CPUs: default any>] [-s <device pump scheduling: default fifo:1>]"
+        " [-S <network pump scheduling: default inherited>] [-N <NUMA node for stream buffers: default local>]");
     return 0;
 }
 
+// returns listening socket, or -1 for a bad address, -2 if we cannot bind
+static int listenOn(const char *host, const char *port) {
+    struct addrinfo *res = nullptr;
+    if (getaddrinfo(host, port, nullptr, &res)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"parsing listen host");
+        return -1;
+    }
+    int lsock = socket(AF_INET, SOCK_STREAM, 0);
+    int opt=1;
+    setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(int));
+    if (lsock<0 || bind(lsock, res->ai_addr, res->ai_addrlen)!=0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"binding listen socket");
+        freeaddrinfo(res);
+        return -2;
+    }
+    listen(lsock, 5);
+    freeaddrinfo(res);
+    return lsock;
+}
+
+// as listenOn, for same host clients at a Unix domain socket path ('@' for the abstract
+// namespace), replacing any stale socket left there
+static int listenUnix(const char *path) {
+    struct sockaddr_un addr;
+    socklen_t len;
+    if (!unixAddress(std::string("unix:")+path, addr, len)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"parsing unix socket path");
+        return -1;
+    }
+    if ('@'!=path[0])
+        unlink(path);
+    int usock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (usock<0 || bind(usock, (struct sockaddr *)&addr, len)!=0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"binding unix socket: %s", strerror(errno));
+        return -2;
+    }
+    listen(usock, 5);
+    return usock;
+}
+
 int main(int argc, char **argv) {
     const char *host = "0.0.0.0";
     const char *port = "20655";           // 0x50AF ~= SOAP
+    const char *mport = nullptr;
+    const char *upath = nullptr;
     for (int arg=1; arg<argc; ++arg) {
         if (strncmp(argv[arg],"-?",2)==0 || strncmp(argv[arg],"--h",3)==0)
             return usage();
@@ -1268,71 +3665,142 @@ int main(int argc, char **argv) {
             host = argv[++arg];
         else if (strncmp(argv[arg],"-p",2)==0)
             port = argv[++arg];
+        else if (strncmp(argv[arg],"-m",2)==0)
+            mport = argv[++arg];
+        else if (strncmp(argv[arg],"-u",2)==0)
+            upath = argv[++arg];
+        else if (strncmp(argv[arg],"-k",2)==0)
+            s_poolKeep = atof(argv[++arg]);
+        else if (strncmp(argv[arg],"-w",2)==0)
+            s_poolWarm = true;
+        else if (strncmp(argv[arg],"-r",2)==0)
+            s_recordDir = argv[++arg];
+        else if (strncmp(argv[arg],"-a",2)==0)
+            s_pumpCpus = argv[++arg];
+        else if (strncmp(argv[arg],"-n",2)==0)
+            s_netCpus = argv[++arg];
+        else if (strncmp(argv[arg],"-s",2)==0)
+            s_pumpSched = argv[++arg];
+        else if (strncmp(argv[arg],"-S",2)==0)
+            s_netSched = argv[++arg];
+        else if (strncmp(argv[arg],"-N",2)==0)
+            s_numaNode = argv[++arg];
+    }
+    if (!schedValid(s_pumpCpus, s_pumpSched) || !schedValid(s_netCpus, s_netSched)) {
+        fprintf(stderr, "SoapyTCPServer: bad CPU list or scheduling policy\n");
+        return usage()+1;
     }
+    schedCurrent(s_startCpus, s_startSched);
+    // our own tcpremote driver (if loaded here) must not go looking for servers when we
+    // enumerate for a client, see findTCPRemote
+    setenv("SOAPY_TCPREMOTE_SERVER", "1", 1);
     // Detect current log level - shenannigans required as we cannot simply read the value
     s_defaultLogLevel = detectLogLevel();
     printf("SoapyTCPServer: log level=%d\n", (int)s_defaultLogLevel);
-    // Now collect all log levels, we filter per-client ourselves
+    // Now collect the log levels we (or log stream clients) want, we filter per-client ourselves
     SoapySDR_registerLogHandler(handleLog);
-    SoapySDR_setLogLevel(SOAPY_SDR_TRACE);
+    updateLogLevel();
     printf("SoapyTCPServer: listening on: %s:%s\n", host, port);
-    // Set up listen socket
-    struct addrinfo *res = nullptr;
-    if (getaddrinfo(host, port, nullptr, &res)) {
-        SoapySDR_logf(SOAPY_SDR_ERROR,"parsing listen host");
-        return 1;
+    // Set up listen socket(s)
+    int lsock = listenOn(host, port);
+    if (lsock<0)
+        return -lsock;
+    int msock = -1;
+    if (mport) {
+        printf("SoapyTCPServer: metrics on: %s:%s\n", host, mport);
+        msock = listenOn(host, mport);
+        if (msock<0)
+            return -msock;
     }
-    int lsock = socket(AF_INET, SOCK_STREAM, 0);
-    int opt=1;
-    setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(int));
-    if (lsock<0 || bind(lsock, res->ai_addr, res->ai_addrlen)!=0) {
-        SoapySDR_logf(SOAPY_SDR_ERROR,"binding listen socket");
-        return 2;
+    int usock = -1;
+    if (upath) {
+        printf("SoapyTCPServer: listening on: unix:%s\n", upath);
+        usock = listenUnix(upath);
+        if (usock<0)
+            return -usock;
     }
-    listen(lsock, 5);
-    freeaddrinfo(res);
-    // Wait for connections / requests on RPC sockets
-    while (true) {
-        // allocate maximum possible number of pollfds, then omit data stream connections
-        size_t nfds = s_connections.size()+1;
-        struct pollfd pfds[nfds];
-        pfds[0].fd = lsock;
-        pfds[0].events = POLLIN;
-        pfds[0].revents = 0;
-        nfds = 1;
-        for (auto it=s_connections.begin(); it!=s_connections.end(); ++it) {
-            if (it->second.rpc || it->second.log) {  // RPC or LOG connection
-                pfds[nfds].fd = it->first;
-                pfds[nfds].events = POLLIN;
-                pfds[nfds].revents = 0;
-                ++nfds;
-            }
+    // Idle device pool (-k), closing devices nobody has come back for
+    if (s_poolKeep>0) {
+        printf("SoapyTCPServer: keeping idle devices for: %gs%s\n", s_poolKeep, s_poolWarm ? " (and warm streams)" : "");
+        pthread_t pid;
+        if (pthread_create(&pid, nullptr, poolReaper, nullptr)) {
+            SoapySDR_log(SOAPY_SDR_ERROR,"creating device pool reaper");
+            return 3;
         }
-        if (poll(pfds, nfds, -1)<=0) {
+        pthread_detach(pid);
+    } else {
+        s_poolWarm = false;
+    }
+    // Wait for connections / requests on RPC sockets
+    s_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (s_epoll<0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"creating epoll: %s", strerror(errno));
+        return 3;
+    }
+    watchSocket(lsock);
+    if (msock>=0)
+        watchSocket(msock);
+    if (usock>=0)
+        watchSocket(usock);
+    bool running = true;
+    while (running) {
+        struct epoll_event evs[64];
+        int nev = epoll_wait(s_epoll, evs, 64, -1);
+        if (nev<0) {
+            if (EINTR==errno)
+                continue;
             SoapySDR_logf(SOAPY_SDR_ERROR,"waiting for input");
             return 3;
         }
-        // Handle listen socket events
-        if (pfds[0].revents && handleListen(pfds)<0)
-            break;
-        // Handle RPC or LOG socket events
-        for (size_t idx=1; idx<nfds; ++idx) {
-            if (pfds[idx].revents) {
-                ConnectionInfo &ci = s_connections.at(pfds[idx].fd);
-                if (ci.rpc) {
-                    if (handleRPC(pfds+idx, ci)<0)
-                        return 4;
-                }
-                if (ci.log) {
-                    // any input or error on log stream means we're done
-                    fclose(ci.log);
-                    s_connections.erase(pfds[idx].fd);
-                    SoapySDR_logf(SOAPY_SDR_INFO, "log stream closed: %d", pfds[idx].fd);
-                }
+        for (int idx=0; idx<nev; ++idx) {
+            int fd = evs[idx].data.fd;
+            // Handle listen socket events
+            if (lsock==fd || usock==fd) {
+                if (handleListen(fd, evs[idx].events)<0)
+                    running = false;
+                continue;
+            }
+            // Metrics requests
+            if (msock==fd) {
+                handleMetricsListen(msock);
+                continue;
+            }
+            if (s_metrics.find(fd)!=s_metrics.end()) {
+                handleMetrics(fd);
+                continue;
+            }
+            // Newly accepted, not yet typed
+            if (s_accepted.find(fd)!=s_accepted.end()) {
+                handleAccepted(fd);
+                continue;
+            }
+            // Handle RPC or LOG socket events (may have been closed by an earlier event)
+            ConnectionInfo *ci = findConnection(fd);
+            if (!ci)
+                continue;
+            if (ci->rpc) {
+                // over to the worker, which re-arms the socket when done
+                postWorker(ci->worker, evs[idx].events);
+            } else if (ci->log) {
+                // any input or error on log stream means we're done
+                unwatchSocket(fd);
+                std::unique_lock<std::recursive_mutex> lock(s_lock);
+                fclose(ci->log);
+                s_connections.erase(fd);
+                lock.unlock();
+                updateLogLevel();
+                SoapySDR_logf(SOAPY_SDR_INFO, "log stream closed: %d", fd);
             }
         }
     }
     s_connections.clear();
     close(lsock);
+    if (msock>=0)
+        close(msock);
+    if (usock>=0) {
+        close(usock);
+        if ('@'!=upath[0])
+            unlink(upath);
+    }
     return 0;
 }
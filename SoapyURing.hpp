@@ -0,0 +1,480 @@
+// SoapyURing.hpp - io_uring data connection I/O for receive streams
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapyURing_hpp
+#define SoapyURing_hpp
+
+// Receive streams may ask (tcpremote:uring=1) for their data connection to be
+// driven through io_uring at both ends, where the build found the kernel
+// header (TCPREMOTE_IO_URING, see CMakeLists.txt) and the kernel allows it at
+// run time (otherwise both ends quietly carry on as before). Design notes:
+// - no liburing, the kernel interface is small enough to drive directly: one
+//   ring each, no SQ polling thread, waits use IORING_ENTER_EXT_ARG timeouts
+//   (5.11), so rings without it are refused.
+// - server (URingSender, from netPump): a few large registered buffers, filled
+//   from the stream's pipe while the previous run of them is being written, each
+//   run submitted as one linked chain of IORING_OP_WRITE_FIXED, so ordering is
+//   kept and there is one system call per run, not per write. A short write
+//   breaks the chain (the rest are cancelled), what is left is sent again in
+//   the next chain.
+// - client (URingReceiver, from fillStream): one multishot IORING_OP_RECV into
+//   a ring of provided buffers (6.0), so while data flows completions are read
+//   from shared memory with no system call at all, and a wait is one
+//   io_uring_enter. When the provided buffers run out (the application is not
+//   reading) the receive ends and the socket fills, so TCP pushes back as
+//   before, it is armed again once data has been taken.
+// - blocking: nothing here blocks beyond the timeouts given, stopping is up to
+//   the caller (URingSender::cancel, or closing the ring).
+
+#ifdef TCPREMOTE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <vector>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// one submission & completion ring, mapped as the kernel asks
+class URing
+{
+public:
+    URing() : fd(-1), sqMap(nullptr), cqMap(nullptr), sqes(nullptr), sqLen(0), cqLen(0), sqesLen(0), sqLocal(0) {}
+    ~URing() { close(); }
+    // false (errno set) if io_uring is not available, or too old for us
+    bool open(unsigned entries) {
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (fd<0)
+            return false;
+        if (!(p.features & IORING_FEAT_EXT_ARG)) {
+            close();
+            errno = ENOSYS;
+            return false;
+        }
+        sqLen = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+        cqLen = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+            sqLen = cqLen = sqLen>cqLen ? sqLen : cqLen;
+        sqMap = (uint8_t *)mmap(nullptr, sqLen, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (MAP_FAILED==sqMap) {
+            sqMap = nullptr;
+            close();
+            return false;
+        }
+        cqMap = single ? sqMap : (uint8_t *)mmap(nullptr, cqLen, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED==cqMap) {
+            cqMap = nullptr;
+            close();
+            return false;
+        }
+        sqesLen = p.sq_entries*sizeof(struct io_uring_sqe);
+        sqes = (struct io_uring_sqe *)mmap(nullptr, sqesLen, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (MAP_FAILED==sqes) {
+            sqes = nullptr;
+            close();
+            return false;
+        }
+        sqHead = (unsigned *)(sqMap + p.sq_off.head);
+        sqTail = (unsigned *)(sqMap + p.sq_off.tail);
+        sqMask = *(unsigned *)(sqMap + p.sq_off.ring_mask);
+        sqEntries = p.sq_entries;
+        // (entries are always used in ring order, so the index array never changes)
+        unsigned *array = (unsigned *)(sqMap + p.sq_off.array);
+        for (unsigned i=0; i<sqEntries; ++i)
+            array[i] = i;
+        cqHead = (unsigned *)(cqMap + p.cq_off.head);
+        cqTail = (unsigned *)(cqMap + p.cq_off.tail);
+        cqMask = *(unsigned *)(cqMap + p.cq_off.ring_mask);
+        cqes = (struct io_uring_cqe *)(cqMap + p.cq_off.cqes);
+        sqLocal = *sqTail;
+        return true;
+    }
+    void close() {
+        if (sqes)
+            munmap(sqes, sqesLen);
+        if (cqMap && cqMap!=sqMap)
+            munmap(cqMap, cqLen);
+        if (sqMap)
+            munmap(sqMap, sqLen);
+        sqes = nullptr;
+        sqMap = cqMap = nullptr;
+        if (fd>=0)
+            ::close(fd);
+        fd = -1;
+    }
+    int register_(unsigned op, void *arg, unsigned num) {
+        return (int)syscall(__NR_io_uring_register, fd, op, arg, num);
+    }
+    // the next submission entry (cleared), null if the ring is full
+    struct io_uring_sqe *sqe() {
+        if (sqLocal - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+            return nullptr;
+        struct io_uring_sqe *e = &sqes[sqLocal & sqMask];
+        memset(e, 0, sizeof(*e));
+        ++sqLocal;
+        return e;
+    }
+    // submit what has been queued, and wait up to timeoutUs (<0: forever) for 'wait'
+    // completions, -1 on error (errno), timeouts are not errors
+    int enter(unsigned wait, long timeoutUs) {
+        unsigned submit = sqLocal - *sqTail;
+        __atomic_store_n(sqTail, sqLocal, __ATOMIC_RELEASE);
+        if (0==submit && 0==wait)
+            return 0;
+        unsigned flags = wait>0 ? IORING_ENTER_GETEVENTS : 0;
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        if (wait>0 && timeoutUs>=0) {
+            ts.tv_sec = timeoutUs/1000000;
+            ts.tv_nsec = (timeoutUs%1000000)*1000;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+        int rv = (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags,
+            (flags & IORING_ENTER_EXT_ARG) ? (void *)&arg : nullptr, sizeof(arg));
+        if (rv<0 && (ETIME==errno || EINTR==errno))
+            return 0;
+        return rv;
+    }
+    // the oldest completion, null if none, seen() when done with it
+    struct io_uring_cqe *cqe() {
+        unsigned head = *cqHead;
+        if (head==__atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+            return nullptr;
+        return &cqes[head & cqMask];
+    }
+    void seen() {
+        __atomic_store_n(cqHead, *cqHead+1, __ATOMIC_RELEASE);
+    }
+
+private:
+    int fd;
+    uint8_t *sqMap, *cqMap;
+    struct io_uring_sqe *sqes;
+    size_t sqLen, cqLen, sqesLen;
+    unsigned *sqHead, *sqTail, *cqHead, *cqTail;
+    unsigned sqMask, cqMask, sqEntries;
+    unsigned sqLocal;
+    struct io_uring_cqe *cqes;
+};
+
+// (server) writes to a socket from registered buffers ("slots"), in order: fill slots
+// while the last chain is in flight, send() submits the lot as the next chain
+class URingSender
+{
+public:
+    URingSender() : sock(-1), slotSize(0), mem(nullptr), first(0), filled(0), inflight(0), failed(0), sent(0) {}
+    ~URingSender() {
+        cancel();
+        ring.close();
+        free(mem);
+    }
+    // 'count' slots of 'size' bytes for writing to 'sock', false (errno) if unavailable
+    bool open(int sock, size_t size, unsigned count) {
+        this->sock = sock;
+        slotSize = size;
+        if (posix_memalign((void **)&mem, 4096, size*count)) {
+            mem = nullptr;
+            errno = ENOMEM;
+            return false;
+        }
+        // (two of everything: a chain and its cancellations)
+        if (!ring.open(count*2))
+            return false;
+        std::vector<struct iovec> iov(count);
+        for (unsigned i=0; i<count; ++i) {
+            iov[i].iov_base = mem + i*size;
+            iov[i].iov_len = size;
+        }
+        if (ring.register_(IORING_REGISTER_BUFFERS, iov.data(), count)<0)
+            return false;
+        slots.assign(count, Slot());
+        return true;
+    }
+    size_t size() const { return slotSize; }
+    // bytes written so far
+    uint64_t written() const { return sent; }
+    // anything waiting to be sent, or in flight
+    bool busy() const { return filled>0; }
+    // the next slot to fill, null if they are all in use
+    uint8_t *slot() {
+        if (filled==slots.size())
+            return nullptr;
+        return mem + ((first+filled)%slots.size())*slotSize;
+    }
+    // the slot from slot() now holds 'len' bytes
+    void fill(size_t len) {
+        Slot &s = slots[(first+filled)%slots.size()];
+        s.len = len;
+        s.off = 0;
+        ++filled;
+    }
+    // once the last chain has finished, submit what is waiting (as one chain), then wait
+    // up to timeoutUs for it to finish: 1 when it has, 0 on timeout, -1 on error (errno)
+    int send(long timeoutUs) {
+        if (0==inflight && filled>inflight) {
+            for (unsigned n=0; n<filled; ++n) {
+                unsigned i = (first+n)%slots.size();
+                struct io_uring_sqe *e = ring.sqe();
+                if (!e)
+                    break;
+                e->opcode = IORING_OP_WRITE_FIXED;
+                e->fd = sock;
+                e->addr = (uint64_t)(uintptr_t)(mem + i*slotSize + slots[i].off);
+                e->len = (unsigned)(slots[i].len - slots[i].off);
+                e->buf_index = (uint16_t)i;
+                e->user_data = i;
+                if (n+1<filled)
+                    e->flags = IOSQE_IO_LINK;
+                ++inflight;
+            }
+            if (ring.enter(0, 0)<0) {
+                inflight = 0;
+                return -1;
+            }
+        }
+        reap();
+        while (inflight>0) {
+            if (ring.enter(1, timeoutUs)<0)
+                return -1;
+            if (!reap())
+                return 0;
+        }
+        if (failed) {
+            errno = failed;
+            failed = 0;
+            return -1;
+        }
+        return 1;
+    }
+    // give up on whatever is waiting or in flight (socket broken, or stopping)
+    void cancel() {
+        if (inflight>0) {
+            for (unsigned n=0; n<filled; ++n) {
+                struct io_uring_sqe *e = ring.sqe();
+                if (!e)
+                    break;
+                e->opcode = IORING_OP_ASYNC_CANCEL;
+                e->addr = (first+n)%slots.size();
+                e->user_data = ~0ULL;
+            }
+            ring.enter(0, 0);
+            while (inflight>0 && ring.enter(1, 100000)>=0 && reap())
+                ;
+        }
+        first = filled = inflight = 0;
+        failed = 0;
+    }
+
+private:
+    struct Slot {
+        size_t len, off;
+    };
+    URing ring;
+    int sock;
+    size_t slotSize;
+    uint8_t *mem;
+    std::vector<Slot> slots;
+    // oldest slot in use, how many are (filled), and of those, submitted (inflight)
+    unsigned first, filled, inflight;
+    int failed;
+    uint64_t sent;
+
+    // take completions, false if there were none. In order: written slots are done with,
+    // cancelled (after a short write) ones are sent again by the next chain.
+    bool reap() {
+        bool any = false;
+        struct io_uring_cqe *c;
+        while ((c = ring.cqe())!=nullptr) {
+            uint64_t id = c->user_data;
+            int res = c->res;
+            ring.seen();
+            any = true;
+            if (~0ULL==id)
+                continue;
+            --inflight;
+            Slot &s = slots[id];
+            if (res>0) {
+                s.off += res;
+                sent += res;
+            } else if (0==res) {
+                failed = EPIPE;
+            } else if (res!=-ECANCELED && res!=-EINTR && res!=-EAGAIN) {
+                failed = -res;
+            }
+            while (filled>0 && slots[first].off==slots[first].len) {
+                first = (first+1)%slots.size();
+                --filled;
+            }
+        }
+        return any;
+    }
+};
+
+// (client) a multishot receive on a socket, into a ring of provided buffers
+class URingReceiver
+{
+public:
+    URingReceiver() : sock(-1), bufSize(0), bufCount(0), mem(nullptr), bufRing(nullptr), ringLen(0), armed(false),
+        eof(false), error(0), received(false), cur(0), curOff(0), curLen(0) {}
+    ~URingReceiver() {
+        ring.close();
+        if (bufRing)
+            munmap(bufRing, ringLen);
+        free(mem);
+    }
+    // 'count' (a power of two) buffers of 'size' bytes for receiving from 'sock', false (errno) if unavailable
+    bool open(int sock, size_t size, unsigned count) {
+        this->sock = sock;
+        bufSize = size;
+        bufCount = count;
+        if (!ring.open(8))
+            return false;
+        if (posix_memalign((void **)&mem, 4096, size*count)) {
+            mem = nullptr;
+            errno = ENOMEM;
+            return false;
+        }
+        ringLen = (count*sizeof(struct io_uring_buf)+4095)/4096*4096;
+        bufRing = (struct io_uring_buf_ring *)mmap(nullptr, ringLen, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED==bufRing) {
+            bufRing = nullptr;
+            return false;
+        }
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (uint64_t)(uintptr_t)bufRing;
+        reg.ring_entries = count;
+        reg.bgid = 0;
+        if (ring.register_(IORING_REGISTER_PBUF_RING, &reg, 1)<0)
+            return false;
+        for (unsigned i=0; i<count; ++i)
+            provide(i, i);
+        __atomic_store_n(&bufRing->tail, (uint16_t)count, __ATOMIC_RELEASE);
+        return true;
+    }
+    // the kernel refused multishot receives (before any data), ring is no use
+    bool unsupported() const { return EINVAL==error && !received; }
+    // as recv(MSG_DONTWAIT): what has arrived (up to len bytes), 0 at end of stream, -1 on
+    // error (errno, EAGAIN when there is nothing yet)
+    ssize_t recv(uint8_t *dst, size_t len) {
+        size_t done = 0;
+        while (done<len) {
+            if (0==curLen) {
+                if (!next())
+                    break;
+                continue;
+            }
+            size_t n = curLen-curOff<len-done ? curLen-curOff : len-done;
+            memcpy(dst+done, mem + cur*bufSize + curOff, n);
+            done += n;
+            curOff += n;
+            if (curOff==curLen) {
+                recycle(cur);
+                curLen = curOff = 0;
+            }
+        }
+        if (done>0)
+            return (ssize_t)done;
+        if (eof)
+            return 0;
+        if (error) {
+            errno = error;
+            return -1;
+        }
+        if (!armed && !arm())
+            return -1;
+        errno = EAGAIN;
+        return -1;
+    }
+    // wait up to timeoutUs for something to arrive: 1 if it has, 0 on timeout, -1 on error
+    int wait(long timeoutUs) {
+        if (curLen>0 || eof || error || ring.cqe())
+            return 1;
+        if (!armed && !arm())
+            return -1;
+        if (ring.enter(1, timeoutUs)<0)
+            return -1;
+        return ring.cqe() ? 1 : 0;
+    }
+
+private:
+    URing ring;
+    int sock;
+    size_t bufSize;
+    unsigned bufCount;
+    uint8_t *mem;
+    struct io_uring_buf_ring *bufRing;
+    size_t ringLen;
+    bool armed, eof;
+    int error;
+    bool received;
+    // the buffer being taken from
+    uint16_t cur;
+    size_t curOff, curLen;
+
+    void provide(uint16_t bid, unsigned slot) {
+        // (not bufRing->bufs: in C++ the header's flexible array is not at the start)
+        struct io_uring_buf *b = (struct io_uring_buf *)bufRing + (slot & (bufCount-1));
+        b->addr = (uint64_t)(uintptr_t)(mem + bid*bufSize);
+        b->len = (uint32_t)bufSize;
+        b->bid = bid;
+    }
+    void recycle(uint16_t bid) {
+        uint16_t tail = bufRing->tail;
+        provide(bid, tail);
+        __atomic_store_n(&bufRing->tail, (uint16_t)(tail+1), __ATOMIC_RELEASE);
+    }
+    bool arm() {
+        struct io_uring_sqe *e = ring.sqe();
+        if (!e) {
+            errno = EBUSY;
+            return false;
+        }
+        e->opcode = IORING_OP_RECV;
+        e->fd = sock;
+        e->ioprio = IORING_RECV_MULTISHOT;
+        e->flags = IOSQE_BUFFER_SELECT;
+        e->buf_group = 0;
+        if (ring.enter(0, 0)<0)
+            return false;
+        armed = true;
+        return true;
+    }
+    // take the next completion, false if there is none (or the stream has ended)
+    bool next() {
+        if (eof || error)
+            return false;
+        struct io_uring_cqe *c = ring.cqe();
+        if (!c)
+            return false;
+        int res = c->res;
+        unsigned flags = c->flags;
+        ring.seen();
+        if (!(flags & IORING_CQE_F_MORE))
+            armed = false;
+        if (res>0) {
+            cur = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+            curOff = 0;
+            curLen = res;
+            received = true;
+        } else if (0==res) {
+            eof = true;
+        } else if (res!=-ENOBUFS && res!=-EINTR && res!=-ECANCELED) {
+            // (out of buffers: armed again when asked for more)
+            error = -res;
+        }
+        return true;
+    }
+};
+#endif
+
+#endif